@@ -15,14 +15,38 @@
 #ifndef ANALYTICSLOGGER_H__
 #define ANALYTICSLOGGER_H__
 
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
 #include <sstream>
+#include <vector>
 
+/// @class AnalyticsLogger
+///
+/// Writes analytics logs to syslog, tagged with the time they were generated.
+///
+/// By default each log is written synchronously by the thread that generates
+/// it.  If a ring size is supplied, each thread instead copies its logs into
+/// its own fixed-size ring buffer (without taking any locks) and a background
+/// thread writes them to syslog in batches, so that a slow syslog doesn't hold
+/// up SIP processing.  If a thread's ring buffer is full its logs are dropped
+/// (and counted) rather than waiting for the background thread to catch up.
 class AnalyticsLogger
 {
 public:
-  AnalyticsLogger();
+  /// Constructor.
+  ///
+  /// @param ring_size - The number of logs each thread can queue for the
+  ///                    background thread, or 0 to write logs synchronously.
+  AnalyticsLogger(int ring_size = 0);
   virtual ~AnalyticsLogger();
 
+  /// Stops the background thread, after it has written any queued logs.  Logs
+  /// generated once this has been called are written synchronously.
+  void stop();
+
   void log_with_tag_and_timestamp(char* log);
 
   virtual void registration(const std::string& aor,
@@ -50,9 +74,82 @@ public:
   virtual void call_disconnected(const std::string& call_id,
                          int reason);
 
+  /// Returns the number of logs dropped because a ring buffer was full.
+  uint64_t dropped() const { return _dropped.load(); }
+
+protected:
+  /// Writes a log, tagged with the time it was generated.
+  virtual void write(const struct timespec& timestamp, const char* log);
+
 private:
   static const int BUFFER_SIZE = 1000;
+
+  /// The maximum number of logs the background thread writes from one ring
+  /// buffer before moving on to the next.
+  static const int MAX_BATCH_SIZE = 64;
+
+  /// The interval at which the background thread checks for new logs when
+  /// the ring buffers are empty.
+  static const int POLL_INTERVAL_MS = 10;
+
+  struct Record
+  {
+    struct timespec timestamp;
+    char log[BUFFER_SIZE];
+  };
+
+  /// A single-producer, single-consumer ring buffer.  Only the owning thread
+  /// advances tail, and only the background thread advances head.
+  struct Ring
+  {
+    Ring(int size) : records(size), head(0), tail(0) {}
+
+    std::vector<Record> records;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+  };
+
+  Ring* get_ring();
+
+  /// Copies a log into this thread's ring buffer, or drops it if the ring
+  /// buffer is full.
+  void queue(const struct timespec& timestamp, const char* log);
+
+  /// Writes up to MAX_BATCH_SIZE logs from each ring buffer.
+  ///
+  /// @returns the number of logs written.
+  int drain();
+
+  static void* writer_thread_function(void* logger);
+  void writer_thread_function();
+
+  const int _ring_size;
+
+  /// Identifies this logger in each thread's cached ring buffer pointer.
+  const uint64_t _id;
+  static std::atomic<uint64_t> _next_id;
+
+  /// All the ring buffers, one per thread that has logged.  Threads only take
+  /// the lock the first time they log.
+  std::vector<Ring*> _rings;
+  pthread_mutex_t _rings_lock;
+
+  std::atomic<uint64_t> _dropped;
+  std::atomic<bool> _running;
+
+  /// Set when the logger starts stopping.  Threads that see it write their
+  /// logs synchronously rather than queuing them.
+  std::atomic<bool> _stopping;
+
+  /// The number of threads that may be copying a log into a ring buffer.
+  /// Stopping waits for this to reach zero before the final drain, so that
+  /// no log is queued after it and no ring buffer is freed while in use.
+  std::atomic<int> _queue_writes;
+
+  bool _terminated;
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  pthread_t _writer_thread;
 };
 
 #endif
-
@@ -287,6 +287,12 @@ public:
 /// Class to hold a pair of AoRs. The original AoR holds the AoR retrieved
 /// from the store, the current AoR holds any changes made to the AoR before
 /// it's put back in the store
+///
+/// A pair can be created from a single AoR, in which case the original AoR is
+/// copy-on-write - it is only copied when the current AoR is first accessed
+/// for modification, so readers that only look at the current AoR (through
+/// get_current_const) don't pay for a deep copy of every binding and
+/// subscription.
 class AoRPair
 {
 public:
@@ -295,14 +301,22 @@ public:
     _current_aor(current_aor)
   {}
 
+  AoRPair(AoR* aor):
+    _orig_aor(NULL),
+    _current_aor(aor)
+  {}
+
   ~AoRPair()
   {
     delete _orig_aor; _orig_aor = NULL;
     delete _current_aor; _current_aor = NULL;
   }
 
-  /// Get the current AoR
-  AoR* get_current() { return _current_aor; }
+  /// Get the current AoR, which the caller may modify.
+  AoR* get_current() { copy_orig(); return _current_aor; }
+
+  /// Get the current AoR for reading only.
+  const AoR* get_current_const() const { return _current_aor; }
 
   /// Does the current AoR contain any bindings?
   bool current_contains_bindings()
@@ -329,8 +343,25 @@ private:
   AoR* _orig_aor;
   AoR* _current_aor;
 
-  /// Get the original AoR
-  AoR* get_orig() { return _orig_aor; }
+  /// Get the original AoR.  SubscriberDataManager may modify this too, so
+  /// it is copied if that hasn't happened yet.
+  AoR* get_orig() { copy_orig(); return _orig_aor; }
+
+  /// Get the original AoR for reading only.  Until the current AoR has been
+  /// accessed for modification, it is the same as the original.
+  const AoR* orig() const
+  {
+    return (_orig_aor != NULL) ? _orig_aor : _current_aor;
+  }
+
+  /// Takes the copy of the original AoR, if it hasn't been taken yet.
+  void copy_orig()
+  {
+    if ((_orig_aor == NULL) && (_current_aor != NULL))
+    {
+      _orig_aor = new AoR(*_current_aor);
+    }
+  }
 
   /// The subscriber data manager is allowed to access the original AoR
   friend class SubscriberDataManager;
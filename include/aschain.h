@@ -17,6 +17,8 @@ extern "C" {
 #include <pjlib.h>
 }
 
+#include <stdint.h>
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -166,7 +168,6 @@ private:
   std::vector<Ifc> _fallback_ifcs;
   IFCConfiguration _ifc_configuration;
   bool _using_standard_ifcs;
-  rapidxml::xml_document<>* _root;
 
   // The S-CSCF URI for which this AsChain was created
   const std::string _scscf_uri;
@@ -381,6 +382,15 @@ private:
 
 
 /// Lookup table of AsChain objects.
+//
+// Each ODI token identifies a slot in the table directly, so a lookup is a
+// couple of array indexes rather than a search.  The table is split into
+// stripes, each with its own lock, and the tokens for a chain are all
+// allocated from one stripe, so different chains don't contend.
+//
+// A token is the hex encoding of the stripe, the slot within the stripe and
+// a random nonce.  The nonce is replaced every time the slot is reused, so
+// stale tokens (and guessed ones) don't match.
 class AsChainTable
 {
 public:
@@ -398,9 +408,47 @@ private:
   void register_(AsChain* as_chain, std::vector<std::string>& tokens);
   void unregister(std::vector<std::string>& tokens);
 
-  static const int TOKEN_LENGTH = 10;
+  /// A slot in the table.  The slot is free if as_chain is NULL.
+  struct Slot
+  {
+    uint64_t nonce;
+    AsChain* as_chain;
+    size_t index;
+  };
+
+  /// A stripe of the table.  Slots are allocated in chunks, which are never
+  /// freed (until the table is destroyed), and free slots are kept on a free
+  /// list.
+  struct Stripe
+  {
+    pthread_mutex_t lock;
+    std::vector<Slot*> chunks;
+    std::vector<uint32_t> free_slots;
+  };
+
+  static const int NUM_STRIPES = 64;
+  static const uint32_t CHUNK_SIZE = 1024;
+  static const uint32_t MAX_SLOTS_PER_STRIPE = 0x1000000;
+
+  /// Number of hex digits used to encode the stripe, slot and nonce.
+  static const int STRIPE_DIGITS = 2;
+  static const int SLOT_DIGITS = 6;
+  static const int NONCE_DIGITS = 16;
+  static const int TOKEN_LENGTH = STRIPE_DIGITS + SLOT_DIGITS + NONCE_DIGITS;
+
+  static std::string encode_token(uint32_t stripe, uint32_t slot, uint64_t nonce);
+  static bool decode_token(const std::string& token,
+                           uint32_t& stripe,
+                           uint32_t& slot,
+                           uint64_t& nonce);
+  static uint64_t random_nonce();
+
+  /// Returns the slot with the given index in a stripe, or NULL if it hasn't
+  /// been allocated.  Must be called with the stripe lock held.
+  static Slot* get_slot(Stripe& stripe, uint32_t slot);
+
+  std::vector<Stripe*> _stripes;
 
-  /// Map from ODI token to pair of (AsChain, index).
-  std::map<std::string, AsChainLink> _odi_token_map;
-  pthread_mutex_t _lock;
+  /// Used to spread chains across the stripes.
+  std::atomic<uint32_t> _next_stripe;
 };
@@ -15,6 +15,7 @@
 
 
 #include <string>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -25,8 +26,19 @@
 class AstaireAoRStore: public AoRStore
 {
 public:
+  /// The formats in which AoRs can be written to the store.  AoRs in either
+  /// format can always be read.
+  enum class Format
+  {
+    JSON,
+    BINARY
+  };
+
   /// Constructor.
-  AstaireAoRStore(Store* store);
+  ///
+  /// @param store  - The underlying store.
+  /// @param format - The format in which to write AoRs.
+  AstaireAoRStore(Store* store, Format format = Format::JSON);
 
   /// Destructor.
   virtual ~AstaireAoRStore();
@@ -58,19 +70,19 @@ public:
                                      SAS::TrailId trail) override;
 
 
-  /// Class used by the AstaireAoRStore to serialize AoRs from C++
-  /// objects to the JSON format used in the store, and deserialize them.
-  class JsonSerializerDeserializer
+  /// Interface used by the AstaireAoRStore to serialize AoRs from C++
+  /// objects to a format used in the store, and deserialize them.
+  class SerializerDeserializer
   {
   public:
     /// Destructor.
-    ~JsonSerializerDeserializer() {}
+    virtual ~SerializerDeserializer() {}
 
     /// Serialize an AoR object to the format used in the store.
     ///
     /// @param aor_data - The AoR object to serialize.
     /// @return         - The serialized form.
-    std::string serialize_aor(AoR* aor_data);
+    virtual std::string serialize_aor(AoR* aor_data) = 0;
 
     /// Deserialize some data from the store into an AoR object.
     ///
@@ -80,8 +92,45 @@ public:
     ///
     /// @return       - An AoR object, or NULL if the data could not be
     ///                 deserialized (e.g. because it is corrupt).
-    AoR* deserialize_aor(const std::string& aor_id,
-                         const std::string& s);
+    virtual AoR* deserialize_aor(const std::string& aor_id,
+                                 const std::string& s) = 0;
+  };
+
+  /// (De)serializer for the JSON format.
+  class JsonSerializerDeserializer : public SerializerDeserializer
+  {
+  public:
+    /// Destructor.
+    virtual ~JsonSerializerDeserializer() {}
+
+    virtual std::string serialize_aor(AoR* aor_data) override;
+    virtual AoR* deserialize_aor(const std::string& aor_id,
+                                 const std::string& s) override;
+  };
+
+  /// (De)serializer for the compact binary format.  This is much cheaper to
+  /// produce and parse than JSON, and takes less space in the store.
+  ///
+  /// A record starts with a header identifying it as binary (which JSON can't
+  /// start with) and giving the format version.  The AoR's fields follow in a
+  /// fixed order - integers as varints and strings and lists prefixed with
+  /// their lengths.  Binding parameter names are interned: common names are
+  /// written as an index into a fixed table, and other names are written in
+  /// full the first time they appear in a record and as an index after that.
+  class BinarySerializerDeserializer : public SerializerDeserializer
+  {
+  public:
+    /// Destructor.
+    virtual ~BinarySerializerDeserializer() {}
+
+    virtual std::string serialize_aor(AoR* aor_data) override;
+    virtual AoR* deserialize_aor(const std::string& aor_id,
+                                 const std::string& s) override;
+
+    /// Returns whether some data from the store is in the binary format.
+    static bool is_binary(const std::string& s);
+
+    static const uint8_t VERSION = 1;
   };
 
   /// Provides the interface to the data store. This is responsible for
@@ -91,7 +140,7 @@ public:
   class Connector
   {
     Connector(Store* data_store,
-              JsonSerializerDeserializer*& serializer_deserializer);
+              SerializerDeserializer*& serializer_deserializer);
 
     ~Connector();
 
@@ -110,7 +159,13 @@ public:
     friend class AstaireAoRStore;
 
   private:
-    JsonSerializerDeserializer* _serializer_deserializer;
+    /// Used to serialize AoRs written to the store.
+    SerializerDeserializer* _serializer_deserializer;
+
+    /// Used to deserialize AoRs read from the store, depending on the format
+    /// they are in.
+    JsonSerializerDeserializer _json_deserializer;
+    BinarySerializerDeserializer _binary_deserializer;
   };
 
 public:
@@ -110,11 +110,26 @@ public:
   virtual void on_rx_response(pjsip_msg* rsp, int fork_id) override;
   virtual void on_tx_response(pjsip_msg* rsp) override;
   virtual void on_rx_cancel(int status_code, pjsip_msg* req) override;
+  virtual void on_async_complete(void* context) override;
 
 private:
+  /// Routes the request, once any number portability data has been looked up.
+  ///
+  /// @param req                  The request to route.
+  void route_request(pjsip_msg* req);
+
   BGCFSproutlet* _bgcf;
 
   ACR* _acr;
+
+  /// The request being routed while ENUM is queried, and the result of the
+  /// query.
+  pjsip_msg* _pending_req;
+  std::string _enum_uri;
+
+  /// Whether the request has been cancelled.  If it is cancelled while ENUM
+  /// is queried, it is rejected rather than routed.
+  bool _cancelled;
 };
 
 #endif
@@ -53,6 +53,7 @@ struct options
   int                                  pcscf_untrusted_port;
   int                                  pcscf_trusted_port;
   int                                  webrtc_port;
+  int                                  websocket_threads;
   std::string                          upstream_proxy;
   int                                  upstream_proxy_port;
   int                                  upstream_proxy_connections;
@@ -98,7 +99,10 @@ struct options
   int                                  max_call_list_length;
   int                                  memento_threads;
   int                                  call_list_ttl;
+  int                                  pjsip_threads;
   int                                  worker_threads;
+  int                                  worker_queues;
+  int                                  max_queue_depth;
   bool                                 log_to_file;
   std::string                          log_directory;
   int                                  log_level;
@@ -140,7 +144,21 @@ struct options
   bool                                 reject_if_no_matching_ifcs;
   std::string                          dummy_app_server;
   bool                                 http_acr_logging;
+  bool                                 lazy_charging_headers;
   int                                  homestead_timeout;
+  int                                  hss_cache_ttl;
+  int                                  hss_cache_size;
+  int                                  remote_sdm_threads;
+  int                                  async_lookup_threads;
+  int                                  sas_log_threads;
+  int                                  ralf_batch_interval;
+  int                                  ralf_max_queued_acrs;
+  int                                  simservs_cache_ttl;
+  int                                  simservs_cache_size;
+  int                                  analytics_ring_size;
+  int                                  chronos_batch_interval;
+  int                                  chronos_max_queued_timers;
+  bool                                 binary_aor_format;
 };
 
 // Objects that must be shared with dynamically linked sproutlets must be
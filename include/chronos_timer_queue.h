@@ -0,0 +1,149 @@
+/**
+ * @file chronos_timer_queue.h  Queue of updates to registration timers in
+ *                              Chronos.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef CHRONOS_TIMER_QUEUE_H__
+#define CHRONOS_TIMER_QUEUE_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "sas.h"
+#include "chronosconnection.h"
+
+/// @class ChronosTimerQueue
+///
+/// Sends updates to (and deletions of) existing Chronos timers from a
+/// background thread, so that REGISTER and SUBSCRIBE processing doesn't wait
+/// for a round-trip to Chronos.
+///
+/// Updates are held for a batch interval before being sent.  Only the most
+/// recent update to each timer is sent, so a burst of re-registrations for
+/// the same AoR costs a single request to Chronos.
+///
+/// The number of timers with updates waiting is bounded.  When it is full,
+/// the caller is told to send the update itself, as it always has.
+///
+/// Chronos can return a new timer ID in response to an update.  The queue
+/// remembers the new ID until the timer would have expired, and callers swap
+/// it in (with update_timer_id) before using a timer ID they have stored.
+class ChronosTimerQueue
+{
+public:
+  /// Constructor.
+  ///
+  /// @param chronos_conn      - The connection to Chronos.
+  /// @param batch_interval_ms - The interval (in milliseconds) at which
+  ///                            queued updates are sent.
+  /// @param max_pending       - The maximum number of timers with updates
+  ///                            waiting to be sent.
+  ChronosTimerQueue(ChronosConnection* chronos_conn,
+                    int batch_interval_ms,
+                    int max_pending);
+
+  /// Destructor.  Sends any queued updates before returning.
+  virtual ~ChronosTimerQueue();
+
+  /// Queues an update to an existing timer, replacing any update already
+  /// queued for it.
+  ///
+  /// @param timer_id          - The ID of the timer.
+  /// @param expiry            - The timer length (in seconds) from now.
+  /// @param callback_uri      - The URI Chronos calls when the timer pops.
+  /// @param opaque            - The opaque data for the timer.
+  /// @param tags              - The tags for the timer.
+  /// @param trail             - SAS trail.
+  ///
+  /// @returns false if too many updates are already queued, in which case
+  ///          the caller must send the update itself.
+  bool update(const std::string& timer_id,
+              int expiry,
+              const std::string& callback_uri,
+              const std::string& opaque,
+              const std::map<std::string, uint32_t>& tags,
+              SAS::TrailId trail);
+
+  /// Queues the deletion of a timer, replacing any update already queued for
+  /// it.
+  ///
+  /// @returns false if too many updates are already queued, in which case
+  ///          the caller must delete the timer itself.
+  bool remove(const std::string& timer_id,
+              SAS::TrailId trail);
+
+  /// Replaces a timer ID with the ID Chronos returned when a queued update to
+  /// the timer was sent, if Chronos changed it.
+  ///
+  /// @param timer_id          - The stored ID of the timer.  Updated to the
+  ///                            current ID.
+  void update_timer_id(std::string& timer_id);
+
+private:
+  struct Update
+  {
+    bool remove;
+    time_t expires_at;
+    std::string callback_uri;
+    std::string opaque;
+    std::map<std::string, uint32_t> tags;
+    SAS::TrailId trail;
+  };
+
+  typedef std::unordered_map<std::string, Update> Updates;
+
+  struct NewTimerId
+  {
+    std::string timer_id;
+    time_t expires_at;
+  };
+
+  /// The time (in seconds) for which a new timer ID is remembered after the
+  /// timer would have expired, allowing for the timer pop to be processed.
+  static const int NEW_TIMER_ID_GRACE_S = 60;
+
+  /// Queues an update, unless the queue is full.  Updates to timers in the
+  /// batch currently being sent are always queued, so that they can't be
+  /// sent before (and so be overwritten by) the older update in the batch.
+  bool queue(const std::string& timer_id, const Update& update);
+
+  static void* flush_thread_function(void* queue);
+  void flush_thread_function();
+
+  /// Sends a batch of updates to Chronos.  Deletions are sent first.
+  void flush(Updates& updates);
+
+  ChronosConnection* _chronos_conn;
+  const int _batch_interval_ms;
+  const size_t _max_pending;
+
+  /// The updates waiting to be sent, keyed by timer ID.
+  Updates _pending;
+
+  /// The IDs of the timers in the batch currently being sent.
+  std::unordered_set<std::string> _sending;
+
+  /// Timer IDs that Chronos changed when an update was sent, keyed by the
+  /// old ID.
+  std::unordered_map<std::string, NewTimerId> _new_timer_ids;
+
+  bool _terminated;
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  pthread_t _flush_thread;
+};
+
+#endif
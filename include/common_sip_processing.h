@@ -24,12 +24,22 @@ extern "C" {
 #include "snmp_counter_table.h"
 #include "snmp_counter_by_scope_table.h"
 #include "health_checker.h"
+#include "exception_handler.h"
 
+/// Registers the module that does common processing (logging, overload
+/// control and so on) for all SIP messages.
+///
+/// @param exception_handler - Exception handler for the SAS logging threads.
+/// @param sas_log_threads   - The number of threads used to log received
+///                            messages to SAS.  If this is zero, messages are
+///                            logged on the transport thread.
 pj_status_t
 init_common_sip_processing(LoadMonitor* load_monitor_arg,
                            SNMP::CounterByScopeTable* requests_counter_arg,
                            SNMP::CounterByScopeTable* overload_counter_arg,
-                           HealthChecker* health_checker_arg);
+                           HealthChecker* health_checker_arg,
+                           ExceptionHandler* exception_handler = NULL,
+                           int sas_log_threads = 0);
 
 void unregister_common_processing_module(void);
 
@@ -20,6 +20,18 @@ extern "C" {
 // Main entry point
 pj_status_t register_custom_headers();
 
+// Lazy parsing of the P-Charging-Vector and P-Charging-Function-Addresses
+// headers.  When enabled, these headers are only parsed if they are looked up
+// with pjsip_msg_find_parsed_hdr_by_name, so messages that just pass them on
+// don't pay to parse them.
+pj_status_t set_lazy_charging_headers(bool lazy);
+
+// Finds the first header with the given name, parsing it into its typed form
+// first if it has been parsed lazily.  Returns NULL if there is no such
+// header, or if it could not be parsed.
+pjsip_hdr* pjsip_msg_find_parsed_hdr_by_name(pjsip_msg* msg,
+                                             const pj_str_t* name);
+
 /// Custom header structures.
 
 enum session_refresher_t
@@ -66,6 +78,17 @@ typedef struct pjsip_accept_contact_hdr {
   pjsip_param feature_set;
 } pjsip_accept_contact_hdr;
 
+/// A header that is kept as raw text when a message is parsed, and is only
+/// parsed into its typed form when it is first looked up with
+/// pjsip_msg_find_parsed_hdr_by_name.  The parser is NULL if the value has
+/// already been found not to parse.
+typedef struct pjsip_lazy_hdr {
+  PJSIP_DECL_HDR_MEMBER(struct pjsip_lazy_hdr);
+  pj_str_t hvalue;
+  pjsip_parse_hdr_func* parser;
+  pj_pool_t* pool;
+} pjsip_lazy_hdr;
+
 typedef struct pjsip_reject_contact_hdr {
   PJSIP_DECL_HDR_MEMBER(struct pjsip_reject_contact_hdr);
   pjsip_param feature_set;
@@ -36,8 +36,12 @@ public:
   static void destroy(DNSResolver* resolver);
   // Perform a NAPTR query for the specified domain, returning the results in
   // the naptr_reply structure, and logging to the trail.  The caller must
-  // call free_naptr_reply when it has finished with naptr_reply.
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  // call free_naptr_reply when it has finished with naptr_reply.  ttl is set
+  // to the time (in seconds) for which the result may be cached - the
+  // smallest TTL of the answer records on success, or the negative caching
+  // TTL from the SOA record if the domain doesn't exist - or 0 if the result
+  // must not be cached.
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   // Free a naptr_reply structure.
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
 
@@ -57,6 +61,10 @@ private:
                      int timeouts,
                      unsigned char* abuf,
                      int alen);
+  // Get the time for which a DNS response may be cached, from the TTLs of the
+  // answer records, or (for a negative response) from the SOA record in the
+  // authority section.  Returns 0 if the response can't be parsed.
+  static int get_ttl(const unsigned char* abuf, int alen, bool negative);
 
   // The ares data structure that controls actually making the query.
   ares_channel _channel;
@@ -74,6 +82,9 @@ private:
   // The reply data structure.  Only valid between ares_callback and
   // perform_naptr_query returning, and only if _status is ARES_SUCCESS.
   struct ares_naptr_reply* _naptr_reply;
+  // The time for which the result of the last query may be cached.  Only
+  // valid between ares_callback and perform_naptr_query returning.
+  int _ttl;
   // Pointer to a linked list of servers
   struct ares_addr_node _ares_addrs[3];
 
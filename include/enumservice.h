@@ -16,7 +16,10 @@
 #define ENUMSERVICE_H__
 
 #include <list>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
 #include <netinet/in.h>
@@ -26,6 +29,7 @@
 #include "dnsresolver.h"
 #include "communicationmonitor.h"
 #include "updater.h"
+#include "prefix_trie.h"
 
 /// @class EnumService
 ///
@@ -95,8 +99,8 @@ private:
     std::string replace;
   };
 
-  std::vector<NumberPrefix> _number_prefixes;
-  std::map<std::string, NumberPrefix> _prefix_regex_map;
+  // Trie of the number prefixes (with visual separators removed).
+  PrefixTrie<NumberPrefix> _prefix_trie;
   std::string _configuration;
   Updater<void, JSONEnumService>* _updater;
 
@@ -146,7 +150,7 @@ private:
     // Apply the regular expression match/replace processing for this rule.
     std::string replace(const std::string& string, SAS::TrailId trail) const;
     // Compares two rules according to order and preference.
-    static bool compare_order_preference(Rule first, Rule second);
+    static bool compare_order_preference(const Rule& first, const Rule& second);
 
   private:
     // The regular expression and replacement for this rule.
@@ -160,9 +164,55 @@ private:
 
   };
 
+  typedef std::shared_ptr<const std::vector<Rule>> Rules;
+
+  /// @struct CacheEntry
+  ///
+  /// The cached result of a NAPTR query - the status, and the parsed and
+  /// sorted rules if the query succeeded.
+  struct CacheEntry
+  {
+    int status;
+    Rules rules;
+    unsigned long expiry_ms;
+  };
+
+  /// @struct LookupState
+  ///
+  /// The progress of a lookup through the ENUM algorithm.
+  struct LookupState
+  {
+    LookupState(const std::string& aus) :
+      aus(aus),
+      string(aus),
+      dns_queries(0),
+      complete(false),
+      failed(false),
+      server_failed(false),
+      queried(false)
+    {}
+
+    std::string aus;
+    std::string string;
+    int dns_queries;
+    bool complete;
+    bool failed;
+    bool server_failed;
+    // Whether any query was sent to the ENUM server (rather than answered
+    // from the cache).
+    bool queried;
+  };
+
   // Maximum number of DNS queries per request.
   static const int MAX_DNS_QUERIES = 5;
 
+  // Maximum time (in seconds) for which a NAPTR response is cached, whatever
+  // its TTL.
+  static const int MAX_CACHE_TTL = 3600;
+
+  // Maximum number of cached NAPTR responses.
+  static const size_t MAX_CACHE_ENTRIES = 100000;
+
   // Converts a key to an ENUM domain name.
   std::string key_to_domain(const std::string& key) const;
   // Gets a resolver (from thread-local data).
@@ -171,6 +221,24 @@ private:
   static void parse_naptr_reply(const struct ares_naptr_reply* naptr_reply,
                                 std::vector<DNSEnumService::Rule>& rules);
 
+  // Runs the ENUM algorithm until it completes or fails.
+  void translate(LookupState& state, SAS::TrailId trail) const;
+  // Logs the result of a lookup and returns the URI (or the empty string).
+  std::string finish_lookup(const std::string& user,
+                            LookupState& state,
+                            SAS::TrailId trail) const;
+  // Gets the rules for a domain from the cache.  Returns false if there is no
+  // valid cache entry.
+  bool get_cached_rules(const std::string& domain,
+                        int& status,
+                        Rules& rules) const;
+  // Queries the ENUM server for the rules for a domain, and caches them.
+  int query_rules(const std::string& domain,
+                  Rules& rules,
+                  SAS::TrailId trail) const;
+
+  static unsigned long now_ms();
+
   // The IP address of the DNS server to query.
   std::vector<struct IP46Address> _servers;
   // The suffix to apply to domain names used for ENUM lookups.
@@ -183,6 +251,10 @@ private:
   // Helper used to track enum communication state, and issue/clear alarms
   // based upon recent activity.
   CommunicationMonitor* _comm_monitor;
+
+  // Cache of NAPTR responses, keyed on domain.
+  mutable std::unordered_map<std::string, CacheEntry> _cache;
+  mutable boost::shared_mutex _cache_lock;
 };
 
 #endif
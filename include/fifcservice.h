@@ -9,8 +9,8 @@
  * Metaswitch Networks in a separate written agreement.
  */
 
+#include <memory>
 #include <string>
-#include <boost/thread.hpp>
 #include "rapidxml/rapidxml.hpp"
 
 #include "updater.h"
@@ -34,18 +34,27 @@ public:
   void update_fifcs();
 
   /// Get the fallback iFCs
-  std::vector<Ifc> get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const;
+  std::vector<Ifc> get_fallback_ifcs() const;
 
 private:
+  /// An immutable version of the fallback iFC configuration.  The iFCs are
+  /// parsed and compiled when the configuration is loaded, and refer into the
+  /// document, which they keep alive.
+  struct FallbackIfcs
+  {
+    std::shared_ptr<rapidxml::xml_document<> > doc;
+    std::vector<Ifc> ifcs;
+  };
+
   Alarm* _alarm;
-  std::vector<std::string> _fallback_ifcs;
+
+  // The current fallback iFCs.  This is only ever accessed using the atomic
+  // shared_ptr functions - a reload builds a complete new version and swaps it
+  // in, so readers never take a lock.
+  std::shared_ptr<const FallbackIfcs> _fallback_ifcs;
   std::string _configuration;
   Updater<void, FIFCService>* _updater;
 
-  // Mark as mutable to flag that this can be modified without affecting the
-  // external behaviour of the calss, allowing for locking in 'const' methods.
-  mutable boost::shared_mutex _sets_rw_lock;
-
   // Helper functions to set/clear the alarm.
   void set_alarm();
   void clear_alarm();
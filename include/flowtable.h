@@ -24,6 +24,7 @@ extern "C" {
 #include <map>
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <atomic>
 
 #include "snmp_scalar.h"
@@ -84,6 +85,7 @@ private:
   void expiry_timer();
 
   void inc_ref();
+  bool inc_ref_if_live();
 
   FlowTable* _flow_table;
   pjsip_transport* _transport;
@@ -118,12 +120,14 @@ private:
   /// The default identity for this flow.
   std::string _default_id;
 
-  /// Counts the references to this Flow.  This can only be updated or tested
-  /// by a thread which currently holds the FlowTable::_flow_map_lock.
-  int _refs;
+  /// Counts the references to this Flow.  New references are only taken by
+  /// a thread that found the flow in the FlowTable with the relevant shard
+  /// lock held, and once the count reaches zero no new references are taken,
+  /// so the flow can be removed and deleted.
+  std::atomic_int _refs;
 
   // Counts the number of active dialogs on this flow. This can be
-  // updated or tested without FlowTable::_flow_map_lock being held.
+  // updated or tested without any FlowTable lock being held.
   std::atomic_long _dialogs;
 
   /// Timer identifiers - the timer either runs as an expiry timer (when there
@@ -186,23 +190,30 @@ private:
     {
     }
 
-    /// Override operator< so this can be used as a map key.
-    bool operator< (const FlowKey& other) const
+    bool operator== (const FlowKey& other) const
     {
-      // Compare the transport type first.
-      if (_type < other._type)
-      {
-        return true;
-      }
-      else if (_type > other._type)
-      {
-        return false;
-      }
-      else
+      return ((_type == other._type) &&
+              (pj_sockaddr_cmp(&_raddr, &other._raddr) == 0));
+    }
+
+    /// Hashes the fields compared by operator==.
+    size_t hash() const
+    {
+      // FNV-1a over the transport type, address family, address and port.
+      size_t h = 2166136261u;
+      h = (h ^ (size_t)_type) * 16777619u;
+      h = (h ^ (size_t)_raddr.addr.sa_family) * 16777619u;
+      h = (h ^ (size_t)pj_sockaddr_get_port(&_raddr)) * 16777619u;
+
+      const unsigned char* addr =
+                    (const unsigned char*)pj_sockaddr_get_addr(&_raddr);
+      unsigned int addr_len = pj_sockaddr_get_addr_len(&_raddr);
+      for (unsigned int ii = 0; ii < addr_len; ++ii)
       {
-        // The transport is the same, so check the remote addresses.
-        return (pj_sockaddr_cmp(&_raddr, &other._raddr) < 0);
+        h = (h ^ addr[ii]) * 16777619u;
       }
+
+      return h;
     }
 
   private:
@@ -210,9 +221,40 @@ private:
     pj_sockaddr _raddr;
   };
 
-  pthread_mutex_t _flow_map_lock;
-  std::map<FlowKey, Flow*> _tp2flow_map;        // map from transport addresses to flow
-  std::map<std::string, Flow*> _tk2flow_map;    // map from token to flow
+  struct FlowKeyHash
+  {
+    size_t operator()(const FlowKey& key) const { return key.hash(); }
+  };
+
+  /// The flows are held in two sharded hash tables - one keyed on transport
+  /// type and remote address and one keyed on flow token - so that lookups
+  /// for different flows don't contend on a single lock.  Where both locks
+  /// are needed, the address shard lock is always taken first.
+  static const int NUM_SHARDS = 64;
+
+  struct AddressShard
+  {
+    pthread_mutex_t lock;
+    std::unordered_map<FlowKey, Flow*, FlowKeyHash> flows;
+  };
+
+  struct TokenShard
+  {
+    pthread_mutex_t lock;
+    std::unordered_map<std::string, Flow*> flows;
+  };
+
+  AddressShard& address_shard(const FlowKey& key);
+  TokenShard& token_shard(const std::string& token);
+
+  std::vector<AddressShard*> _tp2flow_shards;   // map from transport addresses to flow
+  std::vector<TokenShard*> _tk2flow_shards;     // map from token to flow
+
+  // The number of flows in the table.
+  std::atomic_long _flow_count;
+
+  // Lock held while checking whether quiescing is complete.
+  pthread_mutex_t _quiesce_lock;
 
   // Statistics
   void report_flow_count();
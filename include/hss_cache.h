@@ -0,0 +1,139 @@
+/**
+ * @file hss_cache.h  Node-wide cache of subscriber data from Homestead.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef HSS_CACHE_H__
+#define HSS_CACHE_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ifchandler.h"
+#include "associated_uris.h"
+#include "snmp_counter_table.h"
+
+/// @class HSSCache
+///
+/// Caches the subscriber data returned by Homestead for a public identity -
+/// the registration state, the parsed service profiles, the associated URIs,
+/// the aliases and the charging addresses - so that calls to or from a
+/// subscriber don't each need a round-trip to Homestead.
+///
+/// Entries expire after a fixed TTL.  The cache is split into shards, each
+/// with its own lock and each evicting its least recently used entries when
+/// it is full, so that lookups on different subscribers don't contend.
+///
+/// Each shard has a generation, which is bumped whenever an identity in the
+/// shard is invalidated.  Callers get the generation before fetching the data
+/// from Homestead, and pass it to put, so that data fetched before an
+/// invalidation (for example, by an RTR or PPR) isn't cached after it.
+class HSSCache
+{
+public:
+  /// The cached data for a public identity.
+  struct Data
+  {
+    std::string regstate;
+    std::map<std::string, Ifcs> service_profiles;
+    AssociatedURIs associated_uris;
+    std::vector<std::string> aliases;
+    std::deque<std::string> ccfs;
+    std::deque<std::string> ecfs;
+  };
+
+  /// Constructor.
+  ///
+  /// @param ttl_s          - The time (in seconds) for which entries are valid.
+  /// @param max_entries    - The maximum number of entries in the cache.
+  /// @param hits_tbl       - Counter of cache hits (may be NULL).
+  /// @param misses_tbl     - Counter of cache misses (may be NULL).
+  HSSCache(int ttl_s,
+           int max_entries,
+           SNMP::CounterTable* hits_tbl,
+           SNMP::CounterTable* misses_tbl);
+  virtual ~HSSCache();
+
+  /// Gets the cached data for a public identity.
+  ///
+  /// @returns the data, or NULL if there is no valid entry for the identity.
+  std::shared_ptr<const Data> get(const std::string& public_id);
+
+  /// Gets the current generation for a public identity.  This must be called
+  /// before fetching the data to pass to put.
+  uint64_t generation(const std::string& public_id);
+
+  /// Caches the data for a public identity, replacing any existing entry and
+  /// invalidating the rest of the existing entry's implicit registration set.
+  /// The data is dropped if the identity may have been invalidated since the
+  /// specified generation.
+  ///
+  /// @returns whether the data was cached.
+  bool put(const std::string& public_id,
+           const Data& data,
+           uint64_t generation);
+
+  /// Invalidates the cached data for a public identity, and for all of the
+  /// other identities in its implicit registration set (if that is known).
+  void invalidate(const std::string& public_id);
+
+private:
+  struct Entry
+  {
+    std::string public_id;
+    std::shared_ptr<const Data> data;
+
+    // All the identities in the implicit registration set.
+    std::vector<std::string> irs;
+
+    unsigned long expiry_ms;
+  };
+
+  struct Shard
+  {
+    Shard() : generation(0) {}
+
+    pthread_mutex_t lock;
+    uint64_t generation;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+  };
+
+  Shard& get_shard(const std::string& public_id);
+
+  /// Removes an entry from a shard, returning its implicit registration set.
+  /// Must be called with the shard lock held.
+  static std::vector<std::string> remove_entry(Shard& shard,
+                                               const std::string& public_id);
+
+  /// Invalidates the entries for the identities in an implicit registration
+  /// set, other than the specified one.
+  void invalidate_irs(const std::vector<std::string>& irs,
+                      const std::string& public_id);
+
+  static unsigned long now_ms();
+
+  static const int NUM_SHARDS = 16;
+
+  unsigned long _ttl_ms;
+  size_t _max_entries_per_shard;
+  std::vector<Shard*> _shards;
+  SNMP::CounterTable* _hits_tbl;
+  SNMP::CounterTable* _misses_tbl;
+};
+
+#endif
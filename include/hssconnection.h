@@ -13,6 +13,10 @@
 #define HSSCONNECTION_H__
 
 #include <curl/curl.h>
+#include <pthread.h>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 #include "rapidjson/document.h"
 
 #include "httpconnection.h"
@@ -23,6 +27,7 @@
 #include "load_monitor.h"
 #include "associated_uris.h"
 #include "sifcservice.h"
+#include "hss_cache.h"
 
 /// @class HSSConnection
 ///
@@ -43,6 +48,7 @@ public:
                 SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                 CommunicationMonitor* comm_monitor,
                 SIFCService* sifc_service,
+                HSSCache* cache,
                 long homestead_timeout_ms);
   virtual ~HSSConnection();
 
@@ -124,6 +130,11 @@ public:
                                          SAS::TrailId trail);
   rapidxml::xml_document<>* parse_xml(std::string raw, const std::string& url);
 
+  /// Invalidates any cached subscriber data for the public identity (and the
+  /// rest of its implicit registration set).  This should be called when
+  /// Homestead tells us the subscriber's data has changed.
+  void invalidate_cached_data(const std::string& public_user_identity);
+
   static const std::string REG;
   static const std::string CALL;
   static const std::string DEREG_USER;
@@ -145,6 +156,55 @@ private:
                                   rapidxml::xml_document<>*& root,
                                   SAS::TrailId trail);
 
+  /// An HTTP request to Homestead that is in progress.  Identical requests
+  /// made while it is in progress wait for its response rather than sending
+  /// their own.
+  struct InFlightRequest
+  {
+    InFlightRequest() :
+      complete(false),
+      waiters(0),
+      http_code(HTTP_OK)
+    {
+      pthread_cond_init(&cond, NULL);
+    }
+
+    ~InFlightRequest()
+    {
+      pthread_cond_destroy(&cond);
+    }
+
+    // These are all protected by _in_flight_lock.
+    pthread_cond_t cond;
+    bool complete;
+    int waiters;
+    HTTPCode http_code;
+    std::string response;
+  };
+
+  /// Sends a request to Homestead, unless an identical request is already in
+  /// progress, in which case waits for that request's response instead.
+  ///
+  /// @param key      - Identifies the request.  Requests with the same key
+  ///                   must be idempotent and have the same response.
+  /// @param send     - Sends the request and fills in the response body.
+  /// @param response - Filled in with the response body.
+  ///
+  /// @returns the HTTP result code of the request.
+  HTTPCode send_coalesced(const std::string& key,
+                          const std::function<HTTPCode(std::string&)>& send,
+                          std::string& response);
+
+  /// Returns true if a GET of this path can share a response with other GETs
+  /// of the same path.  Authentication vectors can't be shared, as each
+  /// challenge must use a fresh vector.
+  static bool can_coalesce_get(const std::string& path);
+
+  /// Returns true if a PUT with this body can share a response with other
+  /// PUTs of the same body.  Only calls can, as they don't change the
+  /// subscriber's state on Homestead.
+  static bool can_coalesce_put(const std::string& body);
+
   HttpConnection* _http;
   SNMP::EventAccumulatorTable* _latency_tbl;
   SNMP::EventAccumulatorTable* _mar_latency_tbl;
@@ -152,6 +212,13 @@ private:
   SNMP::EventAccumulatorTable* _uar_latency_tbl;
   SNMP::EventAccumulatorTable* _lir_latency_tbl;
   SIFCService* _sifc_service;
+
+  // Node-wide cache of subscriber data, or NULL if caching is disabled.
+  HSSCache* _cache;
+
+  // Requests to Homestead that are in progress, indexed by key.
+  pthread_mutex_t _in_flight_lock;
+  std::unordered_map<std::string, std::shared_ptr<InFlightRequest> > _in_flight;
 };
 
 #endif
@@ -35,6 +35,11 @@ public:
                 std::string& wildcard,
                 bool do_billing=false);
 
+  /// Does the HSS query, if it hasn't already been done.  This blocks, so can
+  /// be run asynchronously before calling get_scscf, which then uses the
+  /// result rather than querying the HSS itself.
+  void query_hss();
+
 protected:
   /// Do the HSS query.  This must be implemented by the request-type specific
   /// routers.
@@ -70,6 +75,15 @@ protected:
   /// transaction.
   ServerCapabilities _hss_rsp;
 
+  /// Flag which indicates whether _hss_rsp has been parsed from an HSS
+  /// response but not yet passed to the ACR.
+  bool _parsed_hss_rsp;
+
+  /// Flag which indicates whether query_hss has queried the HSS and
+  /// get_scscf hasn't yet used the result, and the result of that query.
+  bool _have_query_result;
+  int _query_result;
+
   /// The list of S-CSCFs already attempted for this request.
   std::vector<std::string> _attempted_scscfs;
 };
@@ -85,9 +85,6 @@ private:
     return _override_npdi;
   }
 
-  /// Attempts to use ENUM to translate the specified Tel URI into a SIP URI.
-  void translate_request_uri(pjsip_msg* req, pj_pool_t* pool, SAS::TrailId trail);
-
   /// Get an ACR instance from the factory.
   /// @param trail                SAS trail identifier to use for the ACR.
   ACR* get_acr(SAS::TrailId trail);
@@ -130,8 +127,66 @@ public:
   virtual void on_rx_response(pjsip_msg* rsp, int fork_id) override;
   virtual void on_tx_response(pjsip_msg* rsp) override;
   virtual void on_rx_cancel(int status_code, pjsip_msg* req) override;
+  virtual void on_async_complete(void* context) override;
 
 private:
+  /// The asynchronous operations that the transaction runs while routing a
+  /// request.
+  enum AsyncOp
+  {
+    HSS_QUERY,
+    TEL_URI_HSS_QUERY,
+    ENUM_LOOKUP,
+    ENUM_HSS_QUERY,
+    RETRY_HSS_QUERY
+  };
+
+  /// Queries the HSS without holding up this thread.  on_async_complete
+  /// carries on processing the request when the query completes.
+  ///
+  /// @param req                  The request to route.
+  /// @param op                   Why the HSS is being queried.
+  void query_hss(pjsip_msg* req, AsyncOp op);
+
+  /// Routes the request to an S-CSCF, once the HSS has been queried.
+  ///
+  /// @param req                  The request to route.
+  void route_to_scscf(pjsip_msg* req);
+
+  /// Attempts to use ENUM to translate the Request-URI of a request whose
+  /// target the HSS doesn't know.  The lookup runs without holding up this
+  /// thread.
+  ///
+  /// @param req                  The request to route.
+  /// @param status_code          The result of the last S-CSCF lookup.
+  void translate_request_uri(pjsip_msg* req, pjsip_status_code status_code);
+
+  /// Routes the request once ENUM has translated its Request-URI.
+  ///
+  /// @param req                  The request to route.
+  /// @param original_req_uri     The Request-URI before the translation.
+  void route_translated_request(pjsip_msg* req, pjsip_uri* original_req_uri);
+
+  /// Routes the request using the result of the S-CSCF lookup, or rejects
+  /// it if no S-CSCF or BGCF is suitable.
+  ///
+  /// @param req                  The request to route.
+  /// @param status_code          The result of the S-CSCF lookup.
+  /// @param scscf_sip_uri        The S-CSCF to route to (if the lookup
+  ///                             succeeded).
+  /// @param wildcard             The wildcard returned on the LIA.
+  void route_request(pjsip_msg* req,
+                     pjsip_status_code status_code,
+                     pjsip_sip_uri* scscf_sip_uri,
+                     const std::string& wildcard);
+
+  /// Retries the request on an alternate S-CSCF, once the HSS has been
+  /// queried again.
+  ///
+  /// @param req                  The request to retry.
+  /// @param rsp                  The failure response from the last S-CSCF.
+  void retry_request(pjsip_msg* req, pjsip_msg* rsp);
+
   /// Determine whether a status code indicates that the S-CSCF wasn't
   /// found.
   ///
@@ -164,6 +219,28 @@ private:
   bool _originating;
   bool _routed_to_bgcf;
 
+  /// The request being routed while the HSS or ENUM is queried.
+  pjsip_msg* _pending_req;
+
+  /// The failure response being held while the HSS is queried for an
+  /// alternate S-CSCF.
+  pjsip_msg* _pending_rsp;
+
+  /// The asynchronous operation in progress.
+  AsyncOp _async_op;
+
+  /// The number of ENUM lookups done so far, and the result of the latest.
+  int _enum_lookups;
+  std::string _enum_uri;
+
+  /// The result of the last S-CSCF lookup, used to route the request if ENUM
+  /// doesn't find a better target.
+  pjsip_status_code _scscf_status;
+
+  /// Whether the request has been cancelled.  If it is cancelled while the
+  /// HSS or ENUM is queried, it is rejected rather than routed.
+  bool _cancelled;
+
   /// Tracks request type and whether a session has been set up for the purposes
   /// of reporting session_establishment stats.  Note that the defintion we
   /// need of "set up" is slightly unusual here: we consider the session to be
@@ -184,11 +261,32 @@ public:
   virtual void on_tx_request(pjsip_msg* req, int fork_id) override;
   virtual void on_rx_response(pjsip_msg* rsp, int fork_id) override;
   virtual void on_tx_response(pjsip_msg* rsp) override;
+  virtual void on_async_complete(void* context) override;
 
 private:
+  /// Queries the HSS without holding up this thread.  on_async_complete
+  /// picks an S-CSCF when the query completes.
+  ///
+  /// @param req                  The REGISTER to route.
+  void query_hss(pjsip_msg* req);
+
+  /// Retries the REGISTER on an alternate S-CSCF, once the HSS has been
+  /// queried again.
+  ///
+  /// @param req                  The REGISTER to retry.
+  /// @param rsp                  The failure response from the last S-CSCF.
+  void retry_request(pjsip_msg* req, pjsip_msg* rsp);
+
   ICSCFSproutlet* _icscf;
   ACR* _acr;
   ICSCFRouter* _router;
+
+  /// The REGISTER being routed while the HSS is queried.
+  pjsip_msg* _pending_req;
+
+  /// The failure response being held while the HSS is queried for an
+  /// alternate S-CSCF.
+  pjsip_msg* _pending_rsp;
 };
 
 #endif
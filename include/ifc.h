@@ -68,14 +68,25 @@ struct AsInvocation
   bool include_register_response;
 };
 
+struct CompiledIfc;
+struct CompiledSpt;
+struct IfcError;
+
 /// A single Initial Filter Criterion (iFC).
+//
+// On construction the iFC's XML is compiled into an immutable form (see
+// CompiledIfc) which is used to evaluate the iFC.  Compiled iFCs are cached
+// and shared between all the Ifc objects with the same XML.
 class Ifc
 {
 public:
-  Ifc(rapidxml::xml_node<>* ifc) :
-    _ifc(ifc)
-  {
-  }
+  Ifc(rapidxml::xml_node<>* ifc);
+
+  /// This constructor creates an Ifc for a node in a document that is shared
+  // between Ifc objects (e.g. the shared or fallback iFC configuration).  The
+  // owner is held by the Ifc (and its copies) to keep the node valid.
+  Ifc(rapidxml::xml_node<>* ifc,
+      std::shared_ptr<const void> owner);
 
   /// This constructor creates an Ifc and makes sure that all of its
   // associated memory is owned by the passed in XML document.
@@ -91,15 +102,29 @@ public:
   AsInvocation as_invocation() const;
 
 private:
+  /// The maximum number of compiled iFCs that are cached.
+  static const size_t MAX_COMPILED_IFCS = 10000;
+
+  static std::shared_ptr<const CompiledIfc> get_compiled_ifc(rapidxml::xml_node<>* ifc);
+
+  static std::shared_ptr<CompiledIfc> compile(rapidxml::xml_node<>* ifc,
+                                              const std::string& ifc_str);
+
+  static void compile_spt(rapidxml::xml_node<>* spt_node,
+                          CompiledSpt& spt);
+
   static bool spt_matches(const SessionCase& session_case,
                           bool is_registered,
                           bool is_initial_registration,
                           pjsip_msg *msg,
-                          rapidxml::xml_node<>* spt,
-                          std::string ifc_str,
-                          std::string server_name,
+                          const CompiledSpt& spt,
+                          const std::string& server_name,
                           SAS::TrailId trail);
 
+  static void report_error(const IfcError& error,
+                           const std::string& server_name,
+                           SAS::TrailId trail);
+
   static void invalid_ifc(std::string error,
                           std::string server_name,
                           int sas_event_id,
@@ -107,5 +132,7 @@ private:
                           SAS::TrailId trail);
 
   rapidxml::xml_node<>* _ifc;
+  std::shared_ptr<const void> _owner;
   std::string _server_name;
+  std::shared_ptr<const CompiledIfc> _compiled;
 };
@@ -15,6 +15,7 @@
 #ifndef MMTEL_H__
 #define MMTEL_H__
 
+#include <memory>
 #include <string>
 
 extern "C" {
@@ -28,6 +29,7 @@ extern "C" {
 #include "appserver.h"
 #include "xdmconnection.h"
 #include "simservs.h"
+#include "simservs_cache.h"
 #include "aschain.h"
 #include "counter.h"
 
@@ -41,9 +43,11 @@ class Mmtel : public AppServer
 {
 public:
   Mmtel(const std::string& service_name,
-        XDMConnection* xdm_client) :
+        XDMConnection* xdm_client,
+        SimservsCache* cache = NULL) :
     AppServer(service_name),
-    _xdmc(xdm_client) {};
+    _xdmc(xdm_client),
+    _cache(cache) {};
 
   AppServerTsx* get_app_tsx(SproutletHelper* helper,
                             pjsip_msg* req,
@@ -53,8 +57,12 @@ public:
 
 private:
   XDMConnection* _xdmc;
+  SimservsCache* _cache;
 
-  simservs *get_user_services(std::string public_id, SAS::TrailId trail);
+  std::shared_ptr<const simservs> get_user_services(std::string public_id,
+                                                    SAS::TrailId trail);
+  std::shared_ptr<const simservs> get_cached_user_services(const std::string& public_id,
+                                                           SAS::TrailId trail);
 };
 
 // Cut-down AS that invokes MMTEL-style call diversion configured through
@@ -86,7 +94,7 @@ class MmtelTsx : public AppServerTsx
 {
 public:
   MmtelTsx(pjsip_msg* req,
-           simservs* user_services,
+           std::shared_ptr<const simservs> user_services,
            SAS::TrailId trail,
            CDivCallback* cdiv_callback = NULL);
   ~MmtelTsx();
@@ -99,7 +107,7 @@ private:
   bool _originating;
   pjsip_method_e _method;
   std::string _country_code;
-  simservs* _user_services;
+  std::shared_ptr<const simservs> _user_services;
   CDivCallback* _cdiv_callback;
   bool _ringing;
   unsigned int _media_conditions;
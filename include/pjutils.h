@@ -269,17 +269,28 @@ bool get_npdi(pjsip_uri* uri);
 bool get_rn(pjsip_uri* uri, std::string& routing_value);
 pjsip_param* get_userpart_param(pjsip_uri* uri, pj_str_t param);
 
-void translate_request_uri(pjsip_msg* req,
-                           pj_pool_t* pool,
-                           EnumService* enum_service,
-                           bool should_override_npdi,
-                           SAS::TrailId trail);
-
-void update_request_uri_np_data(pjsip_msg* req,
-                                pj_pool_t* pool,
-                                EnumService* enum_service,
-                                bool should_override_npdi,
-                                SAS::TrailId trail);
+// ENUM translation of the Request-URI is split into three steps, so that a
+// sproutlet can run the lookup (which may block on the ENUM server) with
+// run_async.  get_enum_user and apply_enum_translation access the request so
+// must be called on the transaction's thread; lookup_enum_user doesn't.
+//
+// get_enum_user returns whether the Request-URI should be translated and, if
+// so, the user to look up.  np_data_only is set when only number portability
+// data is wanted from the lookup.
+bool get_enum_user(pjsip_msg* req,
+                   bool np_data_only,
+                   std::string& user);
+
+std::string lookup_enum_user(const std::string& user,
+                             EnumService* enum_service,
+                             SAS::TrailId trail);
+
+void apply_enum_translation(pjsip_msg* req,
+                            pj_pool_t* pool,
+                            const std::string& enum_uri,
+                            bool np_data_only,
+                            bool should_override_npdi,
+                            SAS::TrailId trail);
 
 bool should_update_np_data(URIClass old_uri_class,
                            URIClass new_uri_class,
@@ -0,0 +1,216 @@
+/**
+ * @file prefix_trie.h  Template definition for a trie used to match numbers
+ *                      against configured number prefixes.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PREFIX_TRIE_H__
+#define PREFIX_TRIE_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Trie mapping number prefixes to values.  The trie is built once (when the
+/// configuration is loaded) and then searched on every lookup, so a lookup
+/// costs one step per character of the number, however many prefixes are
+/// configured.
+///
+/// The nodes are held in a single vector, with each node's children held in
+/// a vector sorted by character, so that a trie of several hundred thousand
+/// prefixes stays compact.
+///
+/// Prefixes and numbers must have had their visual separators removed before
+/// they are passed to the trie.
+template<class T>
+class PrefixTrie
+{
+public:
+  PrefixTrie() : _nodes(1), _values() {}
+
+  /// Adds a prefix to the trie.  If the prefix is already present, the
+  /// existing value is kept.
+  ///
+  /// @returns true if the prefix was added.
+  bool insert(const std::string& prefix, const T& value)
+  {
+    uint32_t node = 0;
+
+    for (std::string::const_iterator c = prefix.begin();
+         c != prefix.end();
+         ++c)
+    {
+      std::vector<Edge>& children = _nodes[node].children;
+      typename std::vector<Edge>::iterator edge = lower_bound(children.begin(),
+                                                               children.end(),
+                                                               *c);
+
+      if ((edge != children.end()) && (edge->first == *c))
+      {
+        node = edge->second;
+      }
+      else
+      {
+        // Add a new node.  Note that this may reallocate _nodes, so the
+        // children reference isn't used after this.
+        uint32_t child = _nodes.size();
+        children.insert(edge, Edge(*c, child));
+        _nodes.push_back(Node());
+        node = child;
+      }
+    }
+
+    if (_nodes[node].value != NO_VALUE)
+    {
+      return false;
+    }
+
+    _nodes[node].value = _values.size();
+    _values.push_back(value);
+    return true;
+  }
+
+  /// Finds the value for the longest prefix of the number.
+  ///
+  /// If match_longer_prefixes is set and the whole number is a proper prefix
+  /// of one or more configured prefixes, the (lexicographically) greatest of
+  /// those configured prefixes is matched instead.  This is how the prefix
+  /// matching in the JSON ENUM and BGCF configuration has always behaved for
+  /// numbers that are shorter than the configured prefixes.
+  ///
+  /// @param number                - The number to match.
+  /// @param match_longer_prefixes - Whether a number may match a configured
+  ///                                prefix that is longer than the number.
+  /// @param matched_prefix        - If not NULL, set to the matched prefix.
+  ///
+  /// @returns the value for the matched prefix, or NULL if there is no match.
+  const T* match(const std::string& number,
+                 bool match_longer_prefixes,
+                 std::string* matched_prefix = NULL) const
+  {
+    uint32_t node = 0;
+    uint32_t best = _nodes[0].value;
+    size_t best_len = 0;
+    size_t len = 0;
+
+    while (len < number.size())
+    {
+      const std::vector<Edge>& children = _nodes[node].children;
+      typename std::vector<Edge>::const_iterator edge =
+                        lower_bound(children.begin(), children.end(), number[len]);
+
+      if ((edge == children.end()) || (edge->first != number[len]))
+      {
+        break;
+      }
+
+      node = edge->second;
+      ++len;
+
+      if (_nodes[node].value != NO_VALUE)
+      {
+        best = _nodes[node].value;
+        best_len = len;
+      }
+    }
+
+    if ((match_longer_prefixes) &&
+        (len == number.size()) &&
+        (!_nodes[node].children.empty()))
+    {
+      // The whole number is a proper prefix of some configured prefixes.
+      // The greatest of those is found by following the last child down to a
+      // leaf (every leaf holds a value).
+      std::string extension;
+
+      while (!_nodes[node].children.empty())
+      {
+        const Edge& edge = _nodes[node].children.back();
+        extension.push_back(edge.first);
+        node = edge.second;
+      }
+
+      if (matched_prefix != NULL)
+      {
+        *matched_prefix = number + extension;
+      }
+
+      return &_values[_nodes[node].value];
+    }
+
+    if (best == NO_VALUE)
+    {
+      return NULL;
+    }
+
+    if (matched_prefix != NULL)
+    {
+      matched_prefix->assign(number, 0, best_len);
+    }
+
+    return &_values[best];
+  }
+
+  /// Returns the number of prefixes in the trie.
+  size_t size() const
+  {
+    return _values.size();
+  }
+
+  bool empty() const
+  {
+    return _values.empty();
+  }
+
+  void swap(PrefixTrie& other)
+  {
+    _nodes.swap(other._nodes);
+    _values.swap(other._values);
+  }
+
+private:
+  typedef std::pair<char, uint32_t> Edge;
+
+  static const uint32_t NO_VALUE = 0xFFFFFFFF;
+
+  struct Node
+  {
+    Node() : children(), value(NO_VALUE) {}
+
+    // Edges to the child nodes, sorted by character.
+    std::vector<Edge> children;
+
+    // Index into _values, or NO_VALUE if no prefix ends at this node.
+    uint32_t value;
+  };
+
+  // Finds the first child whose character is not less than c.  Characters
+  // are compared as unsigned, as std::string does, so that the children are
+  // in the same order as the prefixes would be in a std::map.
+  //
+  // Nodes typically have few children (at most ten for a digit string), so a
+  // linear search is quicker than a binary one.
+  template<class I>
+  static I lower_bound(I begin, I end, char c)
+  {
+    while ((begin != end) &&
+           ((unsigned char)begin->first < (unsigned char)c))
+    {
+      ++begin;
+    }
+    return begin;
+  }
+
+  std::vector<Node> _nodes;
+  std::vector<T> _values;
+};
+
+#endif
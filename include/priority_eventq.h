@@ -0,0 +1,212 @@
+/**
+ * @file priority_eventq.h  Template definition for a multi-class priority
+ *                          event queue.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PRIORITY_EVENTQ_H__
+#define PRIORITY_EVENTQ_H__
+
+#include <pthread.h>
+#include <time.h>
+
+#include <deque>
+#include <vector>
+
+/// Event queue with a fixed number of priority classes.  Items are popped
+/// strictly in priority order (class 0 first), and in FIFO order within a
+/// class.  The interface mirrors eventq, including its deadlock detection:
+/// the queue is considered deadlocked if it has been non-empty for longer than
+/// the deadlock threshold without anything being popped.
+template<class T>
+class priority_eventq
+{
+public:
+  /// Constructor.
+  ///
+  /// @param num_classes        - The number of priority classes.
+  /// @param deadlock_threshold - Time (in milliseconds) after which the queue
+  ///                             is deemed deadlocked if it hasn't been
+  ///                             serviced, or zero to disable detection.
+  priority_eventq(unsigned int num_classes,
+                  unsigned int deadlock_threshold = 0) :
+    _qs(num_classes),
+    _size(0),
+    _terminated(false),
+    _deadlock_threshold(deadlock_threshold),
+    _service_time_ms(0)
+  {
+    pthread_mutex_init(&_m, NULL);
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_cond, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+  }
+
+  ~priority_eventq()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_m);
+  }
+
+  /// Terminates the queue, waking up any threads blocked in pop().
+  void terminate()
+  {
+    pthread_mutex_lock(&_m);
+    _terminated = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_m);
+  }
+
+  /// Sets the deadlock detection threshold (in milliseconds).
+  void set_deadlock_threshold(unsigned int threshold)
+  {
+    pthread_mutex_lock(&_m);
+    _deadlock_threshold = threshold;
+    pthread_mutex_unlock(&_m);
+  }
+
+  /// Checks whether the queue has been non-empty and unserviced for longer
+  /// than the deadlock threshold.
+  bool is_deadlocked()
+  {
+    bool deadlocked = false;
+    pthread_mutex_lock(&_m);
+    if ((_deadlock_threshold > 0) && (_size > 0))
+    {
+      deadlocked = ((now_ms() - _service_time_ms) > _deadlock_threshold);
+    }
+    pthread_mutex_unlock(&_m);
+    return deadlocked;
+  }
+
+  /// Pushes an item onto the queue in the specified priority class.
+  ///
+  /// @returns false if the queue has been terminated.
+  bool push(const T& item, unsigned int priority)
+  {
+    pthread_mutex_lock(&_m);
+    bool pushed = !_terminated;
+
+    if (pushed)
+    {
+      if (_size == 0)
+      {
+        // The queue was idle, so restart the deadlock timer from now.
+        _service_time_ms = now_ms();
+      }
+
+      _qs[priority].push_back(item);
+      ++_size;
+      pthread_cond_signal(&_cond);
+    }
+
+    pthread_mutex_unlock(&_m);
+    return pushed;
+  }
+
+  /// Pops the highest priority item from the queue, waiting for up to
+  /// timeout milliseconds (or indefinitely if timeout is -1) for one to be
+  /// available.
+  ///
+  /// @returns false if the queue was terminated or the wait timed out.
+  bool pop(T& item, int timeout)
+  {
+    pthread_mutex_lock(&_m);
+
+    if ((_size == 0) && (!_terminated) && (timeout != 0))
+    {
+      if (timeout < 0)
+      {
+        while ((_size == 0) && (!_terminated))
+        {
+          pthread_cond_wait(&_cond, &_m);
+        }
+      }
+      else
+      {
+        struct timespec abstime;
+        clock_gettime(CLOCK_MONOTONIC, &abstime);
+        abstime.tv_sec += timeout / 1000;
+        abstime.tv_nsec += (timeout % 1000) * 1000000;
+        if (abstime.tv_nsec >= 1000000000)
+        {
+          abstime.tv_sec += 1;
+          abstime.tv_nsec -= 1000000000;
+        }
+
+        int rc = 0;
+        while ((_size == 0) && (!_terminated) && (rc == 0))
+        {
+          rc = pthread_cond_timedwait(&_cond, &_m, &abstime);
+        }
+      }
+    }
+
+    bool popped = ((!_terminated) && (_size > 0));
+
+    if (popped)
+    {
+      for (typename std::vector<std::deque<T> >::iterator q = _qs.begin();
+           q != _qs.end();
+           ++q)
+      {
+        if (!q->empty())
+        {
+          item = q->front();
+          q->pop_front();
+          break;
+        }
+      }
+
+      --_size;
+      _service_time_ms = now_ms();
+    }
+
+    pthread_mutex_unlock(&_m);
+    return popped;
+  }
+
+  /// Pops the highest priority item, waiting indefinitely for one to be
+  /// available.
+  bool pop(T& item)
+  {
+    return pop(item, -1);
+  }
+
+  /// Returns the total number of items queued across all the priority
+  /// classes.
+  unsigned int size()
+  {
+    pthread_mutex_lock(&_m);
+    unsigned int size = _size;
+    pthread_mutex_unlock(&_m);
+    return size;
+  }
+
+private:
+  static unsigned long now_ms()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+  }
+
+  std::vector<std::deque<T> > _qs;
+  unsigned int _size;
+  bool _terminated;
+  unsigned int _deadlock_threshold;
+  unsigned long _service_time_ms;
+
+  pthread_mutex_t _m;
+  pthread_cond_t _cond;
+};
+
+#endif
@@ -12,18 +12,36 @@
 #ifndef RALF_PROCESSOR_H_
 #define RALF_PROCESSOR_H_
 
+#include <pthread.h>
+
+#include <vector>
+
 #include "threadpool.h"
 #include "sas.h"
 #include "httpconnection.h"
 #include "exception_handler.h"
+#include "snmp_counter_table.h"
 
 class RalfProcessor
 {
 public:
   /// Constructor
+  /// @param ralf_connection    A pointer to the underlying ralf connection.
+  /// @param exception_handler  Exception handler
+  /// @param ralf_threads       Number of ralf threads to start
+  /// @param batch_interval_ms  If non-zero, ACRs are queued and handed to the
+  ///                           ralf threads in batches at this interval (in
+  ///                           milliseconds), rather than one at a time.
+  /// @param max_queued_acrs    When batching, the maximum number of ACRs
+  ///                           waiting to be sent.  Further ACRs are dropped.
+  /// @param dropped_acrs_tbl   Counter of ACRs dropped because too many were
+  ///                           waiting to be sent (may be NULL).
   RalfProcessor(HttpConnection* ralf_connection,
                 ExceptionHandler* exception_handler,
-                const int ralf_threads);
+                const int ralf_threads,
+                const int batch_interval_ms = 0,
+                const int max_queued_acrs = 0,
+                SNMP::CounterTable* dropped_acrs_tbl = NULL);
 
   /// Destructor
   virtual ~RalfProcessor();
@@ -35,31 +53,37 @@ public:
     SAS::TrailId trail;
   };
 
+  /// A batch of requests, sent one after another by a single ralf thread.
+  struct RalfBatch
+  {
+    RalfProcessor* processor;
+    std::vector<RalfRequest*> requests;
+  };
+
   /// This function adds a ralf request to the pool. Actually sending
   /// the Ralf request must be done in a separate thread to avoid
   /// introducing unnecessary latencies in the call path.
   /// @param rr         The RalfRequest to add to the queue
   virtual void send_request_to_ralf(RalfRequest* rr);
 
-  static void exception_callback(RalfProcessor::RalfRequest* work)
-  {
-    // No recovery behaviour as this is asynchronous, so we can't sensibly
-    // respond
-  }
+  /// Called if a ralf thread hits an exception while sending a batch.
+  static void exception_callback(RalfProcessor::RalfBatch* batch);
 
 private:
   /// @class Pool
   /// The thread pool used by the ralf processor
-  class Pool : public ThreadPool<RalfProcessor::RalfRequest*>
+  class Pool : public ThreadPool<RalfProcessor::RalfBatch*>
   {
   public:
     /// Constructor.
+    /// @param processor          The ralf processor that owns this pool.
     /// @param ralf_connection    A pointer to the underlying ralf connection.
     /// @param num_threads        Number of ralf threads to start
     /// @param exception_handler  Exception handler
-    Pool(HttpConnection* ralf_connection,
+    Pool(RalfProcessor* processor,
+         HttpConnection* ralf_connection,
          ExceptionHandler* exception_handler,
-         void (*callback)(RalfProcessor::RalfRequest*),
+         void (*callback)(RalfProcessor::RalfBatch*),
          unsigned int num_threads);
 
     /// Destructor
@@ -67,7 +91,10 @@ private:
 
   private:
     /// Called by worker threads when they pull work off the queue.
-    virtual void process_work(RalfProcessor::RalfRequest*&);
+    virtual void process_work(RalfProcessor::RalfBatch*&);
+
+    /// The ralf processor that owns this pool.
+    RalfProcessor* _processor;
 
     /// Underlying Ralf connection
     HttpConnection* _ralf_connection;
@@ -75,8 +102,40 @@ private:
 
   friend class Pool;
 
+  /// Entry point for the thread that hands the queued ACRs to the pool.
+  static void* flush_thread_function(void* processor);
+  void flush_thread_function();
+
+  /// Hands the queued ACRs to the pool, split into one batch per ralf
+  /// thread.  ACRs for the same call are always in the same batch, so they
+  /// are sent in the order they were queued.
+  void flush(std::vector<RalfRequest*>& requests);
+
+  /// Called by the pool when it has finished with a batch of queued ACRs.
+  /// Frees any requests in the batch that weren't sent, and the batch itself.
+  void batch_complete(RalfBatch* batch);
+
   ///  Thread pool
   Pool* _thread_pool;
+
+  /// Batching configuration.
+  const int _num_threads;
+  const int _batch_interval_ms;
+  const size_t _max_queued_acrs;
+  SNMP::CounterTable* _dropped_acrs_tbl;
+
+  /// When batching, the ACRs waiting for the next flush, and the number of
+  /// ACRs queued in total (including those handed to the pool but not yet
+  /// sent).  Protected by _lock.
+  std::vector<RalfRequest*> _pending;
+  size_t _queued;
+  bool _terminated;
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  pthread_t _flush_thread;
+
+  /// Flush early once this many ACRs are waiting.
+  static const size_t MAX_BATCH_SIZE = 100;
 };
 
 #endif
@@ -0,0 +1,96 @@
+/**
+ * @file sas_rx_log_pool.h  Thread pool that logs received SIP messages to SAS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SAS_RX_LOG_POOL_H__
+#define SAS_RX_LOG_POOL_H__
+
+extern "C" {
+#include <pjsip.h>
+}
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "sas.h"
+#include "threadpool.h"
+#include "exception_handler.h"
+
+/// A received message waiting to be logged to SAS.  This holds a copy of the
+/// message bytes, as the transport's receive buffer is reused as soon as the
+/// message has been passed up the stack.
+struct SASRxLog
+{
+  SAS::TrailId trail;
+  SAS::Timestamp timestamp;
+  pjsip_transport_type_e transport_type;
+  int src_port;
+  std::string src_name;
+  std::string msg;
+};
+
+/// @class SASRxLogPool
+/// Threads that compress received messages and log them to SAS, so that this
+/// isn't done on the transport thread.
+///
+/// The number of messages waiting to be logged is bounded.  When it is full,
+/// further messages are dropped (and counted) rather than holding up the
+/// transport thread or using unbounded memory.
+class SASRxLogPool : public ThreadPool<SASRxLog*>
+{
+public:
+  /// Constructor.
+  ///
+  /// @param exception_handler - Exception handler for the pool threads.
+  /// @param num_threads       - The number of threads.
+  /// @param max_queued        - The maximum number of messages waiting to be
+  ///                            logged.
+  SASRxLogPool(ExceptionHandler* exception_handler,
+               unsigned int num_threads,
+               unsigned int max_queued = DEFAULT_MAX_QUEUED);
+
+  virtual ~SASRxLogPool();
+
+  /// Queues a received message to be logged.  The pool takes ownership of
+  /// the log.
+  ///
+  /// @returns false if too many messages are already waiting, in which case
+  ///          the log is dropped.
+  bool queue_log(SASRxLog* rx_log);
+
+  /// Returns the number of logs dropped because too many were waiting.
+  uint64_t dropped() const { return _dropped.load(); }
+
+  static const unsigned int DEFAULT_MAX_QUEUED = 10000;
+
+protected:
+  /// Logs a received message to SAS.
+  virtual void log(SASRxLog* rx_log);
+
+private:
+  /// Called by worker threads when they pull work off the queue.
+  virtual void process_work(SASRxLog*& rx_log);
+
+  static void exception_callback(SASRxLog* rx_log)
+  {
+    delete rx_log;
+  }
+
+  const unsigned int _max_queued;
+
+  /// The number of logs queued that no thread has started on yet.
+  std::atomic<unsigned int> _queued;
+
+  std::atomic<uint64_t> _dropped;
+};
+
+#endif
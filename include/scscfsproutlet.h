@@ -175,9 +175,6 @@ private:
   /// @param ringing_us Time spent until a 180 Ringing, in microseconds.
   void track_session_setup_time(uint64_t tsx_start_time_usec, bool video_call);
 
-  /// Translate RequestURI using ENUM service if appropriate.
-  void translate_request_uri(pjsip_msg* req, pj_pool_t* pool, SAS::TrailId trail);
-
   /// Get an ACR instance from the factory.
   /// @param trail                SAS trail identifier to use for the ACR.
   /// @param initiator            The initiator of the SIP transaction (calling
@@ -265,6 +262,7 @@ public:
   virtual void on_tx_response(pjsip_msg* rsp) override;
   virtual void on_rx_cancel(int status_code, pjsip_msg* req) override;
   virtual void on_timer_expiry(void* context) override;
+  virtual void on_async_complete(void* context) override;
 
 private:
   /// Examines the top route header to determine the relevant AS chain
@@ -291,6 +289,10 @@ private:
   /// Apply originating services for this request.
   void apply_originating_services(pjsip_msg* req);
 
+  /// Route a request at the end of originating processing, once its
+  /// RequestURI has been translated using ENUM.
+  void route_translated_request(pjsip_msg* req);
+
   /// Apply terminating services for this request.
   void apply_terminating_services(pjsip_msg* req);
 
@@ -501,6 +503,11 @@ private:
   /// HSS. This field should not be changed once it has been set by the
   /// on_rx_intial_request() call.
   std::string _scscf_uri;
+
+  /// The request being routed while ENUM is queried at the end of originating
+  /// processing, and the result of the query.
+  pjsip_msg* _pending_req;
+  std::string _enum_uri;
 };
 
 #endif
@@ -0,0 +1,60 @@
+/**
+ * @file sdm_fanout.h  Functions for accessing the remote subscriber data
+ *                     managers in parallel.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SDM_FANOUT_H__
+#define SDM_FANOUT_H__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "sas.h"
+#include "exception_handler.h"
+#include "subscriber_data_manager.h"
+
+/// In a geo-redundant deployment, Sprout reads from (and writes to) the
+/// subscriber data managers for the remote sites one after another.  These
+/// functions allow those accesses to be made in parallel on a pool of
+/// threads, so that an operation costs the latency of the slowest (or, for a
+/// read, the fastest successful) remote site rather than the sum of all of
+/// them.
+///
+/// Until init is called with a non-zero number of threads, the remote SDMs
+/// are accessed sequentially, as they always have been.
+namespace SDMFanout
+{
+  /// Starts the thread pool used to access the remote SDMs in parallel.
+  ///
+  /// @param exception_handler - Exception handler for the pool threads.
+  /// @param num_threads       - The number of threads, or zero to access the
+  ///                            remote SDMs sequentially.
+  void init(ExceptionHandler* exception_handler, int num_threads);
+
+  /// Stops the thread pool.
+  void term();
+
+  /// Reads the data for an AoR from the remote SDMs.
+  ///
+  /// @returns the first AoR data found that contains bindings (which the
+  ///          caller must delete).  If no remote SDM has bindings for the AoR,
+  ///          returns the data from one of the remote SDMs (which may be empty
+  ///          or NULL).
+  AoRPair* get_aor_data(const std::vector<SubscriberDataManager*>& sdms,
+                        const std::string& aor_id,
+                        SAS::TrailId trail);
+
+  /// Calls fn for each remote SDM, and waits for all the calls to complete.
+  void for_each(const std::vector<SubscriberDataManager*>& sdms,
+                const std::function<void(SubscriberDataManager*)>& fn);
+}
+
+#endif
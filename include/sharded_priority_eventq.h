@@ -0,0 +1,199 @@
+/**
+ * @file sharded_priority_eventq.h  Template definition for a set of priority
+ *                                  event queues serviced by a shared pool of
+ *                                  threads.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SHARDED_PRIORITY_EVENTQ_H__
+#define SHARDED_PRIORITY_EVENTQ_H__
+
+#include <pthread.h>
+
+#include <atomic>
+#include <vector>
+
+#include "priority_eventq.h"
+
+/// A set of priority event queues (shards).  Each consumer has a home shard,
+/// which it services first, and steals from the other shards when its home
+/// shard is empty.  Pushing and popping only lock the shard concerned.  Idle
+/// consumers wait on a single condition variable that is signalled whenever
+/// an item is pushed to any shard, so a backed up shard is drained by idle
+/// consumers immediately rather than whenever they next poll.
+template<class T>
+class sharded_priority_eventq
+{
+public:
+  /// Constructor.
+  ///
+  /// @param num_shards         - The number of shards.
+  /// @param num_classes        - The number of priority classes in each shard.
+  /// @param deadlock_threshold - Time (in milliseconds) after which a shard
+  ///                             is deemed deadlocked if it hasn't been
+  ///                             serviced, or zero to disable detection.
+  sharded_priority_eventq(unsigned int num_shards,
+                          unsigned int num_classes,
+                          unsigned int deadlock_threshold = 0) :
+    _shards(),
+    _size(0),
+    _waiters(0),
+    _terminated(false)
+  {
+    for (unsigned int ii = 0; ii < num_shards; ++ii)
+    {
+      _shards.push_back(new priority_eventq<T>(num_classes,
+                                               deadlock_threshold));
+    }
+
+    pthread_mutex_init(&_m, NULL);
+    pthread_cond_init(&_cond, NULL);
+  }
+
+  ~sharded_priority_eventq()
+  {
+    for (typename std::vector<priority_eventq<T>*>::iterator shard =
+                                                             _shards.begin();
+         shard != _shards.end();
+         ++shard)
+    {
+      delete *shard;
+    }
+
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_m);
+  }
+
+  /// Returns the number of shards.
+  size_t num_shards() const
+  {
+    return _shards.size();
+  }
+
+  /// Terminates the queue, waking up any threads blocked in pop().
+  void terminate()
+  {
+    for (typename std::vector<priority_eventq<T>*>::iterator shard =
+                                                             _shards.begin();
+         shard != _shards.end();
+         ++shard)
+    {
+      (*shard)->terminate();
+    }
+
+    pthread_mutex_lock(&_m);
+    _terminated = true;
+    pthread_cond_broadcast(&_cond);
+    pthread_mutex_unlock(&_m);
+  }
+
+  /// Checks whether any of the shards has been non-empty and unserviced for
+  /// longer than the deadlock threshold.
+  bool is_deadlocked()
+  {
+    for (typename std::vector<priority_eventq<T>*>::iterator shard =
+                                                             _shards.begin();
+         shard != _shards.end();
+         ++shard)
+    {
+      if ((*shard)->is_deadlocked())
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /// Pushes an item onto the specified shard in the specified priority class.
+  ///
+  /// @returns false if the queue has been terminated.
+  bool push(size_t shard, const T& item, unsigned int priority)
+  {
+    bool pushed = _shards[shard]->push(item, priority);
+
+    if (pushed)
+    {
+      // Count the item before checking for waiters.  A consumer registers as
+      // a waiter before checking the count, so either it sees this item or
+      // we see it waiting and wake it.  The shared lock is only taken if
+      // there is a consumer waiting.
+      ++_size;
+
+      if (_waiters > 0)
+      {
+        pthread_mutex_lock(&_m);
+        pthread_cond_signal(&_cond);
+        pthread_mutex_unlock(&_m);
+      }
+    }
+
+    return pushed;
+  }
+
+  /// Pops the highest priority item from the specified home shard or, if it
+  /// is empty, from the first of the other shards that isn't, waiting
+  /// indefinitely for an item to be available.
+  ///
+  /// @returns false if the queue was terminated.
+  bool pop(size_t home_shard, T& item)
+  {
+    while (true)
+    {
+      for (size_t ii = 0; ii < _shards.size(); ++ii)
+      {
+        if (_shards[(home_shard + ii) % _shards.size()]->pop(item, 0))
+        {
+          --_size;
+          return true;
+        }
+      }
+
+      pthread_mutex_lock(&_m);
+      ++_waiters;
+
+      while ((_size <= 0) && (!_terminated))
+      {
+        pthread_cond_wait(&_cond, &_m);
+      }
+
+      --_waiters;
+      bool terminated = _terminated;
+      pthread_mutex_unlock(&_m);
+
+      if (terminated)
+      {
+        return false;
+      }
+    }
+  }
+
+  /// Returns the total number of items queued across all the shards.
+  unsigned int size() const
+  {
+    // The count can briefly go negative if an item is popped before its
+    // pusher has counted it.
+    int size = _size;
+    return (size > 0) ? size : 0;
+  }
+
+private:
+  std::vector<priority_eventq<T>*> _shards;
+
+  // The number of items queued across all the shards, and the number of
+  // consumers waiting for one.
+  std::atomic<int> _size;
+  std::atomic<int> _waiters;
+  bool _terminated;
+
+  pthread_mutex_t _m;
+  pthread_cond_t _cond;
+};
+
+#endif
@@ -13,8 +13,8 @@
 #define SIFCSERVICE_H__
 
 #include <map>
+#include <memory>
 #include <string>
-#include <boost/thread.hpp>
 #include "rapidxml/rapidxml.hpp"
 #include <functional>
 
@@ -43,20 +43,29 @@ public:
   /// Get the iFCs that belong to a set of IDs
   virtual void get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
                                 const std::set<int32_t>& id,
-                                std::shared_ptr<xml_document<> > ifc_doc,
                                 SAS::TrailId trail) const;
 
 private:
+  /// An immutable version of the shared iFC configuration.  The iFCs are
+  /// parsed and compiled when the configuration is loaded, and refer into the
+  /// document, which they keep alive.  This means that iFCs handed out from an
+  /// old version stay valid after the configuration is reloaded.
+  struct Sets
+  {
+    std::shared_ptr<rapidxml::xml_document<> > doc;
+    std::map<int32_t, std::vector<std::pair<int32_t, Ifc>>> sets;
+  };
+
   Alarm* _alarm;
   SNMP::CounterTable* _no_shared_ifcs_set_tbl;
-  std::map<int32_t, std::vector<std::pair<int32_t, std::string>>> _shared_ifc_sets;
+
+  // The current shared iFC sets.  This is only ever accessed using the atomic
+  // shared_ptr functions - a reload builds a complete new version and swaps it
+  // in, so readers never take a lock.
+  std::shared_ptr<const Sets> _shared_ifc_sets;
   std::string _configuration;
   Updater<void, SIFCService>* _updater;
 
-  // Mark as mutable to flag that this can be modified without affecting the
-  // external behaviour of the class, allowing for locking in 'const' methods.
-  mutable boost::shared_mutex _sets_rw_lock;
-
   // Helper functions to set/clear the alarm.
   void set_alarm();
   void clear_alarm();
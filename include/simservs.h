@@ -75,9 +75,9 @@ public:
     bool _allow_call;
   };
 
-  bool oip_enabled();
-  bool oir_enabled();
-  bool oir_presentation_restricted();
+  bool oip_enabled() const;
+  bool oir_enabled() const;
+  bool oir_presentation_restricted() const;
   bool cdiv_enabled() const;
   unsigned int cdiv_no_reply_timer() const;
   const std::vector<CDIVRule>* cdiv_rules() const;
@@ -0,0 +1,115 @@
+/**
+ * @file simservs_cache.h  Cache of subscribers' simservs documents for the
+ *                         MMTEL AS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SIMSERVS_CACHE_H__
+#define SIMSERVS_CACHE_H__
+
+#include <pthread.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "simservs.h"
+#include "snmp_counter_table.h"
+
+/// @class SimservsCache
+///
+/// Caches the parsed simservs document for a public identity, along with the
+/// entity tag the XDMS returned with it, so that the MMTEL AS doesn't need a
+/// round-trip to the XDMS on every call.
+///
+/// Entries are used without checking with the XDMS until their TTL has
+/// passed.  After that, the entry is kept so that the caller can revalidate
+/// it with a conditional request (If-None-Match) - if the document hasn't
+/// changed, the XDMS doesn't need to send it and it doesn't need re-parsing.
+///
+/// The cache is split into shards, each with its own lock and each evicting
+/// its least recently used entries when it is full.
+class SimservsCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param ttl_s             - The time (in seconds) for which entries are
+  ///                            used without revalidation.
+  /// @param max_entries       - The maximum number of entries in the cache.
+  /// @param hits_tbl          - Counter of cache hits (may be NULL).
+  /// @param misses_tbl        - Counter of cache misses (may be NULL).
+  /// @param revalidations_tbl - Counter of expired entries that the XDMS
+  ///                            confirmed were still valid (may be NULL).
+  SimservsCache(int ttl_s,
+                int max_entries,
+                SNMP::CounterTable* hits_tbl,
+                SNMP::CounterTable* misses_tbl,
+                SNMP::CounterTable* revalidations_tbl);
+  virtual ~SimservsCache();
+
+  /// Gets the cached simservs for a public identity.
+  ///
+  /// @param public_id - The public identity.
+  /// @param services  - Set to the cached simservs, if there is an entry
+  ///                    (even an expired one).
+  /// @param etag      - Set to the entity tag of the cached simservs, if there
+  ///                    is an entry (even an expired one).
+  ///
+  /// @returns true if there is an unexpired entry, which can be used without
+  ///          checking with the XDMS.
+  bool get(const std::string& public_id,
+           std::shared_ptr<const simservs>& services,
+           std::string& etag);
+
+  /// Caches the simservs for a public identity, replacing any existing entry.
+  void put(const std::string& public_id,
+           const std::shared_ptr<const simservs>& services,
+           const std::string& etag);
+
+  /// Restarts the TTL of the entry for a public identity, after the XDMS has
+  /// confirmed that it is still valid.
+  void revalidated(const std::string& public_id);
+
+  /// Removes the entry for a public identity.
+  void invalidate(const std::string& public_id);
+
+private:
+  struct Entry
+  {
+    std::string public_id;
+    std::shared_ptr<const simservs> services;
+    std::string etag;
+    unsigned long expiry_ms;
+  };
+
+  struct Shard
+  {
+    pthread_mutex_t lock;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+  };
+
+  Shard& get_shard(const std::string& public_id);
+
+  static unsigned long now_ms();
+
+  static const int NUM_SHARDS = 16;
+
+  unsigned long _ttl_ms;
+  size_t _max_entries_per_shard;
+  std::vector<Shard*> _shards;
+  SNMP::CounterTable* _hits_tbl;
+  SNMP::CounterTable* _misses_tbl;
+  SNMP::CounterTable* _revalidations_tbl;
+};
+
+#endif
@@ -19,6 +19,7 @@ extern "C" {
 #include <stdint.h>
 }
 
+#include <functional>
 #include <list>
 #include "baseresolver.h"
 #include "snmp_success_fail_count_by_request_type_table.h"
@@ -241,6 +242,20 @@ public:
   ///
   virtual bool timer_running(TimerID id) = 0;
 
+  /// Runs an operation that may block, such as a request to Homestead, without
+  /// holding up the worker thread.  The operation runs on a separate thread,
+  /// so must not access the transaction or its messages.  When it completes,
+  /// the on_async_complete callback is called with the context parameter.
+  /// The transaction is kept alive until then.
+  ///
+  /// If asynchronous operations are disabled, the operation runs immediately
+  /// and on_async_complete is called before this method returns.
+  ///
+  /// @param  op           - The operation to run.
+  /// @param  context      - Context parameter returned on the callback.
+  ///
+  virtual void run_async(const std::function<void()>& op, void* context) = 0;
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
@@ -368,6 +383,12 @@ public:
   ///                        was scheduled.
   virtual void on_timer_expiry(void* context) {}
 
+  /// Called when an operation started with run_async completes.
+  ///
+  /// @param  context      - The context parameter specified when the
+  ///                        operation was started.
+  virtual void on_async_complete(void* context) {}
+
 protected:
 
   /// Returns a mutable clone of the original request.  This can be modified
@@ -578,6 +599,16 @@ protected:
   bool timer_running(TimerID id)
     {return _helper->timer_running(id);}
 
+  /// Runs an operation that may block without holding up the worker thread.
+  /// The on_async_complete callback will be called with the context parameter
+  /// when the operation completes.
+  ///
+  /// @param  op           - The operation to run.
+  /// @param  context      - Context parameter returned on the callback.
+  ///
+  void run_async(const std::function<void()>& op, void* context)
+    {_helper->run_async(op, context);}
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
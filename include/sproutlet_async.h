@@ -0,0 +1,61 @@
+/**
+ * @file sproutlet_async.h  Thread pool for operations that sproutlets run
+ *                          asynchronously.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SPROUTLET_ASYNC_H__
+#define SPROUTLET_ASYNC_H__
+
+#include <functional>
+
+#include "exception_handler.h"
+#include "pjutils.h"
+
+/// Sproutlets make blocking requests (to Homestead, the XDMS, the stores and
+/// so on) from worker threads, so a worker thread is tied up for the whole
+/// round-trip of each request.  These functions allow a sproutlet to run such
+/// a request on a separate pool of threads instead, leaving the worker thread
+/// free to process other messages.  When the operation completes, the
+/// sproutlet is resumed on a worker thread (see SproutletTsxHelper::run_async).
+///
+/// Until init is called with a non-zero number of threads, operations are run
+/// synchronously, as they always have been.
+namespace SproutletAsync
+{
+  /// Function used to pass a callback to a worker thread to run.
+  typedef void (*DispatchFn)(PJUtils::Callback* callback);
+
+  /// Starts the thread pool used to run asynchronous operations.
+  ///
+  /// @param exception_handler - Exception handler for the pool threads.
+  /// @param num_threads       - The number of threads, or zero to run
+  ///                            operations synchronously.
+  /// @param dispatch          - Function used to run the callback that
+  ///                            resumes a sproutlet on a worker thread.
+  void init(ExceptionHandler* exception_handler,
+            int num_threads,
+            DispatchFn dispatch);
+
+  /// Stops the thread pool.
+  void term();
+
+  /// @returns true if there is a thread pool to run operations on.
+  bool enabled();
+
+  /// Runs an operation on the thread pool.  When the operation has completed
+  /// (or if the thread running it hit an exception), the resume callback is
+  /// passed to the dispatch function, which takes ownership of it.
+  ///
+  /// @returns false if there is no thread pool, in which case nothing is run
+  ///          and the caller still owns the resume callback.
+  bool run(const std::function<void()>& op, PJUtils::Callback* resume);
+}
+
+#endif
@@ -12,12 +12,14 @@
 #ifndef SPROUTLETPROXY_H__
 #define SPROUTLETPROXY_H__
 
+#include <string.h>
 #include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <list>
 
 #include "basicproxy.h"
+#include "pjutils.h"
 #include "sproutlet.h"
 #include "snmp_sip_request_types.h"
 #include "sproutlet_options.h"
@@ -176,6 +178,33 @@ protected:
     bool cancel_timer(TimerID id);
     bool timer_running(TimerID id);
 
+    /// Callback that resumes a sproutlet on a worker thread when an
+    /// asynchronous operation it started has completed.
+    class AsyncCallback : public PJUtils::Callback
+    {
+    public:
+      AsyncCallback(UASTsx* uas_tsx, SproutletWrapper* tsx, void* context) :
+        _uas_tsx(uas_tsx),
+        _tsx(tsx),
+        _context(context)
+      {}
+
+      void run()
+      {
+        _uas_tsx->process_async_complete(_tsx, _context);
+      }
+
+    private:
+      UASTsx* _uas_tsx;
+      SproutletWrapper* _tsx;
+      void* _context;
+    };
+
+    void process_async_complete(SproutletWrapper* tsx, void* context);
+    bool run_async(SproutletWrapper* tsx,
+                   const std::function<void()>& op,
+                   void* context);
+
     void tx_response(SproutletWrapper* sproutlet,
                      pjsip_tx_data* rsp);
 
@@ -238,9 +267,60 @@ protected:
     /// The UASTsx will persist while there are pending timers.
     std::set<pj_timer_entry*> _pending_timers;
 
+    /// The number of asynchronous operations started by sproutlet tsxs that
+    /// are children of this UASTsx that have not completed yet.  The UASTsx
+    /// will persist while there are pending operations.
+    int _pending_async_ops;
+
     friend class SproutletWrapper;
   };
 
+  /// A key in the routing indexes.  This refers to a string owned elsewhere,
+  /// so that the indexes can be searched with a pj_str_t from a message
+  /// without copying it.
+  struct RouteKey
+  {
+    RouteKey(const char* p, size_t len) : ptr(p), slen(len) {}
+    RouteKey(const pj_str_t* str) : ptr(str->ptr), slen(str->slen) {}
+    RouteKey(const std::string& str) : ptr(str.data()), slen(str.length()) {}
+
+    const char* ptr;
+    size_t slen;
+  };
+
+  /// Hashes and compares route keys.  Hostnames are compared ignoring case,
+  /// but service names are case-sensitive.
+  template<bool IGNORE_CASE>
+  struct RouteKeyHash
+  {
+    size_t operator()(const RouteKey& key) const
+    {
+      // FNV-1a, folding the case of each character if required.
+      size_t h = 2166136261u;
+      for (size_t ii = 0; ii < key.slen; ++ii)
+      {
+        unsigned char c = (unsigned char)key.ptr[ii];
+        h = (h ^ (IGNORE_CASE ? pj_tolower(c) : c)) * 16777619u;
+      }
+      return h;
+    }
+  };
+
+  template<bool IGNORE_CASE>
+  struct RouteKeyEqual
+  {
+    bool operator()(const RouteKey& lhs, const RouteKey& rhs) const
+    {
+      return ((lhs.slen == rhs.slen) &&
+              ((IGNORE_CASE ?
+                  pj_ansi_strnicmp(lhs.ptr, rhs.ptr, lhs.slen) :
+                  memcmp(lhs.ptr, rhs.ptr, lhs.slen)) == 0));
+    }
+  };
+
+  /// Looks up the sproutlet for a service name or alias.
+  Sproutlet* find_service(const RouteKey& name) const;
+
   pjsip_sip_uri* _root_uri;
   std::map<std::string, pjsip_sip_uri*> _root_uris;
 
@@ -248,7 +328,13 @@ protected:
 
   std::map<std::string, Sproutlet*> _services;
 
-  std::map<int, Sproutlet*> _ports;
+  std::unordered_map<int, Sproutlet*> _ports;
+
+  /// Routing indexes, built as sproutlets are registered at start of day and
+  /// read without locking after that.  The keys refer to the hostname of
+  /// _root_uri, and the strings in _host_aliases and _services.
+  std::unordered_set<RouteKey, RouteKeyHash<true>, RouteKeyEqual<true> > _local_hosts;
+  std::unordered_map<RouteKey, Sproutlet*, RouteKeyHash<false>, RouteKeyEqual<false> > _service_index;
 
   std::list<Sproutlet*> _sproutlets;
 
@@ -302,6 +388,7 @@ public:
   bool schedule_timer(void* context, TimerID& id, int duration);
   void cancel_timer(TimerID id);
   bool timer_running(TimerID id);
+  void run_async(const std::function<void()>& op, void* context);
   SAS::TrailId trail() const;
   bool is_uri_reflexive(const pjsip_uri*) const;
   pjsip_sip_uri* get_reflexive_uri(pj_pool_t*) const;
@@ -318,6 +405,7 @@ private:
   void rx_error(int status_code);
   void rx_fork_error(ForkErrorState fork_error, int fork_id);
   void on_timer_pop(TimerID id, void* context);
+  void on_async_complete(void* context);
   void register_tdata(pjsip_tx_data* tdata);
   void deregister_tdata(pjsip_tx_data* tdata);
 
@@ -394,6 +482,11 @@ private:
   /// until all these timers have popped or been cancelled.
   std::set<TimerID> _pending_timers;
 
+  /// The number of asynchronous operations started by this SproutletWrapper
+  /// that have not completed yet.  As with timers, the SproutletWrapper
+  /// won't be deleted until they have all completed.
+  int _pending_async_ops;
+
   SAS::TrailId _trail_id;
 
   friend class SproutletProxy::UASTsx;
@@ -18,6 +18,7 @@ extern "C" {
 }
 
 #include <string>
+#include <vector>
 #include <unordered_set>
 
 #include "sas.h"
@@ -36,7 +37,7 @@ struct stack_data_struct
   pj_caching_pool      cp;
   pj_pool_t           *pool;
   pjsip_endpoint      *endpt;
-  pj_thread_t         *pjsip_transport_thread;
+  std::vector<pj_thread_t*> pjsip_transport_threads;
   int                  pcscf_untrusted_port;
   pjsip_tpfactory     *pcscf_untrusted_tcp_factory;
   int                  pcscf_trusted_port;
@@ -82,14 +83,32 @@ inline bool is_pjsip_transport_thread()
   // This check doesn't make sense in UT, where we use a different threading model
   return true;
 #else
-  return (pj_thread_this() == stack_data.pjsip_transport_thread);
+  // There are only ever a handful of transport threads, so a linear search
+  // is fine.
+  pj_thread_t* this_thread = pj_thread_this();
+  for (std::vector<pj_thread_t*>::const_iterator ii =
+                                   stack_data.pjsip_transport_threads.begin();
+       ii != stack_data.pjsip_transport_threads.end();
+       ++ii)
+  {
+    if (*ii == this_thread)
+    {
+      return true;
+    }
+  }
+  return false;
 #endif
 }
 
+// Note that passing this check does not mean that the caller has the stack to
+// itself - there may be several PJSIP transport threads, and any of them can
+// run transaction callbacks, timers and transport callbacks.  Callers that
+// need to be serialized must use the appropriate lock (typically the
+// transaction group lock).
 #define CHECK_PJ_TRANSPORT_THREAD() \
   if (!is_pjsip_transport_thread()) \
   { \
-    TRC_ERROR("Function expected to be called on PJSIP transport thread (%s) has been called on different thread (%s)", pj_thread_get_name(stack_data.pjsip_transport_thread), pj_thread_get_name(pj_thread_this())); \
+    TRC_ERROR("Function expected to be called on a PJSIP transport thread has been called on different thread (%s)", pj_thread_get_name(pj_thread_this())); \
   };
 
 inline void set_trail(pjsip_rx_data* rdata, SAS::TrailId trail)
@@ -102,9 +121,13 @@ inline void set_trail(pjsip_tx_data* tdata, SAS::TrailId trail)
   tdata->mod_data[stack_data.sas_logging_module_id] = (void*)trail;
 }
 
+extern void record_tsx_trail(pjsip_transaction* tsx, SAS::TrailId trail);
+extern SAS::TrailId find_tsx_trail(const pj_str_t* key);
+
 inline void set_trail(pjsip_transaction* tsx, SAS::TrailId trail)
 {
   tsx->mod_data[stack_data.sas_logging_module_id] = (void*)trail;
+  record_tsx_trail(tsx, trail);
 }
 
 inline SAS::TrailId get_trail(const pjsip_rx_data* rdata)
@@ -153,8 +176,8 @@ extern pj_status_t init_stack(const std::string& sas_system_name,
                               QuiescingManager *quiescing_mgr,
                               const std::string& cdf_domain,
                               std::vector<std::string> sproutlet_uris);
-extern pj_status_t start_pjsip_thread();
-extern pj_status_t stop_pjsip_thread();
+extern pj_status_t start_pjsip_threads(int num_pjsip_threads);
+extern pj_status_t stop_pjsip_threads();
 extern void stop_stack();
 extern void destroy_stack();
 extern pj_status_t init_pjsip();
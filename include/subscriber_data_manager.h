@@ -21,6 +21,7 @@
 
 #include "astaire_aor_store.h"
 #include "chronosconnection.h"
+#include "chronos_timer_queue.h"
 #include "sas.h"
 #include "analyticslogger.h"
 #include "associated_uris.h"
@@ -41,10 +42,13 @@ public:
   /// registration/subscription expiry
   ///
   /// @param chronos_conn    The underlying chronos connection
+  /// @param timer_queue     If not NULL, updates to and deletions of existing
+  ///                        timers are queued here rather than sent inline
   class ChronosTimerRequestSender
   {
   public:
-    ChronosTimerRequestSender(ChronosConnection* chronos_conn);
+    ChronosTimerRequestSender(ChronosConnection* chronos_conn,
+                              ChronosTimerQueue* timer_queue = NULL);
 
     virtual ~ChronosTimerRequestSender();
 
@@ -65,6 +69,7 @@ public:
 
   private:
     ChronosConnection* _chronos_conn;
+    ChronosTimerQueue* _timer_queue;
 
     /// Build the tag info map from an AoR
     virtual void build_tag_info(AoR* aor,
@@ -146,10 +151,13 @@ public:
   /// @param analytics_logger   - AnalyticsLogger for reporting registration events.
   /// @param is_primary         - Whether the underlying data store is the local
   ///                             store or remote
+  /// @param timer_queue        - If not NULL, queue used to send updates to
+  ///                             existing Chronos timers asynchronously.
   SubscriberDataManager(AoRStore* aor_store,
                         ChronosConnection* chronos_connection,
                         AnalyticsLogger* analytics_logger,
-                        bool is_primary);
+                        bool is_primary,
+                        ChronosTimerQueue* timer_queue = NULL);
 
   /// Destructor.
   virtual ~SubscriberDataManager();
@@ -183,6 +191,13 @@ public:
                                      bool& all_bindings_expired = unused_bool);
 
 private:
+  // Check whether an AoR has any out of date bindings or subscriptions, that
+  // expire_aor_members would remove
+  //
+  // @param aor_data  The AoR to check
+  // @param now       The current time
+  static bool has_expired_members(const AoR* aor_data, int now);
+
   // Expire any out of date bindings in the current AoR
   //
   // @param aor_pair  The AoRPair to expire
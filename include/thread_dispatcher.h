@@ -20,11 +20,22 @@ extern "C" {
 #include "load_monitor.h"
 #include "snmp_event_accumulator_table.h"
 #include "snmp_event_accumulator_by_scope_table.h"
+#include "snmp_counter_by_scope_table.h"
 #include "exception_handler.h"
 
+// Initialize the thread dispatcher.  If num_worker_queues_arg is greater than
+// one, received messages are sharded across that many queues by Call-ID, with
+// each worker thread servicing one queue (and stealing from the others when
+// its own queue is idle).  If max_queue_depth_arg is non-zero, requests that
+// would start a new session are rejected with a 503 once that many events are
+// queued (responses and in-dialog requests are always queued, and are
+// serviced ahead of new sessions).
 pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
+                                   int num_worker_queues_arg,
+                                   int max_queue_depth_arg,
                                    SNMP::EventAccumulatorByScopeTable* latency_tbl_arg,
                                    SNMP::EventAccumulatorByScopeTable* queue_size_tbl_arg,
+                                   SNMP::CounterByScopeTable* overload_counter_arg,
                                    LoadMonitor* load_monitor_arg,
                                    ExceptionHandler* exception_handler_arg);
 
@@ -34,7 +45,19 @@ pj_status_t start_worker_threads();
 pj_status_t stop_worker_threads();
 
 // Add a Callback object to the queue, to be run on a worker thread.
-// This MUST be called from the main PJSIP transport thread.
+// This MUST be called from a PJSIP transport thread.
 void add_callback_to_queue(PJUtils::Callback*);
 
+// Received messages are handed off to the worker threads with the parsed
+// message held in a tx_data.  If the specified rx_data was handed off in this
+// way, this returns that tx_data (with a reference held for the caller) so
+// the caller can use it as its own copy of the message rather than cloning
+// the rx_data.  Otherwise returns NULL.
+//
+// A message can only be adopted once.  The rx_data and the tx_data share the
+// parsed message, so once the caller has modified the message it must only
+// use the rx_data for the headers the rx_data has shortcuts to (Via, From, To,
+// Call-ID, CSeq and so on), which it must not modify.
+pjsip_tx_data* adopt_rx_msg(pjsip_rx_data* rdata);
+
 #endif
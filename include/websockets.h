@@ -18,7 +18,8 @@
 #include <websocketpp/websocketpp.hpp>
 
 extern pjsip_module mod_ws_transport;
-extern pj_status_t init_websockets(unsigned short port);
+extern pj_status_t init_websockets(unsigned short port,
+                                   unsigned int num_threads = 1);
 extern void  destroy_websockets();
 
 #endif
@@ -36,7 +36,29 @@ public:
 
   bool get_simservs(const std::string& user, std::string& xml_data, const std::string& password, SAS::TrailId trail);
 
+  /// The status returned by a conditional GET when the document hasn't
+  /// changed.
+  static const HTTPCode NOT_MODIFIED = 304;
+
+  /// Gets the simservs document for a user, unless it matches the supplied
+  /// entity tag.
+  ///
+  /// @param user     - The user.
+  /// @param xml_data - Set to the document, if it is returned.
+  /// @param etag     - On entry, the entity tag of the copy of the document
+  ///                   the caller already has (or empty if it doesn't have
+  ///                   one).  Set to the entity tag of the returned document.
+  ///
+  /// @returns HTTP_OK if the document was returned, NOT_MODIFIED if the
+  ///          caller's copy is still valid, or an error.
+  virtual HTTPCode get_simservs(const std::string& user,
+                                std::string& xml_data,
+                                std::string& etag,
+                                SAS::TrailId trail);
+
 private:
+  std::string simservs_url(const std::string& user);
+
   HttpConnection* _http;
   SNMP::EventAccumulatorTable* _latency_tbl;
 };
@@ -1473,7 +1473,7 @@ void RalfACR::store_charging_addresses(pjsip_msg* msg)
       (_record_type == EVENT_RECORD))
   {
     pjsip_p_c_f_a_hdr* p_cfa_hdr = (pjsip_p_c_f_a_hdr*)
-                             pjsip_msg_find_hdr_by_name(msg, &STR_P_C_F_A, NULL);
+                             pjsip_msg_find_parsed_hdr_by_name(msg, &STR_P_C_F_A);
     if (p_cfa_hdr != NULL)
     {
       // Clear out any existing entries.
@@ -1587,7 +1587,7 @@ void RalfACR::store_associated_uris(pjsip_msg* msg)
 void RalfACR::store_charging_info(pjsip_msg* msg)
 {
   pjsip_p_c_v_hdr* pcv_hdr = (pjsip_p_c_v_hdr*)
-                             pjsip_msg_find_hdr_by_name(msg, &STR_P_C_V, NULL);
+                             pjsip_msg_find_parsed_hdr_by_name(msg, &STR_P_C_V);
   if (pcv_hdr != NULL)
   {
     TRC_DEBUG("Found P-Charging-Vector header, store information");
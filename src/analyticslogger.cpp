@@ -13,6 +13,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <sched.h>
 #include <time.h>
 
 // Common STL includes.
@@ -25,24 +26,140 @@
 #include <string>
 
 #include "analyticslogger.h"
+#include "log.h"
 
-AnalyticsLogger::AnalyticsLogger()
+std::atomic<uint64_t> AnalyticsLogger::_next_id(1);
+
+AnalyticsLogger::AnalyticsLogger(int ring_size) :
+  _ring_size(ring_size),
+  _id(_next_id++),
+  _rings(),
+  _dropped(0),
+  _running(false),
+  _stopping(false),
+  _queue_writes(0),
+  _terminated(false)
 {
+  pthread_mutex_init(&_rings_lock, NULL);
+  pthread_mutex_init(&_lock, NULL);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  if (_ring_size > 0)
+  {
+    TRC_STATUS("Writing analytics logs in the background (%d per thread queued)",
+               _ring_size);
+    _running = true;
+    pthread_create(&_writer_thread,
+                   NULL,
+                   &AnalyticsLogger::writer_thread_function,
+                   (void*)this);
+  }
 }
 
 AnalyticsLogger::~AnalyticsLogger()
 {
+  stop();
+
+  // If another thread stopped the logger, it may not have finished waiting
+  // for queued writes yet, so check again before freeing the ring buffers.
+  while (_queue_writes.load() > 0)
+  {
+    sched_yield();
+  }
+
+  for (std::vector<Ring*>::iterator it = _rings.begin();
+       it != _rings.end();
+       ++it)
+  {
+    delete *it;
+  }
+  _rings.clear();
+
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
+  pthread_mutex_destroy(&_rings_lock);
+}
+
+void AnalyticsLogger::stop()
+{
+  if ((!_running.load()) || (_stopping.exchange(true)))
+  {
+    return;
+  }
+
+  // No new logs are queued now, but wait for any threads that are part way
+  // through queuing one.  A thread counts itself in before checking whether
+  // the logger is stopping, so either it has seen that we are stopping or we
+  // see it here.
+  while (_queue_writes.load() > 0)
+  {
+    sched_yield();
+  }
+
+  // The writer thread writes any queued logs before exiting.
+  pthread_mutex_lock(&_lock);
+  _terminated = true;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_lock);
+  pthread_join(_writer_thread, NULL);
+
+  _running = false;
 }
 
 void AnalyticsLogger::log_with_tag_and_timestamp(char* log)
 {
-  // Add the current UTC time, in RFC3339 format.
-  struct timespec timespec;
+  struct timespec timestamp;
+  clock_gettime(CLOCK_REALTIME, &timestamp);
+
+  if (_running.load())
+  {
+    ++_queue_writes;
+
+    if (!_stopping.load())
+    {
+      queue(timestamp, log);
+      --_queue_writes;
+      return;
+    }
+
+    --_queue_writes;
+  }
+
+  write(timestamp, log);
+}
+
+void AnalyticsLogger::queue(const struct timespec& timestamp, const char* log)
+{
+  // Copy the log into this thread's ring buffer for the writer thread, unless
+  // it is full.
+  Ring* ring = get_ring();
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint64_t head = ring->head.load(std::memory_order_acquire);
+
+  if (tail - head >= ring->records.size())
+  {
+    ++_dropped;
+    return;
+  }
+
+  Record& record = ring->records[tail % ring->records.size()];
+  record.timestamp = timestamp;
+  strncpy(record.log, log, sizeof(record.log) - 1);
+  record.log[sizeof(record.log) - 1] = '\0';
+  ring->tail.store(tail + 1, std::memory_order_release);
+}
+
+void AnalyticsLogger::write(const struct timespec& timestamp, const char* log)
+{
+  // Add the time, in UTC and RFC3339 format.
   struct tm dt;
-  clock_gettime(CLOCK_REALTIME, &timespec);
-  gmtime_r(&timespec.tv_sec, &dt);
-  char timestamp[100];
-  sprintf(timestamp,
+  gmtime_r(&timestamp.tv_sec, &dt);
+  char timestamp_str[100];
+  sprintf(timestamp_str,
           "%4.4d-%2.2d-%2.2dT%2.2d:%2.2d:%2.2d.%3.3d+00:00",
           (dt.tm_year + 1900),
           (dt.tm_mon + 1),
@@ -50,9 +167,110 @@ void AnalyticsLogger::log_with_tag_and_timestamp(char* log)
           dt.tm_hour,
           dt.tm_min,
           dt.tm_sec,
-          (int)(timespec.tv_nsec / 1000000));
+          (int)(timestamp.tv_nsec / 1000000));
+
+  syslog(LOG_INFO, "<analytics> %s %s", timestamp_str, log);
+}
+
+AnalyticsLogger::Ring* AnalyticsLogger::get_ring()
+{
+  // Each thread caches its ring buffer, along with the ID of the logger it
+  // belongs to.
+  static thread_local uint64_t cached_id = 0;
+  static thread_local Ring* cached_ring = NULL;
+
+  if (cached_id != _id)
+  {
+    cached_ring = new Ring(_ring_size);
+    cached_id = _id;
+
+    pthread_mutex_lock(&_rings_lock);
+    _rings.push_back(cached_ring);
+    pthread_mutex_unlock(&_rings_lock);
+  }
+
+  return cached_ring;
+}
+
+int AnalyticsLogger::drain()
+{
+  // Threads only add ring buffers, and they aren't deleted until the logger
+  // is, so it's safe to work on a copy of the list.
+  pthread_mutex_lock(&_rings_lock);
+  std::vector<Ring*> rings = _rings;
+  pthread_mutex_unlock(&_rings_lock);
+
+  int written = 0;
+
+  for (std::vector<Ring*>::iterator it = rings.begin();
+       it != rings.end();
+       ++it)
+  {
+    Ring* ring = *it;
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+    for (int ii = 0; (head != tail) && (ii < MAX_BATCH_SIZE); ++ii)
+    {
+      Record& record = ring->records[head % ring->records.size()];
+      write(record.timestamp, record.log);
+      ++head;
+      ring->head.store(head, std::memory_order_release);
+      ++written;
+    }
+  }
+
+  return written;
+}
+
+void* AnalyticsLogger::writer_thread_function(void* logger)
+{
+  ((AnalyticsLogger*)logger)->writer_thread_function();
+  return NULL;
+}
+
+void AnalyticsLogger::writer_thread_function()
+{
+  uint64_t reported_dropped = 0;
+
+  pthread_mutex_lock(&_lock);
+
+  while (!_terminated)
+  {
+    pthread_mutex_unlock(&_lock);
+    int written = drain();
+
+    uint64_t dropped = _dropped.load();
+    if (dropped != reported_dropped)
+    {
+      TRC_WARNING("Analytics logs generated faster than they can be written - dropped %lu",
+                  dropped - reported_dropped);
+      reported_dropped = dropped;
+    }
+
+    pthread_mutex_lock(&_lock);
+
+    if ((written == 0) && (!_terminated))
+    {
+      // Nothing to write, so wait a while before checking again.  Threads
+      // don't signal when they queue a log, as that would mean taking a lock.
+      struct timespec wake;
+      clock_gettime(CLOCK_MONOTONIC, &wake);
+      wake.tv_nsec += POLL_INTERVAL_MS * 1000000;
+      if (wake.tv_nsec >= 1000000000)
+      {
+        wake.tv_sec += 1;
+        wake.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&_cond, &_lock, &wake);
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
 
-  syslog(LOG_INFO, "<analytics> %s %s", timestamp, log);
+  while (drain() > 0)
+  {
+  }
 }
 
 void AnalyticsLogger::registration(const std::string& aor,
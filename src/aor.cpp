@@ -507,10 +507,10 @@ AoR::Bindings AoRPair::get_updated_bindings()
 
     // Find any binding match in the original AoR
     AoR::Bindings::const_iterator orig_aor_binding_match =
-      _orig_aor->bindings().find(b_id);
+      orig()->bindings().find(b_id);
 
     // If the binding is only in the current AoR, it has been created
-    if (orig_aor_binding_match == _orig_aor->bindings().end())
+    if (orig_aor_binding_match == orig()->bindings().end())
     {
       TRC_DEBUG("Binding %s has been created", current_aor_binding.first.c_str());
       updated_bindings.insert(std::make_pair(b_id, binding));
@@ -546,10 +546,10 @@ AoR::Subscriptions AoRPair::get_updated_subscriptions()
 
     // Find any subscriptions match in the original AoR
     AoR::Subscriptions::const_iterator orig_aor_subscription_match =
-      _orig_aor->subscriptions().find(s_id);
+      orig()->subscriptions().find(s_id);
 
     // If the subscription is only in the current AoR, it has been created
-    if (orig_aor_subscription_match == _orig_aor->subscriptions().end())
+    if (orig_aor_subscription_match == orig()->subscriptions().end())
     {
       TRC_DEBUG("Subscription %s has been created", current_aor_subscription.first.c_str());
       updated_subscriptions.insert(std::make_pair(s_id, subscription));
@@ -578,7 +578,7 @@ AoR::Bindings AoRPair::get_removed_bindings()
 
   // Iterate over original bindings and record those not in current AoR
   for (std::pair<std::string, AoR::Binding*> orig_aor_binding :
-         _orig_aor->bindings())
+         orig()->bindings())
   {
     if (_current_aor->bindings().find(orig_aor_binding.first) ==
         _current_aor->bindings().end())
@@ -599,7 +599,7 @@ AoR::Subscriptions AoRPair::get_removed_subscriptions()
 
   // Iterate over original subscriptions and record those not in current AoR
   for (std::pair<std::string, AoR::Subscription*> orig_aor_subscription :
-         _orig_aor->subscriptions())
+         orig()->subscriptions())
   {
     // Is this subscription present in the new AoR?
     if (_current_aor->subscriptions().find(orig_aor_subscription.first) ==
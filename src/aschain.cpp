@@ -10,6 +10,7 @@
  */
 
 #include <boost/lexical_cast.hpp>
+#include <random>
 
 #include "log.h"
 #include "pjutils.h"
@@ -49,7 +50,6 @@ AsChain::AsChain(AsChainTable* as_chain_table,
   _fallback_ifcs({}),
   _ifc_configuration(ifc_configuration),
   _using_standard_ifcs(true),
-  _root(NULL),
   _scscf_uri(scscf_uri)
 {
   TRC_DEBUG("Creating AsChain %p with %d iFCs and adding to map", this, ifcs.size());
@@ -67,8 +67,7 @@ AsChain::AsChain(AsChainTable* as_chain_table,
 
   if ((fifc_service) && (_ifc_configuration._apply_fallback_ifcs))
   {
-    _root = new rapidxml::xml_document<>;
-    _fallback_ifcs = fifc_service->get_fallback_ifcs(_root);
+    _fallback_ifcs = fifc_service->get_fallback_ifcs();
   }
 }
 
@@ -99,8 +98,6 @@ AsChain::~AsChain()
   }
 
   _as_chain_table->unregister(_odi_tokens);
-
-  delete _root; _root = NULL;
 }
 
 
@@ -349,15 +346,36 @@ void AsChainLink::on_response(int status_code)
 }
 
 
-AsChainTable::AsChainTable()
+AsChainTable::AsChainTable() :
+  _stripes(),
+  _next_stripe(0)
 {
-  pthread_mutex_init(&_lock, NULL);
+  for (int ii = 0; ii < NUM_STRIPES; ++ii)
+  {
+    Stripe* stripe = new Stripe();
+    pthread_mutex_init(&stripe->lock, NULL);
+    _stripes.push_back(stripe);
+  }
 }
 
 
 AsChainTable::~AsChainTable()
 {
-  pthread_mutex_destroy(&_lock);
+  for (std::vector<Stripe*>::iterator it = _stripes.begin();
+       it != _stripes.end();
+       ++it)
+  {
+    for (std::vector<Slot*>::iterator chunk = (*it)->chunks.begin();
+         chunk != (*it)->chunks.end();
+         ++chunk)
+    {
+      delete[] *chunk;
+    }
+
+    pthread_mutex_destroy(&(*it)->lock);
+    delete *it;
+  }
+  _stripes.clear();
 }
 
 
@@ -366,32 +384,181 @@ AsChainTable::~AsChainTable()
 void AsChainTable::register_(AsChain* as_chain, std::vector<std::string>& tokens)
 {
   size_t len = as_chain->size() + 1;
-  pthread_mutex_lock(&_lock);
+  uint32_t stripe_ix = _next_stripe++ % _stripes.size();
+  Stripe& stripe = *_stripes[stripe_ix];
+
+  pthread_mutex_lock(&stripe.lock);
 
   for (size_t i = 0; i < len; i++)
   {
-    std::string token;
-    Utils::create_random_token(TOKEN_LENGTH, token);
-    tokens.push_back(token);
-    _odi_token_map[token] = AsChainLink(as_chain, i);
+    if (stripe.free_slots.empty())
+    {
+      // Allocate another chunk of slots.
+      uint32_t first = stripe.chunks.size() * CHUNK_SIZE;
+
+      if (first >= MAX_SLOTS_PER_STRIPE)
+      {
+        // LCOV_EXCL_START - Can't fill the table in UT.
+        TRC_ERROR("Unable to allocate ODI token - AS chain table is full");
+        tokens.push_back("");
+        continue;
+        // LCOV_EXCL_STOP
+      }
+
+      Slot* chunk = new Slot[CHUNK_SIZE];
+      stripe.chunks.push_back(chunk);
+
+      for (uint32_t jj = CHUNK_SIZE; jj > 0; --jj)
+      {
+        chunk[jj - 1].nonce = 0;
+        chunk[jj - 1].as_chain = NULL;
+        chunk[jj - 1].index = 0;
+        stripe.free_slots.push_back(first + jj - 1);
+      }
+    }
+
+    uint32_t slot_ix = stripe.free_slots.back();
+    stripe.free_slots.pop_back();
+
+    Slot* slot = get_slot(stripe, slot_ix);
+    slot->nonce = random_nonce();
+    slot->as_chain = as_chain;
+    slot->index = i;
+
+    tokens.push_back(encode_token(stripe_ix, slot_ix, slot->nonce));
   }
 
-  pthread_mutex_unlock(&_lock);
+  pthread_mutex_unlock(&stripe.lock);
 }
 
 
 void AsChainTable::unregister(std::vector<std::string>& tokens)
 {
-  pthread_mutex_lock(&_lock);
-
   for (std::vector<std::string>::iterator it = tokens.begin();
        it != tokens.end();
        ++it)
   {
-    _odi_token_map.erase(*it);
+    uint32_t stripe_ix;
+    uint32_t slot_ix;
+    uint64_t nonce;
+
+    if (!decode_token(*it, stripe_ix, slot_ix, nonce))
+    {
+      // LCOV_EXCL_START - Only hit if the table was full.
+      continue;
+      // LCOV_EXCL_STOP
+    }
+
+    Stripe& stripe = *_stripes[stripe_ix];
+    pthread_mutex_lock(&stripe.lock);
+
+    Slot* slot = get_slot(stripe, slot_ix);
+    if ((slot != NULL) &&
+        (slot->as_chain != NULL) &&
+        (slot->nonce == nonce))
+    {
+      slot->as_chain = NULL;
+      slot->index = 0;
+      stripe.free_slots.push_back(slot_ix);
+    }
+
+    pthread_mutex_unlock(&stripe.lock);
+  }
+}
+
+
+std::string AsChainTable::encode_token(uint32_t stripe,
+                                       uint32_t slot,
+                                       uint64_t nonce)
+{
+  static const char HEX[] = "0123456789abcdef";
+  char buf[TOKEN_LENGTH];
+  int pos = TOKEN_LENGTH;
+
+  for (int ii = 0; ii < NONCE_DIGITS; ++ii)
+  {
+    buf[--pos] = HEX[nonce & 0xf];
+    nonce >>= 4;
+  }
+
+  for (int ii = 0; ii < SLOT_DIGITS; ++ii)
+  {
+    buf[--pos] = HEX[slot & 0xf];
+    slot >>= 4;
   }
 
-  pthread_mutex_unlock(&_lock);
+  for (int ii = 0; ii < STRIPE_DIGITS; ++ii)
+  {
+    buf[--pos] = HEX[stripe & 0xf];
+    stripe >>= 4;
+  }
+
+  return std::string(buf, TOKEN_LENGTH);
+}
+
+
+bool AsChainTable::decode_token(const std::string& token,
+                                uint32_t& stripe,
+                                uint32_t& slot,
+                                uint64_t& nonce)
+{
+  if (token.size() != (size_t)TOKEN_LENGTH)
+  {
+    return false;
+  }
+
+  uint64_t values[3] = {0, 0, 0};
+  const int digits[3] = {STRIPE_DIGITS, SLOT_DIGITS, NONCE_DIGITS};
+  size_t pos = 0;
+
+  for (int field = 0; field < 3; ++field)
+  {
+    for (int ii = 0; ii < digits[field]; ++ii)
+    {
+      char c = token[pos++];
+      uint64_t digit;
+
+      if ((c >= '0') && (c <= '9'))
+      {
+        digit = c - '0';
+      }
+      else if ((c >= 'a') && (c <= 'f'))
+      {
+        digit = c - 'a' + 10;
+      }
+      else
+      {
+        return false;
+      }
+
+      values[field] = (values[field] << 4) | digit;
+    }
+  }
+
+  if (values[0] >= (uint64_t)NUM_STRIPES)
+  {
+    return false;
+  }
+
+  stripe = values[0];
+  slot = values[1];
+  nonce = values[2];
+  return true;
+}
+
+
+uint64_t AsChainTable::random_nonce()
+{
+  static thread_local std::mt19937_64 generator(std::random_device{}());
+  return generator();
+}
+
+
+AsChainTable::Slot* AsChainTable::get_slot(Stripe& stripe, uint32_t slot)
+{
+  uint32_t chunk = slot / CHUNK_SIZE;
+  return (chunk < stripe.chunks.size()) ?
+         &stripe.chunks[chunk][slot % CHUNK_SIZE] : NULL;
 }
 
 
@@ -431,30 +598,42 @@ void AsChain::reset_chain(bool using_standard_ifcs)
 // is finished with the link.
 AsChainLink AsChainTable::lookup(const std::string& token)
 {
-  pthread_mutex_lock(&_lock);
-  std::map<std::string, AsChainLink>::const_iterator it =
-                                                    _odi_token_map.find(token);
-  if (it == _odi_token_map.end())
+  uint32_t stripe_ix;
+  uint32_t slot_ix;
+  uint64_t nonce;
+
+  if (!decode_token(token, stripe_ix, slot_ix, nonce))
+  {
+    return AsChainLink(NULL, 0);
+  }
+
+  Stripe& stripe = *_stripes[stripe_ix];
+  pthread_mutex_lock(&stripe.lock);
+
+  Slot* slot = get_slot(stripe, slot_ix);
+  if ((slot == NULL) ||
+      (slot->as_chain == NULL) ||
+      (slot->nonce != nonce))
   {
-    pthread_mutex_unlock(&_lock);
+    pthread_mutex_unlock(&stripe.lock);
     return AsChainLink(NULL, 0);
   }
   else
   {
     // Found the AsChainLink.  Add a reference to the AsChain.
-    const AsChainLink& as_chain_link = it->second;
+    AsChainLink as_chain_link(slot->as_chain, slot->index);
     if (as_chain_link._as_chain->inc_ref())
     {
       // Flag that the AS corresponding to the previous link in the chain has
       // effectively responded.
       as_chain_link._as_chain->_responsive[as_chain_link._index - 1] = true;
-      pthread_mutex_unlock(&_lock);
+      pthread_mutex_unlock(&stripe.lock);
       return as_chain_link;
     } else {
       // Failed to increment the count - AS chain must be in the process of
       // being destroyed.  Pretend we didn't find it.
       // LCOV_EXCL_START - Can't hit this window condition in UT.
-      pthread_mutex_unlock(&_lock);
+      pthread_mutex_unlock(&stripe.lock);
       return AsChainLink(NULL, 0);
       // LCOV_EXCL_STOP
     }
@@ -11,15 +11,30 @@
 
 
 // Common STL includes.
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
 #include "astaire_aor_store.h"
 #include "json_parse_utils.h"
 #include "rapidjson/error/en.h"
 #include "sproutsasevent.h"
 
 
-AstaireAoRStore::AstaireAoRStore(Store* store) : AoRStore()
+AstaireAoRStore::AstaireAoRStore(Store* store, Format format) : AoRStore()
 {
-  JsonSerializerDeserializer* serializer_deserializer = new JsonSerializerDeserializer();
+  SerializerDeserializer* serializer_deserializer;
+
+  if (format == Format::BINARY)
+  {
+    serializer_deserializer = new BinarySerializerDeserializer();
+  }
+  else
+  {
+    serializer_deserializer = new JsonSerializerDeserializer();
+  }
+
   _connector = new Connector(store, serializer_deserializer); // Takes ownership of serializer_deserializer
 }
 
@@ -53,9 +68,11 @@ Store::Status AstaireAoRStore::set_aor_data(const std::string& aor_id,
 /// AstaireAoRStore::Connector Methods
 
 AstaireAoRStore::Connector::Connector(Store* data_store,
-                            JsonSerializerDeserializer*& serializer_deserializer) :
+                            SerializerDeserializer*& serializer_deserializer) :
   _data_store(data_store),
-  _serializer_deserializer(serializer_deserializer)
+  _serializer_deserializer(serializer_deserializer),
+  _json_deserializer(),
+  _binary_deserializer()
 {
   // We have taken ownership of the serializer_deserializer.
   serializer_deserializer = NULL;
@@ -83,9 +100,14 @@ AoR* AstaireAoRStore::Connector::get_aor_data(
 
   if (status == Store::Status::OK)
   {
-    // Retrieved the data, so deserialize it.
+    // Retrieved the data, so deserialize it.  The record may be in either
+    // format, whichever we are writing.
     TRC_DEBUG("Data store returned a record, CAS = %ld", cas);
-    aor_data = _serializer_deserializer->deserialize_aor(aor_id, data);
+    SerializerDeserializer* deserializer =
+      BinarySerializerDeserializer::is_binary(data) ?
+        (SerializerDeserializer*)&_binary_deserializer :
+        (SerializerDeserializer*)&_json_deserializer;
+    aor_data = deserializer->deserialize_aor(aor_id, data);
 
     if (aor_data != NULL)
     {
@@ -304,3 +326,449 @@ std::string AstaireAoRStore::JsonSerializerDeserializer::serialize_aor(AoR* aor_
 
   return sb.GetString();
 }
+
+
+//
+// (De)serializer for the binary SubscriberDataManager format.
+//
+
+namespace
+{
+
+// Binary records start with a zero byte (which a JSON document can't) and a
+// marker, followed by the format version.
+const char BINARY_MAGIC[] = {'\0', 'A', 'o', 'R'};
+const size_t BINARY_HEADER_LENGTH = sizeof(BINARY_MAGIC) + 1;
+
+// Binding parameter names that are written as an index into this table
+// rather than in full.  Names can only be added to the end of this table (and
+// the format version must then be changed).
+const char* const INTERNED_PARAM_NAMES[] = {
+  "+sip.instance",
+  "reg-id",
+  "expires",
+  "q",
+  "transport",
+  "ob",
+  "+sip.ice",
+  "+g.3gpp.icsi-ref",
+  "+g.3gpp.smsip",
+  "+g.oma.sip-im",
+  "+g.3gpp.iari-ref",
+  "video",
+  "audio",
+  "text",
+  "+g.3gpp.accesstype",
+  "+g.3gpp.srvcc-alerting",
+  "+g.3gpp.ps2cs-srvcc-orig-pre-alerting",
+  "+g.3gpp.mid-call",
+  "+sip.pnsreg",
+};
+const size_t NUM_INTERNED_PARAM_NAMES =
+  sizeof(INTERNED_PARAM_NAMES) / sizeof(INTERNED_PARAM_NAMES[0]);
+
+/// Thrown if a binary record is truncated or otherwise invalid.
+struct BinaryFormatError
+{
+  BinaryFormatError(const char* file, int line) : _file(file), _line(line) {}
+  const char* _file;
+  int _line;
+};
+
+#define BINARY_ASSERT(COND)                                                    \
+  if (!(COND))                                                                 \
+  {                                                                            \
+    throw BinaryFormatError(__FILE__, __LINE__);                               \
+  }
+
+/// Returns the index of each name in the fixed table of interned parameter
+/// names.  Index N refers to entry N - 1.
+const std::unordered_map<std::string, uint64_t>& interned_param_name_indexes()
+{
+  static const std::unordered_map<std::string, uint64_t> indexes = []()
+  {
+    std::unordered_map<std::string, uint64_t> map;
+    for (size_t ii = 0; ii < NUM_INTERNED_PARAM_NAMES; ++ii)
+    {
+      map[INTERNED_PARAM_NAMES[ii]] = ii + 1;
+    }
+    return map;
+  }();
+
+  return indexes;
+}
+
+class BinaryWriter
+{
+public:
+  BinaryWriter(std::string& s) : _s(s) {}
+
+  void write_header()
+  {
+    _s.append(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    _s.push_back((char)AstaireAoRStore::BinarySerializerDeserializer::VERSION);
+  }
+
+  void write_varint(uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      _s.push_back((char)((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    _s.push_back((char)value);
+  }
+
+  // Signed integers are zigzag encoded, so that small negative values are
+  // short too.
+  void write_int(int value)
+  {
+    int64_t v = value;
+    write_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+  }
+
+  void write_bool(bool value)
+  {
+    _s.push_back(value ? 1 : 0);
+  }
+
+  void write_string(const std::string& value)
+  {
+    write_varint(value.size());
+    _s.append(value);
+  }
+
+  void write_strings(const std::list<std::string>& values)
+  {
+    write_varint(values.size());
+    for (std::list<std::string>::const_iterator it = values.begin();
+         it != values.end();
+         ++it)
+    {
+      write_string(*it);
+    }
+  }
+
+  // Writes a binding parameter name, as an index if it is in the fixed table
+  // or has already been written in this record.  Index 0 means the name
+  // follows in full.
+  void write_param_name(const std::string& name)
+  {
+    const std::unordered_map<std::string, uint64_t>& interned =
+      interned_param_name_indexes();
+    std::unordered_map<std::string, uint64_t>::const_iterator it =
+      interned.find(name);
+
+    if (it != interned.end())
+    {
+      write_varint(it->second);
+      return;
+    }
+
+    it = _param_names.find(name);
+
+    if (it != _param_names.end())
+    {
+      write_varint(it->second);
+    }
+    else
+    {
+      write_varint(0);
+      write_string(name);
+      uint64_t index = NUM_INTERNED_PARAM_NAMES + _param_names.size() + 1;
+      _param_names[name] = index;
+    }
+  }
+
+private:
+  std::string& _s;
+
+  // Parameter names written in full so far in this record, mapped to the
+  // indexes that refer to them.
+  std::unordered_map<std::string, uint64_t> _param_names;
+};
+
+class BinaryReader
+{
+public:
+  BinaryReader(const std::string& s) :
+    _p(s.data()),
+    _end(s.data() + s.size())
+  {
+  }
+
+  void skip(size_t length)
+  {
+    BINARY_ASSERT((size_t)(_end - _p) >= length);
+    _p += length;
+  }
+
+  uint64_t read_varint()
+  {
+    uint64_t value = 0;
+
+    for (int shift = 0; ; shift += 7)
+    {
+      BINARY_ASSERT((_p < _end) && (shift < 64));
+      uint8_t byte = (uint8_t)*_p++;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+
+      if ((byte & 0x80) == 0)
+      {
+        break;
+      }
+    }
+
+    return value;
+  }
+
+  int read_int()
+  {
+    uint64_t v = read_varint();
+    return (int)(int64_t)((v >> 1) ^ (~(v & 1) + 1));
+  }
+
+  bool read_bool()
+  {
+    BINARY_ASSERT(_p < _end);
+    return (*_p++ != 0);
+  }
+
+  std::string read_string()
+  {
+    uint64_t length = read_varint();
+    BINARY_ASSERT((uint64_t)(_end - _p) >= length);
+    std::string value(_p, length);
+    _p += length;
+    return value;
+  }
+
+  // Reads a count of items that follow, each taking at least one byte, so
+  // that a corrupt count can't make us loop for ever.
+  uint64_t read_count()
+  {
+    uint64_t count = read_varint();
+    BINARY_ASSERT((uint64_t)(_end - _p) >= count);
+    return count;
+  }
+
+  void read_strings(std::list<std::string>& values)
+  {
+    for (uint64_t count = read_count(); count > 0; --count)
+    {
+      values.push_back(read_string());
+    }
+  }
+
+  std::string read_param_name()
+  {
+    uint64_t index = read_varint();
+
+    if (index == 0)
+    {
+      _param_names.push_back(read_string());
+      return _param_names.back();
+    }
+    else if (index <= NUM_INTERNED_PARAM_NAMES)
+    {
+      return INTERNED_PARAM_NAMES[index - 1];
+    }
+
+    index -= NUM_INTERNED_PARAM_NAMES;
+    BINARY_ASSERT(index <= _param_names.size());
+    return _param_names[index - 1];
+  }
+
+  bool at_end() const { return _p == _end; }
+
+private:
+  const char* _p;
+  const char* _end;
+
+  // Parameter names read in full so far in this record.  Index
+  // NUM_INTERNED_PARAM_NAMES + N refers to entry N - 1.
+  std::vector<std::string> _param_names;
+};
+
+} // namespace
+
+bool AstaireAoRStore::BinarySerializerDeserializer::is_binary(const std::string& s)
+{
+  return ((s.size() >= BINARY_HEADER_LENGTH) &&
+          (memcmp(s.data(), BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0));
+}
+
+AoR* AstaireAoRStore::BinarySerializerDeserializer::
+  deserialize_aor(const std::string& aor_id, const std::string& s)
+{
+  TRC_DEBUG("Deserialize binary record of %d bytes", (int)s.size());
+
+  if (!is_binary(s))
+  {
+    TRC_DEBUG("Record is not in binary format");
+    return NULL;
+  }
+
+  uint8_t version = (uint8_t)s[sizeof(BINARY_MAGIC)];
+  if (version != VERSION)
+  {
+    TRC_INFO("Unsupported binary record version %d", version);
+    return NULL;
+  }
+
+  AoR* aor = new AoR(aor_id);
+  BinaryReader reader(s);
+
+  try
+  {
+    reader.skip(BINARY_HEADER_LENGTH);
+
+    aor->_notify_cseq = reader.read_int();
+    aor->_timer_id = reader.read_string();
+    aor->_scscf_uri = reader.read_string();
+
+    for (uint64_t count = reader.read_count(); count > 0; --count)
+    {
+      std::string binding_id = reader.read_string();
+      TRC_DEBUG("  Binding: %s", binding_id.c_str());
+      AoR::Binding* b = aor->get_binding(binding_id);
+
+      b->_uri = reader.read_string();
+      b->_cid = reader.read_string();
+      b->_cseq = reader.read_int();
+      b->_expires = reader.read_int();
+      b->_priority = reader.read_int();
+
+      for (uint64_t num_params = reader.read_count();
+           num_params > 0;
+           --num_params)
+      {
+        std::string name = reader.read_param_name();
+        b->_params[name] = reader.read_string();
+      }
+
+      reader.read_strings(b->_path_headers);
+      reader.read_strings(b->_path_uris);
+      b->_private_id = reader.read_string();
+      b->_emergency_registration = reader.read_bool();
+    }
+
+    for (uint64_t count = reader.read_count(); count > 0; --count)
+    {
+      AoR::Subscription* sub = aor->get_subscription(reader.read_string());
+
+      sub->_req_uri = reader.read_string();
+      sub->_from_uri = reader.read_string();
+      sub->_from_tag = reader.read_string();
+      sub->_to_uri = reader.read_string();
+      sub->_to_tag = reader.read_string();
+      sub->_cid = reader.read_string();
+      reader.read_strings(sub->_route_uris);
+      sub->_expires = reader.read_int();
+    }
+
+    aor->_associated_uris.clear_uris();
+    for (uint64_t count = reader.read_count(); count > 0; --count)
+    {
+      std::string uri = reader.read_string();
+      bool barred = reader.read_bool();
+      aor->_associated_uris.add_uri(uri, barred);
+    }
+
+    if (reader.read_bool())
+    {
+      std::string distinct = reader.read_string();
+      std::string wildcard = reader.read_string();
+      aor->_associated_uris.add_wildcard_mapping(wildcard, distinct);
+    }
+
+    BINARY_ASSERT(reader.at_end());
+  }
+  catch (BinaryFormatError err)
+  {
+    TRC_INFO("Failed to deserialize binary record (hit error at %s:%d)",
+             err._file, err._line);
+    delete aor; aor = NULL;
+  }
+
+  return aor;
+}
+
+std::string AstaireAoRStore::BinarySerializerDeserializer::serialize_aor(AoR* aor_data)
+{
+  std::string s;
+  s.reserve(512);
+  BinaryWriter writer(s);
+
+  writer.write_header();
+
+  writer.write_int(aor_data->_notify_cseq);
+  writer.write_string(aor_data->_timer_id);
+  writer.write_string(aor_data->_scscf_uri);
+
+  writer.write_varint(aor_data->bindings().size());
+  for (AoR::Bindings::const_iterator it = aor_data->bindings().begin();
+       it != aor_data->bindings().end();
+       ++it)
+  {
+    const AoR::Binding* b = it->second;
+    writer.write_string(it->first);
+    writer.write_string(b->_uri);
+    writer.write_string(b->_cid);
+    writer.write_int(b->_cseq);
+    writer.write_int(b->_expires);
+    writer.write_int(b->_priority);
+
+    writer.write_varint(b->_params.size());
+    for (std::map<std::string, std::string>::const_iterator p = b->_params.begin();
+         p != b->_params.end();
+         ++p)
+    {
+      writer.write_param_name(p->first);
+      writer.write_string(p->second);
+    }
+
+    writer.write_strings(b->_path_headers);
+    writer.write_strings(b->_path_uris);
+    writer.write_string(b->_private_id);
+    writer.write_bool(b->_emergency_registration);
+  }
+
+  writer.write_varint(aor_data->subscriptions().size());
+  for (AoR::Subscriptions::const_iterator it = aor_data->subscriptions().begin();
+       it != aor_data->subscriptions().end();
+       ++it)
+  {
+    const AoR::Subscription* sub = it->second;
+    writer.write_string(it->first);
+    writer.write_string(sub->_req_uri);
+    writer.write_string(sub->_from_uri);
+    writer.write_string(sub->_from_tag);
+    writer.write_string(sub->_to_uri);
+    writer.write_string(sub->_to_tag);
+    writer.write_string(sub->_cid);
+    writer.write_strings(sub->_route_uris);
+    writer.write_int(sub->_expires);
+  }
+
+  std::vector<std::string> uris = aor_data->_associated_uris.get_all_uris();
+  writer.write_varint(uris.size());
+  for (std::vector<std::string>::const_iterator it = uris.begin();
+       it != uris.end();
+       ++it)
+  {
+    writer.write_string(*it);
+    writer.write_bool(aor_data->_associated_uris.is_impu_barred(*it));
+  }
+
+  std::map<std::string, std::string> wildcard_mapping =
+    aor_data->_associated_uris.get_wildcard_mapping();
+  writer.write_bool(!wildcard_mapping.empty());
+  if (!wildcard_mapping.empty())
+  {
+    writer.write_string(wildcard_mapping.begin()->first);
+    writer.write_string(wildcard_mapping.begin()->second);
+  }
+
+  return s;
+}
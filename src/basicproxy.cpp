@@ -29,6 +29,7 @@ extern "C" {
 #include "constants.h"
 #include "basicproxy.h"
 #include "uri_classifier.h"
+#include "thread_dispatcher.h"
 
 
 BasicProxy::BasicProxy(pjsip_endpoint* endpt,
@@ -439,9 +440,11 @@ BasicProxy::UASTsx::UASTsx(BasicProxy* proxy) :
 
 void BasicProxy::UASTsx::unbind_from_pjsip_tsx()
 {
-  // We expect to only be called on the PJSIP transport thread, and our data
-  // race/locking safety is based on this assumption. Raise an error log if
-  // this is not the case.
+  // We expect to only be called on a PJSIP transport thread, from a PJSIP
+  // transaction callback.  There may be several transport threads, so our
+  // data race/locking safety relies on the caller being in this transaction's
+  // context (and so holding the group lock).  Raise an error log if we're not
+  // on a transport thread.
   CHECK_PJ_TRANSPORT_THREAD();
 
   if (_tsx != NULL)
@@ -451,11 +454,17 @@ void BasicProxy::UASTsx::unbind_from_pjsip_tsx()
     _tsx = NULL;
 
     // The trying timer should only be running when we have a PJSIP transaction,
-    // so cancel it if it is running.
+    // so cancel it if it is running.  If it is cancelled, release the context
+    // it was holding.  If it can't be cancelled, it is already popping on
+    // another transport thread and will release the context itself.
     if (_trying_timer.id == TRYING_TIMER)
     {
       _trying_timer.id = 0;
-      pjsip_endpt_cancel_timer(stack_data.endpt, &_trying_timer);
+      if (pj_timer_heap_cancel(pjsip_endpt_get_timer_heap(stack_data.endpt),
+                               &_trying_timer) > 0)
+      {
+        _context_count--;
+      }
     }
   }
 }
@@ -547,7 +556,14 @@ pj_status_t BasicProxy::UASTsx::init(pjsip_rx_data* rdata)
   // Do any start of transaction logging operations.
   on_tsx_start(rdata);
 
-  _req = PJUtils::clone_msg(stack_data.endpt, rdata);
+  // If the request was handed off from the transport thread by the thread
+  // dispatcher, adopt its copy of the message rather than cloning it again.
+  _req = adopt_rx_msg(rdata);
+  if (_req == NULL)
+  {
+    _req = PJUtils::clone_msg(stack_data.endpt, rdata);
+  }
+
   if (_req == NULL)
   {
     // LCOV_EXCL_START - no UT for forcing PJSIP errors.
@@ -601,8 +617,12 @@ pj_status_t BasicProxy::UASTsx::init(pjsip_rx_data* rdata)
     else if (!_proxy->_delay_trying)
     {
       // Send the 100 Trying after 3.5 secs if a final response hasn't been
-      // sent.
+      // sent.  The timer holds a context on this transaction (released when
+      // it pops or is cancelled), so the transaction can't be destroyed under
+      // it if it pops on one transport thread while another is destroying the
+      // transaction.
       _trying_timer.id = TRYING_TIMER;
+      _context_count++;
       pj_time_val delay = {(PJSIP_T2_TIMEOUT - PJSIP_T1_TIMEOUT) / 1000,
                            (PJSIP_T2_TIMEOUT - PJSIP_T1_TIMEOUT) % 1000 };
       pjsip_endpt_schedule_timer(stack_data.endpt, &(_trying_timer), &delay);
@@ -1480,11 +1500,14 @@ void BasicProxy::UASTsx::exit_context()
 /// Handle the trying timer expiring on this transaction.
 void BasicProxy::UASTsx::trying_timer_expired()
 {
+  // Take the group lock.  The timer has been holding a context since it was
+  // scheduled, which is released below.
   enter_context();
+  _context_count--;
 
-  // We expect to only be called on the PJSIP transport thread, and our data
-  // race/locking safety is based on this assumption. Raise an error log if
-  // this is not the case.
+  // We expect to only be called on a PJSIP transport thread.  There may be
+  // several, so our data race/locking safety relies on the group lock taken
+  // above. Raise an error log if we're not on a transport thread.
   CHECK_PJ_TRANSPORT_THREAD();
 
   TRC_DEBUG("Trying timer expired for %s, transaction state = %s",
@@ -1507,13 +1530,12 @@ void BasicProxy::UASTsx::trying_timer_expired()
 
 
 /// Static method called by PJSIP when a trying timer expires.  The instance
-/// is stored in the user_data field of the timer entry.
+/// is stored in the user_data field of the timer entry.  The entry's ID is
+/// only checked once the transaction's lock is held, as the timer may be
+/// being cancelled on another transport thread.
 void BasicProxy::UASTsx::trying_timer_callback(pj_timer_heap_t *timer_heap, struct pj_timer_entry *entry)
 {
-  if (entry->id == TRYING_TIMER)
-  {
-    ((BasicProxy::UASTsx*)entry->user_data)->trying_timer_expired();
-  }
+  ((BasicProxy::UASTsx*)entry->user_data)->trying_timer_expired();
 }
 
 
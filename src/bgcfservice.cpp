@@ -78,7 +78,7 @@ void BgcfService::update_routes()
   try
   {
     std::map<std::string, std::vector<std::string>> new_domain_routes;
-    std::map<std::string, std::vector<std::string>> new_number_routes;
+    PrefixTrie<std::vector<std::string>> new_number_routes;
 
     JSON_ASSERT_CONTAINS(doc, "routes");
     JSON_ASSERT_ARRAY(doc["routes"]);
@@ -121,9 +121,8 @@ void BgcfService::update_routes()
         else
         {
           routing_value = (*routes_it)["number"].GetString();
-          new_number_routes.insert(
-                    std::make_pair(Utils::remove_visual_separators(routing_value),
-                                   route_vec));
+          new_number_routes.insert(Utils::remove_visual_separators(routing_value),
+                                   route_vec);
         }
 
         route_vec.clear();
@@ -140,7 +139,7 @@ void BgcfService::update_routes()
     // Take a write lock on the mutex in RAII style
     boost::lock_guard<boost::shared_mutex> write_lock(_routes_rw_lock);
     _domain_routes = new_domain_routes;
-    _number_routes = new_number_routes;
+    _number_routes.swap(new_number_routes);
   }
   catch (JsonFormatError err)
   {
@@ -222,41 +221,38 @@ std::vector<std::string> BgcfService::get_route_from_number(
   // Take a read lock on the mutex in RAII style
   boost::shared_lock<boost::shared_mutex> read_lock(_routes_rw_lock);
 
-  // The number routes map is ordered by length of key. Start from the end of
-  // the map to get the longest prefixes first.
-  for (std::map<std::string, std::vector<std::string>>::const_reverse_iterator it =
-        _number_routes.rbegin();
-       it != _number_routes.rend();
-       it++)
-  {
-    int len = std::min(number.size(), (*it).first.size());
-
-    if (Utils::remove_visual_separators(number).compare(0,
-                                                        len,
-                                                        (*it).first,
-                                                        0,
-                                                        len) == 0)
-    {
-      // Found a match, so return it
-      TRC_DEBUG("Match found. Number: %s, prefix: %s",
-                number.c_str(), (*it).first.c_str());
+  // Strip the visual separators from the number once, and then walk the trie
+  // to find the longest matching prefix.  A number without visual separators
+  // may also match a longer prefix that it is the start of.
+  std::string stripped_number = Utils::remove_visual_separators(number);
+  std::string matched_prefix;
 
-      SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_NUMBER, 0);
-      event.add_var_param(number);
-      std::string route_string;
+  const std::vector<std::string>* routes =
+                   _number_routes.match(stripped_number,
+                                        (stripped_number.size() == number.size()),
+                                        &matched_prefix);
 
-      for (std::vector<std::string>::const_iterator ii = (*it).second.begin();
-                                                    ii != (*it).second.end();
-                                                    ++ii)
-      {
-        route_string = route_string + *ii + ";";
-      }
+  if (routes != NULL)
+  {
+    // Found a match, so return it
+    TRC_DEBUG("Match found. Number: %s, prefix: %s",
+              number.c_str(), matched_prefix.c_str());
 
-      event.add_var_param(route_string);
-      SAS::report_event(event);
+    SAS::Event event(trail, SASEvent::BGCF_FOUND_ROUTE_NUMBER, 0);
+    event.add_var_param(number);
+    std::string route_string;
 
-      return (*it).second;
+    for (std::vector<std::string>::const_iterator ii = routes->begin();
+                                                  ii != routes->end();
+                                                  ++ii)
+    {
+      route_string = route_string + *ii + ";";
     }
+
+    event.add_var_param(route_string);
+    SAS::report_event(event);
+
+    return *routes;
   }
 
   SAS::Event event(trail, SASEvent::BGCF_NO_ROUTE_NUMBER, 0);
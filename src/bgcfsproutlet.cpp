@@ -90,7 +90,10 @@ ACR* BGCFSproutlet::get_acr(SAS::TrailId trail)
 BGCFSproutletTsx::BGCFSproutletTsx(BGCFSproutlet* bgcf) :
   SproutletTsx(bgcf),
   _bgcf(bgcf),
-  _acr(NULL)
+  _acr(NULL),
+  _pending_req(NULL),
+  _enum_uri(),
+  _cancelled(false)
 {
 }
 
@@ -112,14 +115,69 @@ void BGCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
   _acr = _bgcf->get_acr(trail());
   _acr->rx_request(req);
 
+  std::string user;
+
+  if (!PJUtils::get_enum_user(req, true, user))
+  {
+    route_request(req);
+  }
+  else if (_bgcf->_enum_service == NULL)
+  {
+    // There's nothing to look up, so this just reports that ENUM isn't
+    // enabled.
+    PJUtils::lookup_enum_user(user, NULL, trail());
+    route_request(req);
+  }
+  else
+  {
+    // Look up any number portability data without holding up this thread,
+    // and route the request when the lookup completes.
+    EnumService* enum_service = _bgcf->_enum_service;
+    SAS::TrailId trail_id = trail();
+    std::string* enum_uri = &_enum_uri;
+    _pending_req = req;
+    run_async([enum_service, user, trail_id, enum_uri]()
+              {
+                *enum_uri = PJUtils::lookup_enum_user(user,
+                                                      enum_service,
+                                                      trail_id);
+              },
+              NULL);
+  }
+}
+
+
+void BGCFSproutletTsx::on_async_complete(void* context)
+{
+  pjsip_msg* req = _pending_req;
+  _pending_req = NULL;
+
+  if (_cancelled)
+  {
+    // The request was cancelled during the ENUM lookup.  It hasn't been
+    // forwarded, so there's no fork to cancel - just reject it.
+    TRC_DEBUG("Request cancelled during ENUM lookup, not routing it");
+    pjsip_msg* rsp = create_response(req, PJSIP_SC_REQUEST_TERMINATED);
+    send_response(rsp);
+    free_msg(req);
+    return;
+  }
+
+  PJUtils::apply_enum_translation(req,
+                                  get_pool(req),
+                                  _enum_uri,
+                                  true,
+                                  _bgcf->_override_npdi,
+                                  trail());
+  route_request(req);
+}
+
+
+void BGCFSproutletTsx::route_request(pjsip_msg* req)
+{
   std::vector<std::string> bgcf_routes;
   std::string routing_value;
   bool routing_with_number = false;
-  PJUtils::update_request_uri_np_data(req,
-                                      get_pool(req),
-                                      _bgcf->_enum_service,
-                                      _bgcf->_override_npdi,
-                                      trail());
   pjsip_uri* req_uri = (pjsip_uri*)req->line.req.uri;
   URIClass uri_class = URIClassifier::classify_uri(req_uri);
 
@@ -265,6 +323,8 @@ void BGCFSproutletTsx::on_tx_response(pjsip_msg* rsp)
 // LCOV_EXCL_START - TODO add to UTs
 void BGCFSproutletTsx::on_rx_cancel(int status_code, pjsip_msg* cancel_req)
 {
+  _cancelled = true;
+
   if ((status_code == PJSIP_SC_REQUEST_TERMINATED) &&
       (cancel_req != NULL))
   {
@@ -0,0 +1,278 @@
+/**
+ * @file chronos_timer_queue.cpp  Queue of updates to registration timers in
+ *                                Chronos.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+
+#include <vector>
+
+#include "log.h"
+#include "chronos_timer_queue.h"
+
+ChronosTimerQueue::ChronosTimerQueue(ChronosConnection* chronos_conn,
+                                     int batch_interval_ms,
+                                     int max_pending) :
+  _chronos_conn(chronos_conn),
+  _batch_interval_ms(batch_interval_ms),
+  _max_pending(max_pending),
+  _pending(),
+  _new_timer_ids(),
+  _terminated(false)
+{
+  pthread_mutex_init(&_lock, NULL);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  TRC_STATUS("Sending Chronos timer updates in batches every %dms (at most %d queued)",
+             _batch_interval_ms, max_pending);
+  pthread_create(&_flush_thread,
+                 NULL,
+                 &ChronosTimerQueue::flush_thread_function,
+                 (void*)this);
+}
+
+ChronosTimerQueue::~ChronosTimerQueue()
+{
+  // Stop the flush thread.  It sends any queued updates before exiting.
+  pthread_mutex_lock(&_lock);
+  _terminated = true;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_lock);
+  pthread_join(_flush_thread, NULL);
+
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
+}
+
+bool ChronosTimerQueue::update(const std::string& timer_id,
+                               int expiry,
+                               const std::string& callback_uri,
+                               const std::string& opaque,
+                               const std::map<std::string, uint32_t>& tags,
+                               SAS::TrailId trail)
+{
+  Update update;
+  update.remove = false;
+  update.expires_at = time(NULL) + expiry;
+  update.callback_uri = callback_uri;
+  update.opaque = opaque;
+  update.tags = tags;
+  update.trail = trail;
+
+  return queue(timer_id, update);
+}
+
+bool ChronosTimerQueue::remove(const std::string& timer_id,
+                               SAS::TrailId trail)
+{
+  Update update;
+  update.remove = true;
+  update.expires_at = 0;
+  update.trail = trail;
+
+  return queue(timer_id, update);
+}
+
+bool ChronosTimerQueue::queue(const std::string& timer_id,
+                              const Update& update)
+{
+  bool queued = true;
+
+  pthread_mutex_lock(&_lock);
+
+  Updates::iterator it = _pending.find(timer_id);
+
+  if (it != _pending.end())
+  {
+    // There's already an update waiting for this timer, which this one
+    // supersedes.
+    TRC_DEBUG("Replacing queued update to Chronos timer %s", timer_id.c_str());
+    it->second = update;
+  }
+  else if ((_pending.size() >= _max_pending) &&
+           (_sending.find(timer_id) == _sending.end()))
+  {
+    queued = false;
+  }
+  else
+  {
+    _pending.insert(std::make_pair(timer_id, update));
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  if (!queued)
+  {
+    TRC_DEBUG("Too many Chronos timer updates queued - sending update to %s immediately",
+              timer_id.c_str());
+  }
+
+  return queued;
+}
+
+void ChronosTimerQueue::update_timer_id(std::string& timer_id)
+{
+  pthread_mutex_lock(&_lock);
+
+  // Follow the chain of new IDs, in case the ID has changed more than once.
+  // Each ID is only replaced by a new one, so this terminates.
+  std::unordered_map<std::string, NewTimerId>::const_iterator it =
+                                                _new_timer_ids.find(timer_id);
+  while (it != _new_timer_ids.end())
+  {
+    TRC_DEBUG("Chronos timer %s is now %s",
+              timer_id.c_str(), it->second.timer_id.c_str());
+    timer_id = it->second.timer_id;
+    it = _new_timer_ids.find(timer_id);
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+void* ChronosTimerQueue::flush_thread_function(void* queue)
+{
+  ((ChronosTimerQueue*)queue)->flush_thread_function();
+  return NULL;
+}
+
+void ChronosTimerQueue::flush_thread_function()
+{
+  pthread_mutex_lock(&_lock);
+
+  while (true)
+  {
+    struct timespec abstime;
+    clock_gettime(CLOCK_MONOTONIC, &abstime);
+    abstime.tv_sec += _batch_interval_ms / 1000;
+    abstime.tv_nsec += (_batch_interval_ms % 1000) * 1000000;
+    if (abstime.tv_nsec >= 1000000000)
+    {
+      abstime.tv_sec += 1;
+      abstime.tv_nsec -= 1000000000;
+    }
+
+    int rc = 0;
+    while ((!_terminated) && (rc == 0))
+    {
+      rc = pthread_cond_timedwait(&_cond, &_lock, &abstime);
+    }
+
+    bool terminated = _terminated;
+    Updates updates;
+    updates.swap(_pending);
+
+    for (Updates::const_iterator it = updates.begin();
+         it != updates.end();
+         ++it)
+    {
+      _sending.insert(it->first);
+    }
+
+    // Send the updates without holding the lock, so that threads can queue
+    // more in the meantime.
+    pthread_mutex_unlock(&_lock);
+    flush(updates);
+    pthread_mutex_lock(&_lock);
+
+    _sending.clear();
+
+    if (terminated)
+    {
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+void ChronosTimerQueue::flush(Updates& updates)
+{
+  if (updates.empty())
+  {
+    return;
+  }
+
+  TRC_DEBUG("Sending %d queued Chronos timer updates", (int)updates.size());
+
+  // Delete the timers for removed AoRs first, as they free up resources in
+  // Chronos.
+  for (Updates::iterator it = updates.begin(); it != updates.end(); ++it)
+  {
+    if (it->second.remove)
+    {
+      _chronos_conn->send_delete(it->first, it->second.trail);
+    }
+  }
+
+  time_t now = time(NULL);
+
+  for (Updates::iterator it = updates.begin(); it != updates.end(); ++it)
+  {
+    if (!it->second.remove)
+    {
+      // The timer length is relative to when the update is sent, not when it
+      // was queued.
+      int expiry = (it->second.expires_at > now) ?
+                     (int)(it->second.expires_at - now) : 1;
+      std::string timer_id = it->first;
+      HTTPCode status = _chronos_conn->send_put(timer_id,
+                                                expiry,
+                                                it->second.callback_uri,
+                                                it->second.opaque,
+                                                it->second.trail,
+                                                it->second.tags);
+
+      if (status != HTTP_OK)
+      {
+        TRC_WARNING("Failed to update Chronos timer %s: %d",
+                    it->first.c_str(), status);
+      }
+      else if (timer_id != it->first)
+      {
+        // Chronos has changed the timer's ID.  The AoR still holds the old
+        // one, so remember the new one until the AoR is next updated.
+        TRC_DEBUG("Chronos changed timer ID %s to %s",
+                  it->first.c_str(), timer_id.c_str());
+        NewTimerId new_timer_id;
+        new_timer_id.timer_id = timer_id;
+        new_timer_id.expires_at = now + expiry;
+
+        pthread_mutex_lock(&_lock);
+        _new_timer_ids[it->first] = new_timer_id;
+        pthread_mutex_unlock(&_lock);
+      }
+    }
+  }
+
+  // Forget new timer IDs for timers that have long since expired, by which
+  // time the AoRs holding the old IDs have been updated or removed.
+  pthread_mutex_lock(&_lock);
+
+  for (std::unordered_map<std::string, NewTimerId>::iterator it =
+                                                       _new_timer_ids.begin();
+       it != _new_timer_ids.end();
+      )
+  {
+    if (it->second.expires_at + NEW_TIMER_ID_GRACE_S < now)
+    {
+      it = _new_timer_ids.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
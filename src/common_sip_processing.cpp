@@ -38,6 +38,7 @@ extern "C" {
 #include "load_monitor.h"
 #include "health_checker.h"
 #include "uri_classifier.h"
+#include "sas_rx_log_pool.h"
 
 static SNMP::CounterByScopeTable* requests_counter = NULL;
 static SNMP::CounterByScopeTable* overload_counter = NULL;
@@ -49,6 +50,8 @@ static pj_status_t process_on_tx_msg(pjsip_tx_data* tdata);
 
 static SAS::TrailId DONT_LOG_TO_SAS = 0xFFFFFFFF;
 
+static SASRxLogPool* sas_rx_log_pool = NULL;
+
 // Module handling common processing for all SIP messages - logging,
 // overload control, and rejection of bad requests.
 
@@ -106,6 +109,53 @@ static void local_log_tx_msg(pjsip_tx_data* tdata)
               tdata->buf.start);
 }
 
+/// Gets the SAS trail of the transaction with the specified key, or 0 if
+/// there is no such transaction or it can't safely be accessed.
+///
+/// Note that we are NOT locking the transaction object before we fetch the
+/// trail ID from it.  This is deliberate - we cannot get a group lock from
+/// this routine as we may already have obtained the IO lock (which is lower
+/// in the locking hierarchy) higher up the stack.
+/// (e.g. from ioqueue_common_abs::ioqueue_dispatch_read_event) and grabbing
+/// the group lock here may cause us to deadlock with a thread using the locks
+/// in the right order.
+///
+/// This is safe for the following reasons
+/// - The transaction objects are only ever destroyed by the transport thread,
+///   so if there is only one transport thread (the current thread), we don't
+///   need to worry about the tsx pointers being invalid.  If there are several
+///   transport threads, a transaction could be destroyed by another of them
+///   while we are reading it, so we don't read it at all.  Instead we look
+///   the trail up in the index of transaction trails maintained by the stack
+///   (see record_tsx_trail), which has its own lock.
+/// - In principle, the trail IDs (which are 64 bit numbers stored as void*s
+///   since thats the format of the generic PJSIP user data area) might be
+///   being written to as we are reading them, thereby invalidating them.
+///   However, the chances of this happening are exceedingly remote and, if it
+///   ever happened, the worst that could happen is that the trail ID would be
+///   invalid and the log we're about to make unreachable by SAS.  This is
+///   assumed to be sufficiently low impact as to be ignorable for practical
+///   purposes.
+static SAS::TrailId get_tsx_trail(pj_str_t* key)
+{
+  SAS::TrailId trail = 0;
+
+  if (stack_data.pjsip_transport_threads.size() <= 1)
+  {
+    pjsip_transaction* tsx = pjsip_tsx_layer_find_tsx(key, PJ_FALSE);
+    if (tsx)
+    {
+      trail = get_trail(tsx);
+    }
+  }
+  else
+  {
+    trail = find_tsx_trail(key);
+  }
+
+  return trail;
+}
+
 // LCOV_EXCL_START - can't meaningfully test SAS in UT
 static void sas_log_rx_msg(pjsip_rx_data* rdata)
 {
@@ -113,27 +163,6 @@ static void sas_log_rx_msg(pjsip_rx_data* rdata)
   SAS::TrailId trail = 0;
 
   // Look for the SAS Trail ID for the corresponding transaction object.
-  //
-  // Note that we are NOT locking the transaction object before we fetch the
-  // trail ID from it.  This is deliberate - we cannot get a group lock from
-  // this routine as we may already have obtained the IO lock (which is lower
-  // in the locking hierarchy) higher up the stack.
-  // (e.g. from ioqueue_common_abs::ioqueue_dispatch_read_event) and grabbing
-  // the group lock here may cause us to deadlock with a thread using the locks
-  // in the right order.
-  //
-  // This is safe for the following reasons
-  // - The transaction objects are only ever invalidated by the current thread
-  //   (i.e. the transport thread), so we don't need to worry about the tsx
-  //   pointers being invalid.
-  // - In principle, the trail IDs (which are 64 bit numbers stored as void*s
-  //   since thats the format of the generic PJSIP user data area) might be
-  //   being written to as we are reading them, thereby invalidating them.
-  //   However, the chances of this happening are exceedingly remote and, if it
-  //   ever happened, the worst that could happen is that the trail ID would be
-  //   invalid and the log we're about to make unreachable by SAS.  This is
-  //   assumed to be sufficiently low impact as to be ignorable for practical
-  //   purposes.
   if (rdata->msg_info.msg->type == PJSIP_RESPONSE_MSG)
   {
     // Message is a response, so try to correlate to an existing UAC
@@ -141,12 +170,7 @@ static void sas_log_rx_msg(pjsip_rx_data* rdata)
     pj_str_t key;
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_ROLE_UAC,
                          &rdata->msg_info.cseq->method, rdata);
-    pjsip_transaction* tsx = pjsip_tsx_layer_find_tsx(&key, PJ_FALSE);
-    if (tsx)
-    {
-      // Found the UAC transaction, so get the trail if there is one.
-      trail = get_trail(tsx);
-    }
+    trail = get_tsx_trail(&key);
   }
   else if (rdata->msg_info.msg->line.req.method.id == PJSIP_ACK_METHOD)
   {
@@ -155,12 +179,7 @@ static void sas_log_rx_msg(pjsip_rx_data* rdata)
     pj_str_t key;
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_UAS_ROLE,
                          &rdata->msg_info.cseq->method, rdata);
-    pjsip_transaction* tsx = pjsip_tsx_layer_find_tsx(&key, PJ_FALSE);
-    if (tsx)
-    {
-      // Found the UAS transaction, so get the trail if there is one.
-      trail = get_trail(tsx);
-    }
+    trail = get_tsx_trail(&key);
   }
   else if (rdata->msg_info.msg->line.req.method.id == PJSIP_CANCEL_METHOD)
   {
@@ -169,12 +188,7 @@ static void sas_log_rx_msg(pjsip_rx_data* rdata)
     pj_str_t key;
     pjsip_tsx_create_key(rdata->tp_info.pool, &key, PJSIP_UAS_ROLE,
                          pjsip_get_invite_method(), rdata);
-    pjsip_transaction* tsx = pjsip_tsx_layer_find_tsx(&key, PJ_FALSE);
-    if (tsx)
-    {
-      // Found the INVITE UAS transaction, so get the trail if there is one.
-      trail = get_trail(tsx);
-    }
+    trail = get_tsx_trail(&key);
   }
   else if ((rdata->msg_info.msg->line.req.method.id == PJSIP_OPTIONS_METHOD) &&
            (URIClassifier::classify_uri(rdata->msg_info.msg->line.req.uri) == NODE_LOCAL_SIP_URI))
@@ -212,13 +226,30 @@ static void sas_log_rx_msg(pjsip_rx_data* rdata)
     PJUtils::mark_sas_call_branch_ids(trail, cid, rdata->msg_info.msg);
   }
 
-  // Log the message event.
-  SAS::Event event(trail, SASEvent::RX_SIP_MSG, 0);
-  event.add_static_param(pjsip_transport_get_type_from_flag(rdata->tp_info.transport->flag));
-  event.add_static_param(rdata->pkt_info.src_port);
-  event.add_var_param(rdata->pkt_info.src_name);
-  event.add_compressed_param(rdata->msg_info.len, rdata->msg_info.msg_buf, &SASEvent::PROFILE_SIP);
-  SAS::report_event(event);
+  // Log the message event.  If there are threads to do so, the (relatively
+  // expensive) compression and logging of the message is handed off to them,
+  // so the transport thread only has to copy the message bytes.
+  if (sas_rx_log_pool != NULL)
+  {
+    SASRxLog* rx_log = new SASRxLog();
+    rx_log->trail = trail;
+    rx_log->timestamp = SAS::get_current_timestamp();
+    rx_log->transport_type =
+      pjsip_transport_get_type_from_flag(rdata->tp_info.transport->flag);
+    rx_log->src_port = rdata->pkt_info.src_port;
+    rx_log->src_name = rdata->pkt_info.src_name;
+    rx_log->msg.assign(rdata->msg_info.msg_buf, rdata->msg_info.len);
+    sas_rx_log_pool->queue_log(rx_log);
+  }
+  else
+  {
+    SAS::Event event(trail, SASEvent::RX_SIP_MSG, 0);
+    event.add_static_param(pjsip_transport_get_type_from_flag(rdata->tp_info.transport->flag));
+    event.add_static_param(rdata->pkt_info.src_port);
+    event.add_var_param(rdata->pkt_info.src_name);
+    event.add_compressed_param(rdata->msg_info.len, rdata->msg_info.msg_buf, &SASEvent::PROFILE_SIP);
+    SAS::report_event(event);
+  }
 }
 
 
@@ -384,12 +415,22 @@ pj_status_t
 init_common_sip_processing(LoadMonitor* load_monitor_arg,
                            SNMP::CounterByScopeTable* requests_counter_arg,
                            SNMP::CounterByScopeTable* overload_counter_arg,
-                           HealthChecker* health_checker_arg)
+                           HealthChecker* health_checker_arg,
+                           ExceptionHandler* exception_handler,
+                           int sas_log_threads)
 {
   // Register the stack modules.
   pjsip_endpt_register_module(stack_data.endpt, &mod_common_processing);
   stack_data.sas_logging_module_id = mod_common_processing.id;
 
+  if (sas_log_threads > 0)
+  {
+    TRC_STATUS("Logging received messages to SAS on %d threads",
+               sas_log_threads);
+    sas_rx_log_pool = new SASRxLogPool(exception_handler, sas_log_threads);
+    sas_rx_log_pool->start();
+  }
+
   overload_counter = overload_counter_arg;
   requests_counter = requests_counter_arg;
 
@@ -404,4 +445,11 @@ init_common_sip_processing(LoadMonitor* load_monitor_arg,
 void unregister_common_processing_module(void)
 {
   pjsip_endpt_unregister_module(stack_data.endpt, &mod_common_processing);
+
+  if (sas_rx_log_pool != NULL)
+  {
+    sas_rx_log_pool->stop();
+    sas_rx_log_pool->join();
+    delete sas_rx_log_pool; sas_rx_log_pool = NULL;
+  }
 }
@@ -67,9 +67,10 @@ void ConnectionTracker::connection_state_update(pjsip_transport *tp,
     TRC_DEBUG("Connection %p has been destroyed", tp);
 
     pthread_mutex_lock(&_lock);
-    // We expect to only be called on the PJSIP transport thread, and our data
-    // race/locking safety is based on this assumption. Raise an error log if
-    // this is not the case.
+    // We expect to only be called on a PJSIP transport thread. There may be
+    // several, and connections can be destroyed on any of them, so our data
+    // race/locking safety is based on _lock. Raise an error log if we're not
+    // on a transport thread.
     CHECK_PJ_TRANSPORT_THREAD();
 
     _connection_listeners.erase(tp);
@@ -109,9 +110,9 @@ void ConnectionTracker::connection_active(pjsip_transport *tp)
     pthread_mutex_lock(&_lock);
 
     // We expect to be called by only websocket transport threads, or the PJSIP
-    // transport thread. We must NOT be called by the PJSIP worker thread.
-    // Race/locking safety is based on the above assumption. Raise an error log
-    // if the above is not the case.
+    // transport threads. We must NOT be called by the PJSIP worker threads.
+    // Race/locking safety between the transport threads is based on _lock.
+    // Raise an error log if the above is not the case.
     if ((strcmp(pj_thread_get_name(pj_thread_this()), "websockets")) != 0)
     {
       CHECK_PJ_TRANSPORT_THREAD();
@@ -162,9 +163,10 @@ void ConnectionTracker::quiesce()
   TRC_STATUS("Start quiescing connections");
 
   pthread_mutex_lock(&_lock);
-  // We expect to only be called on the PJSIP transport thread, and our data
-  // race/locking safety is based on this assumption. Raise an error log if
-  // this is not the case.
+  // We expect to only be called on the first PJSIP transport thread, which is
+  // the only one that handles quiescing.  Our data race/locking safety against
+  // the other transport threads is based on _lock. Raise an error log if we're
+  // not on a transport thread.
   CHECK_PJ_TRANSPORT_THREAD();
 
   // Flag that we're now quiescing. It is illegal to call this method if we're
@@ -217,9 +219,10 @@ void ConnectionTracker::unquiesce()
   TRC_DEBUG("Unquiesce connections");
 
   pthread_mutex_lock(&_lock);
-  // We expect to only be called on the PJSIP transport thread, and our data
-  // race/locking safety is based on this assumption. Raise an error log if
-  // this is not the case.
+  // We expect to only be called on the first PJSIP transport thread, which is
+  // the only one that handles quiescing.  Our data race/locking safety against
+  // the other transport threads is based on _lock. Raise an error log if we're
+  // not on a transport thread.
   CHECK_PJ_TRANSPORT_THREAD();
 
   // It is not possible to "un-shutdown" a pjsip transport.  All connections
@@ -1435,6 +1435,233 @@ int pjsip_accept_contact_hdr_print_on(void* void_hdr,
   return buf-startbuf;
 }
 
+/*****************************************************************************/
+/* Lazily parsed headers                                                     */
+/*****************************************************************************/
+static void* pjsip_lazy_hdr_clone(pj_pool_t* pool, const void* o);
+static void* pjsip_lazy_hdr_shallow_clone(pj_pool_t* pool, const void* o);
+static int pjsip_lazy_hdr_print_on(void* h, char* buf, pj_size_t len);
+
+static pjsip_hdr_vptr pjsip_lazy_hdr_vptr = {
+  pjsip_lazy_hdr_clone,
+  pjsip_lazy_hdr_shallow_clone,
+  pjsip_lazy_hdr_print_on
+};
+
+static pjsip_lazy_hdr* pjsip_lazy_hdr_create(pj_pool_t* pool,
+                                             const pj_str_t* name,
+                                             pjsip_parse_hdr_func* parser)
+{
+  pjsip_lazy_hdr* hdr = PJ_POOL_ZALLOC_T(pool, pjsip_lazy_hdr);
+
+  // Based on init_hdr from sip_msg.c
+  hdr->type = PJSIP_H_OTHER;
+  hdr->name = *name;
+  hdr->sname = *name;
+  hdr->vptr = &pjsip_lazy_hdr_vptr;
+  pj_list_init(hdr);
+  hdr->parser = parser;
+  hdr->pool = pool;
+
+  return hdr;
+}
+
+static void* pjsip_lazy_hdr_clone(pj_pool_t* pool, const void* o)
+{
+  pjsip_lazy_hdr* other = (pjsip_lazy_hdr*)o;
+  pjsip_lazy_hdr* hdr = pjsip_lazy_hdr_create(pool, &other->name, other->parser);
+  pj_strdup(pool, &hdr->hvalue, &other->hvalue);
+  return hdr;
+}
+
+static void* pjsip_lazy_hdr_shallow_clone(pj_pool_t* pool, const void* o)
+{
+  pjsip_lazy_hdr* other = (pjsip_lazy_hdr*)o;
+  pjsip_lazy_hdr* hdr = pjsip_lazy_hdr_create(pool, &other->name, other->parser);
+  hdr->hvalue = other->hvalue;
+  return hdr;
+}
+
+static int pjsip_lazy_hdr_print_on(void* h, char* buf, pj_size_t len)
+{
+  pjsip_lazy_hdr* hdr = (pjsip_lazy_hdr*)h;
+  char* p = buf;
+
+  // Header name, ": ", the raw value and the terminating NULL.
+  if ((hdr->name.slen + 2 + hdr->hvalue.slen + 1) > (pj_ssize_t)len) {
+    return -1;
+  }
+
+  pj_memcpy(p, hdr->name.ptr, hdr->name.slen);
+  p += hdr->name.slen;
+  *p++ = ':';
+  *p++ = ' ';
+  pj_memcpy(p, hdr->hvalue.ptr, hdr->hvalue.slen);
+  p += hdr->hvalue.slen;
+  *p = '\0';
+
+  return p - buf;
+}
+
+/// Parses a header into a pjsip_lazy_hdr, which just holds the raw header
+/// value and the parser to use on it when it is needed.
+static pjsip_hdr* parse_lazy_hdr(pjsip_parse_ctx* ctx,
+                                 const pj_str_t* name,
+                                 pjsip_parse_hdr_func* parser)
+{
+  const pjsip_parser_const_t* pc = pjsip_parser_const();
+  pj_scanner* scanner = ctx->scanner;
+  pjsip_lazy_hdr* hdr = pjsip_lazy_hdr_create(ctx->pool, name, parser);
+
+  // Based on parse_generic_string_hdr from sip_parser.c
+  if (pj_cis_match(&pc->pjsip_NOT_NEWLINE, *scanner->curptr)) {
+    pj_scan_get(scanner, &pc->pjsip_NOT_NEWLINE, &hdr->hvalue);
+  }
+  pjsip_parse_end_hdr_imp(scanner);
+
+  return (pjsip_hdr*)hdr;
+}
+
+static pjsip_hdr* parse_hdr_p_charging_vector_lazy(pjsip_parse_ctx* ctx)
+{
+  return parse_lazy_hdr(ctx, &STR_P_C_V, &parse_hdr_p_charging_vector);
+}
+
+static pjsip_hdr* parse_hdr_p_charging_function_addresses_lazy(pjsip_parse_ctx* ctx)
+{
+  return parse_lazy_hdr(ctx, &STR_P_C_F_A, &parse_hdr_p_charging_function_addresses);
+}
+
+static void on_lazy_hdr_syntax_error(pj_scanner* scanner)
+{
+  PJ_UNUSED_ARG(scanner);
+  PJ_THROW(PJSIP_SYN_ERR_EXCEPTION);
+}
+
+/// Runs the typed parser over the raw value of a lazily parsed header.
+///
+/// @returns The typed header, or NULL if the value couldn't be parsed.
+static pjsip_hdr* parse_lazy_hdr_value(pjsip_lazy_hdr* lazy)
+{
+  PJ_USE_EXCEPTION;
+  pj_pool_t* pool = lazy->pool;
+  pjsip_hdr* hdr = NULL;
+
+  // The scanner requires a NULL terminated buffer, and the typed header
+  // points into it, so it is allocated from the header's pool.
+  char* buf = (char*)pj_pool_alloc(pool, lazy->hvalue.slen + 1);
+  pj_memcpy(buf, lazy->hvalue.ptr, lazy->hvalue.slen);
+  buf[lazy->hvalue.slen] = '\0';
+
+  pj_scanner scanner;
+  pj_scan_init(&scanner,
+               buf,
+               lazy->hvalue.slen,
+               PJ_SCAN_AUTOSKIP_WS_HEADER,
+               &on_lazy_hdr_syntax_error);
+
+  pjsip_parse_ctx ctx;
+  ctx.scanner = &scanner;
+  ctx.pool = pool;
+  ctx.rdata = NULL;
+
+  PJ_TRY {
+    hdr = lazy->parser(&ctx);
+  }
+  PJ_CATCH_ANY {
+    TRC_INFO("Failed to parse %.*s header: %.*s",
+             (int)lazy->name.slen, lazy->name.ptr,
+             (int)lazy->hvalue.slen, lazy->hvalue.ptr);
+    hdr = NULL;
+  }
+  PJ_END;
+
+  pj_scan_fini(&scanner);
+
+  return hdr;
+}
+
+pjsip_hdr* pjsip_msg_find_parsed_hdr_by_name(pjsip_msg* msg,
+                                             const pj_str_t* name)
+{
+  pjsip_hdr* hdr = (pjsip_hdr*)pjsip_msg_find_hdr_by_name(msg, name, NULL);
+
+  if ((hdr != NULL) && (hdr->vptr == &pjsip_lazy_hdr_vptr))
+  {
+    pjsip_lazy_hdr* lazy = (pjsip_lazy_hdr*)hdr;
+    pjsip_hdr* parsed_hdr = NULL;
+
+    if (lazy->parser != NULL)
+    {
+      parsed_hdr = parse_lazy_hdr_value(lazy);
+
+      if (parsed_hdr != NULL)
+      {
+        // Swap the typed header into the message, so it is only parsed once.
+        pj_list_insert_before(hdr, parsed_hdr);
+        pj_list_erase(hdr);
+      }
+      else
+      {
+        // The header couldn't be parsed.  It is left in the message as it
+        // is, and is passed on untouched, but its parser is cleared so that
+        // later lookups don't try to parse it again.
+        lazy->parser = NULL;
+      }
+    }
+
+    hdr = parsed_hdr;
+  }
+
+  return hdr;
+}
+
+/// The headers that can be parsed lazily, with their typed and lazy parsers.
+struct lazy_hdr_parsers
+{
+  const char* name;
+  pjsip_parse_hdr_func* parser;
+  pjsip_parse_hdr_func* lazy_parser;
+};
+
+static const lazy_hdr_parsers LAZY_CHARGING_HDRS[] =
+{
+  {"P-Charging-Vector",
+   &parse_hdr_p_charging_vector,
+   &parse_hdr_p_charging_vector_lazy},
+  {"P-Charging-Function-Addresses",
+   &parse_hdr_p_charging_function_addresses,
+   &parse_hdr_p_charging_function_addresses_lazy},
+};
+
+static bool lazy_charging_hdrs = false;
+
+pj_status_t set_lazy_charging_headers(bool lazy)
+{
+  pj_status_t status = PJ_SUCCESS;
+
+  if (lazy != lazy_charging_hdrs)
+  {
+    for (size_t ii = 0;
+         ii < sizeof(LAZY_CHARGING_HDRS) / sizeof(LAZY_CHARGING_HDRS[0]);
+         ++ii)
+    {
+      const lazy_hdr_parsers& hdr = LAZY_CHARGING_HDRS[ii];
+      pjsip_unregister_hdr_parser(hdr.name,
+                                  NULL,
+                                  lazy ? hdr.parser : hdr.lazy_parser);
+      status = pjsip_register_hdr_parser(hdr.name,
+                                         NULL,
+                                         lazy ? hdr.lazy_parser : hdr.parser);
+      PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
+    }
+
+    lazy_charging_hdrs = lazy;
+  }
+
+  return status;
+}
+
 /// Register all of our custom header parsers with pjSIP.  This should be
 // called once during startup.
 pj_status_t register_custom_headers()
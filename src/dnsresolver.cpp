@@ -29,7 +29,8 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
                          _trail(0),
                          _domain(""),
                          _status(ARES_SUCCESS),
-                         _naptr_reply(NULL)
+                         _naptr_reply(NULL),
+                         _ttl(0)
 {
   // Set options to ensure we always get a response as quickly as possible -
   // we are on the call path!
@@ -104,19 +105,21 @@ void DNSResolver::destroy(DNSResolver* resolver)
 }
 
 
-int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
   send_naptr_query(domain, trail);
   wait_for_response();
 
   // Save off the results...
   naptr_reply = _naptr_reply;
+  ttl = _ttl;
   int status = _status;
   // ...and then clear out our state.
   _trail = 0;
   _domain = "";
   _naptr_reply = NULL;
   _status = ARES_SUCCESS;
+  _ttl = 0;
 
   return status;
 }
@@ -231,6 +234,7 @@ void DNSResolver::ares_callback(int status,
                                 int alen)
 {
   _status = status;
+  _ttl = 0;
   if (status == ARES_SUCCESS)
   {
     // Log that we've succeeded.
@@ -245,9 +249,20 @@ void DNSResolver::ares_callback(int status,
     {
       TRC_WARNING("Unparseable DNS ENUM response from host %s: %s", _domain.c_str(), ares_strerror(status));
     }
+    else
+    {
+      _ttl = get_ttl(abuf, alen, false);
+    }
   }
   else
   {
+    if ((status == ARES_ENOTFOUND) && (abuf != NULL))
+    {
+      // The domain doesn't exist (or has no NAPTR records).  This can be
+      // cached for the time given by the SOA record (RFC 2308).
+      _ttl = get_ttl(abuf, alen, true);
+    }
+
     // Log that we've failed.
     TRC_WARNING("DNS ENUM query failed for host %s: %s", _domain.c_str(), ares_strerror(status));
     SAS::Event event(_trail, SASEvent::RX_ENUM_ERR, 0);
@@ -259,6 +274,113 @@ void DNSResolver::ares_callback(int status,
 }
 
 
+// Reads a 16-bit or 32-bit big-endian value from a DNS message.
+static inline unsigned int dns_read16(const unsigned char* p)
+{
+  return ((unsigned int)p[0] << 8) | (unsigned int)p[1];
+}
+
+static inline unsigned int dns_read32(const unsigned char* p)
+{
+  return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+         ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+// Skips over a (possibly compressed) domain name in a DNS message, returning
+// a pointer to the byte after it, or NULL if the name is malformed.
+static const unsigned char* dns_skip_name(const unsigned char* p,
+                                          const unsigned char* abuf,
+                                          int alen)
+{
+  char* name = NULL;
+  long enclen = 0;
+  if (ares_expand_name(p, abuf, alen, &name, &enclen) != ARES_SUCCESS)
+  {
+    return NULL;
+  }
+  ares_free_string(name);
+  return p + enclen;
+}
+
+
+int DNSResolver::get_ttl(const unsigned char* abuf, int alen, bool negative)
+{
+  const unsigned char* end = abuf + alen;
+
+  if (alen < NS_HFIXEDSZ)
+  {
+    return 0;
+  }
+
+  unsigned int qdcount = dns_read16(abuf + 4);
+  unsigned int ancount = dns_read16(abuf + 6);
+  unsigned int nscount = dns_read16(abuf + 8);
+  const unsigned char* p = abuf + NS_HFIXEDSZ;
+
+  // Skip the question section.
+  for (unsigned int ii = 0; ii < qdcount; ii++)
+  {
+    p = dns_skip_name(p, abuf, alen);
+    if ((p == NULL) || (p + NS_QFIXEDSZ > end))
+    {
+      return 0;
+    }
+    p += NS_QFIXEDSZ;
+  }
+
+  // For a positive response, use the smallest TTL in the answer section.  For
+  // a negative response, use the smaller of the SOA record's TTL and its
+  // MINIMUM field from the authority section.
+  unsigned int num_rrs = negative ? (ancount + nscount) : ancount;
+  bool found = false;
+  unsigned int ttl = 0;
+
+  for (unsigned int ii = 0; ii < num_rrs; ii++)
+  {
+    p = dns_skip_name(p, abuf, alen);
+    if ((p == NULL) || (p + NS_RRFIXEDSZ > end))
+    {
+      return 0;
+    }
+
+    unsigned int type = dns_read16(p);
+    unsigned int rr_ttl = dns_read32(p + 4);
+    unsigned int rdlength = dns_read16(p + 8);
+    const unsigned char* rdata = p + NS_RRFIXEDSZ;
+    p = rdata + rdlength;
+    if (p > end)
+    {
+      return 0;
+    }
+
+    if (negative)
+    {
+      if ((ii < ancount) || (type != ns_t_soa))
+      {
+        continue;
+      }
+
+      // Skip the MNAME and RNAME fields to find MINIMUM, the last of the five
+      // 32-bit fields that follow them.
+      const unsigned char* soa = dns_skip_name(rdata, abuf, alen);
+      soa = (soa != NULL) ? dns_skip_name(soa, abuf, alen) : NULL;
+      if ((soa == NULL) || (soa + 20 > p))
+      {
+        return 0;
+      }
+      rr_ttl = std::min(rr_ttl, dns_read32(soa + 16));
+    }
+
+    ttl = found ? std::min(ttl, rr_ttl) : rr_ttl;
+    found = true;
+  }
+
+  // TTLs are unsigned 32-bit values, but anything with the top bit set must be
+  // treated as zero (RFC 2181).
+  return ((found) && (ttl <= 0x7FFFFFFF)) ? (int)ttl : 0;
+}
+
+
 DNSResolver* DNSResolverFactory::new_resolver(const std::vector<struct IP46Address>& servers) const
 {
   return new DNSResolver(servers);
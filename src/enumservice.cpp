@@ -15,6 +15,7 @@
 #include "json_parse_utils.h"
 #include <fstream>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -147,8 +148,7 @@ void JSONEnumService::update_enum()
 
   try
   {
-    std::vector<NumberPrefix> new_number_prefixes;
-    std::map<std::string, NumberPrefix> new_prefix_regex_map;
+    PrefixTrie<NumberPrefix> new_prefix_trie;
 
     JSON_ASSERT_CONTAINS(doc, "number_blocks");
     JSON_ASSERT_ARRAY(doc["number_blocks"]);
@@ -173,11 +173,10 @@ void JSONEnumService::update_enum()
 
         if (parse_regex_replace(regex, pfix.match, pfix.replace))
         {
-          // Create an array in order of entries in json file, and a map
-          // (automatically sorted in order of key length) so we can later
-          // match numbers to the most specific prefixes
-          new_number_prefixes.push_back(pfix);
-          new_prefix_regex_map.insert(std::make_pair(prefix, pfix));
+          // Add the prefix to the trie so we can later match numbers to the
+          // most specific prefixes.  If a prefix appears more than once, the
+          // first entry in the json file is used.
+          new_prefix_trie.insert(prefix, pfix);
           TRC_STATUS("  Adding number prefix %s, regex=%s",
                      pfix.prefix.c_str(), regex.c_str());
         }
@@ -198,8 +197,7 @@ void JSONEnumService::update_enum()
 
     // Take a write lock on the mutex in RAII style
     boost::lock_guard<boost::shared_mutex> write_lock(_number_prefixes_rw_lock);
-    _number_prefixes = new_number_prefixes;
-    _prefix_regex_map = new_prefix_regex_map;
+    _prefix_trie.swap(new_prefix_trie);
   }
   catch (JsonFormatError err)
   {
@@ -276,28 +274,24 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
 // the object.
 const JSONEnumService::NumberPrefix* JSONEnumService::prefix_match(const std::string& number) const
 {
-  // Iterate through map in reverse order (already sorted by key length during
-  // construction) to find the most specific matching prefix
-  for (std::map<std::string, NumberPrefix>::const_reverse_iterator it =
-                                                     _prefix_regex_map.rbegin();
-       it != _prefix_regex_map.rend();
-       it++)
+  // Strip the visual separators from the number once, and then walk the trie
+  // to find the most specific matching prefix.  A number without visual
+  // separators may also match a longer prefix that it is the start of.
+  std::string stripped_number = Utils::remove_visual_separators(number);
+  std::string matched_prefix;
+
+  const NumberPrefix* pfix =
+                      _prefix_trie.match(stripped_number,
+                                         (stripped_number.size() == number.size()),
+                                         &matched_prefix);
+
+  if (pfix != NULL)
   {
-    int len = std::min(number.size(), (*it).first.size());
-
-    TRC_DEBUG("Comparing first %d numbers of %s against prefix %s",
-              len, number.c_str(), (*it).first.c_str());
-
-    if (Utils::remove_visual_separators(number).
-                                      compare(0, len, (*it).first, 0, len) == 0)
-    {
-      // Found a match, so return it.
-      TRC_DEBUG("Match found");
-      return &((*it).second);
-    }
+    TRC_DEBUG("Number %s matches prefix %s",
+              number.c_str(), matched_prefix.c_str());
   }
 
-  return NULL;
+  return pfix;
 }
 
 DNSEnumService::DNSEnumService(const std::vector<std::string>& dns_servers,
@@ -306,7 +300,8 @@ DNSEnumService::DNSEnumService(const std::vector<std::string>& dns_servers,
                                CommunicationMonitor* comm_monitor) :
                                _dns_suffix(dns_suffix),
                                _resolver_factory(resolver_factory),
-                               _comm_monitor(comm_monitor)
+                               _comm_monitor(comm_monitor),
+                               _cache()
 {
   // Initialize the ares library.  This might have already been done by curl
   // but it's safe to do it twice.
@@ -388,36 +383,43 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
   // Determine the Application Unique String (AUS) from the user.  This is
   // used to form the first key, and also as the input into the regular
   // expressions.
-  std::string aus = user_to_aus(user);
-  std::string string = aus;
-  // Get the resolver to use.  This comes from thread-local data.
-  DNSResolver* resolver = get_resolver();
+  LookupState state(user_to_aus(user));
+  translate(state, trail);
+
+  return finish_lookup(user, state, trail);
+}
+
+
+void DNSEnumService::translate(LookupState& state,
+                               SAS::TrailId trail) const
+{
   // Spin round until we've finished (successfully or otherwise) or we've done
   // the maximum number of queries.
-  bool complete = false;
-  bool failed = false;
-  bool server_failed = false;
-  int dns_queries = 0;
-  while ((!complete) &&
-         (!failed) &&
-         (dns_queries < MAX_DNS_QUERIES))
+  while ((!state.complete) &&
+         (!state.failed) &&
+         (state.dns_queries < MAX_DNS_QUERIES))
   {
-    // Translate the key into a domain and issue a query for it.
-    std::string domain = key_to_domain(string);
-    struct ares_naptr_reply* naptr_reply = NULL;
-    int status = resolver->perform_naptr_query(domain, naptr_reply, trail);
+    // Translate the key into a domain, and get the rules for it - from the
+    // cache if possible, otherwise by issuing a query.
+    std::string domain = key_to_domain(state.string);
+    int status;
+    Rules rules;
+
+    if (!get_cached_rules(domain, status, rules))
+    {
+      status = query_rules(domain, rules, trail);
+      state.queried = true;
+    }
+
     if (status == ARES_SUCCESS)
     {
-      // Parse the reply into a sorted list of rules.
-      std::vector<Rule> rules;
-      parse_naptr_reply(naptr_reply, rules);
       // Now spin through the rules, looking for the first match.
       std::vector<DNSEnumService::Rule>::const_iterator rule;
-      for (rule = rules.begin();
-           rule != rules.end();
+      for (rule = rules->begin();
+           rule != rules->end();
            ++rule)
       {
-        if (rule->matches(string))
+        if (rule->matches(state.string))
         {
           // We found a match, so apply the regular expression to the AUS (not
           // the previous string - this is what ENUM mandates).  If this was a
@@ -426,13 +428,13 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
           // next key.
           try
           {
-            string = rule->replace(aus, trail);
-            complete = rule->is_terminal();
+            state.string = rule->replace(state.aus, trail);
+            state.complete = rule->is_terminal();
           }
           catch(...) // LCOV_EXCL_START Only throws if expression too complex or similar hard-to-hit conditions
           {
             TRC_ERROR("Failed to translate number with regex");
-            failed = true;
+            state.failed = true;
             // LCOV_EXCL_STOP
           }
           break;
@@ -440,34 +442,34 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
       }
       // If we didn't find a match (and so hit the end of the list), consider
       // this a failure.
-      failed = failed || (rule == rules.end());
+      state.failed = state.failed || (rule == rules->end());
     }
     else if (status == ARES_ENOTFOUND)
     {
       // Our DNS query failed, so give up, but this is not an ENUM server issue -
       // we just tried to look up an unknown name.
-      failed = true;
+      state.failed = true;
     }
     else
     {
       // Our DNS query failed. Give up, and track an ENUM server failure.
-      failed = true;
-      server_failed = true;
+      state.failed = true;
+      state.server_failed = true;
     }
 
+    state.dns_queries++;
+  }
+}
 
-    // Free off the NAPTR reply if we have one.
-    if (naptr_reply != NULL)
-    {
-      resolver->free_naptr_reply(naptr_reply);
-      naptr_reply = NULL;
-    }
 
-    dns_queries++;
-  }
+std::string DNSEnumService::finish_lookup(const std::string& user,
+                                          LookupState& state,
+                                          SAS::TrailId trail) const
+{
+  std::string string = state.string;
 
   // Log that we've finished processing (and whether it was successful or not).
-  if (complete)
+  if (state.complete)
   {
     TRC_DEBUG("Enum lookup completes: %s", string.c_str());
     SAS::Event event(trail, SASEvent::ENUM_COMPLETE, 0);
@@ -486,10 +488,11 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
   }
 
   // Report state of last communication attempt (which may potentially set/clear
-  // an associated alarm).
-  if (_comm_monitor)
+  // an associated alarm).  Lookups answered entirely from the cache don't say
+  // anything about the state of the ENUM server.
+  if ((_comm_monitor) && (state.queried))
   {
-    if (server_failed)
+    if (state.server_failed)
     {
       _comm_monitor->inform_failure();
     }
@@ -503,6 +506,108 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
 }
 
 
+bool DNSEnumService::get_cached_rules(const std::string& domain,
+                                      int& status,
+                                      Rules& rules) const
+{
+  boost::shared_lock<boost::shared_mutex> read_lock(_cache_lock);
+
+  std::unordered_map<std::string, CacheEntry>::const_iterator it =
+                                                           _cache.find(domain);
+
+  if ((it == _cache.end()) || (it->second.expiry_ms <= now_ms()))
+  {
+    return false;
+  }
+
+  TRC_DEBUG("Found cached NAPTR response for %s", domain.c_str());
+  status = it->second.status;
+  rules = it->second.rules;
+  return true;
+}
+
+
+int DNSEnumService::query_rules(const std::string& domain,
+                                Rules& rules,
+                                SAS::TrailId trail) const
+{
+  // Get the resolver to use.  This comes from thread-local data.
+  DNSResolver* resolver = get_resolver();
+  struct ares_naptr_reply* naptr_reply = NULL;
+  int ttl = 0;
+  int status = resolver->perform_naptr_query(domain, naptr_reply, ttl, trail);
+
+  // Parse the reply into a sorted list of rules.  The rules are cached in
+  // this form, so the regular expressions are only compiled once for each
+  // response.
+  std::vector<Rule>* new_rules = new std::vector<Rule>();
+  if (status == ARES_SUCCESS)
+  {
+    parse_naptr_reply(naptr_reply, *new_rules);
+  }
+  rules.reset(new_rules);
+
+  // Free off the NAPTR reply if we have one.
+  if (naptr_reply != NULL)
+  {
+    resolver->free_naptr_reply(naptr_reply);
+    naptr_reply = NULL;
+  }
+
+  // Cache successful responses, and responses saying that the domain doesn't
+  // exist, for as long as the DNS server said we could.  Other failures are
+  // never cached.
+  if (((status == ARES_SUCCESS) || (status == ARES_ENOTFOUND)) && (ttl > 0))
+  {
+    TRC_DEBUG("Caching NAPTR response for %s for %ds", domain.c_str(), ttl);
+    CacheEntry entry;
+    entry.status = status;
+    entry.rules = rules;
+    ttl = (ttl < MAX_CACHE_TTL) ? ttl : MAX_CACHE_TTL;
+    entry.expiry_ms = now_ms() + (unsigned long)ttl * 1000;
+
+    boost::lock_guard<boost::shared_mutex> write_lock(_cache_lock);
+
+    if (_cache.size() >= MAX_CACHE_ENTRIES)
+    {
+      // The cache is full.  Throw away the expired entries and, if that
+      // doesn't free up any space, start again with an empty cache.
+      unsigned long now = now_ms();
+      for (std::unordered_map<std::string, CacheEntry>::iterator it = _cache.begin();
+           it != _cache.end();)
+      {
+        if (it->second.expiry_ms <= now)
+        {
+          it = _cache.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+
+      if (_cache.size() >= MAX_CACHE_ENTRIES)
+      {
+        TRC_DEBUG("NAPTR cache is full - clearing it");
+        _cache.clear();
+      }
+    }
+
+    _cache[domain] = entry;
+  }
+
+  return status;
+}
+
+
+unsigned long DNSEnumService::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+
 std::string DNSEnumService::key_to_domain(const std::string& key) const
 {
   // First strip all non-numeric characters from the key.
@@ -615,7 +720,7 @@ std::string DNSEnumService::Rule::replace(const std::string& string, SAS::TrailI
 }
 
 
-bool DNSEnumService::Rule::compare_order_preference(DNSEnumService::Rule first, DNSEnumService::Rule second)
+bool DNSEnumService::Rule::compare_order_preference(const DNSEnumService::Rule& first, const DNSEnumService::Rule& second)
 {
   return ((first._order < second._order) ||
           ((first._order == second._order) &&
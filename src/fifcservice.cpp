@@ -11,12 +11,12 @@
 
 #include <sys/stat.h>
 #include <fstream>
+#include <memory>
 
 #include "fifcservice.h"
 #include "sprout_pd_definitions.h"
 #include "utils.h"
 #include "xml_utils.h"
-#include "rapidxml/rapidxml_print.hpp"
 
 FIFCService::FIFCService(Alarm* alarm,
                          std::string configuration):
@@ -32,7 +32,7 @@ FIFCService::FIFCService(Alarm* alarm,
 FIFCService::~FIFCService()
 {
   delete _updater; _updater = NULL;
-  _fallback_ifcs.clear();
+  _fallback_ifcs.reset();
   delete _alarm; _alarm = NULL;
 }
 
@@ -68,8 +68,10 @@ void FIFCService::update_fifcs()
     return;
   }
 
-  // Now parse the document.
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
+  // Now parse the document.  The document is kept as part of the new version
+  // of the fallback iFCs, as the iFCs refer into it.
+  std::shared_ptr<rapidxml::xml_document<> > root =
+                                 std::make_shared<rapidxml::xml_document<> >();
 
   // Check the file contains valid xml.
   try
@@ -83,7 +85,6 @@ void FIFCService::update_fifcs()
               err.what());
     CL_SPROUT_FIFC_FILE_INVALID_XML.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
@@ -94,19 +95,16 @@ void FIFCService::update_fifcs()
               "invalid (missing FallbackIFCsSet block)");
     CL_SPROUT_FIFC_FILE_MISSING_FALLBACK_IFCS_SET.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
   // If we have reached this point, we are definitely going to update the current
-  // fallback ifc list.
-  // Take a lock while we do so.
-  boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
+  // fallback ifc list.  Build the new version without any lock held - calls
+  // carry on using the current version until the new one is swapped in below.
   bool any_errors = false;
-  _fallback_ifcs.clear();
 
   // Parse any iFCs that are present.
-  std::multimap<int32_t, std::string> ifc_map;
+  std::multimap<int32_t, Ifc> ifc_map;
   rapidxml::xml_node<>* fifc_set = root->first_node(FIFCService::FALLBACK_IFCS_SET);
   rapidxml::xml_node<>* ifc = NULL;
   for (ifc = fifc_set->first_node(RegDataXMLUtils::IFC);
@@ -133,20 +131,21 @@ void FIFCService::update_fifcs()
       }
     }
     // Creating the iFC always passes, and the iFC isn't validated any
-    // further at this stage.
-    std::string ifc_str;
-    rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-    ifc_map.insert(std::make_pair(priority, ifc_str));
+    // further at this stage.  This compiles the iFC now, rather than on the
+    // first call that uses it.
+    ifc_map.insert(std::make_pair(priority, Ifc(ifc, root)));
   }
 
-  std::vector<std::string> ifcs_vec;
-  for (std::pair<int32_t, std::string> ifc_pair : ifc_map)
+  std::shared_ptr<FallbackIfcs> new_fallback_ifcs = std::make_shared<FallbackIfcs>();
+  new_fallback_ifcs->doc = root;
+  for (const std::pair<int32_t, Ifc>& ifc_pair : ifc_map)
   {
-    ifcs_vec.push_back(ifc_pair.second);
+    new_fallback_ifcs->ifcs.push_back(ifc_pair.second);
   }
 
-  TRC_DEBUG("Adding %lu fallback iFC(s)", ifcs_vec.size());
-  _fallback_ifcs = ifcs_vec;
+  TRC_DEBUG("Adding %lu fallback iFC(s)", new_fallback_ifcs->ifcs.size());
+  std::atomic_store(&_fallback_ifcs,
+                    std::shared_ptr<const FallbackIfcs>(new_fallback_ifcs));
 
   if (any_errors)
   {
@@ -157,22 +156,22 @@ void FIFCService::update_fifcs()
     clear_alarm();
   }
 
-  delete root; root = NULL;
   return;
 }
 
-std::vector<Ifc> FIFCService::get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const
+std::vector<Ifc> FIFCService::get_fallback_ifcs() const
 {
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_sets_rw_lock);
+  // Take a reference to the current version of the fallback iFCs.  The
+  // returned iFCs keep the configuration they came from alive, so stay valid
+  // if the configuration is reloaded.
+  std::shared_ptr<const FallbackIfcs> fallback_ifcs = std::atomic_load(&_fallback_ifcs);
 
-  std::vector<Ifc> ifc_vec;
-  for (std::string ifc : _fallback_ifcs)
+  if (!fallback_ifcs)
   {
-    ifc_vec.push_back(Ifc(ifc, ifc_doc));
+    return std::vector<Ifc>();
   }
 
-  return ifc_vec;
+  return fallback_ifcs->ifcs;
 }
 
 void FIFCService::set_alarm()
@@ -27,13 +27,25 @@ extern "C" {
 #include "flowtable.h"
 
 FlowTable::FlowTable(QuiescingManager* qm, SNMP::U32Scalar* connection_count) :
-  _tp2flow_map(),
-  _tk2flow_map(),
+  _tp2flow_shards(),
+  _tk2flow_shards(),
+  _flow_count(0),
   _conn_count(connection_count),
   _quiescing(false),
   _qm(qm)
 {
-  pthread_mutex_init(&_flow_map_lock, NULL);
+  for (int ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    AddressShard* address_shard = new AddressShard();
+    pthread_mutex_init(&address_shard->lock, NULL);
+    _tp2flow_shards.push_back(address_shard);
+
+    TokenShard* token_shard = new TokenShard();
+    pthread_mutex_init(&token_shard->lock, NULL);
+    _tk2flow_shards.push_back(token_shard);
+  }
+
+  pthread_mutex_init(&_quiesce_lock, NULL);
   report_flow_count();
 }
 
@@ -41,14 +53,42 @@ FlowTable::FlowTable(QuiescingManager* qm, SNMP::U32Scalar* connection_count) :
 FlowTable::~FlowTable()
 {
   // Delete all the existing flows.
-  for (std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.begin();
-       i != _tp2flow_map.end();
-       ++i)
+  for (std::vector<AddressShard*>::iterator shard = _tp2flow_shards.begin();
+       shard != _tp2flow_shards.end();
+       ++shard)
+  {
+    for (std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = (*shard)->flows.begin();
+         i != (*shard)->flows.end();
+         ++i)
+    {
+      delete i->second;
+    }
+
+    pthread_mutex_destroy(&(*shard)->lock);
+    delete *shard;
+  }
+
+  for (std::vector<TokenShard*>::iterator shard = _tk2flow_shards.begin();
+       shard != _tk2flow_shards.end();
+       ++shard)
   {
-    delete i->second;
+    pthread_mutex_destroy(&(*shard)->lock);
+    delete *shard;
   }
 
-  pthread_mutex_destroy(&_flow_map_lock);
+  pthread_mutex_destroy(&_quiesce_lock);
+}
+
+
+FlowTable::AddressShard& FlowTable::address_shard(const FlowKey& key)
+{
+  return *_tp2flow_shards[key.hash() % _tp2flow_shards.size()];
+}
+
+
+FlowTable::TokenShard& FlowTable::token_shard(const std::string& token)
+{
+  return *_tk2flow_shards[std::hash<std::string>()(token) % _tk2flow_shards.size()];
 }
 
 
@@ -58,41 +98,49 @@ Flow* FlowTable::find_create_flow(pjsip_transport* transport, const pj_sockaddr*
 {
   Flow* flow = NULL;
   FlowKey key(transport->key.type, raddr);
+  AddressShard& shard = address_shard(key);
 
   char buf[100];
   TRC_DEBUG("Find or create flow for transport %s (%d), remote address %s",
             transport->obj_name, transport->key.type,
             pj_sockaddr_print(raddr, buf, sizeof(buf), 3));
 
-  pthread_mutex_lock(&_flow_map_lock);
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.flows.find(key);
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
+  if ((i != shard.flows.end()) && (i->second->inc_ref_if_live()))
+  {
+    // Found a matching flow, so return this one.
+    flow = i->second;
 
-  if (i == _tp2flow_map.end())
+    TRC_DEBUG("Found flow record %p", flow);
+  }
+  else
   {
-    // No matching flow, so create a new one.
+    // No matching flow (or only one that is being removed), so create a new
+    // one.
     flow = new Flow(this, transport, raddr);
 
-    // Add the new flow to the maps.
-    _tp2flow_map.insert(std::make_pair(key, flow));
-    _tk2flow_map.insert(std::make_pair(flow->token(), flow));
+    // Add the new flow to the maps, replacing any flow that is being removed.
+    shard.flows[key] = flow;
+
+    TokenShard& tk_shard = token_shard(flow->token());
+    pthread_mutex_lock(&tk_shard.lock);
+    tk_shard.flows.insert(std::make_pair(flow->token(), flow));
+    pthread_mutex_unlock(&tk_shard.lock);
+
+    ++_flow_count;
 
     TRC_DEBUG("Added flow record %p", flow);
 
     report_flow_count();
-  }
-  else
-  {
-    // Found a matching flow, so return this one.
-    flow = i->second;
 
-    TRC_DEBUG("Found flow record %p", flow);
+    // Add a reference to the flow.
+    flow->inc_ref();
   }
 
-  // Add a reference to the flow.
-  flow->inc_ref();
-
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_mutex_unlock(&shard.lock);
 
   return flow;
 }
@@ -104,28 +152,27 @@ Flow* FlowTable::find_flow(pjsip_transport* transport, const pj_sockaddr* raddr)
 {
   Flow* flow = NULL;
   FlowKey key(transport->key.type, raddr);
+  AddressShard& shard = address_shard(key);
 
   char buf[100];
   TRC_DEBUG("Find flow for transport %s (%d), remote address %s",
             transport->obj_name, transport->key.type,
             pj_sockaddr_print(raddr, buf, sizeof(buf), 3));
 
-  pthread_mutex_lock(&_flow_map_lock);
+  pthread_mutex_lock(&shard.lock);
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
+  std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.flows.find(key);
 
-  if (i != _tp2flow_map.end())
+  // Increment the reference count on the flow, unless it is being removed.
+  if ((i != shard.flows.end()) && (i->second->inc_ref_if_live()))
   {
     // Found a matching flow, so return this one.
     flow = i->second;
 
-    // Increment the reference count on the flow.
-    flow->inc_ref();
-
     TRC_DEBUG("Found flow record %p", flow);
   }
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_mutex_unlock(&shard.lock);
 
   return flow;
 }
@@ -135,31 +182,33 @@ Flow* FlowTable::find_flow(pjsip_transport* transport, const pj_sockaddr* raddr)
 Flow* FlowTable::find_flow(const std::string& token)
 {
   Flow* flow = NULL;
+  TokenShard& shard = token_shard(token);
 
   TRC_DEBUG("Find flow for flow token %s", token.c_str());
 
-  pthread_mutex_lock(&_flow_map_lock);
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, Flow*>::iterator i = shard.flows.find(token);
 
-  std::map<std::string, Flow*>::iterator i = _tk2flow_map.find(token);
-  if (i != _tk2flow_map.end())
+  // Add a reference to the flow, unless it is being removed.
+  if ((i != shard.flows.end()) && (i->second->inc_ref_if_live()))
   {
     // Found a flow matching the token.
     flow = i->second;
 
-    // Add a reference to the flow.
-    flow->inc_ref();
-
     TRC_DEBUG("Found flow record %p", flow);
   }
 
-  pthread_mutex_unlock(&_flow_map_lock);
+  pthread_mutex_unlock(&shard.lock);
 
   return flow;
 }
 
 void FlowTable::check_quiescing_state()
 {
-  if (_tp2flow_map.empty() && is_quiescing() && (_qm != NULL))
+  pthread_mutex_lock(&_quiesce_lock);
+
+  if ((_flow_count == 0) && is_quiescing() && (_qm != NULL))
   {
     TRC_DEBUG("Flow map is empty and we are quiescing - start transaction-based quiescing");
     _qm->flows_gone();
@@ -167,58 +216,68 @@ void FlowTable::check_quiescing_state()
   else
   {
     TRC_DEBUG("Checked quiescing state: flow_map is %s, is_quiescing() result is %s, _qm (QuiescingManager reference) is %s",
-              _tp2flow_map.empty() ? "empty" : "not empty",
+              (_flow_count == 0) ? "empty" : "not empty",
               is_quiescing()? "true" : "false",
               (_qm == NULL) ? "NULL" : "not NULL");
   }
+
+  pthread_mutex_unlock(&_quiesce_lock);
 }
 
+/// Removes a flow whose reference count has reached zero from the flow table
+/// and deletes it.
 void FlowTable::remove_flow(Flow* flow)
 {
-  pthread_mutex_lock(&_flow_map_lock);
-
   TRC_DEBUG("Remove flow %p", flow);
 
   FlowKey key(flow->transport()->key.type, flow->remote_addr());
+  AddressShard& shard = address_shard(key);
+  TokenShard& tk_shard = token_shard(flow->token());
 
-  std::map<FlowKey, Flow*>::iterator i = _tp2flow_map.find(key);
-  if (i != _tp2flow_map.end())
-  {
-    _tp2flow_map.erase(i);
-  }
+  pthread_mutex_lock(&shard.lock);
 
-  std::map<std::string, Flow*>::iterator j = _tk2flow_map.find(flow->token());
-  if (j != _tk2flow_map.end())
+  // The address may have been taken over by a new flow since this one's
+  // reference count reached zero, so only remove the entry if it is for this
+  // flow.
+  std::unordered_map<FlowKey, Flow*, FlowKeyHash>::iterator i = shard.flows.find(key);
+  if ((i != shard.flows.end()) && (i->second == flow))
   {
-    _tk2flow_map.erase(j);
+    shard.flows.erase(i);
   }
 
+  pthread_mutex_lock(&tk_shard.lock);
+  tk_shard.flows.erase(flow->token());
+  pthread_mutex_unlock(&tk_shard.lock);
+
+  --_flow_count;
+
+  pthread_mutex_unlock(&shard.lock);
+
+  // Any thread that found the flow before it was removed did so with one of
+  // the shard locks held, and won't have taken a reference, so the flow can
+  // now be deleted.
   report_flow_count();
 
   delete flow;
 
   check_quiescing_state();
-
-  pthread_mutex_unlock(&_flow_map_lock);
 }
 
 void FlowTable::report_flow_count()
 {
-  TRC_DEBUG("Reporting current flow count: %d", _tp2flow_map.size());
-  _conn_count->value = _tp2flow_map.size();
+  long flow_count = _flow_count.load();
+  TRC_DEBUG("Reporting current flow count: %ld", flow_count);
+  _conn_count->value = flow_count;
 }
 
 void FlowTable::quiesce()
 {
   TRC_DEBUG("FlowTable was kicked to quiesce");
   _quiescing = true;
-  pthread_mutex_lock(&_flow_map_lock);
 
   // If we have no flows, quiesce now - otherwise we do this in
   // remove_flow when the last flow disappears
   check_quiescing_state();
-
-  pthread_mutex_unlock(&_flow_map_lock);
 }
 
 void FlowTable::unquiesce()
@@ -566,12 +625,37 @@ void Flow::restart_timer(int id, int timeout)
 }
 
 
-/// Increment the reference count on the flow.  This is always called when
-/// the flowtable lock is held, so no need to lock.
+/// Increment the reference count on a flow that is known to be live (i.e.
+/// a flow that has just been created).
 void Flow::inc_ref()
 {
-  ++_refs;
-  TRC_DEBUG("Dialog count now %d for flow %s", _refs, _default_id.c_str());
+  int refs = ++_refs;
+  TRC_DEBUG("Dialog count now %d for flow %s", refs, _default_id.c_str());
+}
+
+
+/// Increment the reference count on a flow found in the flow table, unless
+/// the count has already reached zero (in which case the flow is about to be
+/// removed and must not be used).  This is always called with the relevant
+/// flow table shard lock held.
+///
+/// @returns true if a reference was taken.
+bool Flow::inc_ref_if_live()
+{
+  int refs = _refs.load();
+
+  do
+  {
+    if (refs == 0)
+    {
+      TRC_DEBUG("Flow %p is being removed", this);
+      return false;
+    }
+  }
+  while (!_refs.compare_exchange_weak(refs, refs + 1));
+
+  TRC_DEBUG("Dialog count now %d for flow %s", refs + 1, _default_id.c_str());
+  return true;
 }
 
 
@@ -579,17 +663,15 @@ void Flow::inc_ref()
 /// to zero.
 void Flow::dec_ref()
 {
-  pthread_mutex_lock(&_flow_table->_flow_map_lock);
+  int refs = --_refs;
 
-  if ((--_refs) == 0)
+  if (refs == 0)
   {
-    pthread_mutex_unlock(&_flow_table->_flow_map_lock);
     _flow_table->remove_flow(this);
   }
   else
   {
-    TRC_DEBUG("Dialog count now %d for flow %s", _refs, _default_id.c_str());
-    pthread_mutex_unlock(&_flow_table->_flow_map_lock);
+    TRC_DEBUG("Dialog count now %d for flow %s", refs, _default_id.c_str());
   }
 }
 
@@ -416,6 +416,13 @@ HTTPCode DeregistrationTask::handle_request()
        it!=_bindings.end();
        ++it)
   {
+    // The subscriber's registration has changed, so any subscriber data we
+    // have cached is out of date.
+    if (_cfg->_hss != NULL)
+    {
+      _cfg->_hss->invalidate_cached_data(it->first);
+    }
+
     AoRPair* aor_pair = deregister_bindings(_cfg->_sdm,
                                             _cfg->_hss,
                                             _cfg->_fifc_service,
@@ -950,6 +957,22 @@ HTTPCode PushProfileTask::update_associated_uris(SAS::TrailId trail)
 {
   HTTPCode rc = HTTP_OK;
   bool all_bindings_expired = false;
+
+  // The subscriber's profile has changed, so any subscriber data we have
+  // cached for the implicit registration set is out of date.
+  if (_cfg->_hss != NULL)
+  {
+    _cfg->_hss->invalidate_cached_data(_default_public_id);
+
+    std::vector<std::string> uris = _associated_uris.get_all_uris();
+    for (std::vector<std::string>::iterator it = uris.begin();
+         it != uris.end();
+         ++it)
+    {
+      _cfg->_hss->invalidate_cached_data(*it);
+    }
+  }
+
   AoRPair* aor_pair = get_and_set_local_aor_data(_cfg->_sdm,
                                                  _default_public_id,
                                                  &_associated_uris,
@@ -0,0 +1,214 @@
+/**
+ * @file hss_cache.cpp  Node-wide cache of subscriber data from Homestead.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "log.h"
+#include "hss_cache.h"
+
+HSSCache::HSSCache(int ttl_s,
+                   int max_entries,
+                   SNMP::CounterTable* hits_tbl,
+                   SNMP::CounterTable* misses_tbl) :
+  _ttl_ms((unsigned long)ttl_s * 1000),
+  _max_entries_per_shard(std::max(1, max_entries / NUM_SHARDS)),
+  _shards(),
+  _hits_tbl(hits_tbl),
+  _misses_tbl(misses_tbl)
+{
+  for (int ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    Shard* shard = new Shard();
+    pthread_mutex_init(&shard->lock, NULL);
+    _shards.push_back(shard);
+  }
+}
+
+HSSCache::~HSSCache()
+{
+  for (std::vector<Shard*>::iterator it = _shards.begin();
+       it != _shards.end();
+       ++it)
+  {
+    pthread_mutex_destroy(&(*it)->lock);
+    delete *it;
+  }
+  _shards.clear();
+}
+
+std::shared_ptr<const HSSCache::Data> HSSCache::get(const std::string& public_id)
+{
+  std::shared_ptr<const Data> data;
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+    shard.entries.find(public_id);
+
+  if (it != shard.entries.end())
+  {
+    if (it->second->expiry_ms > now_ms())
+    {
+      // Move the entry to the front of the LRU list.
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+      data = it->second->data;
+    }
+    else
+    {
+      TRC_DEBUG("Cached HSS data for %s has expired", public_id.c_str());
+      shard.lru.erase(it->second);
+      shard.entries.erase(it);
+    }
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+
+  if (data)
+  {
+    TRC_DEBUG("Found cached HSS data for %s", public_id.c_str());
+    if (_hits_tbl != NULL)
+    {
+      _hits_tbl->increment();
+    }
+  }
+  else
+  {
+    if (_misses_tbl != NULL)
+    {
+      _misses_tbl->increment();
+    }
+  }
+
+  return data;
+}
+
+uint64_t HSSCache::generation(const std::string& public_id)
+{
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+  uint64_t generation = shard.generation;
+  pthread_mutex_unlock(&shard.lock);
+
+  return generation;
+}
+
+bool HSSCache::put(const std::string& public_id,
+                   const Data& data,
+                   uint64_t generation)
+{
+  Entry entry;
+  entry.public_id = public_id;
+  entry.data = std::make_shared<const Data>(data);
+  entry.irs = AssociatedURIs(data.associated_uris).get_all_uris();
+  entry.expiry_ms = now_ms() + _ttl_ms;
+
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+
+  if (shard.generation != generation)
+  {
+    pthread_mutex_unlock(&shard.lock);
+    TRC_DEBUG("Not caching HSS data for %s - it may have been invalidated since it was fetched",
+              public_id.c_str());
+    return false;
+  }
+
+  std::vector<std::string> irs = remove_entry(shard, public_id);
+  shard.lru.push_front(entry);
+  shard.entries[public_id] = shard.lru.begin();
+
+  while (shard.lru.size() > _max_entries_per_shard)
+  {
+    TRC_DEBUG("Evicting cached HSS data for %s",
+              shard.lru.back().public_id.c_str());
+    shard.entries.erase(shard.lru.back().public_id);
+    shard.lru.pop_back();
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+
+  // The subscriber's data may have changed, so drop the rest of the implicit
+  // registration set that was cached with the old data.
+  invalidate_irs(irs, public_id);
+
+  return true;
+}
+
+void HSSCache::invalidate(const std::string& public_id)
+{
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+  std::vector<std::string> irs = remove_entry(shard, public_id);
+  shard.generation++;
+  pthread_mutex_unlock(&shard.lock);
+
+  TRC_DEBUG("Invalidating cached HSS data for %s (implicit registration set of %d)",
+            public_id.c_str(), (int)irs.size());
+
+  invalidate_irs(irs, public_id);
+}
+
+void HSSCache::invalidate_irs(const std::vector<std::string>& irs,
+                              const std::string& public_id)
+{
+  // The rest of the implicit registration set is in other shards, so is
+  // removed one at a time rather than holding several shard locks at once.
+  for (std::vector<std::string>::const_iterator it = irs.begin();
+       it != irs.end();
+       ++it)
+  {
+    if (*it != public_id)
+    {
+      Shard& irs_shard = get_shard(*it);
+      pthread_mutex_lock(&irs_shard.lock);
+      remove_entry(irs_shard, *it);
+      irs_shard.generation++;
+      pthread_mutex_unlock(&irs_shard.lock);
+    }
+  }
+}
+
+HSSCache::Shard& HSSCache::get_shard(const std::string& public_id)
+{
+  return *_shards[std::hash<std::string>()(public_id) % _shards.size()];
+}
+
+std::vector<std::string> HSSCache::remove_entry(Shard& shard,
+                                                const std::string& public_id)
+{
+  std::vector<std::string> irs;
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+    shard.entries.find(public_id);
+
+  if (it != shard.entries.end())
+  {
+    irs = it->second->irs;
+    shard.lru.erase(it->second);
+    shard.entries.erase(it);
+  }
+
+  return irs;
+}
+
+unsigned long HSSCache::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
@@ -46,6 +46,7 @@ HSSConnection::HSSConnection(const std::string& server,
                              SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                              CommunicationMonitor* comm_monitor,
                              SIFCService* sifc_service,
+                             HSSCache* cache,
                              long homestead_timeout_ms) :
   _http(new HttpConnection(server,
                            false,
@@ -63,8 +64,11 @@ HSSConnection::HSSConnection(const std::string& server,
   _sar_latency_tbl(homestead_sar_latency_tbl),
   _uar_latency_tbl(homestead_uar_latency_tbl),
   _lir_latency_tbl(homestead_lir_latency_tbl),
-  _sifc_service(sifc_service)
+  _sifc_service(sifc_service),
+  _cache(cache),
+  _in_flight()
 {
+  pthread_mutex_init(&_in_flight_lock, NULL);
 }
 
 
@@ -72,6 +76,7 @@ HSSConnection::~HSSConnection()
 {
   delete _http;
   _http = NULL;
+  pthread_mutex_destroy(&_in_flight_lock);
 }
 
 /// Get an Authentication Vector as JSON object. Caller is responsible for deleting.
@@ -147,7 +152,21 @@ HTTPCode HSSConnection::get_json_object(const std::string& path,
                                         SAS::TrailId trail)
 {
   std::string json_data;
-  HTTPCode rc = _http->send_get(path, json_data, "", trail);
+  HTTPCode rc;
+
+  if (can_coalesce_get(path))
+  {
+    rc = send_coalesced("GET " + path,
+                        [this, &path, trail](std::string& rsp)
+                        {
+                          return _http->send_get(path, rsp, "", trail);
+                        },
+                        json_data);
+  }
+  else
+  {
+    rc = _http->send_get(path, json_data, "", trail);
+  }
 
   if (rc == HTTP_OK)
   {
@@ -207,12 +226,22 @@ HTTPCode HSSConnection::put_for_xml_object(const std::string& path,
     req_headers.push_back("Cache-control: no-cache");
   }
 
-  HTTPCode http_code = _http->send_put(path,
-                                       rsp_headers,
-                                       raw_data,
-                                       body,
-                                       req_headers,
-                                       trail);
+  std::function<HTTPCode(std::string&)> send =
+    [this, &path, &rsp_headers, &body, &req_headers, trail](std::string& rsp)
+    {
+      return _http->send_put(path, rsp_headers, rsp, body, req_headers, trail);
+    };
+  HTTPCode http_code;
+
+  if (can_coalesce_put(body))
+  {
+    std::string key = "PUT " + path + (cache_allowed ? "" : " no-cache") + "\n" + body;
+    http_code = send_coalesced(key, send, raw_data);
+  }
+  else
+  {
+    http_code = send(raw_data);
+  }
 
   if (http_code == HTTP_OK)
   {
@@ -230,7 +259,12 @@ HTTPCode HSSConnection::get_xml_object(const std::string& path,
 {
   std::string raw_data;
 
-  HTTPCode http_code = _http->send_get(path, raw_data, "", trail);
+  HTTPCode http_code = send_coalesced("GET " + path,
+                                      [this, &path, trail](std::string& rsp)
+                                      {
+                                        return _http->send_get(path, rsp, "", trail);
+                                      },
+                                      raw_data);
 
   if (http_code == HTTP_OK)
   {
@@ -241,6 +275,74 @@ HTTPCode HSSConnection::get_xml_object(const std::string& path,
 }
 
 
+HTTPCode HSSConnection::send_coalesced(const std::string& key,
+                                       const std::function<HTTPCode(std::string&)>& send,
+                                       std::string& response)
+{
+  pthread_mutex_lock(&_in_flight_lock);
+
+  std::unordered_map<std::string, std::shared_ptr<InFlightRequest> >::iterator it =
+    _in_flight.find(key);
+
+  if (it != _in_flight.end())
+  {
+    // An identical request is already in progress, so wait for its response.
+    std::shared_ptr<InFlightRequest> request = it->second;
+    TRC_DEBUG("Waiting for in-progress Homestead request: %s", key.c_str());
+    ++request->waiters;
+
+    while (!request->complete)
+    {
+      pthread_cond_wait(&request->cond, &_in_flight_lock);
+    }
+
+    HTTPCode http_code = request->http_code;
+    response = request->response;
+    pthread_mutex_unlock(&_in_flight_lock);
+    return http_code;
+  }
+
+  std::shared_ptr<InFlightRequest> request = std::make_shared<InFlightRequest>();
+  _in_flight[key] = request;
+  pthread_mutex_unlock(&_in_flight_lock);
+
+  HTTPCode http_code = send(response);
+
+  pthread_mutex_lock(&_in_flight_lock);
+  _in_flight.erase(key);
+  request->http_code = http_code;
+  request->complete = true;
+
+  if (request->waiters > 0)
+  {
+    TRC_DEBUG("Sharing Homestead response with %d other requests",
+              request->waiters);
+    request->response = response;
+    pthread_cond_broadcast(&request->cond);
+  }
+
+  pthread_mutex_unlock(&_in_flight_lock);
+
+  return http_code;
+}
+
+
+bool HSSConnection::can_coalesce_get(const std::string& path)
+{
+  // Private identities are escaped in the path, so can't contain a "/".
+  std::string resource = path.substr(0, path.find('?'));
+  return !((resource.compare(0, 6, "/impi/") == 0) &&
+           (resource.find("/av") != std::string::npos));
+}
+
+
+bool HSSConnection::can_coalesce_put(const std::string& body)
+{
+  static const std::string CALL_PREFIX = "{\"reqtype\": \"" + CALL + "\"";
+  return (body.compare(0, CALL_PREFIX.size(), CALL_PREFIX) == 0);
+}
+
+
 bool compare_charging_addrs(const rapidxml::xml_node<>* ca1,
                             const rapidxml::xml_node<>* ca2)
 {
@@ -539,6 +641,29 @@ HTTPCode HSSConnection::update_registration_state(const std::string& public_user
   event.add_var_param(type);
   SAS::report_event(event);
 
+  // Calls don't change the subscriber's state on Homestead, so can be served
+  // from the cache (unless the caller wants up to date data).
+  if ((_cache != NULL) &&
+      (type == CALL) &&
+      (cache_allowed) &&
+      (wildcard.empty()))
+  {
+    std::shared_ptr<const HSSCache::Data> data = _cache->get(public_user_identity);
+
+    if (data)
+    {
+      TRC_DEBUG("Using cached subscriber data for %s",
+                public_user_identity.c_str());
+      regstate = data->regstate;
+      ifcs_map = data->service_profiles;
+      associated_uris = data->associated_uris;
+      aliases = data->aliases;
+      ccfs = data->ccfs;
+      ecfs = data->ecfs;
+      return HTTP_OK;
+    }
+  }
+
   std::string path = "/impu/" + Utils::url_escape(public_user_identity) + "/reg-data";
   if (!private_user_identity.empty())
   {
@@ -550,6 +675,12 @@ HTTPCode HSSConnection::update_registration_state(const std::string& public_user
   // to it, so we want to delete the underlying document when they all go out
   // of scope.
 
+  // Note the cache generation before querying Homestead, so that the response
+  // isn't cached if the subscriber's data is invalidated while the request is
+  // in progress.
+  uint64_t cache_generation = (_cache != NULL) ?
+                              _cache->generation(public_user_identity) : 0;
+
   rapidxml::xml_document<>* root_underlying_ptr = NULL;
   std::string json_wildcard =
         (wildcard != "") ? ", \"wildcard_identity\": \"" + wildcard + "\"" : "";
@@ -582,20 +713,61 @@ HTTPCode HSSConnection::update_registration_state(const std::string& public_user
     // the subscriber on the HSS or been unable to communicate with
     // the HSS successfully. In either case we should fail.
     TRC_ERROR("Could not get subscriber data from HSS");
+
+    if ((_cache != NULL) && (type != CALL) && (type != REG))
+    {
+      // This is a deregistration, so the cached data is out of date even if
+      // the request failed.
+      _cache->invalidate(public_user_identity);
+    }
+
     return http_code;
   }
 
-  return decode_homestead_xml(public_user_identity,
-                              root,
-                              regstate,
-                              ifcs_map,
-                              associated_uris,
-                              aliases,
-                              ccfs,
-                              ecfs,
-                              _sifc_service,
-                              false,
-                              trail) ? HTTP_OK : HTTP_SERVER_ERROR;
+  bool decoded = decode_homestead_xml(public_user_identity,
+                                      root,
+                                      regstate,
+                                      ifcs_map,
+                                      associated_uris,
+                                      aliases,
+                                      ccfs,
+                                      ecfs,
+                                      _sifc_service,
+                                      false,
+                                      trail);
+
+  if (_cache != NULL)
+  {
+    if ((decoded) && ((type == CALL) || (type == REG)) && (wildcard.empty()))
+    {
+      // A registration may have changed the subscriber's data, so this
+      // replaces anything cached for the subscriber.
+      HSSCache::Data data;
+      data.regstate = regstate;
+      data.service_profiles = ifcs_map;
+      data.associated_uris = associated_uris;
+      data.aliases = aliases;
+      data.ccfs = ccfs;
+      data.ecfs = ecfs;
+      _cache->put(public_user_identity, data, cache_generation);
+    }
+    else
+    {
+      // A deregistration removes the subscriber's data, so drop anything
+      // cached for the subscriber.
+      _cache->invalidate(public_user_identity);
+    }
+  }
+
+  return decoded ? HTTP_OK : HTTP_SERVER_ERROR;
+}
+
+void HSSConnection::invalidate_cached_data(const std::string& public_user_identity)
+{
+  if (_cache != NULL)
+  {
+    _cache->invalidate(public_user_identity);
+  }
 }
 
 HTTPCode HSSConnection::get_registration_data(const std::string& public_user_identity,
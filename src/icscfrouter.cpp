@@ -35,6 +35,9 @@ ICSCFRouter::ICSCFRouter(HSSConnection* hss,
   _port(port),
   _queried_caps(false),
   _hss_rsp(),
+  _parsed_hss_rsp(false),
+  _have_query_result(false),
+  _query_result(PJSIP_SC_OK),
   _attempted_scscfs()
 {
 }
@@ -67,8 +70,25 @@ int ICSCFRouter::get_scscf(pj_pool_t* pool,
 
   if (!_queried_caps)
   {
-    // Do the HSS query.
-    status_code = hss_query();
+    // Do the HSS query, unless query_hss has already done it.
+    if (_have_query_result)
+    {
+      status_code = _query_result;
+      _have_query_result = false;
+    }
+    else
+    {
+      status_code = hss_query();
+    }
+
+    if ((_acr != NULL) && (_parsed_hss_rsp))
+    {
+      // Pass the server capabilities to the ACR for reporting.  This is done
+      // here rather than when the response is parsed, as the query may have
+      // been run off the transaction's thread.
+      _acr->server_capabilities(_hss_rsp);
+    }
+    _parsed_hss_rsp = false;
 
     if (do_billing)
     {
@@ -180,6 +200,20 @@ int ICSCFRouter::get_scscf(pj_pool_t* pool,
 }
 
 
+/// Queries the HSS, if it hasn't already been queried, and stores the result
+/// for the next call to get_scscf.  This doesn't use the PJSIP pool, and the
+/// ACR is only updated with the result by get_scscf, so it is safe to run off
+/// the transaction's thread.
+void ICSCFRouter::query_hss()
+{
+  if ((!_queried_caps) && (!_have_query_result))
+  {
+    _query_result = hss_query();
+    _have_query_result = true;
+  }
+}
+
+
 /// Parses the response from the HSS.
 int ICSCFRouter::parse_hss_response(rapidjson::Document*& rsp, bool queried_caps)
 {
@@ -267,11 +301,8 @@ int ICSCFRouter::parse_hss_response(rapidjson::Document*& rsp, bool queried_caps
   // the HSS decided to return capabilities anyway.
   _queried_caps = (status_code == PJSIP_SC_OK) ? queried_caps : false;
 
-  if (_acr != NULL)
-  {
-    // Pass the server capabilities to the ACR for reporting.
-    _acr->server_capabilities(_hss_rsp);
-  }
+  // Record that there are server capabilities to pass to the ACR.
+  _parsed_hss_rsp = true;
 
   return status_code;
 }
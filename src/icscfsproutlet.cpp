@@ -118,18 +118,6 @@ ACR* ICSCFSproutlet::get_acr(SAS::TrailId trail)
                                ACR::NODE_ROLE_TERMINATING);
 }
 
-/// Translates a Tel URI to a SIP URI (if ENUM is enabled).
-void ICSCFSproutlet::translate_request_uri(pjsip_msg* req,
-                                           pj_pool_t* pool,
-                                           SAS::TrailId trail)
-{
-  PJUtils::translate_request_uri(req,
-                                 pool,
-                                 _enum_service,
-                                 should_override_npdi(),
-                                 trail);
-}
-
 /*****************************************************************************/
 /* REGISTER handling.                                                        */
 /*****************************************************************************/
@@ -139,7 +127,9 @@ ICSCFSproutletRegTsx::ICSCFSproutletRegTsx(ICSCFSproutlet* icscf) :
   SproutletTsx(icscf),
   _icscf(icscf),
   _acr(NULL),
-  _router(NULL)
+  _router(NULL),
+  _pending_req(NULL),
+  _pending_rsp(NULL)
 {
 }
 
@@ -263,6 +253,34 @@ void ICSCFSproutletRegTsx::on_rx_initial_request(pjsip_msg* req)
                                             auth_type,
                                             emergency);
 
+  // Query the HSS without holding up this thread, and pick an S-CSCF when
+  // the query completes.
+  query_hss(req);
+}
+
+
+void ICSCFSproutletRegTsx::query_hss(pjsip_msg* req)
+{
+  ICSCFRouter* router = _router;
+  _pending_req = req;
+  run_async([router]() { router->query_hss(); }, NULL);
+}
+
+
+void ICSCFSproutletRegTsx::on_async_complete(void* context)
+{
+  pjsip_msg* req = _pending_req;
+  pjsip_msg* rsp = _pending_rsp;
+  _pending_req = NULL;
+  _pending_rsp = NULL;
+
+  if (rsp != NULL)
+  {
+    // This query was for a retry to an alternate S-CSCF.
+    retry_request(req, rsp);
+    return;
+  }
+
   // We have a router, query it for an S-CSCF to use.
   pjsip_sip_uri* scscf_sip_uri = NULL;
   std::string dummy_wildcard;
@@ -339,55 +357,62 @@ void ICSCFSproutletRegTsx::on_rx_response(pjsip_msg* rsp, int fork_id)
     event.add_var_param(st_code);
     SAS::report_event(event);
 
-    // Now we can simply reuse the UA router we made on the initial request.
-    pjsip_sip_uri* scscf_sip_uri = NULL;
-    pjsip_msg* req = original_request();
-    std::string wildcard;
-    int status_code = _router->get_scscf(get_pool(req), scscf_sip_uri, wildcard);
+    // Now we can simply reuse the UA router we made on the initial request,
+    // querying the HSS again (if required) without holding up this thread.
+    _pending_rsp = rsp;
+    query_hss(original_request());
+  }
+  else
+  {
+    // Provisional, successful or non-retryable response, simply forward on
+    // upstream.  If this is a final response, there will be no more retries.
+    send_response(rsp);
+  }
+}
 
-    if (status_code == PJSIP_SC_OK)
-    {
-      TRC_DEBUG("Found SCSCF for REGISTER");
 
-      req->line.req.uri = (pjsip_uri*)scscf_sip_uri;
-      send_request(req);
+void ICSCFSproutletRegTsx::retry_request(pjsip_msg* req, pjsip_msg* rsp)
+{
+  pjsip_sip_uri* scscf_sip_uri = NULL;
+  std::string wildcard;
+  int status_code = _router->get_scscf(get_pool(req), scscf_sip_uri, wildcard);
 
-      // We're not forwarding this response upstream.
-      free_msg(rsp);
-    }
-    else
-    {
-      // In the register case the spec's are quite particular about how
-      // failures are reported.
-      if (status_code == PJSIP_SC_FORBIDDEN)
-      {
-        // The HSS has returned a negative response to the user registration
-        // request - I-CSCF should respond with 403.
-        rsp->line.status.code = PJSIP_SC_FORBIDDEN;
-        rsp->line.status.reason =
-          *pjsip_get_status_text(rsp->line.status.code);
-      }
-      else
-      {
-        // The I-CSCF can't select an S-CSCF for the REGISTER request (either
-        // because there are no more S-CSCFs that meet the mandatory
-        // capabilitires, or the HSS is temporarily unavailable). There was at
-        // least one valid S-CSCF (as this is retry processing). The I-CSCF
-        // must return 504 (TS 24.229, 5.3.1.3) in this case.
-        rsp->line.status.code = PJSIP_SC_SERVER_TIMEOUT;
-        rsp->line.status.reason =
-          *pjsip_get_status_text(rsp->line.status.code);
-      }
+  if (status_code == PJSIP_SC_OK)
+  {
+    TRC_DEBUG("Found SCSCF for REGISTER");
 
-      // We're done, no more retries.
-      free_msg(req);
-      send_response(rsp);
-    }
+    req->line.req.uri = (pjsip_uri*)scscf_sip_uri;
+    send_request(req);
+
+    // We're not forwarding this response upstream.
+    free_msg(rsp);
   }
   else
   {
-    // Provisional, successful or non-retryable response, simply forward on
-    // upstream.  If this is a final response, there will be no more retries.
+    // In the register case the spec's are quite particular about how
+    // failures are reported.
+    if (status_code == PJSIP_SC_FORBIDDEN)
+    {
+      // The HSS has returned a negative response to the user registration
+      // request - I-CSCF should respond with 403.
+      rsp->line.status.code = PJSIP_SC_FORBIDDEN;
+      rsp->line.status.reason =
+        *pjsip_get_status_text(rsp->line.status.code);
+    }
+    else
+    {
+      // The I-CSCF can't select an S-CSCF for the REGISTER request (either
+      // because there are no more S-CSCFs that meet the mandatory
+      // capabilitires, or the HSS is temporarily unavailable). There was at
+      // least one valid S-CSCF (as this is retry processing). The I-CSCF
+      // must return 504 (TS 24.229, 5.3.1.3) in this case.
+      rsp->line.status.code = PJSIP_SC_SERVER_TIMEOUT;
+      rsp->line.status.reason =
+        *pjsip_get_status_text(rsp->line.status.code);
+    }
+
+    // We're done, no more retries.
+    free_msg(req);
     send_response(rsp);
   }
 }
@@ -416,6 +441,12 @@ ICSCFSproutletTsx::ICSCFSproutletTsx(ICSCFSproutlet* icscf,
   _router(NULL),
   _originating(false),
   _routed_to_bgcf(false),
+  _pending_req(NULL),
+  _pending_rsp(NULL),
+  _async_op(HSS_QUERY),
+  _enum_lookups(0),
+  _scscf_status(PJSIP_SC_OK),
+  _cancelled(false),
   _req_type(req_type),
   _session_set_up(false)
 {
@@ -542,9 +573,85 @@ void ICSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
                                             impu,
                                             _originating);
 
+  // Query the HSS without holding up this thread, and route the request when
+  // the query completes.
+  query_hss(req, HSS_QUERY);
+}
+
+
+void ICSCFSproutletTsx::on_async_complete(void* context)
+{
+  pjsip_msg* req = _pending_req;
+  pjsip_msg* rsp = _pending_rsp;
+  _pending_req = NULL;
+  _pending_rsp = NULL;
+
+  if (_cancelled)
+  {
+    if (rsp != NULL)
+    {
+      // The request was cancelled while we were looking for an S-CSCF to
+      // retry it on, so just forward the failure response.
+      TRC_DEBUG("Request cancelled during HSS query, not retrying it");
+      free_msg(req);
+      send_response(rsp);
+    }
+    else
+    {
+      // The request was cancelled while we were querying the HSS or ENUM.
+      // It hasn't been forwarded, so there's no fork to cancel - just reject
+      // it.
+      TRC_DEBUG("Request cancelled during HSS or ENUM query, not routing it");
+      rsp = create_response(req, PJSIP_SC_REQUEST_TERMINATED);
+      send_response(rsp);
+      free_msg(req);
+    }
+    return;
+  }
+
+  switch (_async_op)
+  {
+  case ENUM_LOOKUP:
+    {
+      pjsip_uri* original_req_uri = req->line.req.uri;
+      PJUtils::apply_enum_translation(req,
+                                      get_pool(req),
+                                      _enum_uri,
+                                      false,
+                                      _icscf->should_override_npdi(),
+                                      trail());
+      route_translated_request(req, original_req_uri);
+    }
+    break;
+
+  case RETRY_HSS_QUERY:
+    retry_request(req, rsp);
+    break;
+
+  case HSS_QUERY:
+  case TEL_URI_HSS_QUERY:
+  case ENUM_HSS_QUERY:
+    route_to_scscf(req);
+    break;
+  }
+}
+
+
+void ICSCFSproutletTsx::query_hss(pjsip_msg* req, AsyncOp op)
+{
+  ICSCFRouter* router = _router;
+  _pending_req = req;
+  _async_op = op;
+  run_async([router]() { router->query_hss(); }, NULL);
+}
+
+
+void ICSCFSproutletTsx::route_to_scscf(pjsip_msg* req)
+{
+  pj_pool_t* pool = get_pool(req);
   pjsip_sip_uri* scscf_sip_uri = NULL;
 
-  // Use the router we just created to query the HSS for an S-CSCF to use.
+  // Use the router to pick an S-CSCF using the result of the HSS query.
   // TS 32.260 Table 5.2.1.1 says an EVENT ACR should be generated on the
   // completion of a Cx query issued in response to a SIP INVITE
   bool do_billing = (req->line.req.method.id == PJSIP_INVITE_METHOD);
@@ -555,98 +662,41 @@ void ICSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
                                           wildcard,
                                           do_billing);
 
-  if ((!_originating) && (scscf_not_found(status_code)))
+  if ((!_originating) &&
+      ((scscf_not_found(status_code)) || (_async_op == TEL_URI_HSS_QUERY)))
   {
-    TRC_DEBUG("Couldn't find an S-CSCF, attempt to translate the URI");
-    pjsip_uri* uri = PJUtils::term_served_user(req);
-    URIClass uri_class = URIClassifier::classify_uri(uri, false);
-
-    // For terminating processing, if the HSS indicates that the user does not
-    // exist, and if the request URI is a tel URI, try an ENUM translation. If
-    // this succeeds, go back to the HSS. See TS24.229, 5.3.2.1.
-    //
-    // Before doing that we should check whether the enforce_user_phone flag is
-    // set. If it isn't, and we have a numeric SIP URI, it is possible that
-    // this should have been a tel URI, so translate it and do the HSS lookup
-    // again.  Once again, only do this for global numbers.
-    if (PJSIP_URI_SCHEME_IS_SIP(uri) && (uri_class == GLOBAL_PHONE_NUMBER))
-    {
-      TRC_DEBUG("enforce_user_phone set to false, try using a tel URI");
-      uri = PJUtils::translate_sip_uri_to_tel_uri((pjsip_sip_uri*)uri, pool);
-      req->line.req.uri = uri;
-
-      // We need to change the IMPU stored on our LIR router so that when
-      // we do a new LIR we look up the new IMPU.
-      impu = PJUtils::public_id_from_uri(PJUtils::term_served_user(req));
-      ((ICSCFLIRouter *)_router)->change_impu(impu);
-      status_code = (pjsip_status_code)_router->get_scscf(pool,
-                                                          scscf_sip_uri,
-                                                          wildcard,
-                                                          do_billing);
-    }
-
-    if (_icscf->_enum_service)
+    if (_async_op == HSS_QUERY)
     {
-      // If we still haven't found an S-CSCF, we can now try an ENUM lookup.
-      // We put this processing in a loop because in theory we may go round
-      // several times before finding an S-CSCF. In reality this is unlikely
-      // so we set MAX_ENUM_LOOKUPS to 2.
-      for (int ii = 0;
-           (ii < MAX_ENUM_LOOKUPS) && (scscf_not_found(status_code));
-           ++ii)
+      TRC_DEBUG("Couldn't find an S-CSCF, attempt to translate the URI");
+      pjsip_uri* uri = PJUtils::term_served_user(req);
+      URIClass uri_class = URIClassifier::classify_uri(uri, false);
+
+      // For terminating processing, if the HSS indicates that the user does
+      // not exist, and if the request URI is a tel URI, try an ENUM
+      // translation. If this succeeds, go back to the HSS. See TS24.229,
+      // 5.3.2.1.
+      //
+      // Before doing that we should check whether the enforce_user_phone flag
+      // is set. If it isn't, and we have a numeric SIP URI, it is possible
+      // that this should have been a tel URI, so translate it and do the HSS
+      // lookup again.  Once again, only do this for global numbers.
+      if (PJSIP_URI_SCHEME_IS_SIP(uri) && (uri_class == GLOBAL_PHONE_NUMBER))
       {
-        if (PJSIP_URI_SCHEME_IS_TEL(uri))
-        {
-          // Do an ENUM lookup and see if we should translate the TEL URI
-          pjsip_uri* original_req_uri = req->line.req.uri;
-          _icscf->translate_request_uri(req, get_pool(req), trail());
-          uri = req->line.req.uri;
-          URIClass uri_class = URIClassifier::classify_uri(uri, false, true);
-
-          std::string rn;
-
-          if ((uri_class == NP_DATA) ||
-              (uri_class == FINAL_NP_DATA))
-          {
-            // We got number portability information from ENUM - drop out and route to the BGCF.
-            route_to_bgcf(req);
-            return;
-          }
-          else if (pjsip_uri_cmp(PJSIP_URI_IN_REQ_URI,
-                                 original_req_uri,
-                                 req->line.req.uri) != PJ_SUCCESS)
-          {
-            // The URI has changed, so make sure we do a LIR lookup on it.
-            impu = PJUtils::public_id_from_uri(req->line.req.uri);
-            ((ICSCFLIRouter *)_router)->change_impu(impu);
-          }
-
-          // If we successfully translate the req URI and end up with either another TEL URI or a
-          // local SIP URI, we should look for an S-CSCF again.
-          if ((uri_class == LOCAL_PHONE_NUMBER) ||
-              (uri_class == GLOBAL_PHONE_NUMBER) ||
-              (uri_class == HOME_DOMAIN_SIP_URI))
-          {
-            // TEL or local SIP URI.  Look up the S-CSCF again.
-            status_code = (pjsip_status_code)_router->get_scscf(pool,
-                                                                scscf_sip_uri,
-                                                                wildcard,
-                                                                do_billing);
-          }
-          else
-          {
-            // Number translated to off-switch.  Drop out of the loop.
-            ii = MAX_ENUM_LOOKUPS;
-          }
-        }
-        else
-        {
-          // Can't translate the number, skip to the end of the loop.
-          ii = MAX_ENUM_LOOKUPS;
-        }
+        TRC_DEBUG("enforce_user_phone set to false, try using a tel URI");
+        uri = PJUtils::translate_sip_uri_to_tel_uri((pjsip_sip_uri*)uri, pool);
+        req->line.req.uri = uri;
+
+        // We need to change the IMPU stored on our LIR router so that when
+        // we do a new LIR we look up the new IMPU.
+        std::string impu =
+          PJUtils::public_id_from_uri(PJUtils::term_served_user(req));
+        ((ICSCFLIRouter *)_router)->change_impu(impu);
+        query_hss(req, TEL_URI_HSS_QUERY);
+        return;
       }
     }
-    else
+
+    if (!_icscf->_enum_service)
     {
       // The user is not in the HSS and ENUM is not configured. TS 24.229
       // says that, as an alternative to ENUM, we can "forward the request to
@@ -657,8 +707,104 @@ void ICSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
       route_to_bgcf(req);
       return;
     }
+    else if (scscf_not_found(status_code))
+    {
+      // If we still haven't found an S-CSCF, we can now try an ENUM lookup.
+      translate_request_uri(req, status_code);
+      return;
+    }
   }
 
+  route_request(req, status_code, scscf_sip_uri, wildcard);
+}
+
+
+void ICSCFSproutletTsx::translate_request_uri(pjsip_msg* req,
+                                              pjsip_status_code status_code)
+{
+  // We may go round several times before finding an S-CSCF. In reality this
+  // is unlikely so we set MAX_ENUM_LOOKUPS to 2.
+  _scscf_status = status_code;
+
+  if ((_enum_lookups < MAX_ENUM_LOOKUPS) &&
+      (PJSIP_URI_SCHEME_IS_TEL(req->line.req.uri)))
+  {
+    ++_enum_lookups;
+    std::string user;
+
+    if (PJUtils::get_enum_user(req, false, user))
+    {
+      // Do an ENUM lookup without holding up this thread, and see if we
+      // should translate the TEL URI when it completes.
+      EnumService* enum_service = _icscf->_enum_service;
+      SAS::TrailId trail_id = trail();
+      std::string* enum_uri = &_enum_uri;
+      _pending_req = req;
+      _async_op = ENUM_LOOKUP;
+      run_async([enum_service, user, trail_id, enum_uri]()
+                {
+                  *enum_uri = PJUtils::lookup_enum_user(user,
+                                                        enum_service,
+                                                        trail_id);
+                },
+                NULL);
+    }
+    else
+    {
+      route_translated_request(req, req->line.req.uri);
+    }
+  }
+  else
+  {
+    // Can't translate the number.
+    route_request(req, status_code, NULL, "");
+  }
+}
+
+
+void ICSCFSproutletTsx::route_translated_request(pjsip_msg* req,
+                                                 pjsip_uri* original_req_uri)
+{
+  URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri, false, true);
+
+  if ((uri_class == NP_DATA) ||
+      (uri_class == FINAL_NP_DATA))
+  {
+    // We got number portability information from ENUM - drop out and route to the BGCF.
+    route_to_bgcf(req);
+    return;
+  }
+  else if (pjsip_uri_cmp(PJSIP_URI_IN_REQ_URI,
+                         original_req_uri,
+                         req->line.req.uri) != PJ_SUCCESS)
+  {
+    // The URI has changed, so make sure we do a LIR lookup on it.
+    std::string impu = PJUtils::public_id_from_uri(req->line.req.uri);
+    ((ICSCFLIRouter *)_router)->change_impu(impu);
+  }
+
+  // If we successfully translate the req URI and end up with either another TEL URI or a
+  // local SIP URI, we should look for an S-CSCF again.
+  if ((uri_class == LOCAL_PHONE_NUMBER) ||
+      (uri_class == GLOBAL_PHONE_NUMBER) ||
+      (uri_class == HOME_DOMAIN_SIP_URI))
+  {
+    // TEL or local SIP URI.  Look up the S-CSCF again.
+    query_hss(req, ENUM_HSS_QUERY);
+  }
+  else
+  {
+    // Number translated to off-switch.
+    route_request(req, _scscf_status, NULL, "");
+  }
+}
+
+
+void ICSCFSproutletTsx::route_request(pjsip_msg* req,
+                                      pjsip_status_code status_code,
+                                      pjsip_sip_uri* scscf_sip_uri,
+                                      const std::string& wildcard)
+{
   URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri);
   if (status_code == PJSIP_SC_OK)
   {
@@ -750,57 +896,64 @@ void ICSCFSproutletTsx::on_rx_response(pjsip_msg* rsp, int fork_id)
     event.add_var_param(st_code);
     SAS::report_event(event);
 
-    // Now we can simply reuse the UA router we made on the initial request.
-    pjsip_sip_uri* scscf_sip_uri = NULL;
-    pjsip_msg* req = original_request();
-    pj_pool_t* pool = get_pool(req);
-
-    // TS 32.260 Table 5.2.1.1 says an EVENT ACR should be generated on the
-    // completion of a Cx query issued in response to a SIP INVITE. It's
-    // ambiguous on whether this should be sent on each Cx query completion
-    // so we err on the side of over-sending events.
-    bool do_billing = (rsp->line.req.method.id == PJSIP_INVITE_METHOD);
-    std::string wildcard;
-    int status_code = _router->get_scscf(pool,
-                                         scscf_sip_uri,
-                                         wildcard,
-                                         do_billing);
-
-    if (status_code == PJSIP_SC_OK)
-    {
-      TRC_DEBUG("Found SCSCF for non-REGISTER");
+    // Now we can simply reuse the UA router we made on the initial request,
+    // querying the HSS again (if required) without holding up this thread.
+    _pending_rsp = rsp;
+    query_hss(original_request(), RETRY_HSS_QUERY);
+  }
+  else
+  {
+    // Provisional, successful or non-retryable response, simply forward on
+    // upstream.
+    send_response(rsp);
+  }
+}
 
-      if (_originating)
-      {
-        // Add the `orig` parameter.
-        pjsip_param* orig_param = PJ_POOL_ALLOC_T(pool, pjsip_param);
-        pj_strdup(pool, &orig_param->name, &STR_ORIG);
-        orig_param->value.slen = 0;
-        pj_list_insert_after(&scscf_sip_uri->other_param, orig_param);
-      }
 
-      // Add the P-Profile-Key header here if we've got a wildcard
-      if (wildcard != "")
-      {
-        add_p_profile_header(wildcard, req);
-      }
+void ICSCFSproutletTsx::retry_request(pjsip_msg* req, pjsip_msg* rsp)
+{
+  pjsip_sip_uri* scscf_sip_uri = NULL;
+  pj_pool_t* pool = get_pool(req);
+
+  // TS 32.260 Table 5.2.1.1 says an EVENT ACR should be generated on the
+  // completion of a Cx query issued in response to a SIP INVITE. It's
+  // ambiguous on whether this should be sent on each Cx query completion
+  // so we err on the side of over-sending events.
+  bool do_billing = (rsp->line.req.method.id == PJSIP_INVITE_METHOD);
+  std::string wildcard;
+  int status_code = _router->get_scscf(pool,
+                                       scscf_sip_uri,
+                                       wildcard,
+                                       do_billing);
 
-      PJUtils::add_route_header(req, scscf_sip_uri, pool);
-      send_request(req);
+  if (status_code == PJSIP_SC_OK)
+  {
+    TRC_DEBUG("Found SCSCF for non-REGISTER");
 
-      // We're not forwarding this response upstream.
-      free_msg(rsp);
+    if (_originating)
+    {
+      // Add the `orig` parameter.
+      pjsip_param* orig_param = PJ_POOL_ALLOC_T(pool, pjsip_param);
+      pj_strdup(pool, &orig_param->name, &STR_ORIG);
+      orig_param->value.slen = 0;
+      pj_list_insert_after(&scscf_sip_uri->other_param, orig_param);
     }
-    else
+
+    // Add the P-Profile-Key header here if we've got a wildcard
+    if (wildcard != "")
     {
-      free_msg(req);
-      send_response(rsp);
+      add_p_profile_header(wildcard, req);
     }
+
+    PJUtils::add_route_header(req, scscf_sip_uri, pool);
+    send_request(req);
+
+    // We're not forwarding this response upstream.
+    free_msg(rsp);
   }
   else
   {
-    // Provisional, successful or non-retryable response, simply forward on
-    // upstream.
+    free_msg(req);
     send_response(rsp);
   }
 }
@@ -865,6 +1018,8 @@ void ICSCFSproutletTsx::on_tx_response(pjsip_msg* rsp)
 
 void ICSCFSproutletTsx::on_rx_cancel(int status_code, pjsip_msg* cancel_req)
 {
+  _cancelled = true;
+
   // If this is cancelling a terminating INVITE then check whether we need to
   // update our session establishment stats.
   if (!_originating &&
@@ -10,7 +10,11 @@
  */
 
 #include <boost/regex.hpp>
+#include <boost/thread.hpp>
 #include <cassert>
+#include <cstring>
+#include <list>
+#include <unordered_map>
 
 extern "C" {
 #include <pjlib-util.h>
@@ -44,6 +48,245 @@ using namespace rapidxml;
 #define ORIGINATING_UNREGISTERED 3
 #define ORIGINATING_CDIV 4
 
+/// An error found while compiling an iFC.  Errors aren't reported when the
+/// iFC is compiled, but when (and only if) evaluating the iFC reaches the part
+/// of the iFC that is in error, so that a compiled iFC behaves exactly as the
+/// XML did when it was evaluated directly.
+struct IfcError
+{
+  enum Type
+  {
+    NONE,
+
+    // An error parsing a value, reported by throwing an xml_error.
+    XML_ERROR,
+
+    // An invalid trigger, reported with an IFC_INVALID SAS event.
+    INVALID_IFC,
+
+    // A missing application server, reported with an IFC_INVALID_NOAS SAS
+    // event.
+    NO_AS
+  };
+
+  IfcError() : type(NONE), text() {}
+  IfcError(Type type_arg, const std::string& text_arg) :
+    type(type_arg), text(text_arg) {}
+
+  Type type;
+  std::string text;
+};
+
+/// A compiled service point trigger.
+struct CompiledSpt
+{
+  enum Class
+  {
+    METHOD,
+    SIP_HEADER,
+    SESSION_CASE,
+    REQUEST_URI,
+    SESSION_DESCRIPTION,
+    UNIMPLEMENTED
+  };
+
+  /// A RegistrationType from the extension to a REGISTER Method trigger.
+  struct RegType
+  {
+    int reg_type;
+    IfcError error;
+  };
+
+  CompiledSpt() :
+    spt_class(UNIMPLEMENTED),
+    negated(false),
+    session_case(0),
+    has_content(false),
+    has_reg_types(false)
+  {}
+
+  // Any error in the ConditionNegated element.
+  IfcError negated_error;
+  bool negated;
+
+  // Any error that is reported whenever the trigger is evaluated - for
+  // example, a missing class or an invalid regular expression.
+  IfcError error;
+
+  // The class of the trigger, and the name of the class element.
+  Class spt_class;
+  std::string class_name;
+
+  // The class-specific parameters of the trigger.  The regular expressions
+  // are compiled with no_except, so status() is non-zero if a regular
+  // expression is invalid.
+  std::string method;
+  int session_case;
+  boost::regex regex;
+  bool has_content;
+  boost::regex content_regex;
+  bool has_reg_types;
+  std::vector<RegType> reg_types;
+
+  // The groups the trigger is in, and any error parsing the Group elements.
+  std::vector<int32_t> groups;
+  IfcError group_error;
+};
+
+/// A compiled iFC.  This holds everything needed to evaluate an iFC against a
+/// message - the ServerName, the ProfilePartIndicator and the trigger point,
+/// with the regular expressions in the trigger point already compiled.  It is
+/// immutable once compiled, so can be shared between threads.
+struct CompiledIfc
+{
+  CompiledIfc() :
+    profile_part_indicator(-1),
+    has_trigger(false),
+    cnf(false)
+  {}
+
+  // The XML for the iFC, which is SAS logged on every evaluation.
+  std::string ifc_str;
+
+  // The canonical form of the iFC's XML (see canonicalize_ifc), which
+  // identifies the iFC in the cache of compiled iFCs.
+  std::string canonical;
+
+  // Any error in the ApplicationServer element.
+  IfcError as_error;
+  std::string server_name;
+
+  // Any error in the ProfilePartIndicator element, and its value (or -1 if
+  // it's not present).
+  IfcError profile_part_indicator_error;
+  int profile_part_indicator;
+
+  bool has_trigger;
+  IfcError cnf_error;
+  bool cnf;
+  std::vector<CompiledSpt> spts;
+};
+
+// Cache of compiled iFCs, keyed by a hash of the iFC's XML.  Subscribers'
+// iFCs are re-read from their service profiles for every transaction, so this
+// means the compiled iFCs (and in particular their regular expressions) are
+// shared between transactions rather than being recompiled each time.  If the
+// cache fills up (which only happens if there are a very large number of
+// distinct iFCs in use), the least recently used iFC is evicted.
+//
+// The hash is calculated by walking the parsed XML, which is much cheaper than
+// printing it.  A hit is confirmed by walking the XML again and comparing it
+// with the canonical form stored in the compiled iFC, so two iFCs with the same
+// hash can't be confused.
+typedef std::list<std::pair<uint64_t, std::shared_ptr<const CompiledIfc>>> CompiledIfcList;
+static CompiledIfcList compiled_ifcs_lru;
+static std::unordered_map<uint64_t, CompiledIfcList::iterator> compiled_ifcs;
+static boost::mutex compiled_ifcs_lock;
+
+/// Feeds a string to out, preceded by its length.
+template <typename Out>
+static void canonicalize_string(const char* str, size_t len, Out& out)
+{
+  out((const char*)&len, sizeof(len));
+  out(str, len);
+}
+
+/// Feeds the canonical form of an iFC's XML to out, a piece at a time.  The
+/// canonical form contains the type, name and value of each node and the name
+/// and value of each attribute, in document order, with each string preceded
+/// by its length so that different XML can't give the same canonical form.
+template <typename Out>
+static void canonicalize_ifc(const xml_node<>* node, Out& out)
+{
+  char type = 'a' + (char)node->type();
+  out(&type, 1);
+  canonicalize_string(node->name(), node->name_size(), out);
+  canonicalize_string(node->value(), node->value_size(), out);
+
+  for (const xml_attribute<>* attr = node->first_attribute();
+       attr != NULL;
+       attr = attr->next_attribute())
+  {
+    out("@", 1);
+    canonicalize_string(attr->name(), attr->name_size(), out);
+    canonicalize_string(attr->value(), attr->value_size(), out);
+  }
+
+  for (const xml_node<>* child = node->first_node();
+       child != NULL;
+       child = child->next_sibling())
+  {
+    canonicalize_ifc(child, out);
+  }
+
+  out("/", 1);
+}
+
+/// Calculates the FNV-1a hash of a canonical form.
+struct CanonicalHash
+{
+  CanonicalHash() : hash(14695981039346656037ULL) {}
+
+  void operator()(const char* data, size_t len)
+  {
+    for (size_t ii = 0; ii < len; ++ii)
+    {
+      hash ^= (unsigned char)data[ii];
+      hash *= 1099511628211ULL;
+    }
+  }
+
+  uint64_t hash;
+};
+
+/// Builds a canonical form.
+struct CanonicalBuilder
+{
+  void operator()(const char* data, size_t len) { str.append(data, len); }
+
+  std::string str;
+};
+
+/// Checks whether a canonical form matches an existing one.
+struct CanonicalMatcher
+{
+  CanonicalMatcher(const std::string& str) : str(str), pos(0), match(true) {}
+
+  void operator()(const char* data, size_t len)
+  {
+    if ((match) &&
+        (len <= str.size() - pos) &&
+        (memcmp(str.data() + pos, data, len) == 0))
+    {
+      pos += len;
+    }
+    else
+    {
+      match = false;
+    }
+  }
+
+  bool matched() const { return (match) && (pos == str.size()); }
+
+  const std::string& str;
+  size_t pos;
+  bool match;
+};
+
+Ifc::Ifc(rapidxml::xml_node<>* ifc) :
+  _ifc(ifc),
+  _compiled(get_compiled_ifc(ifc))
+{
+}
+
+Ifc::Ifc(rapidxml::xml_node<>* ifc,
+         std::shared_ptr<const void> owner) :
+  _ifc(ifc),
+  _owner(owner),
+  _compiled(get_compiled_ifc(ifc))
+{
+}
+
 Ifc::Ifc(std::string ifc_str,
          rapidxml::xml_document<>* ifc_doc) :
   _ifc(NULL)
@@ -59,36 +302,186 @@ Ifc::Ifc(std::string ifc_str,
   _ifc = ifc_doc->clone_node(new_document->first_node());
 
   delete new_document;
+
+  _compiled = get_compiled_ifc(_ifc);
 }
 
-void Ifc::invalid_ifc(std::string error,
-                      std::string server_name,
-                      int sas_event_id,
-                      int instance_id,
-                      SAS::TrailId trail)
+/// Gets the compiled form of an iFC, either from the cache or by compiling it.
+std::shared_ptr<const CompiledIfc> Ifc::get_compiled_ifc(xml_node<>* ifc)
 {
-  SAS::Event event(trail, sas_event_id, instance_id);
-  event.add_var_param(server_name);
-  event.add_var_param(error);
-  SAS::report_event(event);
-  throw xml_error(error.c_str());
+  CanonicalHash hasher;
+  canonicalize_ifc(ifc, hasher);
+
+  std::shared_ptr<const CompiledIfc> compiled;
+
+  {
+    boost::lock_guard<boost::mutex> lock(compiled_ifcs_lock);
+    std::unordered_map<uint64_t, CompiledIfcList::iterator>::const_iterator it =
+      compiled_ifcs.find(hasher.hash);
+
+    if (it != compiled_ifcs.end())
+    {
+      // Mark the iFC as the most recently used.
+      compiled_ifcs_lru.splice(compiled_ifcs_lru.begin(),
+                               compiled_ifcs_lru,
+                               it->second);
+      compiled = it->second->second;
+    }
+  }
+
+  if (compiled)
+  {
+    CanonicalMatcher matcher(compiled->canonical);
+    canonicalize_ifc(ifc, matcher);
+
+    if (matcher.matched())
+    {
+      return compiled;
+    }
+
+    // LCOV_EXCL_START - needs a hash collision.
+    TRC_DEBUG("Compiled iFC cache hash collision - replacing entry");
+    // LCOV_EXCL_STOP
+  }
+
+  std::string ifc_str;
+  rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
+  std::shared_ptr<CompiledIfc> new_compiled = compile(ifc, ifc_str);
+
+  CanonicalBuilder builder;
+  canonicalize_ifc(ifc, builder);
+  new_compiled->canonical.swap(builder.str);
+
+  boost::lock_guard<boost::mutex> lock(compiled_ifcs_lock);
+
+  std::unordered_map<uint64_t, CompiledIfcList::iterator>::iterator it =
+    compiled_ifcs.find(hasher.hash);
+
+  if (it != compiled_ifcs.end())
+  {
+    // Another thread has compiled an iFC with this hash in the meantime (or
+    // there's a collision), so replace it.
+    compiled_ifcs_lru.erase(it->second);
+    compiled_ifcs.erase(it);
+  }
+  else if (compiled_ifcs.size() >= MAX_COMPILED_IFCS)
+  {
+    TRC_DEBUG("Compiled iFC cache is full - evicting least recently used iFC");
+    compiled_ifcs.erase(compiled_ifcs_lru.back().first);
+    compiled_ifcs_lru.pop_back();
+  }
+
+  compiled_ifcs_lru.push_front(std::make_pair(hasher.hash, new_compiled));
+  compiled_ifcs[hasher.hash] = compiled_ifcs_lru.begin();
+
+  return new_compiled;
 }
 
-// Test if the SPT matches. Ignores grouping and negation, and just
-// evaluates the service point trigger in the node.
-// @return true if the SPT matches, false if not
-// @throw xml_error if there is a problem evaluating the trigger.
-bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
-                      bool is_registered,               //< The registration state
-                      bool is_initial_registration,
-                      pjsip_msg* msg,                   //< The message being matched
-                      xml_node<>* spt,                  //< The Service Point Trigger node
-                      std::string ifc_str,
-                      std::string server_name,
-                      SAS::TrailId trail)
+/// Compiles an iFC.  This never throws - any errors in the iFC are recorded in
+/// the compiled iFC, and reported when it is evaluated.
+std::shared_ptr<CompiledIfc> Ifc::compile(xml_node<>* ifc,
+                                          const std::string& ifc_str)
 {
+  std::shared_ptr<CompiledIfc> compiled = std::make_shared<CompiledIfc>();
+  compiled->ifc_str = ifc_str;
+
+  xml_node<>* as = ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
+  if (as == NULL)
+  {
+    compiled->as_error = IfcError(IfcError::NO_AS,
+                                  "iFC missing ApplicationServer element");
+    return compiled;
+  }
+
+  compiled->server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
+  if (compiled->server_name.empty())
+  {
+    compiled->as_error = IfcError(IfcError::NO_AS, "iFC has no ServerName");
+    return compiled;
+  }
+
+  xml_node<>* profile_part_indicator = ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
+  if (profile_part_indicator)
+  {
+    try
+    {
+      compiled->profile_part_indicator =
+                          XMLUtils::parse_integer(profile_part_indicator,
+                                                  "ProfilePartIndicator",
+                                                  0,
+                                                  1);
+    }
+    catch (xml_error err)
+    {
+      compiled->profile_part_indicator_error =
+                                IfcError(IfcError::XML_ERROR, err.what());
+      return compiled;
+    }
+  }
+
+  xml_node<>* trigger = ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
+  if (!trigger)
+  {
+    return compiled;
+  }
+
+  compiled->has_trigger = true;
+
+  try
+  {
+    compiled->cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
+                                         RegDataXMLUtils::CONDITION_TYPE_CNF);
+  }
+  catch (xml_error err)
+  {
+    compiled->cnf_error = IfcError(IfcError::XML_ERROR, err.what());
+    return compiled;
+  }
+
+  for (xml_node<>* spt_node = trigger->first_node(RegDataXMLUtils::SPT);
+       spt_node;
+       spt_node = spt_node->next_sibling(RegDataXMLUtils::SPT))
+  {
+    compiled->spts.push_back(CompiledSpt());
+    compile_spt(spt_node, compiled->spts.back());
+  }
+
+  return compiled;
+}
+
+/// Compiles a service point trigger.
+void Ifc::compile_spt(xml_node<>* spt_node, CompiledSpt& spt)
+{
+  xml_node<>* neg_node = spt_node->first_node(RegDataXMLUtils::CONDITION_NEGATED);
+  try
+  {
+    spt.negated = neg_node && XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+  }
+  catch (xml_error err)
+  {
+    spt.negated_error = IfcError(IfcError::XML_ERROR, err.what());
+  }
+
+  for (xml_node<>* group_node = spt_node->first_node(RegDataXMLUtils::GROUP);
+       group_node;
+       group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+  {
+    try
+    {
+      spt.groups.push_back(XMLUtils::parse_integer(group_node,
+                                                   "Group ID",
+                                                   0,
+                                                   std::numeric_limits<int32_t>::max()));
+    }
+    catch (xml_error err)
+    {
+      spt.group_error = IfcError(IfcError::XML_ERROR, err.what());
+      break;
+    }
+  }
+
   // Find the class node.
-  xml_node<>* node = spt->first_node();
+  xml_node<>* node = spt_node->first_node();
   const char* name = NULL;
 
   for (; node; node = node->next_sibling())
@@ -100,132 +493,270 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
     {
       if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
       {
-        invalid_ifc("Missing class for service point trigger", server_name, SASEvent::IFC_INVALID, 0, trail);
-      }
-      else
-      {
-        break;
+        node = NULL;
       }
+
+      break;
     }
   }
 
   if (!node)
   {
-    invalid_ifc("Missing class for service point trigger", server_name, SASEvent::IFC_INVALID, 0, trail);
+    spt.error = IfcError(IfcError::INVALID_IFC,
+                         "Missing class for service point trigger");
+    return;
   }
 
-  // Now interpret the node depending on its class.
-  bool ret = false;
+  spt.class_name = name;
 
-  if (strcmp(RegDataXMLUtils::METHOD, name) == 0)
+  try
   {
-    // If we have a REGISTER we may need to match on RegistrationType.
-    if ((strcmp("REGISTER", node->value()) == 0) &&
-        (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0))
+    if (strcmp(RegDataXMLUtils::METHOD, name) == 0)
     {
-      ret = true;
-      node = node->next_sibling();
-      if (node)
+      spt.spt_class = CompiledSpt::METHOD;
+      spt.method = node->value();
+
+      // If we have a REGISTER we may need to match on RegistrationType.
+      if (spt.method == "REGISTER")
       {
-        name = node->name();
-        if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
+        xml_node<>* ext_node = node->next_sibling();
+        if ((ext_node) &&
+            (strcmp(ext_node->name(), RegDataXMLUtils::EXTENSION) == 0))
         {
-          for (xml_node<>* reg_type_node = node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
+          spt.has_reg_types = true;
+
+          for (xml_node<>* reg_type_node = ext_node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
                reg_type_node;
                reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
           {
-            name = reg_type_node->name();
-            int reg_type = XMLUtils::parse_integer(reg_type_node,
-                                                   "registration type",
-                                                   0,
-                                                   2);
+            CompiledSpt::RegType reg_type;
+            reg_type.reg_type = -1;
 
-            // Find expiry value from SIP message if it is present to determine
-            // whether we have a de-registration.  Set an arbitrary default value of
-            // an hour.
-            pj_bool_t dereg = PJUtils::is_deregistration(msg);
-
-            switch (reg_type)
+            try
             {
-            case INITIAL_REGISTRATION:
-              ret = (is_initial_registration && !dereg);
-              break;
-            case REREGISTRATION:
-              ret = (!is_initial_registration && !dereg);
-              break;
-            case DEREGISTRATION:
-              ret = dereg;
-              break;
-            default:
-              // LCOV_EXCL_START Unreachable
-              TRC_WARNING("Impossible case %d", reg_type);
-              ret = false;
-              break;
-              // LCOV_EXCL_STOP
+              reg_type.reg_type = XMLUtils::parse_integer(reg_type_node,
+                                                          "registration type",
+                                                          0,
+                                                          2);
             }
-
-            // If we've found a match, break out of the for loop.
-            if (ret)
+            catch (xml_error err)
             {
-              break;
+              reg_type.error = IfcError(IfcError::XML_ERROR, err.what());
             }
+
+            spt.reg_types.push_back(reg_type);
           }
         }
       }
     }
+    else if (strcmp(RegDataXMLUtils::SIP_HEADER, name) == 0)
+    {
+      spt.spt_class = CompiledSpt::SIP_HEADER;
+      xml_node<>* spt_header = node->first_node(RegDataXMLUtils::HEADER);
+      xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
+
+      if (!spt_header)
+      {
+        spt.error = IfcError(IfcError::INVALID_IFC,
+                             "Missing Header element for SIPHeader service point trigger");
+        return;
+      }
+
+      spt.regex = boost::regex(XMLUtils::get_text_or_cdata(spt_header),
+                               boost::regex_constants::icase |
+                               boost::regex_constants::no_except);
+      if (spt.regex.status())
+      {
+        spt.error = IfcError(IfcError::INVALID_IFC,
+                             "Invalid regular expression in Header element for SIPHeader service point trigger");
+        return;
+      }
+
+      if (spt_content)
+      {
+        spt.has_content = true;
+        spt.content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                         boost::regex_constants::no_except);
+      }
+    }
+    else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
+    {
+      spt.spt_class = CompiledSpt::SESSION_CASE;
+      spt.session_case = XMLUtils::parse_integer(node, "session case", 0, 4);
+    }
+    else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
+    {
+      spt.spt_class = CompiledSpt::REQUEST_URI;
+      spt.regex = boost::regex(XMLUtils::get_text_or_cdata(node),
+                               boost::regex_constants::no_except);
+      if (spt.regex.status())
+      {
+        spt.error = IfcError(IfcError::INVALID_IFC,
+                             "Invalid regular expression in Request URI service point trigger");
+      }
+    }
+    else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
+    {
+      spt.spt_class = CompiledSpt::SESSION_DESCRIPTION;
+      xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
+      xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
+
+      if (!spt_line)
+      {
+        spt.error = IfcError(IfcError::INVALID_IFC,
+                             "Missing Line element for SessionDescription service point trigger");
+        return;
+      }
+
+      spt.regex = boost::regex(XMLUtils::get_text_or_cdata(spt_line),
+                               boost::regex_constants::no_except);
+      if (spt.regex.status())
+      {
+        spt.error = IfcError(IfcError::INVALID_IFC,
+                             "Invalid regular expression in Line element for Session Description service point trigger");
+        return;
+      }
+
+      if (spt_content)
+      {
+        spt.has_content = true;
+        spt.content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                         boost::regex_constants::no_except);
+      }
+    }
     else
     {
-      ret = (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0);
+      spt.spt_class = CompiledSpt::UNIMPLEMENTED;
     }
   }
-  else if (strcmp(RegDataXMLUtils::SIP_HEADER, name) == 0)
+  catch (xml_error err)
   {
-    xml_node<>* spt_header = node->first_node(RegDataXMLUtils::HEADER);
-    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
-    boost::regex header_regex;
-    boost::regex content_regex;
-    pjsip_hdr* header = NULL;
+    spt.error = IfcError(IfcError::XML_ERROR, err.what());
+  }
+}
 
-    if (!spt_header)
-    {
-      invalid_ifc("Missing Header element for SIPHeader service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
-    }
+/// Reports an error found when the iFC was compiled.
+//
+// @throw xml_error always.
+void Ifc::report_error(const IfcError& error,
+                       const std::string& server_name,
+                       SAS::TrailId trail)
+{
+  if (error.type == IfcError::INVALID_IFC)
+  {
+    invalid_ifc(error.text, server_name, SASEvent::IFC_INVALID, 0, trail);
+  }
+  else if (error.type == IfcError::NO_AS)
+  {
+    SAS::Event event(trail, SASEvent::IFC_INVALID_NOAS, 0);
+    SAS::report_event(event);
+  }
 
-    header_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_header),
-                                boost::regex_constants::icase |
-                                boost::regex_constants::no_except);
-    if (header_regex.status())
+  throw xml_error(error.text);
+}
+
+void Ifc::invalid_ifc(std::string error,
+                      std::string server_name,
+                      int sas_event_id,
+                      int instance_id,
+                      SAS::TrailId trail)
+{
+  SAS::Event event(trail, sas_event_id, instance_id);
+  event.add_var_param(server_name);
+  event.add_var_param(error);
+  SAS::report_event(event);
+  throw xml_error(error.c_str());
+}
+
+// Test if the SPT matches. Ignores grouping and negation, and just
+// evaluates the service point trigger.
+// @return true if the SPT matches, false if not
+// @throw xml_error if there is a problem evaluating the trigger.
+bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
+                      bool is_registered,               //< The registration state
+                      bool is_initial_registration,
+                      pjsip_msg* msg,                   //< The message being matched
+                      const CompiledSpt& spt,           //< The compiled Service Point Trigger
+                      const std::string& server_name,
+                      SAS::TrailId trail)
+{
+  if (spt.error.type != IfcError::NONE)
+  {
+    report_error(spt.error, server_name, trail);
+  }
+
+  // Now interpret the trigger depending on its class.
+  bool ret = false;
+
+  switch (spt.spt_class)
+  {
+  case CompiledSpt::METHOD:
+    ret = (pj_strcmp2(&msg->line.req.method.name, spt.method.c_str()) == 0);
+
+    // If we have a REGISTER we may need to match on RegistrationType.
+    if ((ret) && (spt.has_reg_types))
     {
-      invalid_ifc("Invalid regular expression in Header element for SIPHeader service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
+      for (std::vector<CompiledSpt::RegType>::const_iterator reg_type = spt.reg_types.begin();
+           reg_type != spt.reg_types.end();
+           ++reg_type)
+      {
+        if (reg_type->error.type != IfcError::NONE)
+        {
+          report_error(reg_type->error, server_name, trail);
+        }
+
+        // Find expiry value from SIP message if it is present to determine
+        // whether we have a de-registration.
+        pj_bool_t dereg = PJUtils::is_deregistration(msg);
+
+        switch (reg_type->reg_type)
+        {
+        case INITIAL_REGISTRATION:
+          ret = (is_initial_registration && !dereg);
+          break;
+        case REREGISTRATION:
+          ret = (!is_initial_registration && !dereg);
+          break;
+        case DEREGISTRATION:
+          ret = dereg;
+          break;
+        default:
+          // LCOV_EXCL_START Unreachable
+          TRC_WARNING("Impossible case %d", reg_type->reg_type);
+          ret = false;
+          break;
+          // LCOV_EXCL_STOP
+        }
+
+        // If we've found a match, break out of the for loop.
+        if (ret)
+        {
+          break;
+        }
+      }
     }
+    break;
 
-    for (header = msg->hdr.next; header != &msg->hdr; header = header->next)
+  case CompiledSpt::SIP_HEADER:
+    for (pjsip_hdr* header = msg->hdr.next; header != &msg->hdr; header = header->next)
     {
-      if (boost::regex_search(PJUtils::pj_str_to_string(&(header->name)), header_regex))
+      if (boost::regex_search(PJUtils::pj_str_to_string(&(header->name)), spt.regex))
       {
-        if (!spt_content)
+        if (!spt.has_content)
         {
           // We've found a matching header, and don't have to match on content
           ret = true;
         }
         else
         {
-          std::string header_value = PJUtils::get_header_value(header);
-          // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once
-          if (content_regex.status())
+          if (spt.content_regex.status())
           {
-            content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                         boost::regex_constants::no_except);
-            if (content_regex.status())
-            {
-              invalid_ifc("Invalid regular expression in Content element for SIPHeader service point trigger",
-                          server_name, SASEvent::IFC_INVALID, 0, trail);
-            }
+            invalid_ifc("Invalid regular expression in Content element for SIPHeader service point trigger",
+                        server_name, SASEvent::IFC_INVALID, 0, trail);
           }
 
-          if (boost::regex_search(header_value, content_regex))
+          std::string header_value = PJUtils::get_header_value(header);
+          if (boost::regex_search(header_value, spt.content_regex))
           {
             // We've found a matching header, and have matching content in one field
             ret = true;
@@ -238,11 +769,10 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         break;
       }
     }
-  }
-  else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
-  {
-    int direction = XMLUtils::parse_integer(node, "session case", 0, 4);
-    switch (direction)
+    break;
+
+  case CompiledSpt::SESSION_CASE:
+    switch (spt.session_case)
     {
     case ORIGINATING_REGISTERED:
       ret = (session_case == SessionCase::Originating) && is_registered;
@@ -261,81 +791,55 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
       break;
     default:
       // LCOV_EXCL_START Unreachable
-      TRC_WARNING("Impossible case %d", direction);
+      TRC_WARNING("Impossible case %d", spt.session_case);
       ret = false;
       break;
     // LCOV_EXCL_STOP
     }
-  }
-  else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
-  {
-    boost::regex req_uri_regex;
-    std::string test_string;
+    break;
 
-    if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
+  case CompiledSpt::REQUEST_URI:
     {
-      pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+      std::string test_string;
 
-      // Match against the telephone-subscriber part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      test_string = PJUtils::pj_str_to_string(&req_uri->number);
-    }
-    else if (PJSIP_URI_SCHEME_IS_URN(msg->line.req.uri))
-    {
-      pjsip_other_uri* req_uri = (pjsip_other_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // There is nothing in TS 29.228 about what to match against in the case
-      // of a urn URI. So just pull out the entire content (which is everything
-      // after "urn:").
-      test_string = PJUtils::pj_str_to_string(&req_uri->content);
-    }
-    else
-    {
-      pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // Compare against the hostport part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
+      if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
+      {
+        pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
 
-      if (req_uri->port != 0)
+        // Match against the telephone-subscriber part of the Req URI, as per Table F.1
+        // of 3GPP TS 29.228.
+        test_string = PJUtils::pj_str_to_string(&req_uri->number);
+      }
+      else if (PJSIP_URI_SCHEME_IS_URN(msg->line.req.uri))
       {
-        hostport += ":" + std::to_string(req_uri->port);
+        pjsip_other_uri* req_uri = (pjsip_other_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+
+        // There is nothing in TS 29.228 about what to match against in the case
+        // of a urn URI. So just pull out the entire content (which is everything
+        // after "urn:").
+        test_string = PJUtils::pj_str_to_string(&req_uri->content);
       }
+      else
+      {
+        pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
 
-      test_string = hostport;
-    }
+        // Compare against the hostport part of the Req URI, as per Table F.1
+        // of 3GPP TS 29.228.
+        std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
 
-    req_uri_regex = boost::regex(XMLUtils::get_text_or_cdata(node),
-                                 boost::regex_constants::no_except);
-    if (req_uri_regex.status())
-    {
-      invalid_ifc("Invalid regular expression in Request URI service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
-    }
-    ret = boost::regex_search(test_string, req_uri_regex);
-  }
-  else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
-  {
-    xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
-    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
-    boost::regex line_regex;
-    boost::regex content_regex;
-    char newline = '\n';
+        if (req_uri->port != 0)
+        {
+          hostport += ":" + std::to_string(req_uri->port);
+        }
 
-    if (!spt_line)
-    {
-      invalid_ifc("Missing Line element for SessionDescription service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
-    }
+        test_string = hostport;
+      }
 
-    line_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_line),
-                              boost::regex_constants::no_except);
-    if (line_regex.status())
-    {
-      invalid_ifc("Invalid regular expression in Line element for Session Description service point trigger",
-                  server_name, SASEvent::IFC_INVALID, 0, trail);
+      ret = boost::regex_search(test_string, spt.regex);
     }
+    break;
 
+  case CompiledSpt::SESSION_DESCRIPTION:
     // Check if the message body is SDP.
     if (msg->body &&
         (!pj_stricmp2(&msg->body->content_type.type, "application")) &&
@@ -346,29 +850,24 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         // Split the message body into each SDP line.
         std::stringstream sdp((char *)msg->body->data);
         std::string sdp_line;
+        char newline = '\n';
         while((std::getline(sdp, sdp_line, newline)) && (ret == false))
         {
           // Match the line regex on the first character of the SDP line.
           std::string sdp_identifier(1, sdp_line[0]);
-          if (boost::regex_search(sdp_identifier, line_regex))
+          if (boost::regex_search(sdp_identifier, spt.regex))
           {
-            if (!spt_content)
+            if (!spt.has_content)
             {
               // We've found a matching line type, and don't have to match on content.
               ret = true;
             }
             else
             {
-              // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once.
-              if (content_regex.status())
+              if (spt.content_regex.status())
               {
-                content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                             boost::regex_constants::no_except);
-                if (content_regex.status())
-                {
-                  invalid_ifc("Invalid regular expression in Content element for Session Description service point trigger",
-                              server_name, SASEvent::IFC_INVALID, 0, trail);
-                }
+                invalid_ifc("Invalid regular expression in Content element for Session Description service point trigger",
+                            server_name, SASEvent::IFC_INVALID, 0, trail);
               }
 
               // Check the second character of the line is an equals sign, and then
@@ -376,7 +875,7 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
               if (sdp_line.find_first_of("=") == 1)
               {
                 sdp_line.erase(0,2);
-                if (boost::regex_search(sdp_line, content_regex))
+                if (boost::regex_search(sdp_line, spt.content_regex))
                 {
                   // We've found a matching line.
                   ret = true;
@@ -391,14 +890,16 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
         }
       }
     }
-  }
-  else
-  {
-    TRC_WARNING("Unimplemented iFC service point trigger class: %s", name);
+    break;
+
+  default:
+    TRC_WARNING("Unimplemented iFC service point trigger class: %s",
+                spt.class_name.c_str());
     ret = false;
+    break;
   }
 
-  TRC_DEBUG("SPT class %s: result %s", name, ret ? "true" : "false");
+  TRC_DEBUG("SPT class %s: result %s", spt.class_name.c_str(), ret ? "true" : "false");
   return ret;
 }
 
@@ -413,45 +914,29 @@ bool Ifc::filter_matches(const SessionCase& session_case,
                          pjsip_msg* msg,
                          SAS::TrailId trail) const
 {
-  std::string ifc_str;
-  rapidxml::print(std::back_inserter(ifc_str), *_ifc, 0);
+  const CompiledIfc& ifc = *_compiled;
 
   SAS::Event event(trail, SASEvent::IFC_TESTING, 0);
-  event.add_compressed_param(ifc_str, &SASEvent::PROFILE_SERVICE_PROFILE);
+  event.add_compressed_param(ifc.ifc_str, &SASEvent::PROFILE_SERVICE_PROFILE);
   SAS::report_event(event);
-  std::string server_name;
 
   try
   {
-    xml_node<>* as = _ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
-    if (as == NULL)
+    if (ifc.as_error.type != IfcError::NONE)
     {
-      std::string error_msg = "iFC missing ApplicationServer element";
-
-      SAS::Event event(trail, SASEvent::IFC_INVALID_NOAS, 0);
-      SAS::report_event(event);
-
-      throw xml_error(error_msg);
+      report_error(ifc.as_error, "", trail);
     }
 
-    server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
-    if (server_name.empty())
-    {
-      std::string error_msg = "iFC has no ServerName";
+    const std::string& server_name = ifc.server_name;
 
-      SAS::Event event(trail, SASEvent::IFC_INVALID_NOAS, 0);
-      SAS::report_event(event);
-
-      throw xml_error(error_msg);
+    if (ifc.profile_part_indicator_error.type != IfcError::NONE)
+    {
+      report_error(ifc.profile_part_indicator_error, server_name, trail);
     }
 
-    xml_node<>* profile_part_indicator = _ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
-    if (profile_part_indicator)
+    if (ifc.profile_part_indicator != -1)
     {
-      bool reg = XMLUtils::parse_integer(profile_part_indicator,
-                                         "ProfilePartIndicator",
-                                         0,
-                                         1) == 0;
+      bool reg = (ifc.profile_part_indicator == 0);
       if (reg != is_registered)
       {
         std::string reg_state = reg ? "reg" : "unreg";
@@ -473,8 +958,7 @@ bool Ifc::filter_matches(const SessionCase& session_case,
     // That means each AsInvocation would have to belong to a pool,
     // though, and that's not easy in the current architecture.
 
-    xml_node<>* trigger = _ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
-    if (!trigger)
+    if (!ifc.has_trigger)
     {
       TRC_DEBUG("iFC has no trigger point - unconditional match");  // 3GPP TS 29.228 sB.2.2
 
@@ -485,47 +969,54 @@ bool Ifc::filter_matches(const SessionCase& session_case,
       return true;
     }
 
-    bool cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
-                                    RegDataXMLUtils::CONDITION_TYPE_CNF);
+    if (ifc.cnf_error.type != IfcError::NONE)
+    {
+      report_error(ifc.cnf_error, server_name, trail);
+    }
+
+    bool cnf = ifc.cnf;
 
     // In CNF (conjunct-of-disjuncts, i.e., big-AND of ORs), as we
     // work through each SPT we OR it into its group(s). At the end,
     // we AND all the groups together. In DNF we do the converse.
     std::map<int32_t, bool> groups;
 
-    for (xml_node<>* spt = trigger->first_node(RegDataXMLUtils::SPT);
-         spt;
-         spt = spt->next_sibling(RegDataXMLUtils::SPT))
+    for (std::vector<CompiledSpt>::const_iterator spt = ifc.spts.begin();
+         spt != ifc.spts.end();
+         ++spt)
     {
-      xml_node<>* neg_node = spt->first_node(RegDataXMLUtils::CONDITION_NEGATED);
-      bool neg = neg_node && XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+      if (spt->negated_error.type != IfcError::NONE)
+      {
+        report_error(spt->negated_error, server_name, trail);
+      }
+
       bool val = spt_matches(session_case,
                              is_registered,
                              is_initial_registration,
                              msg,
-                             spt,
-                             ifc_str,
+                             *spt,
                              server_name,
-                             trail) != neg;
+                             trail) != spt->negated;
 
-      for (xml_node<>* group_node = spt->first_node(RegDataXMLUtils::GROUP);
-           group_node;
-           group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+      for (std::vector<int32_t>::const_iterator group = spt->groups.begin();
+           group != spt->groups.end();
+           ++group)
       {
-        int32_t group = XMLUtils::parse_integer(group_node,
-                                                "Group ID",
-                                                0,
-                                                std::numeric_limits<int32_t>::max());
-        TRC_DEBUG("Add to group %d val %s", (int)group, val ? "true" : "false");
-        if (groups.find(group) == groups.end())
+        TRC_DEBUG("Add to group %d val %s", (int)*group, val ? "true" : "false");
+        if (groups.find(*group) == groups.end())
         {
-          groups[group] = val;
+          groups[*group] = val;
         }
         else
         {
-          groups[group] = cnf ? (groups[group] || val) : (groups[group] && val);
+          groups[*group] = cnf ? (groups[*group] || val) : (groups[*group] && val);
         }
       }
+
+      if (spt->group_error.type != IfcError::NONE)
+      {
+        report_error(spt->group_error, server_name, trail);
+      }
     }
 
     bool ret = cnf;
@@ -43,6 +43,8 @@ extern "C" {
 #include "stack.h"
 #include "bono.h"
 #include "hssconnection.h"
+#include "sdm_fanout.h"
+#include "sproutlet_async.h"
 #include "xdmconnection.h"
 #include "bono.h"
 #include "websockets.h"
@@ -61,6 +63,7 @@ extern "C" {
 #include "scscfselector.h"
 #include "chronosconnection.h"
 #include "chronoshandlers.h"
+#include "chronos_timer_queue.h"
 #include "handlers.h"
 #include "httpstack.h"
 #include "sproutlet.h"
@@ -70,6 +73,7 @@ extern "C" {
 #include "alarm.h"
 #include "communicationmonitor.h"
 #include "common_sip_processing.h"
+#include "custom_headers.h"
 #include "thread_dispatcher.h"
 #include "exception_handler.h"
 #include "scscfsproutlet.h"
@@ -140,6 +144,23 @@ enum OptionTypes
   OPT_DUMMY_APP_SERVER,
   OPT_HTTP_ACR_LOGGING,
   OPT_HOMESTEAD_TIMEOUT,
+  OPT_WORKER_QUEUES,
+  OPT_MAX_QUEUE_DEPTH,
+  OPT_HSS_CACHE_TTL,
+  OPT_HSS_CACHE_SIZE,
+  OPT_REMOTE_SDM_THREADS,
+  OPT_RALF_BATCH_INTERVAL,
+  OPT_RALF_MAX_QUEUED_ACRS,
+  OPT_SIMSERVS_CACHE_TTL,
+  OPT_SIMSERVS_CACHE_SIZE,
+  OPT_ANALYTICS_RING_SIZE,
+  OPT_CHRONOS_BATCH_INTERVAL,
+  OPT_CHRONOS_MAX_QUEUED_TIMERS,
+  OPT_BINARY_AOR_FORMAT,
+  OPT_ASYNC_LOOKUP_THREADS,
+  OPT_SAS_LOG_THREADS,
+  OPT_WEBSOCKET_THREADS,
+  OPT_LAZY_CHARGING_HEADERS,
 };
 
 
@@ -202,6 +223,7 @@ const static struct pj_getopt_option long_opt[] =
   { "sip-blacklist-duration",       required_argument, 0, OPT_SIP_BLACKLIST_DURATION},
   { "http-blacklist-duration",      required_argument, 0, OPT_HTTP_BLACKLIST_DURATION},
   { "astaire-blacklist-duration",   required_argument, 0, OPT_ASTAIRE_BLACKLIST_DURATION},
+  { "binary-aor-format",            no_argument,       0, OPT_BINARY_AOR_FORMAT},
   { "sip-tcp-connect-timeout",      required_argument, 0, OPT_SIP_TCP_CONNECT_TIMEOUT},
   { "sip-tcp-send-timeout",         required_argument, 0, OPT_SIP_TCP_SEND_TIMEOUT},
   { "dns-timeout",                  required_argument, 0, OPT_DNS_TIMEOUT},
@@ -210,6 +232,11 @@ const static struct pj_getopt_option long_opt[] =
   { "stateless-proxies",            required_argument, 0, OPT_STATELESS_PROXIES},
   { "non-registering-pbxes",        required_argument, 0, OPT_NON_REGISTERING_PBXES},
   { "ralf-threads",                 required_argument, 0, OPT_RALF_THREADS},
+  { "ralf-batch-interval",          required_argument, 0, OPT_RALF_BATCH_INTERVAL},
+  { "ralf-max-queued-acrs",         required_argument, 0, OPT_RALF_MAX_QUEUED_ACRS},
+  { "simservs-cache-ttl",           required_argument, 0, OPT_SIMSERVS_CACHE_TTL},
+  { "simservs-cache-size",          required_argument, 0, OPT_SIMSERVS_CACHE_SIZE},
+  { "analytics-ring-size",          required_argument, 0, OPT_ANALYTICS_RING_SIZE},
   { "non-register-authentication",  required_argument, 0, OPT_NON_REGISTER_AUTHENTICATION},
   { "pbx-service-route",            required_argument, 0, OPT_PBX_SERVICE_ROUTE},
   { "force-3pr-body",               no_argument,       0, OPT_FORCE_THIRD_PARTY_REGISTER_BODY},
@@ -224,11 +251,22 @@ const static struct pj_getopt_option long_opt[] =
   { "disable-tcp-switch",           no_argument,       0, OPT_DISABLE_TCP_SWITCH},
   { "chronos-hostname",             required_argument, 0, OPT_CHRONOS_HOSTNAME},
   { "sprout-chronos-callback-uri",  required_argument, 0, OPT_SPROUT_CHRONOS_CALLBACK_URI},
+  { "chronos-batch-interval",       required_argument, 0, OPT_CHRONOS_BATCH_INTERVAL},
+  { "chronos-max-queued-timers",    required_argument, 0, OPT_CHRONOS_MAX_QUEUED_TIMERS},
   { "apply-fallback-ifcs",          no_argument,       0, OPT_APPLY_FALLBACK_IFCS},
   { "reject-if-no-matching-ifcs",   no_argument,       0, OPT_REJECT_IF_NO_MATCHING_IFCS},
   { "dummy-app-server",             required_argument, 0, OPT_DUMMY_APP_SERVER},
   { "http-acr-logging",             no_argument,       0, OPT_HTTP_ACR_LOGGING},
   { "homestead-timeout",            required_argument, 0, OPT_HOMESTEAD_TIMEOUT},
+  { "worker-queues",                required_argument, 0, OPT_WORKER_QUEUES},
+  { "max-queue-depth",              required_argument, 0, OPT_MAX_QUEUE_DEPTH},
+  { "hss-cache-ttl",                required_argument, 0, OPT_HSS_CACHE_TTL},
+  { "hss-cache-size",               required_argument, 0, OPT_HSS_CACHE_SIZE},
+  { "remote-sdm-threads",           required_argument, 0, OPT_REMOTE_SDM_THREADS},
+  { "async-lookup-threads",         required_argument, 0, OPT_ASYNC_LOOKUP_THREADS},
+  { "sas-log-threads",              required_argument, 0, OPT_SAS_LOG_THREADS},
+  { "websocket-threads",            required_argument, 0, OPT_WEBSOCKET_THREADS},
+  { "lazy-charging-headers",        no_argument,       0, OPT_LAZY_CHARGING_HEADERS},
   { NULL,                           0,                 0, 0}
 };
 
@@ -257,6 +295,8 @@ static void usage(void)
        " -s, --scscf <port>         Enable S-CSCF function on the specified port\n"
        " -w, --webrtc-port N        Set local WebRTC listener port to N\n"
        "                            If not specified WebRTC support will be disabled\n"
+       "     --websocket-threads N  Number of threads serving WebRTC (WebSocket) connections\n"
+       "                            (default: 1)\n"
        " -l, --localhost [<hostname>|<private hostname>,<public hostname>]\n"
        "                            Override the local host name with the specified\n"
        "                            hostname(s) or IP address(es).  If one name/address\n"
@@ -303,7 +343,21 @@ static void usage(void)
        "                            If 'pcscf,icscf,as', it also Record-Routes between every AS.\n"
        " -G, --ralf <server>        Name/IP address of Ralf (Rf) billing server.\n"
        "     --ralf-threads N       Number of Ralf threads (default: 25)\n"
+       "     --ralf-batch-interval N\n"
+       "                            Interval in ms at which queued ACRs are handed to the Ralf\n"
+       "                            threads in batches. If this is 0, each ACR is handed to the\n"
+       "                            Ralf threads as soon as it is generated (default: 0)\n"
+       "     --ralf-max-queued-acrs N\n"
+       "                            Maximum number of ACRs waiting to be sent to Ralf when\n"
+       "                            batching. Further ACRs are dropped (default: 10000)\n"
        " -X, --xdms <server>        Name/IP address of XDM server\n"
+       "     --simservs-cache-ttl N Time in seconds for which the MMTEL AS uses a subscriber's\n"
+       "                            simservs document without checking with the XDM server\n"
+       "                            whether it has changed. If this is 0, simservs documents\n"
+       "                            are not cached (default: 0)\n"
+       "     --simservs-cache-size N\n"
+       "                            Maximum number of subscribers whose simservs documents\n"
+       "                            are cached (default: 100000)\n"
        "     --dns-server <server>[,<server2>,<server3>]\n"
        "                            IP addresses of the DNS servers to use (defaults to 127.0.0.1)\n"
        " -E, --enum <server>[,<server2>,<server3>]\n"
@@ -345,11 +399,24 @@ static void usage(void)
        "                            Specify the HTTP bind address\n"
        " -o  --http-port <port>     Specify the HTTP bind port\n"
        " -q  --http-threads N       Number of HTTP threads (default: 1)\n"
-       " -P, --pjsip-threads N      Number of PJSIP threads (default: 1)\n"
+       " -P, --pjsip-threads N      Number of PJSIP transport threads polling for socket events and\n"
+       "                            timers (default: 1)\n"
        " -B, --billing-cdf <server> Billing CDF server\n"
        " -W, --worker-threads N     Number of worker threads (default: 1)\n"
+       "     --worker-queues N      Number of queues to shard received messages across by Call-ID.\n"
+       "                            Each worker thread services one queue, and steals work from the\n"
+       "                            others when its own queue is idle (default: 1)\n"
+       "     --max-queue-depth N    Number of queued messages above which new-session requests are\n"
+       "                            rejected with a 503. Responses and in-dialog requests are always\n"
+       "                            queued, and are processed before new sessions. If this is 0,\n"
+       "                            there is no limit (default: 0)\n"
        " -a, --analytics <directory>\n"
        "                            Generate analytics logs in specified directory\n"
+       "     --analytics-ring-size N\n"
+       "                            Number of analytics logs each thread can queue for a\n"
+       "                            background thread to write. Further logs are dropped\n"
+       "                            until it catches up. If this is 0, analytics logs are\n"
+       "                            written synchronously (default: 0)\n"
        " -A, --authentication       Enable authentication\n"
        "     --allow-emergency-registration\n"
        "                            Allow the P-CSCF to acccept emergency registrations.\n"
@@ -376,6 +443,9 @@ static void usage(void)
        "                            The amount of time to blacklist an HTTP peer when it is unresponsive.\n"
        "     --astaire-blacklist-duration <secs>\n"
        "                            The amount of time to blacklist an Astaire node when it is unresponsive.\n"
+       "     --binary-aor-format    Write registration data to the store in a compact binary format\n"
+       "                            rather than JSON. Data in either format can always be read, so\n"
+       "                            this should only be set once all nodes support it\n"
        "     --sip-tcp-connect-timeout <milliseconds>\n"
        "                            The amount of time to wait for a SIP TCP connection to establish.\n"
        "     --sip-tcp-send-timeout <milliseconds>\n"
@@ -435,6 +505,14 @@ static void usage(void)
        "                            Specify the sprout hostname used for Chronos callbacks. If unset \n"
        "                            the default is to use the sprout-hostname.\n"
        "                            Ignored if chronos-hostname is not set.\n"
+       "     --chronos-batch-interval N\n"
+       "                            If non-zero, updates to and deletions of existing registration\n"
+       "                            timers are queued and sent to Chronos every N milliseconds,\n"
+       "                            with only the latest update to each timer being sent. If 0, they\n"
+       "                            are sent as each REGISTER or SUBSCRIBE is processed (default: 0)\n"
+       "     --chronos-max-queued-timers N\n"
+       "                            Maximum number of timers with updates queued for Chronos.\n"
+       "                            Further updates are sent immediately (default: 10000)\n"
        "     --apply-default-ifcs   Whether calls that don't have any matching iFCs should have some \n"
        "                            preconfigured iFCs applied instead.\n"
        "     --reject-if-no-matching-ifcs\n"
@@ -444,7 +522,31 @@ static void usage(void)
        "                            then the iFC is skipped over.\n"
        "     --http-acr-logging     Whether to include the bodies of ACR HTTP requests when they are logged \n"
        "                            to SAS\n"
+       "     --lazy-charging-headers\n"
+       "                            Only parse P-Charging-Vector and P-Charging-Function-Addresses\n"
+       "                            headers when their contents are needed, rather than on every\n"
+       "                            message. Malformed headers are then passed on, rather than\n"
+       "                            causing the message to be rejected\n"
        "     --homestead-timeout    The timeout in ms to use on HTTP requests to Homestead\n"
+       "     --hss-cache-ttl N      Time in seconds for which subscriber data from Homestead is\n"
+       "                            cached and used for calls. If this is 0, subscriber data is\n"
+       "                            not cached (default: 0)\n"
+       "     --hss-cache-size N     Maximum number of subscribers whose data is cached\n"
+       "                            (default: 100000)\n"
+       "     --remote-sdm-threads N Number of threads used to read from and write to the\n"
+       "                            remote site registration stores in parallel. If this is\n"
+       "                            0, the remote sites are accessed one after another\n"
+       "                            (default: 0)\n"
+       "     --async-lookup-threads N\n"
+       "                            Number of threads used to run HSS lookups for the I-CSCF, so\n"
+       "                            that they don't hold up the SIP worker threads. If this is 0,\n"
+       "                            the lookups are run on the worker threads (default: 0)\n"
+       "     --sas-log-threads N\n"
+       "                            Number of threads used to compress received SIP messages and\n"
+       "                            log them to SAS, so that this isn't done on the transport\n"
+       "                            thread. If too many messages are waiting to be logged,\n"
+       "                            further messages aren't logged. If this is 0, messages are\n"
+       "                            logged on the transport thread (default: 1)\n"
        " -N, --plugin-option <plugin>,<name>,<value>\n"
        "                            Provide an option value to a plugin.\n"
        " -F, --log-file <directory>\n"
@@ -798,6 +900,46 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_RALF_BATCH_INTERVAL:
+      {
+        VALIDATE_INT_PARAM(options->ralf_batch_interval,
+                           ralf_batch_interval,
+                           Ralf batch interval);
+      }
+      break;
+
+    case OPT_RALF_MAX_QUEUED_ACRS:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->ralf_max_queued_acrs,
+                                    ralf_max_queued_acrs,
+                                    Maximum queued ACRs);
+      }
+      break;
+
+    case OPT_SIMSERVS_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM(options->simservs_cache_ttl,
+                           simservs_cache_ttl,
+                           Simservs cache TTL);
+      }
+      break;
+
+    case OPT_SIMSERVS_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->simservs_cache_size,
+                                    simservs_cache_size,
+                                    Simservs cache size);
+      }
+      break;
+
+    case OPT_ANALYTICS_RING_SIZE:
+      {
+        VALIDATE_INT_PARAM(options->analytics_ring_size,
+                           analytics_ring_size,
+                           Analytics ring size);
+      }
+      break;
+
     case 'E':
       options->enum_servers.clear();
       Utils::split_string(std::string(pj_optarg), ',', options->enum_servers, 0, false);
@@ -886,6 +1028,14 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case 'P':
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->pjsip_threads,
+                                    pjsip_threads,
+                                    Number of PJSIP threads);
+      }
+      break;
+
     case 'W':
       {
         VALIDATE_INT_PARAM_NON_ZERO(options->worker_threads,
@@ -1149,6 +1299,13 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_BINARY_AOR_FORMAT:
+      {
+        TRC_INFO("Writing registration data in binary format");
+        options->binary_aor_format = true;
+      }
+      break;
+
     case OPT_FORCE_THIRD_PARTY_REGISTER_BODY:
       {
         TRC_INFO("Forcing inclusion of original REGISTER requests/responses on third-party REGISTERs");
@@ -1235,6 +1392,22 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       TRC_INFO("Sprout Chronos callback uri set to %s", pj_optarg);
       break;
 
+    case OPT_CHRONOS_BATCH_INTERVAL:
+      {
+        VALIDATE_INT_PARAM(options->chronos_batch_interval,
+                           chronos_batch_interval,
+                           Chronos batch interval);
+      }
+      break;
+
+    case OPT_CHRONOS_MAX_QUEUED_TIMERS:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->chronos_max_queued_timers,
+                                    chronos_max_queued_timers,
+                                    Maximum queued Chronos timers);
+      }
+      break;
+
     case OPT_APPLY_FALLBACK_IFCS:
       options->apply_fallback_ifcs = true;
       TRC_INFO("Requests that have no matching iFCs will have some preconfigured iFCs applied");
@@ -1255,6 +1428,11 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       TRC_INFO("Bodies of ACR HTTP messages will be logged to SAS");
       break;
 
+    case OPT_LAZY_CHARGING_HEADERS:
+      options->lazy_charging_headers = true;
+      TRC_INFO("Charging headers will only be parsed when needed");
+      break;
+
     case OPT_HOMESTEAD_TIMEOUT:
       {
         VALIDATE_INT_PARAM(options->homestead_timeout,
@@ -1263,6 +1441,70 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_WORKER_QUEUES:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->worker_queues,
+                                    worker_queues,
+                                    Number of worker queues);
+      }
+      break;
+
+    case OPT_MAX_QUEUE_DEPTH:
+      {
+        VALIDATE_INT_PARAM(options->max_queue_depth,
+                           max_queue_depth,
+                           Maximum worker queue depth);
+      }
+      break;
+
+    case OPT_HSS_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM(options->hss_cache_ttl,
+                           hss_cache_ttl,
+                           HSS cache TTL);
+      }
+      break;
+
+    case OPT_HSS_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->hss_cache_size,
+                                    hss_cache_size,
+                                    HSS cache size);
+      }
+      break;
+
+    case OPT_REMOTE_SDM_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->remote_sdm_threads,
+                           remote_sdm_threads,
+                           Remote SDM threads);
+      }
+      break;
+
+    case OPT_ASYNC_LOOKUP_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->async_lookup_threads,
+                           async_lookup_threads,
+                           Asynchronous lookup threads);
+      }
+      break;
+
+    case OPT_SAS_LOG_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->sas_log_threads,
+                           sas_log_threads,
+                           SAS logging threads);
+      }
+      break;
+
+    case OPT_WEBSOCKET_THREADS:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->websocket_threads,
+                                    websocket_threads,
+                                    WebSocket threads);
+      }
+      break;
+
     case OPT_LISTEN_PORT:
       {
         int listen_port;
@@ -1404,7 +1646,9 @@ ExceptionHandler* exception_handler = NULL;
 AlarmManager* alarm_manager = NULL;
 AnalyticsLogger* analytics_logger = NULL;
 ChronosConnection* chronos_connection = NULL;
+ChronosTimerQueue* chronos_timer_queue = NULL;
 SIFCService* sifc_service = NULL;
+HSSCache* hss_cache = NULL;
 FIFCService* fifc_service = NULL;
 MMFService* mmf_service = NULL;
 
@@ -1507,13 +1751,16 @@ int create_astaire_stores(struct options opt,
     return 1;
   }
 
-  local_aor_store = new AstaireAoRStore(local_data_store);
+  AstaireAoRStore::Format aor_format = opt.binary_aor_format ?
+                                         AstaireAoRStore::Format::BINARY :
+                                         AstaireAoRStore::Format::JSON;
+  local_aor_store = new AstaireAoRStore(local_data_store, aor_format);
 
   for (std::vector<Store*>::iterator it = remote_data_stores.begin();
        it != remote_data_stores.end();
        ++it)
   {
-    AoRStore* remote_aor_store = new AstaireAoRStore(*it);
+    AoRStore* remote_aor_store = new AstaireAoRStore(*it, aor_format);
     remote_aor_stores.push_back(remote_aor_store);
   }
 
@@ -1647,6 +1894,7 @@ int main(int argc, char* argv[])
   opt.pcscf_untrusted_port = 0;
   opt.upstream_proxy_port = 0;
   opt.webrtc_port = 0;
+  opt.websocket_threads = 1;
   opt.ibcf = PJ_FALSE;
   opt.external_icscf_uri = "";
   opt.auth_enabled = PJ_FALSE;
@@ -1664,7 +1912,10 @@ int main(int argc, char* argv[])
   opt.record_routing_model = 1;
   opt.default_session_expires = 10 * 60;
   opt.max_session_expires = 10 * 60;
+  opt.pjsip_threads = 1;
   opt.worker_threads = 1;
+  opt.worker_queues = 1;
+  opt.max_queue_depth = 0;
   opt.analytics_enabled = PJ_FALSE;
   opt.http_address = "127.0.0.1";
   opt.http_port = 9888;
@@ -1696,8 +1947,16 @@ int main(int argc, char* argv[])
   opt.session_terminated_timeout_ms = SCSCFSproutlet::DEFAULT_SESSION_TERMINATED_TIMEOUT;
   opt.stateless_proxies.clear();
   opt.ralf_threads = 25;
+  opt.ralf_batch_interval = 0;
+  opt.ralf_max_queued_acrs = 10000;
+  opt.simservs_cache_ttl = 0;
+  opt.simservs_cache_size = 100000;
+  opt.analytics_ring_size = 0;
+  opt.chronos_batch_interval = 0;
+  opt.chronos_max_queued_timers = 10000;
   opt.non_register_auth_mode = NonRegisterAuthentication::NEVER;
   opt.force_third_party_register_body = false;
+  opt.binary_aor_format = false;
   opt.listen_port = 0;
   SPROUTLET_MACRO(SPROUTLET_CFG_OPTIONS_DEFAULT_VALUES)
   opt.nonce_count_supported = false;
@@ -1708,7 +1967,13 @@ int main(int argc, char* argv[])
   opt.reject_if_no_matching_ifcs = false;
   opt.dummy_app_server = "";
   opt.http_acr_logging = false;
+  opt.lazy_charging_headers = false;
   opt.homestead_timeout = 750;
+  opt.hss_cache_ttl = 0;
+  opt.hss_cache_size = 100000;
+  opt.remote_sdm_threads = 0;
+  opt.async_lookup_threads = 0;
+  opt.sas_log_threads = 1;
 
   status = init_logging_options(argc, argv, &opt);
 
@@ -1784,7 +2049,7 @@ int main(int argc, char* argv[])
 
   if (opt.analytics_enabled)
   {
-    analytics_logger = new AnalyticsLogger();
+    analytics_logger = new AnalyticsLogger(opt.analytics_ring_size);
   }
 
   std::vector<std::string> sproutlet_uris;
@@ -1894,6 +2159,9 @@ int main(int argc, char* argv[])
   SNMP::EventAccumulatorTable* homestead_uar_latency_table = NULL;
   SNMP::EventAccumulatorTable* homestead_lir_latency_table = NULL;
   SNMP::CounterTable* no_shared_ifcs_set_table = NULL;
+  SNMP::CounterTable* ralf_dropped_acrs_table = NULL;
+  SNMP::CounterTable* hss_cache_hits_table = NULL;
+  SNMP::CounterTable* hss_cache_misses_table = NULL;
 
   SNMP::ContinuousAccumulatorByScopeTable* token_rate_table = NULL;
   SNMP::ScalarByScopeTable* smoothed_latency_scalar = NULL;
@@ -1935,8 +2203,14 @@ int main(int argc, char* argv[])
                                                                  ".1.2.826.0.1.1578918.9.3.3.5");
     homestead_lir_latency_table = SNMP::EventAccumulatorTable::create("sprout_homestead_lir_latency",
                                                                  ".1.2.826.0.1.1578918.9.3.3.6");
+    hss_cache_hits_table = SNMP::CounterTable::create("sprout_homestead_cache_hits",
+                                                      ".1.2.826.0.1.1578918.9.3.3.7");
+    hss_cache_misses_table = SNMP::CounterTable::create("sprout_homestead_cache_misses",
+                                                        ".1.2.826.0.1.1578918.9.3.3.8");
     no_shared_ifcs_set_table = SNMP::CounterTable::create("no_shared_ifcs_set",
                                                           ".1.2.826.0.1.1578918.9.3.40");
+    ralf_dropped_acrs_table = SNMP::CounterTable::create("sprout_ralf_dropped_acrs",
+                                                         ".1.2.826.0.1.1578918.9.3.43");
     token_rate_table = SNMP::ContinuousAccumulatorByScopeTable::create("sprout_token_rate",
                                                                        ".1.2.826.0.1.1578918.9.3.27");
     smoothed_latency_scalar = SNMP::ScalarByScopeTable::create("sprout_smoothed_latency",
@@ -2035,6 +2309,12 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (opt.lazy_charging_headers)
+  {
+    TRC_STATUS("Parsing charging headers lazily");
+    set_lazy_charging_headers(true);
+  }
+
   //If the flag is set, disable UDP-to-TCP uplift.
   if (opt.disable_tcp_switch)
   {
@@ -2066,7 +2346,10 @@ int main(int argc, char* argv[])
                                          !opt.http_acr_logging);
     ralf_processor = new RalfProcessor(ralf_connection,
                                        exception_handler,
-                                       opt.ralf_threads);
+                                       opt.ralf_threads,
+                                       opt.ralf_batch_interval,
+                                       opt.ralf_max_queued_acrs,
+                                       ralf_dropped_acrs_table);
   }
   else
   {
@@ -2086,6 +2369,17 @@ int main(int argc, char* argv[])
                                              AlarmDef::SPROUT_SIFC_STATUS,
                                              AlarmDef::CRITICAL),
                                    no_shared_ifcs_set_table);
+
+    if (opt.hss_cache_ttl > 0)
+    {
+      TRC_STATUS("Caching subscriber data from Homestead for %d seconds",
+                 opt.hss_cache_ttl);
+      hss_cache = new HSSCache(opt.hss_cache_ttl,
+                               opt.hss_cache_size,
+                               hss_cache_hits_table,
+                               hss_cache_misses_table);
+    }
+
     hss_connection = new HSSConnection(opt.hss_server,
                                        http_resolver,
                                        load_monitor,
@@ -2097,6 +2391,7 @@ int main(int argc, char* argv[])
                                        homestead_lir_latency_table,
                                        hss_comm_monitor,
                                        sifc_service,
+                                       hss_cache,
                                        opt.homestead_timeout);
   }
 
@@ -2172,7 +2467,8 @@ int main(int argc, char* argv[])
     pj_bool_t websockets_enabled = (opt.webrtc_port != 0);
     if (websockets_enabled)
     {
-      status = init_websockets((unsigned short)opt.webrtc_port);
+      status = init_websockets((unsigned short)opt.webrtc_port,
+                               opt.websocket_threads);
       if (status != PJ_SUCCESS)
       {
         TRC_ERROR("Error initializing websockets, %s",
@@ -2202,10 +2498,18 @@ int main(int argc, char* argv[])
 
   // Use the AOR stores we've create to create the local (and optionally remote)
   // SDMs.
+  if (opt.chronos_batch_interval > 0)
+  {
+    chronos_timer_queue = new ChronosTimerQueue(chronos_connection,
+                                                opt.chronos_batch_interval,
+                                                opt.chronos_max_queued_timers);
+  }
+
   local_sdm = new SubscriberDataManager(local_aor_store,
                                         chronos_connection,
                                         analytics_logger,
-                                        true);
+                                        true,
+                                        chronos_timer_queue);
 
   for (std::vector<AoRStore*>::iterator it = remote_aor_stores.begin();
        it != remote_aor_stores.end();
@@ -2218,6 +2522,11 @@ int main(int argc, char* argv[])
     remote_sdms.push_back(remote_sdm);
   }
 
+  if (!remote_sdms.empty())
+  {
+    SDMFanout::init(exception_handler, opt.remote_sdm_threads);
+  }
+
   // Start the HTTP stack early as plugins might need to register handlers
   // with it.
   HttpStack* http_stack_sig = new HttpStack(opt.http_threads,
@@ -2301,14 +2610,24 @@ int main(int argc, char* argv[])
   init_common_sip_processing(load_monitor,
                              requests_counter,
                              overload_counter,
-                             hc);
+                             hc,
+                             exception_handler,
+                             opt.sas_log_threads);
 
   init_thread_dispatcher(opt.worker_threads,
+                         opt.worker_queues,
+                         opt.max_queue_depth,
                          latency_table,
                          queue_size_table,
+                         overload_counter,
                          load_monitor,
                          exception_handler);
 
+  // Sproutlets resume on the worker threads after asynchronous lookups.
+  SproutletAsync::init(exception_handler,
+                       opt.async_lookup_threads,
+                       &add_callback_to_queue);
+
   // Create worker threads first as they take work from the PJSIP threads so
   // need to be ready.
   status = start_worker_threads();
@@ -2318,7 +2637,7 @@ int main(int argc, char* argv[])
     return 1;
   }
 
-  status = start_pjsip_thread();
+  status = start_pjsip_threads(opt.pjsip_threads);
   if (status != PJ_SUCCESS)
   {
     CL_SPROUT_SIP_STACK_INIT_FAIL.log(PJUtils::pj_status_to_string(status).c_str());
@@ -2456,11 +2775,12 @@ int main(int argc, char* argv[])
     }
   }
 
-  // Terminate the PJSIP thread and the worker threads to exit.  We kill
-  // the PJSIP thread first - if we killed the worker threads first the
+  // Terminate the PJSIP threads and the worker threads to exit.  We kill
+  // the PJSIP threads first - if we killed the worker threads first the
   // rx_msg_q will stop getting serviced so could fill up blocking
   // the PJSIP thread, causing a deadlock.
-  stop_pjsip_thread();
+  stop_pjsip_threads();
+  SproutletAsync::term();
   stop_worker_threads();
 
   // We must call stop_stack here because this terminates the
@@ -2493,12 +2813,17 @@ int main(int argc, char* argv[])
 
   delete http_stack_sig; http_stack_sig = NULL;
   delete http_stack_mgmt; http_stack_mgmt = NULL;
+
+  // Send any queued timer updates before deleting the Chronos connection.
+  delete chronos_timer_queue; chronos_timer_queue = NULL;
   delete chronos_connection;
   delete hss_connection;
+  delete hss_cache;
   delete fifc_service;
   delete mmf_service;
   delete sifc_service;
   delete quiescing_mgr;
+  SDMFanout::term();
   delete exception_handler;
   delete load_monitor;
   delete local_sdm;
@@ -2572,6 +2897,9 @@ int main(int argc, char* argv[])
   delete homestead_uar_latency_table;
   delete homestead_lir_latency_table;
   delete no_shared_ifcs_set_table;
+  delete ralf_dropped_acrs_table;
+  delete hss_cache_hits_table;
+  delete hss_cache_misses_table;
 
   delete token_rate_table;
   delete smoothed_latency_scalar;
@@ -53,7 +53,7 @@ AppServerTsx* Mmtel::get_app_tsx(SproutletHelper* helper,
     pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(&psu_hdr->name_addr);
     std::string served_user = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR, uri);
 
-    simservs* user_services = get_user_services(served_user, trail);
+    std::shared_ptr<const simservs> user_services = get_user_services(served_user, trail);
     mmtel_tsx = new MmtelTsx(req, user_services, trail);
   }
   else
@@ -69,8 +69,14 @@ AppServerTsx* Mmtel::get_app_tsx(SproutletHelper* helper,
 // @returns The simservs object if it is relevant and present.  If there is
 // no simservs configuration for the user, returns a default simservs object
 // with all services disabled.
-simservs* Mmtel::get_user_services(std::string public_id, SAS::TrailId trail)
+std::shared_ptr<const simservs> Mmtel::get_user_services(std::string public_id,
+                                                         SAS::TrailId trail)
 {
+  if (_cache != NULL)
+  {
+    return get_cached_user_services(public_id, trail);
+  }
+
   // Fetch the user's simservs configuration from the XDMS
   TRC_DEBUG("Fetching simservs configuration for %s", public_id.c_str());
   {
@@ -84,13 +90,87 @@ simservs* Mmtel::get_user_services(std::string public_id, SAS::TrailId trail)
     TRC_DEBUG("Failed to fetch simservs configuration for %s, no MMTel services enabled", public_id.c_str());
     SAS::Event event(trail, SASEvent::FAILED_RETRIEVE_SIMSERVS, 0);
     SAS::report_event(event);
-    return new simservs("");
+    return std::make_shared<const simservs>("");
   }
 
   // Parse the retrieved XDMS information
-  simservs *user_services = new simservs(simservs_xml);
+  return std::make_shared<const simservs>(simservs_xml);
+}
+
+// Get the user services configuration from the cache, fetching it from the
+// XDMS if it isn't cached or revalidating it with the XDMS if the cached copy
+// has expired.  If an expired copy can't be revalidated, it is used anyway.
+std::shared_ptr<const simservs> Mmtel::get_cached_user_services(const std::string& public_id,
+                                                                SAS::TrailId trail)
+{
+  std::shared_ptr<const simservs> user_services;
+  std::string etag;
+
+  if (_cache->get(public_id, user_services, etag))
+  {
+    TRC_DEBUG("Using cached simservs configuration for %s", public_id.c_str());
+    return user_services;
+  }
+
+  TRC_DEBUG("Fetching simservs configuration for %s", public_id.c_str());
+  {
+    SAS::Event event(trail, SASEvent::RETRIEVING_SIMSERVS, 0);
+    event.add_var_param(public_id);
+    SAS::report_event(event);
+  }
+
+  // Only ask the XDMS to skip sending the document if we have a copy of it.
+  if (!user_services)
+  {
+    etag.clear();
+  }
 
-  return user_services;
+  std::string simservs_xml;
+  HTTPCode http_code = _xdmc->get_simservs(public_id, simservs_xml, etag, trail);
+
+  if ((http_code == XDMConnection::NOT_MODIFIED) && (user_services))
+  {
+    TRC_DEBUG("Cached simservs configuration for %s is still valid",
+              public_id.c_str());
+    _cache->revalidated(public_id);
+    return user_services;
+  }
+  else if (http_code == HTTP_OK)
+  {
+    user_services = std::make_shared<const simservs>(simservs_xml);
+    _cache->put(public_id, user_services, etag);
+    return user_services;
+  }
+  else if (http_code == HTTP_NOT_FOUND)
+  {
+    // The user has no simservs configuration.  Cache this too, so that users
+    // without MMTEL services don't cost a request to the XDMS on every call.
+    TRC_DEBUG("No simservs configuration for %s, no MMTel services enabled",
+              public_id.c_str());
+    SAS::Event event(trail, SASEvent::FAILED_RETRIEVE_SIMSERVS, 0);
+    SAS::report_event(event);
+    user_services = std::make_shared<const simservs>("");
+    _cache->put(public_id, user_services, "");
+    return user_services;
+  }
+
+  // Any other failure isn't cached, so that the next call tries again.
+  SAS::Event event(trail, SASEvent::FAILED_RETRIEVE_SIMSERVS, 0);
+  SAS::report_event(event);
+
+  if (user_services)
+  {
+    // We couldn't revalidate our copy, but it's better to keep providing the
+    // user's services from it than to disable them while the XDMS is
+    // unavailable.
+    TRC_DEBUG("Failed to revalidate simservs configuration for %s, using cached copy",
+              public_id.c_str());
+    return user_services;
+  }
+
+  TRC_DEBUG("Failed to fetch simservs configuration for %s, no MMTel services enabled",
+            public_id.c_str());
+  return std::make_shared<const simservs>("");
 }
 
 /// Constructor.
@@ -228,7 +308,8 @@ AppServerTsx* CallDiversionAS::get_app_tsx(SproutletHelper* helper,
         }
       }
 
-      simservs* user_services = new simservs(target, conditions, no_reply_timer);
+      std::shared_ptr<const simservs> user_services =
+                    std::make_shared<const simservs>(target, conditions, no_reply_timer);
       mmtel_tsx = new MmtelTsx(req, user_services, trail, this);
 
       {
@@ -256,7 +337,7 @@ AppServerTsx* CallDiversionAS::get_app_tsx(SproutletHelper* helper,
 
 /// Constructor for the MmtelTsx.
 MmtelTsx::MmtelTsx(pjsip_msg* req,
-                   simservs* user_services,
+                   std::shared_ptr<const simservs> user_services,
                    SAS::TrailId trail,
                    CDivCallback* cdiv_callback) :
   AppServerTsx(),
@@ -348,11 +429,6 @@ MmtelTsx::~MmtelTsx()
     cancel_timer(_no_reply_timer);
     _no_reply_timer = 0;
   }
-
-  if (_user_services != NULL)
-  {
-    delete _user_services;
-  }
 }
 
 // Apply Mmtel processing on initial invite.
@@ -29,7 +29,11 @@ private:
   Mmtel* _mmtel;
   SNMP::IPCountTable* _xdm_cxn_count_tbl;
   SNMP::EventAccumulatorTable* _xdm_latency_tbl;
+  SNMP::CounterTable* _simservs_cache_hits_tbl;
+  SNMP::CounterTable* _simservs_cache_misses_tbl;
+  SNMP::CounterTable* _simservs_cache_revalidations_tbl;
   XDMConnection* _xdm_connection;
+  SimservsCache* _simservs_cache;
 };
 
 /// Export the plug-in using the magic symbol "sproutlet_plugin"
@@ -41,7 +45,11 @@ MMTELASPlugin sproutlet_plugin;
 MMTELASPlugin::MMTELASPlugin() :
   _mmtel_sproutlet(NULL),
   _mmtel(NULL),
-  _xdm_connection(NULL)
+  _simservs_cache_hits_tbl(NULL),
+  _simservs_cache_misses_tbl(NULL),
+  _simservs_cache_revalidations_tbl(NULL),
+  _xdm_connection(NULL),
+  _simservs_cache(NULL)
 {
 }
 
@@ -76,8 +84,25 @@ bool MMTELASPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
                                           _xdm_cxn_count_tbl,
                                           _xdm_latency_tbl);
 
+      if (opt.simservs_cache_ttl > 0)
+      {
+        TRC_STATUS("Caching simservs documents for %d seconds",
+                   opt.simservs_cache_ttl);
+        _simservs_cache_hits_tbl = SNMP::CounterTable::create("homer-cache-hits",
+                                                              ".1.2.826.0.1.1578918.9.3.2.3");
+        _simservs_cache_misses_tbl = SNMP::CounterTable::create("homer-cache-misses",
+                                                                ".1.2.826.0.1.1578918.9.3.2.4");
+        _simservs_cache_revalidations_tbl = SNMP::CounterTable::create("homer-cache-revalidations",
+                                                                       ".1.2.826.0.1.1578918.9.3.2.5");
+        _simservs_cache = new SimservsCache(opt.simservs_cache_ttl,
+                                            opt.simservs_cache_size,
+                                            _simservs_cache_hits_tbl,
+                                            _simservs_cache_misses_tbl,
+                                            _simservs_cache_revalidations_tbl);
+      }
+
       // Load the MMTEL AppServer
-      _mmtel = new Mmtel(opt.prefix_mmtel, _xdm_connection);
+      _mmtel = new Mmtel(opt.prefix_mmtel, _xdm_connection, _simservs_cache);
       _mmtel_sproutlet = new SproutletAppServerShim(_mmtel,
                                                     opt.port_mmtel,
                                                     opt.uri_mmtel,
@@ -95,7 +120,11 @@ void MMTELASPlugin::unload()
 {
   delete _mmtel_sproutlet;
   delete _mmtel;
+  delete _simservs_cache;
   delete _xdm_connection;
   delete _xdm_cxn_count_tbl;
   delete _xdm_latency_tbl;
+  delete _simservs_cache_hits_tbl;
+  delete _simservs_cache_misses_tbl;
+  delete _simservs_cache_revalidations_tbl;
 }
@@ -2239,21 +2239,46 @@ pjsip_param* PJUtils::get_userpart_param(pjsip_uri* uri, pj_str_t param)
 }
 
 
-/// Attempt ENUM lookup if appropriate.
-static std::string query_enum(pjsip_msg* req,
-                              EnumService* enum_service,
-                              SAS::TrailId trail)
+/// Classifies the Request-URI for ENUM translation.  When only number
+/// portability data is wanted, a numeric SIP URI is only treated as a phone
+/// number if it has user=phone.
+static URIClass classify_enum_uri(pjsip_msg* req, bool np_data_only)
+{
+  return URIClassifier::classify_uri(req->line.req.uri, np_data_only, true);
+}
+
+bool PJUtils::get_enum_user(pjsip_msg* req,
+                            bool np_data_only,
+                            std::string& user)
+{
+  URIClass uri_class = classify_enum_uri(req, np_data_only);
+
+  if ((uri_class == GLOBAL_PHONE_NUMBER) ||
+      (uri_class == NP_DATA) ||
+      (uri_class == FINAL_NP_DATA))
+  {
+    // Request is either to a URI in this domain, or a Tel URI, so attempt
+    // to translate it according to 5.4.3.2 section 10.
+    TRC_DEBUG("Translating URI");
+    pj_str_t pj_user = PJUtils::user_from_uri(req->line.req.uri);
+    user = PJUtils::pj_str_to_string(&pj_user);
+    return true;
+  }
+
+  TRC_DEBUG("Not translating URI");
+  return false;
+}
+
+std::string PJUtils::lookup_enum_user(const std::string& user,
+                                      EnumService* enum_service,
+                                      SAS::TrailId trail)
 {
-  std::string user;
   std::string new_uri;
-  pjsip_uri* uri = req->line.req.uri;
 
   if (enum_service != NULL)
   {
     // Perform an ENUM lookup if we have a tel URI, or if we have
     // a SIP URI which is being treated as a phone number.
-    pj_str_t pj_user = PJUtils::user_from_uri(uri);
-    user = PJUtils::pj_str_to_string(&pj_user);
     TRC_DEBUG("Performing ENUM translation for user %s", user.c_str());
     new_uri = enum_service->lookup_uri_from_user(user, trail);
   }
@@ -2263,143 +2288,81 @@ static std::string query_enum(pjsip_msg* req,
     SAS::Event event(trail, SASEvent::ENUM_NOT_ENABLED, 0);
     SAS::report_event(event);
   }
+
   return new_uri;
 }
 
-void PJUtils::translate_request_uri(pjsip_msg* req,
-                                    pj_pool_t* pool,
-                                    EnumService* enum_service,
-                                    bool should_override_npdi,
-                                    SAS::TrailId trail)
+void PJUtils::apply_enum_translation(pjsip_msg* req,
+                                     pj_pool_t* pool,
+                                     const std::string& enum_uri,
+                                     bool np_data_only,
+                                     bool should_override_npdi,
+                                     SAS::TrailId trail)
 {
-  pjsip_uri* uri = req->line.req.uri;
-  URIClass uri_class = URIClassifier::classify_uri(uri, false, true);
-
-  if ((uri_class == GLOBAL_PHONE_NUMBER) ||
-      (uri_class == NP_DATA) ||
-      (uri_class == FINAL_NP_DATA))
+  if (enum_uri.empty())
   {
-
-    // Request is either to a URI in this domain, or a Tel URI, so attempt
-    // to translate it according to 5.4.3.2 section 10.
-    TRC_DEBUG("Translating URI");
-    std::string new_uri_str = query_enum(req,
-                                         enum_service,
-                                         trail);
-
-    if (!new_uri_str.empty())
-    {
-      pjsip_uri* new_uri = (pjsip_uri*)PJUtils::uri_from_string(new_uri_str,
-                                                                pool);
-
-      if (new_uri == NULL)
-      {
-        // The ENUM lookup has returned an invalid URI. Reject the
-        // request.
-        TRC_WARNING("Invalid ENUM response: %s", new_uri_str.c_str());
-        SAS::Event event(trail, SASEvent::ENUM_INVALID, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-        return;
-      }
-
-      // The URI was successfully translated, so see what it is.
-      URIClass new_uri_class = URIClassifier::classify_uri(new_uri, false, true);
-      std::string rn;
-      get_rn(new_uri, rn);
-
-      if ((new_uri_class == HOME_DOMAIN_SIP_URI) ||
-          (new_uri_class == NODE_LOCAL_SIP_URI) ||
-          (new_uri_class == OFFNET_SIP_URI))
-      {
-        // Translation to a real SIP URI - this always takes priority.
-        TRC_DEBUG("Translated URI %s is a real SIP URI - replacing Request-URI",
-                  new_uri_str.c_str());
-        req->line.req.uri = new_uri;
-        SAS::Event event(trail, SASEvent::SIP_URI_FROM_ENUM, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-      }
-      else if ((new_uri_class == NP_DATA) || (new_uri_class == FINAL_NP_DATA))
-      {
-        if (should_update_np_data(uri_class, new_uri_class, new_uri_str, rn, should_override_npdi, trail))
-        {
-          req->line.req.uri = new_uri;
-        }
-      }
-      else
-      {
-        // We got a TEL URI of some description - update the Request-URI anyway and expect a
-        // downstream MGCF to sort it out.
-        TRC_DEBUG("Translated URI %s is not a SIP URI - replacing Request-URI anyway",
-                  new_uri_str.c_str());
-        req->line.req.uri = new_uri;
-        SAS::Event event(trail, SASEvent::NON_SIP_URI_FROM_ENUM, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-      }
-    }
+    return;
   }
-}
 
-void PJUtils::update_request_uri_np_data(pjsip_msg* req,
-                                    pj_pool_t* pool,
-                                    EnumService* enum_service,
-                                    bool should_override_npdi,
-                                    SAS::TrailId trail)
-{
-  pjsip_uri* uri = req->line.req.uri;
-  URIClass uri_class = URIClassifier::classify_uri(uri, true, true);
+  std::string new_uri_str = enum_uri;
+  URIClass uri_class = classify_enum_uri(req, np_data_only);
+  pjsip_uri* new_uri = (pjsip_uri*)PJUtils::uri_from_string(new_uri_str, pool);
 
-  if ((uri_class == GLOBAL_PHONE_NUMBER) ||
-      (uri_class == NP_DATA) ||
-      (uri_class == FINAL_NP_DATA))
+  if (new_uri == NULL)
   {
+    // The ENUM lookup has returned an invalid URI. Reject the
+    // request.
+    TRC_WARNING("Invalid ENUM response: %s", new_uri_str.c_str());
+    SAS::Event event(trail, SASEvent::ENUM_INVALID, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
+    return;
+  }
 
-    // Request is either to a URI in this domain, or a Tel URI, so attempt
-    // to translate it according to 5.4.3.2 section 10.
-    TRC_DEBUG("Translating URI");
-    std::string new_uri_str = query_enum(req,
-                                         enum_service,
-                                         trail);
+  // The URI was successfully translated, so see what it is.
+  URIClass new_uri_class = URIClassifier::classify_uri(new_uri, false, true);
+  std::string rn;
+  get_rn(new_uri, rn);
 
-    if (!new_uri_str.empty())
+  if ((new_uri_class == NP_DATA) || (new_uri_class == FINAL_NP_DATA))
+  {
+    if (should_update_np_data(uri_class, new_uri_class, new_uri_str, rn, should_override_npdi, trail))
     {
-      pjsip_uri* new_uri = (pjsip_uri*)PJUtils::uri_from_string(new_uri_str,
-                                                                pool);
-
-      if (new_uri == NULL)
-      {
-        // The ENUM lookup has returned an invalid URI. Reject the
-        // request.
-        TRC_WARNING("Invalid ENUM response: %s", new_uri_str.c_str());
-        SAS::Event event(trail, SASEvent::ENUM_INVALID, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-        return;
-      }
-
-      // The URI was successfully translated, so see what it is.
-      URIClass new_uri_class = URIClassifier::classify_uri(new_uri, false, true);
-      std::string rn;
-      get_rn(new_uri, rn);
-
-      if ((new_uri_class == NP_DATA) || (new_uri_class == FINAL_NP_DATA))
-      {
-        if (should_update_np_data(uri_class, new_uri_class, new_uri_str, rn, should_override_npdi, trail))
-        {
-          req->line.req.uri = new_uri;
-        }
-      }
+      req->line.req.uri = new_uri;
     }
   }
+  else if (np_data_only)
+  {
+    // Only number portability data is wanted, so leave the Request-URI
+    // alone.
+    TRC_DEBUG("Translated URI %s has no NP data - not replacing Request-URI",
+              new_uri_str.c_str());
+  }
+  else if ((new_uri_class == HOME_DOMAIN_SIP_URI) ||
+           (new_uri_class == NODE_LOCAL_SIP_URI) ||
+           (new_uri_class == OFFNET_SIP_URI))
+  {
+    // Translation to a real SIP URI - this always takes priority.
+    TRC_DEBUG("Translated URI %s is a real SIP URI - replacing Request-URI",
+              new_uri_str.c_str());
+    req->line.req.uri = new_uri;
+    SAS::Event event(trail, SASEvent::SIP_URI_FROM_ENUM, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
+  }
   else
   {
-    TRC_DEBUG("Not translating URI");
+    // We got a TEL URI of some description - update the Request-URI anyway and expect a
+    // downstream MGCF to sort it out.
+    TRC_DEBUG("Translated URI %s is not a SIP URI - replacing Request-URI anyway",
+              new_uri_str.c_str());
+    req->line.req.uri = new_uri;
+    SAS::Event event(trail, SASEvent::NON_SIP_URI_FROM_ENUM, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
   }
 }
 
-
 bool PJUtils::should_update_np_data(URIClass old_uri_class,
                            URIClass new_uri_class,
                            std::string& new_uri_str,
@@ -8,59 +8,281 @@
  * Otherwise no rights are granted except for those provided to you by
  * Metaswitch Networks in a separate written agreement.
  */
+#include <time.h>
+
+#include <algorithm>
+#include <functional>
+
 #include "ralf_processor.h"
 #include "exception_handler.h"
+#include "log.h"
 
 /// Constructor.
 RalfProcessor::RalfProcessor(HttpConnection* ralf_connection,
                              ExceptionHandler* exception_handler,
-                             const int ralf_threads) :
-  _thread_pool(new Pool(ralf_connection,
+                             const int ralf_threads,
+                             const int batch_interval_ms,
+                             const int max_queued_acrs,
+                             SNMP::CounterTable* dropped_acrs_tbl) :
+  _thread_pool(new Pool(this,
+                        ralf_connection,
                         exception_handler,
                         &exception_callback,
-                        ralf_threads))
+                        ralf_threads)),
+  _num_threads(ralf_threads),
+  _batch_interval_ms(batch_interval_ms),
+  _max_queued_acrs(max_queued_acrs),
+  _dropped_acrs_tbl(dropped_acrs_tbl),
+  _pending(),
+  _queued(0),
+  _terminated(false)
 {
+  pthread_mutex_init(&_lock, NULL);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
   _thread_pool->start();
+
+  if (_batch_interval_ms > 0)
+  {
+    TRC_STATUS("Sending ACRs to Ralf in batches every %dms (at most %d queued)",
+               _batch_interval_ms, max_queued_acrs);
+    pthread_create(&_flush_thread,
+                   NULL,
+                   &RalfProcessor::flush_thread_function,
+                   (void*)this);
+  }
 }
 
 /// Destructor.
 RalfProcessor::~RalfProcessor()
 {
+  if (_batch_interval_ms > 0)
+  {
+    // Stop the flush thread.  It hands any queued ACRs to the pool before
+    // exiting.
+    pthread_mutex_lock(&_lock);
+    _terminated = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+    pthread_join(_flush_thread, NULL);
+  }
+
   if (_thread_pool != NULL)
   {
     _thread_pool->stop();
     _thread_pool->join();
     delete _thread_pool; _thread_pool = NULL;
   }
+
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
 }
 
 /// Adds a ralf request to the queue
 void RalfProcessor::send_request_to_ralf(RalfRequest* rr)
 {
-  _thread_pool->add_work(rr);
+  if (_batch_interval_ms == 0)
+  {
+    RalfBatch* batch = new RalfBatch();
+    batch->processor = this;
+    batch->requests.push_back(rr);
+    _thread_pool->add_work(batch);
+    return;
+  }
+
+  // Queue the request for the next flush, unless there are already too many
+  // ACRs waiting to be sent.  We'd rather drop an ACR than hold up the
+  // thread that generated it.
+  bool dropped = false;
+
+  pthread_mutex_lock(&_lock);
+
+  if (_queued >= _max_queued_acrs)
+  {
+    dropped = true;
+  }
+  else
+  {
+    _pending.push_back(rr);
+    ++_queued;
+
+    if (_pending.size() >= MAX_BATCH_SIZE)
+    {
+      // There's a full batch waiting, so flush it now.
+      pthread_cond_signal(&_cond);
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  if (dropped)
+  {
+    TRC_WARNING("Too many ACRs waiting to be sent to Ralf - dropping ACR for %s",
+                rr->path.c_str());
+    if (_dropped_acrs_tbl != NULL)
+    {
+      _dropped_acrs_tbl->increment();
+    }
+    delete rr;
+  }
+}
+
+void* RalfProcessor::flush_thread_function(void* processor)
+{
+  ((RalfProcessor*)processor)->flush_thread_function();
+  return NULL;
+}
+
+void RalfProcessor::flush_thread_function()
+{
+  pthread_mutex_lock(&_lock);
+
+  while (true)
+  {
+    // Wait for the flush interval, or until there's a full batch waiting.
+    struct timespec abstime;
+    clock_gettime(CLOCK_MONOTONIC, &abstime);
+    abstime.tv_sec += _batch_interval_ms / 1000;
+    abstime.tv_nsec += (_batch_interval_ms % 1000) * 1000000;
+    if (abstime.tv_nsec >= 1000000000)
+    {
+      abstime.tv_sec += 1;
+      abstime.tv_nsec -= 1000000000;
+    }
+
+    int rc = 0;
+    while ((!_terminated) &&
+           (_pending.size() < MAX_BATCH_SIZE) &&
+           (rc == 0))
+    {
+      rc = pthread_cond_timedwait(&_cond, &_lock, &abstime);
+    }
+
+    bool terminated = _terminated;
+    std::vector<RalfRequest*> requests;
+    requests.swap(_pending);
+
+    // Hand the requests to the pool without holding the lock, as this blocks
+    // if the pool's queue is full.
+    pthread_mutex_unlock(&_lock);
+    flush(requests);
+    pthread_mutex_lock(&_lock);
+
+    if (terminated)
+    {
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+void RalfProcessor::flush(std::vector<RalfRequest*>& requests)
+{
+  if (requests.empty())
+  {
+    return;
+  }
+
+  TRC_DEBUG("Flushing %d queued ACRs to Ralf", (int)requests.size());
+
+  std::vector<RalfBatch*> batches(std::max(_num_threads, 1), (RalfBatch*)NULL);
+
+  for (std::vector<RalfRequest*>::iterator it = requests.begin();
+       it != requests.end();
+       ++it)
+  {
+    // The path identifies the call, so ACRs for the same call go in the same
+    // batch.
+    size_t ii = std::hash<std::string>()((*it)->path) % batches.size();
+    if (batches[ii] == NULL)
+    {
+      batches[ii] = new RalfBatch();
+      batches[ii]->processor = this;
+    }
+    batches[ii]->requests.push_back(*it);
+  }
+
+  for (std::vector<RalfBatch*>::iterator it = batches.begin();
+       it != batches.end();
+       ++it)
+  {
+    if (*it != NULL)
+    {
+      _thread_pool->add_work(*it);
+    }
+  }
+}
+
+void RalfProcessor::batch_complete(RalfBatch* batch)
+{
+  for (std::vector<RalfRequest*>::iterator it = batch->requests.begin();
+       it != batch->requests.end();
+       ++it)
+  {
+    delete *it; *it = NULL;
+  }
+
+  if (_batch_interval_ms > 0)
+  {
+    pthread_mutex_lock(&_lock);
+    _queued -= batch->requests.size();
+    pthread_mutex_unlock(&_lock);
+  }
+
+  delete batch;
 }
 
-// Send the ACR to Ralf
-void RalfProcessor::Pool::process_work(RalfProcessor::RalfRequest*& rr)
+void RalfProcessor::exception_callback(RalfProcessor::RalfBatch* batch)
 {
-  // Send the request using HTTPConnection, which adds penalties via
-  // the load monitor if the request fails
+  // No recovery behaviour as this is asynchronous, so we can't sensibly
+  // respond.  The requests that weren't sent are dropped, and no longer
+  // count towards the ACRs queued.
+  TRC_WARNING("Exception sending ACRs to Ralf - dropping the rest of the batch");
+  batch->processor->batch_complete(batch);
+}
+
+// Send the ACRs to Ralf
+void RalfProcessor::Pool::process_work(RalfProcessor::RalfBatch*& batch)
+{
+  // Send the requests one after another using HTTPConnection, which reuses
+  // this thread's connection to Ralf, and adds penalties via the load
+  // monitor if a request fails
   std::map<std::string, std::string> headers;
-  _ralf_connection->send_post(rr->path,
-                              headers,
-                              rr->message,
-                              rr->trail);
-  delete rr; rr = NULL;
+
+  for (std::vector<RalfRequest*>::iterator it = batch->requests.begin();
+       it != batch->requests.end();
+       ++it)
+  {
+    RalfRequest* rr = *it;
+    _ralf_connection->send_post(rr->path,
+                                headers,
+                                rr->message,
+                                rr->trail);
+
+    // Clear each request from the batch once it's sent, so that if a later
+    // one hits an exception, only the unsent requests are freed.
+    delete rr; *it = NULL;
+  }
+
+  _processor->batch_complete(batch);
+  batch = NULL;
 }
 
-RalfProcessor::Pool::Pool(HttpConnection* ralf_connection,
-                          ExceptionHandler* exception_handler, 
-                          void (*callback)(RalfProcessor::RalfRequest*),
+RalfProcessor::Pool::Pool(RalfProcessor* processor,
+                          HttpConnection* ralf_connection,
+                          ExceptionHandler* exception_handler,
+                          void (*callback)(RalfProcessor::RalfBatch*),
                           unsigned int num_threads) :
-  ThreadPool<RalfProcessor::RalfRequest*>(num_threads, 
-                                          exception_handler, 
-                                          callback, 
-                                          100),
+  ThreadPool<RalfProcessor::RalfBatch*>(num_threads,
+                                        exception_handler,
+                                        callback,
+                                        100),
+  _processor(processor),
   _ralf_connection(ralf_connection)
 {}
 
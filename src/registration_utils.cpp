@@ -25,6 +25,7 @@ extern "C" {
 #include "stack.h"
 #include "registrarsproutlet.h"
 #include "registration_utils.h"
+#include "sdm_fanout.h"
 #include "log.h"
 #include <boost/lexical_cast.hpp>
 #include "sproutsasevent.h"
@@ -340,12 +341,10 @@ void RegistrationUtils::register_with_application_servers(Ifcs& ifcs,
   bool found_match;
 
   std::vector<Ifc> fallback_ifcs;
-  rapidxml::xml_document<>* root = NULL;
 
   if ((fifc_service) && (ifc_configuration._apply_fallback_ifcs))
   {
-    root = new rapidxml::xml_document<>;
-    fallback_ifcs = fifc_service->get_fallback_ifcs(root);
+    fallback_ifcs = fifc_service->get_fallback_ifcs();
   }
 
   std::vector<AsInvocation> as_list;
@@ -418,8 +417,6 @@ void RegistrationUtils::register_with_application_servers(Ifcs& ifcs,
                                          trail);
     }
   }
-
-  delete root; root = NULL;
 }
 
 static PJUtils::Callback* build_register_cb(void* token,
@@ -755,13 +752,19 @@ bool RegistrationUtils::remove_bindings(SubscriberDataManager* sdm,
   // make any effort to check whether the local and remote stores are in sync --
   // we'll do this next time we get the data from the store and before we do
   // anything with it.
-  for (std::vector<SubscriberDataManager*>::const_iterator remote_sdm =
-       remote_sdms.begin();
-       remote_sdm != remote_sdms.end();
-       ++remote_sdm)
-  {
-    (void) expire_bindings(*remote_sdm, aor, &associated_uris, binding_id, scscf_uri, trail);
-  }
+  // These writes may happen in parallel, so each gets its own copy of the
+  // S-CSCF URI to write to (they don't use it).
+  SDMFanout::for_each(remote_sdms,
+                      [&](SubscriberDataManager* remote_sdm)
+                      {
+                        std::string remote_scscf_uri;
+                        (void) expire_bindings(remote_sdm,
+                                               aor,
+                                               &associated_uris,
+                                               binding_id,
+                                               remote_scscf_uri,
+                                               trail);
+                      });
 
   return all_bindings_expired;
 }
@@ -0,0 +1,77 @@
+/**
+ * @file sas_rx_log_pool.cpp  Thread pool that logs received SIP messages to
+ *                            SAS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "log.h"
+#include "sproutsasevent.h"
+#include "sas_rx_log_pool.h"
+
+SASRxLogPool::SASRxLogPool(ExceptionHandler* exception_handler,
+                           unsigned int num_threads,
+                           unsigned int max_queued) :
+  ThreadPool<SASRxLog*>(num_threads, exception_handler, &exception_callback),
+  _max_queued(max_queued),
+  _queued(0),
+  _dropped(0)
+{
+}
+
+SASRxLogPool::~SASRxLogPool()
+{
+}
+
+bool SASRxLogPool::queue_log(SASRxLog* rx_log)
+{
+  if (++_queued > _max_queued)
+  {
+    --_queued;
+
+    // Only report the first drop and every thousandth after, so that a slow
+    // SAS connection doesn't flood the log.
+    uint64_t dropped = ++_dropped;
+    if (dropped % 1000 == 1)
+    {
+      TRC_WARNING("Too many received messages waiting to be logged to SAS - dropped %lu",
+                  dropped);
+    }
+
+    delete rx_log;
+    return false;
+  }
+
+  add_work(rx_log);
+  return true;
+}
+
+void SASRxLogPool::process_work(SASRxLog*& rx_log)
+{
+  // Free up the log's place in the queue before logging it, so that the
+  // count stays right even if logging hits an exception.
+  --_queued;
+  log(rx_log);
+  delete rx_log; rx_log = NULL;
+}
+
+// LCOV_EXCL_START - can't meaningfully test SAS in UT
+void SASRxLogPool::log(SASRxLog* rx_log)
+{
+  // The event is timestamped with the time the message was received, so
+  // that it is still ordered correctly against the other events logged
+  // while processing the message.
+  SAS::Event event(rx_log->trail, SASEvent::RX_SIP_MSG, 0);
+  event.set_timestamp(rx_log->timestamp);
+  event.add_static_param(rx_log->transport_type);
+  event.add_static_param(rx_log->src_port);
+  event.add_var_param(rx_log->src_name);
+  event.add_compressed_param(rx_log->msg, &SASEvent::PROFILE_SIP);
+  SAS::report_event(event);
+}
+// LCOV_EXCL_STOP
@@ -24,6 +24,7 @@
 #include "associated_uris.h"
 #include "mmfservice.h"
 #include "scscf_utils.h"
+#include "sdm_fanout.h"
 
 // Constant indicating there is no served user for a request.
 const char* NO_SERVED_USER = "";
@@ -296,20 +297,8 @@ void SCSCFSproutlet::get_bindings(const std::string& aor,
   if ((*aor_pair == NULL) ||
       (!(*aor_pair)->current_contains_bindings()))
   {
-    std::vector<SubscriberDataManager*>::iterator it = _remote_sdms.begin();
-
-    while ((it != _remote_sdms.end()) &&
-           ((*aor_pair == NULL) || !(*aor_pair)->current_contains_bindings()))
-    {
-      delete *aor_pair;
-
-      if ((*it)->has_servers())
-      {
-        *aor_pair = (*it)->get_aor_data(aor, trail);
-      }
-
-      ++it;
-    }
+    delete *aor_pair;
+    *aor_pair = SDMFanout::get_aor_data(_remote_sdms, aor, trail);
   }
 
   // TODO - Log bindings to SAS
@@ -386,19 +375,6 @@ long SCSCFSproutlet::read_hss_data(const std::string& public_id,
 }
 
 
-/// Attempt ENUM lookup if appropriate.
-void SCSCFSproutlet::translate_request_uri(pjsip_msg* req,
-                                           pj_pool_t* pool,
-                                           SAS::TrailId trail)
-{
-  return PJUtils::translate_request_uri(req,
-                                        pool,
-                                        _enum_service,
-                                        should_override_npdi(),
-                                        trail);
-}
-
-
 /// Get an ACR instance from the factory.
 /// @param trail                SAS trail identifier to use for the ACR.
 /// @param initiator            The initiator of the SIP transaction (calling
@@ -484,7 +460,9 @@ SCSCFSproutletTsx::SCSCFSproutletTsx(SCSCFSproutlet* scscf,
   _wildcard(""),
   _se_helper(stack_data.default_session_expires),
   _base_req(nullptr),
-  _scscf_uri()
+  _scscf_uri(),
+  _pending_req(NULL),
+  _enum_uri()
 {
   TRC_DEBUG("S-CSCF Transaction (%p) created", this);
 }
@@ -624,11 +602,11 @@ void SCSCFSproutletTsx::on_rx_initial_request(pjsip_msg* req)
         _scscf->get_bindings(aor, &aor_pair, trail());
 
         if ((aor_pair != NULL) &&
-            (aor_pair->get_current() != NULL))
+            (aor_pair->get_current_const() != NULL))
         {
-          if (!aor_pair->get_current()->bindings().empty())
+          if (!aor_pair->get_current_const()->bindings().empty())
           {
-            const AoR::Bindings bindings = aor_pair->get_current()->bindings();
+            const AoR::Bindings bindings = aor_pair->get_current_const()->bindings();
 
             // Loop over the bindings. If any binding has an emergency registration,
             // let the request through. When routing to UEs, we will make sure we
@@ -1031,9 +1009,8 @@ void SCSCFSproutletTsx::retrieve_odi_and_sesscase(pjsip_msg* req)
     // we'll log an ICID marker to correlate the trails.
     if (!_as_chain_link.is_set())
     {
-      pjsip_p_c_v_hdr* pcv = (pjsip_p_c_v_hdr*)pjsip_msg_find_hdr_by_name(req,
-                                                                          &STR_P_C_V,
-                                                                          NULL);
+      pjsip_p_c_v_hdr* pcv = (pjsip_p_c_v_hdr*)
+                             pjsip_msg_find_parsed_hdr_by_name(req, &STR_P_C_V);
       if (pcv)
       {
         TRC_DEBUG("No ODI token, or invalid ODI token, on request - logging ICID marker %.*s for B2BUA AS correlation", pcv->icid.slen, pcv->icid.ptr);
@@ -1147,7 +1124,7 @@ pjsip_status_code SCSCFSproutletTsx::determine_served_user(pjsip_msg* req)
         // Note that there's no need to change orig_ioi - we don't
         // actually become the originating server when we do this redirect.
         pjsip_p_c_v_hdr* pcv = (pjsip_p_c_v_hdr*)
-                               pjsip_msg_find_hdr_by_name(req, &STR_P_C_V, NULL);
+                               pjsip_msg_find_parsed_hdr_by_name(req, &STR_P_C_V);
         if (pcv)
         {
           TRC_DEBUG("Blanking out term_ioi parameter due to redirect");
@@ -1433,7 +1410,7 @@ void SCSCFSproutletTsx::apply_originating_services(pjsip_msg* req)
 
   // Add ourselves as orig-IOI.
   pjsip_p_c_v_hdr* pcv = (pjsip_p_c_v_hdr*)
-                             pjsip_msg_find_hdr_by_name(req, &STR_P_C_V, NULL);
+                             pjsip_msg_find_parsed_hdr_by_name(req, &STR_P_C_V);
   if (pcv)
   {
     pcv->orig_ioi = PJUtils::domain_from_uri(_as_chain_link.served_user(),
@@ -1476,37 +1453,27 @@ void SCSCFSproutletTsx::apply_originating_services(pjsip_msg* req)
     if (_scscf->_enum_service)
     {
       // Attempt to translate the RequestURI using ENUM or an alternative
-      // database.
-      _scscf->translate_request_uri(req, get_pool(req), trail());
-
-      URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri, true, true);
-      std::string new_uri_str = PJUtils::uri_to_string(PJSIP_URI_IN_REQ_URI, req->line.req.uri);
-      TRC_INFO("New URI string is %s", new_uri_str.c_str());
+      // database.  The lookup is run without holding up this thread, and the
+      // request is routed when it completes.
+      std::string user;
 
-      if ((uri_class == LOCAL_PHONE_NUMBER) ||
-          (uri_class == GLOBAL_PHONE_NUMBER) ||
-          (uri_class == NP_DATA) ||
-          (uri_class == FINAL_NP_DATA))
-      {
-        TRC_DEBUG("Routing to BGCF");
-        SAS::Event event(trail(), SASEvent::PHONE_ROUTING_TO_BGCF, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-        route_to_bgcf(req);
-      }
-      else if (uri_class == OFFNET_SIP_URI)
+      if (PJUtils::get_enum_user(req, false, user))
       {
-        // Destination is off-net, so route to the BGCF.
-        TRC_DEBUG("Routing to BGCF");
-        SAS::Event event(trail(), SASEvent::OFFNET_ROUTING_TO_BGCF, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-        route_to_bgcf(req);
+        EnumService* enum_service = _scscf->_enum_service;
+        SAS::TrailId trail_id = trail();
+        std::string* enum_uri = &_enum_uri;
+        _pending_req = req;
+        run_async([enum_service, user, trail_id, enum_uri]()
+                  {
+                    *enum_uri = PJUtils::lookup_enum_user(user,
+                                                          enum_service,
+                                                          trail_id);
+                  },
+                  NULL);
       }
       else
       {
-        // Destination is on-net so route to the I-CSCF.
-        route_to_icscf(req);
+        route_translated_request(req);
       }
     }
     else
@@ -1521,12 +1488,74 @@ void SCSCFSproutletTsx::apply_originating_services(pjsip_msg* req)
 }
 
 
+void SCSCFSproutletTsx::on_async_complete(void* context)
+{
+  pjsip_msg* req = _pending_req;
+  _pending_req = NULL;
+
+  if (_cancelled)
+  {
+    // The request was cancelled during the ENUM lookup.  It hasn't been
+    // forwarded, so there's no fork to cancel - just reject it.
+    TRC_DEBUG("Request cancelled during ENUM lookup, not routing it");
+    pjsip_msg* rsp = create_response(req, PJSIP_SC_REQUEST_TERMINATED);
+    send_response(rsp);
+    free_msg(req);
+    return;
+  }
+
+  PJUtils::apply_enum_translation(req,
+                                  get_pool(req),
+                                  _enum_uri,
+                                  false,
+                                  _scscf->should_override_npdi(),
+                                  trail());
+  route_translated_request(req);
+}
+
+
+/// Route a request at the end of originating processing, once its
+/// RequestURI has been translated using ENUM.
+void SCSCFSproutletTsx::route_translated_request(pjsip_msg* req)
+{
+  URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri, true, true);
+  std::string new_uri_str = PJUtils::uri_to_string(PJSIP_URI_IN_REQ_URI, req->line.req.uri);
+  TRC_INFO("New URI string is %s", new_uri_str.c_str());
+
+  if ((uri_class == LOCAL_PHONE_NUMBER) ||
+      (uri_class == GLOBAL_PHONE_NUMBER) ||
+      (uri_class == NP_DATA) ||
+      (uri_class == FINAL_NP_DATA))
+  {
+    TRC_DEBUG("Routing to BGCF");
+    SAS::Event event(trail(), SASEvent::PHONE_ROUTING_TO_BGCF, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
+    route_to_bgcf(req);
+  }
+  else if (uri_class == OFFNET_SIP_URI)
+  {
+    // Destination is off-net, so route to the BGCF.
+    TRC_DEBUG("Routing to BGCF");
+    SAS::Event event(trail(), SASEvent::OFFNET_ROUTING_TO_BGCF, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
+    route_to_bgcf(req);
+  }
+  else
+  {
+    // Destination is on-net so route to the I-CSCF.
+    route_to_icscf(req);
+  }
+}
+
+
 /// Apply terminating services for this request.
 void SCSCFSproutletTsx::apply_terminating_services(pjsip_msg* req)
 {
   // Include ourselves as the terminating operator for billing.
   pjsip_p_c_v_hdr* pcv = (pjsip_p_c_v_hdr*)
-                             pjsip_msg_find_hdr_by_name(req, &STR_P_C_V, NULL);
+                             pjsip_msg_find_parsed_hdr_by_name(req, &STR_P_C_V);
   if (pcv)
   {
     pcv->term_ioi = PJUtils::domain_from_uri(_as_chain_link.served_user(),
@@ -1897,13 +1926,13 @@ void SCSCFSproutletTsx::route_to_ue_bindings(pjsip_msg* req)
     _scscf->get_bindings(aor, &aor_pair, trail());
 
     if ((aor_pair != NULL) &&
-        (aor_pair->get_current() != NULL) &&
-        (!aor_pair->get_current()->bindings().empty()))
+        (aor_pair->get_current_const() != NULL) &&
+        (!aor_pair->get_current_const()->bindings().empty()))
     {
       // Retrieved bindings from the store so filter them to an ordered list
       // of targets.
       filter_bindings_to_targets(aor,
-                                 aor_pair->get_current(),
+                                 aor_pair->get_current_const(),
                                  req,
                                  pool,
                                  MAX_FORKING,
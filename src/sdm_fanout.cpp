@@ -0,0 +1,286 @@
+/**
+ * @file sdm_fanout.cpp  Functions for accessing the remote subscriber data
+ *                       managers in parallel.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <pthread.h>
+
+#include <memory>
+
+#include "log.h"
+#include "threadpool.h"
+#include "sdm_fanout.h"
+
+namespace SDMFanout
+{
+
+/// A unit of work for the pool - an access to one remote SDM.  If the thread
+/// running the work hits an exception, abandon is called instead of run
+/// completing, so that the caller isn't left waiting forever.
+struct Work
+{
+  std::function<void()> run;
+  std::function<void()> abandon;
+};
+
+/// @class Pool
+/// The thread pool used to access the remote SDMs.
+class Pool : public ThreadPool<Work*>
+{
+public:
+  Pool(ExceptionHandler* exception_handler, unsigned int num_threads) :
+    ThreadPool<Work*>(num_threads, exception_handler, &exception_callback)
+  {}
+
+  virtual ~Pool() {}
+
+private:
+  /// Called by worker threads when they pull work off the queue.
+  virtual void process_work(Work*& work)
+  {
+    work->run();
+    delete work; work = NULL;
+  }
+
+  static void exception_callback(Work* work)
+  {
+    work->abandon();
+    delete work;
+  }
+};
+
+/// State shared between a caller and the pool threads doing its accesses.
+/// This is reference counted, as a read returns as soon as it has found
+/// bindings, possibly before all the accesses have finished.
+struct Fanout
+{
+  Fanout() :
+    outstanding(0),
+    result(NULL),
+    fallback(NULL)
+  {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~Fanout()
+  {
+    delete result; result = NULL;
+    delete fallback; fallback = NULL;
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+  }
+
+  /// Marks one access as complete.  Must be called with the lock held.
+  void complete()
+  {
+    --outstanding;
+    pthread_cond_signal(&cond);
+  }
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  // The number of accesses still in progress.
+  int outstanding;
+
+  // For reads, the first AoR data found with bindings, and the most recent
+  // AoR data found without.
+  AoRPair* result;
+  AoRPair* fallback;
+};
+
+static Pool* pool = NULL;
+
+void init(ExceptionHandler* exception_handler, int num_threads)
+{
+  if (num_threads > 0)
+  {
+    TRC_STATUS("Accessing remote subscriber data managers in parallel on %d threads",
+               num_threads);
+    pool = new Pool(exception_handler, num_threads);
+    pool->start();
+  }
+}
+
+void term()
+{
+  if (pool != NULL)
+  {
+    pool->stop();
+    pool->join();
+    delete pool; pool = NULL;
+  }
+}
+
+static bool has_bindings(AoRPair* aor_pair)
+{
+  return ((aor_pair != NULL) && (aor_pair->current_contains_bindings()));
+}
+
+AoRPair* get_aor_data(const std::vector<SubscriberDataManager*>& sdms,
+                      const std::string& aor_id,
+                      SAS::TrailId trail)
+{
+  AoRPair* aor_pair = NULL;
+
+  if (pool == NULL)
+  {
+    // Try each remote SDM in turn until one has bindings.
+    for (std::vector<SubscriberDataManager*>::const_iterator it = sdms.begin();
+         (it != sdms.end()) && (!has_bindings(aor_pair));
+         ++it)
+    {
+      if ((*it)->has_servers())
+      {
+        delete aor_pair;
+        aor_pair = (*it)->get_aor_data(aor_id, trail);
+      }
+    }
+
+    return aor_pair;
+  }
+
+  // Issue the reads in parallel, and wait until one of them has found
+  // bindings or they have all finished.
+  std::shared_ptr<Fanout> fanout = std::make_shared<Fanout>();
+
+  for (std::vector<SubscriberDataManager*>::const_iterator it = sdms.begin();
+       it != sdms.end();
+       ++it)
+  {
+    SubscriberDataManager* sdm = *it;
+
+    if (!sdm->has_servers())
+    {
+      continue;
+    }
+
+    pthread_mutex_lock(&fanout->lock);
+    ++fanout->outstanding;
+    pthread_mutex_unlock(&fanout->lock);
+
+    Work* work = new Work();
+    work->run = [fanout, sdm, aor_id, trail]()
+    {
+      AoRPair* data = sdm->get_aor_data(aor_id, trail);
+
+      pthread_mutex_lock(&fanout->lock);
+      if (has_bindings(data))
+      {
+        if (fanout->result == NULL)
+        {
+          fanout->result = data; data = NULL;
+        }
+      }
+      else if (data != NULL)
+      {
+        delete fanout->fallback;
+        fanout->fallback = data; data = NULL;
+      }
+      fanout->complete();
+      pthread_mutex_unlock(&fanout->lock);
+
+      // This is only non-NULL if another remote SDM has already returned
+      // bindings.
+      delete data;
+    };
+    work->abandon = [fanout]()
+    {
+      pthread_mutex_lock(&fanout->lock);
+      fanout->complete();
+      pthread_mutex_unlock(&fanout->lock);
+    };
+
+    pool->add_work(work);
+  }
+
+  pthread_mutex_lock(&fanout->lock);
+
+  while ((fanout->result == NULL) && (fanout->outstanding > 0))
+  {
+    pthread_cond_wait(&fanout->cond, &fanout->lock);
+  }
+
+  if (fanout->result != NULL)
+  {
+    aor_pair = fanout->result;
+    fanout->result = NULL;
+  }
+  else
+  {
+    aor_pair = fanout->fallback;
+    fanout->fallback = NULL;
+  }
+
+  pthread_mutex_unlock(&fanout->lock);
+
+  return aor_pair;
+}
+
+void for_each(const std::vector<SubscriberDataManager*>& sdms,
+              const std::function<void(SubscriberDataManager*)>& fn)
+{
+  if (pool == NULL)
+  {
+    for (std::vector<SubscriberDataManager*>::const_iterator it = sdms.begin();
+         it != sdms.end();
+         ++it)
+    {
+      fn(*it);
+    }
+
+    return;
+  }
+
+  // Run the function for each SDM in parallel, and wait for all of them to
+  // finish.  As we wait, the function (and anything it refers to) stays valid
+  // until the pool has finished with it.
+  std::shared_ptr<Fanout> fanout = std::make_shared<Fanout>();
+
+  pthread_mutex_lock(&fanout->lock);
+  fanout->outstanding = sdms.size();
+  pthread_mutex_unlock(&fanout->lock);
+
+  for (std::vector<SubscriberDataManager*>::const_iterator it = sdms.begin();
+       it != sdms.end();
+       ++it)
+  {
+    SubscriberDataManager* sdm = *it;
+    Work* work = new Work();
+    work->run = [fanout, sdm, &fn]()
+    {
+      fn(sdm);
+
+      pthread_mutex_lock(&fanout->lock);
+      fanout->complete();
+      pthread_mutex_unlock(&fanout->lock);
+    };
+    work->abandon = [fanout]()
+    {
+      pthread_mutex_lock(&fanout->lock);
+      fanout->complete();
+      pthread_mutex_unlock(&fanout->lock);
+    };
+
+    pool->add_work(work);
+  }
+
+  pthread_mutex_lock(&fanout->lock);
+
+  while (fanout->outstanding > 0)
+  {
+    pthread_cond_wait(&fanout->cond, &fanout->lock);
+  }
+
+  pthread_mutex_unlock(&fanout->lock);
+}
+
+}
@@ -12,6 +12,7 @@
 #include <sys/stat.h>
 #include <fstream>
 #include <stdlib.h>
+#include <memory>
 
 #include "sifcservice.h"
 #include "log.h"
@@ -19,7 +20,6 @@
 #include "sproutsasevent.h"
 #include "sprout_pd_definitions.h"
 #include "utils.h"
-#include "rapidxml/rapidxml_print.hpp"
 
 SIFCService::SIFCService(Alarm* alarm,
                          SNMP::CounterTable* no_shared_ifcs_set_tbl,
@@ -65,8 +65,10 @@ void SIFCService::update_sets()
     return;
   }
 
-  // Now parse the document
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
+  // Now parse the document.  The document is kept as part of the new version
+  // of the sets, as the iFCs refer into it.
+  std::shared_ptr<rapidxml::xml_document<> > root =
+                                 std::make_shared<rapidxml::xml_document<> >();
 
   try
   {
@@ -79,7 +81,6 @@ void SIFCService::update_sets()
               err.what());
     CL_SPROUT_SIFC_FILE_INVALID_XML.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
@@ -88,14 +89,14 @@ void SIFCService::update_sets()
     TRC_ERROR("Invalid shared iFCs configuration file - missing SharedIFCsSets block");
     CL_SPROUT_SIFC_FILE_MISSING_SHARED_IFCS_SETS.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
   // At this point, we're definitely going to override the iFCs we've got.
-  // Update our map, taking a lock while we do so.
-  boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
-  _shared_ifc_sets.clear();
+  // Build the new version of the sets without any lock held - calls carry on
+  // using the current version until the new one is swapped in below.
+  std::shared_ptr<Sets> new_sets = std::make_shared<Sets>();
+  new_sets->doc = root;
   bool any_errors = false;
 
   rapidxml::xml_node<>* sets = root->first_node(SIFCService::SHARED_IFCS_SETS);
@@ -128,7 +129,7 @@ void SIFCService::update_sets()
       continue;
     }
 
-    if (_shared_ifc_sets.count(set_id) != 0)
+    if (new_sets->sets.count(set_id) != 0)
     {
       TRC_ERROR("Invalid shared iFC block - SetID (%d) is repeated. Skipping this entry",
                 set_id);
@@ -137,7 +138,7 @@ void SIFCService::update_sets()
       continue;
     }
 
-    std::vector<std::pair<int32_t, std::string>> ifc_set;
+    std::vector<std::pair<int32_t, Ifc>> ifc_set;
 
     for (rapidxml::xml_node<>* ifc = set->first_node(RegDataXMLUtils::IFC);
          ifc != NULL;
@@ -164,16 +165,18 @@ void SIFCService::update_sets()
 
       // Creating the iFC always passes; we don't validate the iFC any further
       // at this stage. We've validated this against a schema before allowing
-      // any upload though.
-      std::string ifc_str;
-      rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-      ifc_set.push_back(std::make_pair(priority, ifc_str));
+      // any upload though.  This compiles the iFC now, rather than on the
+      // first call that uses it.
+      ifc_set.push_back(std::make_pair(priority, Ifc(ifc, root)));
     }
 
     TRC_STATUS("Adding %lu iFCs for ID %d", ifc_set.size(), set_id);
-    _shared_ifc_sets.insert(std::make_pair(set_id, ifc_set));
+    new_sets->sets.insert(std::make_pair(set_id, ifc_set));
   }
 
+  std::atomic_store(&_shared_ifc_sets,
+                    std::shared_ptr<const Sets>(new_sets));
+
   if (any_errors)
   {
     set_alarm();
@@ -182,38 +185,36 @@ void SIFCService::update_sets()
   {
     clear_alarm();
   }
-
-  delete root; root = NULL;
 }
 
 SIFCService::~SIFCService()
 {
   delete _updater; _updater = NULL;
-  _shared_ifc_sets.clear();
+  _shared_ifc_sets.reset();
   delete _alarm; _alarm = NULL;
 }
 
 void SIFCService::get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
                                    const std::set<int32_t>& ids,
-                                   std::shared_ptr<xml_document<> > ifc_doc,
                                    SAS::TrailId trail) const
 {
-  // Take a read lock on the mutex in RAII style
-  boost::shared_lock<boost::shared_mutex> read_lock(_sets_rw_lock);
+  // Take a reference to the current version of the sets.  This stays valid
+  // (and unchanged) for the rest of the call even if the configuration is
+  // reloaded meanwhile.
+  std::shared_ptr<const Sets> sets = std::atomic_load(&_shared_ifc_sets);
 
   for (int id : ids)
   {
     TRC_DEBUG("Getting the shared iFCs for ID %d", id);
-    std::map<int, std::vector<std::pair<int32_t, std::string>>>::const_iterator i =
-                                                      _shared_ifc_sets.find(id);
+    std::map<int32_t, std::vector<std::pair<int32_t, Ifc>>>::const_iterator i;
 
-    if (i != _shared_ifc_sets.end())
+    if ((sets) && ((i = sets->sets.find(id)) != sets->sets.end()))
     {
       TRC_DEBUG("Found iFC set for ID %d", id);
 
-      for (std::pair<int32_t, std::string> ifc : i->second)
+      for (const std::pair<int32_t, Ifc>& ifc : i->second)
       {
-        ifc_map.insert(std::make_pair(ifc.first, Ifc(ifc.second, ifc_doc.get())));
+        ifc_map.insert(ifc);
       }
     }
     else
@@ -0,0 +1,189 @@
+/**
+ * @file simservs_cache.cpp  Cache of subscribers' simservs documents for the
+ *                           MMTEL AS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "log.h"
+#include "simservs_cache.h"
+
+SimservsCache::SimservsCache(int ttl_s,
+                             int max_entries,
+                             SNMP::CounterTable* hits_tbl,
+                             SNMP::CounterTable* misses_tbl,
+                             SNMP::CounterTable* revalidations_tbl) :
+  _ttl_ms((unsigned long)ttl_s * 1000),
+  _max_entries_per_shard(std::max(1, max_entries / NUM_SHARDS)),
+  _shards(),
+  _hits_tbl(hits_tbl),
+  _misses_tbl(misses_tbl),
+  _revalidations_tbl(revalidations_tbl)
+{
+  for (int ii = 0; ii < NUM_SHARDS; ++ii)
+  {
+    Shard* shard = new Shard();
+    pthread_mutex_init(&shard->lock, NULL);
+    _shards.push_back(shard);
+  }
+}
+
+SimservsCache::~SimservsCache()
+{
+  for (std::vector<Shard*>::iterator it = _shards.begin();
+       it != _shards.end();
+       ++it)
+  {
+    pthread_mutex_destroy(&(*it)->lock);
+    delete *it;
+  }
+  _shards.clear();
+}
+
+bool SimservsCache::get(const std::string& public_id,
+                        std::shared_ptr<const simservs>& services,
+                        std::string& etag)
+{
+  bool valid = false;
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+    shard.entries.find(public_id);
+
+  if (it != shard.entries.end())
+  {
+    // Move the entry to the front of the LRU list.  Expired entries are
+    // returned too, so that they can be revalidated.
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    services = it->second->services;
+    etag = it->second->etag;
+    valid = (it->second->expiry_ms > now_ms());
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+
+  if (valid)
+  {
+    TRC_DEBUG("Found cached simservs for %s", public_id.c_str());
+    if (_hits_tbl != NULL)
+    {
+      _hits_tbl->increment();
+    }
+  }
+  else
+  {
+    if (services)
+    {
+      TRC_DEBUG("Cached simservs for %s has expired", public_id.c_str());
+    }
+
+    if (_misses_tbl != NULL)
+    {
+      _misses_tbl->increment();
+    }
+  }
+
+  return valid;
+}
+
+void SimservsCache::put(const std::string& public_id,
+                        const std::shared_ptr<const simservs>& services,
+                        const std::string& etag)
+{
+  Entry entry;
+  entry.public_id = public_id;
+  entry.services = services;
+  entry.etag = etag;
+  entry.expiry_ms = now_ms() + _ttl_ms;
+
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+    shard.entries.find(public_id);
+
+  if (it != shard.entries.end())
+  {
+    shard.lru.erase(it->second);
+    shard.entries.erase(it);
+  }
+
+  shard.lru.push_front(entry);
+  shard.entries[public_id] = shard.lru.begin();
+
+  while (shard.lru.size() > _max_entries_per_shard)
+  {
+    TRC_DEBUG("Evicting cached simservs for %s",
+              shard.lru.back().public_id.c_str());
+    shard.entries.erase(shard.lru.back().public_id);
+    shard.lru.pop_back();
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+}
+
+void SimservsCache::revalidated(const std::string& public_id)
+{
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+    shard.entries.find(public_id);
+
+  if (it != shard.entries.end())
+  {
+    it->second->expiry_ms = now_ms() + _ttl_ms;
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+
+  TRC_DEBUG("Cached simservs for %s is still valid", public_id.c_str());
+  if (_revalidations_tbl != NULL)
+  {
+    _revalidations_tbl->increment();
+  }
+}
+
+void SimservsCache::invalidate(const std::string& public_id)
+{
+  Shard& shard = get_shard(public_id);
+
+  pthread_mutex_lock(&shard.lock);
+
+  std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it =
+    shard.entries.find(public_id);
+
+  if (it != shard.entries.end())
+  {
+    shard.lru.erase(it->second);
+    shard.entries.erase(it);
+  }
+
+  pthread_mutex_unlock(&shard.lock);
+}
+
+SimservsCache::Shard& SimservsCache::get_shard(const std::string& public_id)
+{
+  return *_shards[std::hash<std::string>()(public_id) % _shards.size()];
+}
+
+unsigned long SimservsCache::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
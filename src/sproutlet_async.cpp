@@ -0,0 +1,105 @@
+/**
+ * @file sproutlet_async.cpp  Thread pool for operations that sproutlets run
+ *                            asynchronously.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "log.h"
+#include "threadpool.h"
+#include "sproutlet_async.h"
+
+namespace SproutletAsync
+{
+
+/// An operation for the pool to run, and the callback to dispatch when it has
+/// finished.
+struct Work
+{
+  std::function<void()> op;
+  PJUtils::Callback* resume;
+};
+
+static DispatchFn dispatch_fn = NULL;
+
+/// @class Pool
+/// The thread pool used to run asynchronous operations.
+class Pool : public ThreadPool<Work*>
+{
+public:
+  Pool(ExceptionHandler* exception_handler, unsigned int num_threads) :
+    ThreadPool<Work*>(num_threads, exception_handler, &exception_callback)
+  {}
+
+  virtual ~Pool() {}
+
+private:
+  /// Called by worker threads when they pull work off the queue.
+  virtual void process_work(Work*& work)
+  {
+    work->op();
+    dispatch_fn(work->resume);
+    delete work; work = NULL;
+  }
+
+  /// If the operation hits an exception, the sproutlet is still resumed, so
+  /// that its transaction isn't left waiting forever.
+  static void exception_callback(Work* work)
+  {
+    dispatch_fn(work->resume);
+    delete work;
+  }
+};
+
+static Pool* pool = NULL;
+
+void init(ExceptionHandler* exception_handler,
+          int num_threads,
+          DispatchFn dispatch)
+{
+  if (num_threads > 0)
+  {
+    TRC_STATUS("Running asynchronous sproutlet operations on %d threads",
+               num_threads);
+    dispatch_fn = dispatch;
+    pool = new Pool(exception_handler, num_threads);
+    pool->start();
+  }
+}
+
+void term()
+{
+  if (pool != NULL)
+  {
+    pool->stop();
+    pool->join();
+    delete pool; pool = NULL;
+  }
+}
+
+bool enabled()
+{
+  return (pool != NULL);
+}
+
+bool run(const std::function<void()>& op, PJUtils::Callback* resume)
+{
+  if (pool == NULL)
+  {
+    return false;
+  }
+
+  Work* work = new Work();
+  work->op = op;
+  work->resume = resume;
+  pool->add_work(work);
+
+  return true;
+}
+
+}
@@ -23,6 +23,7 @@ extern "C" {
 #include "pjutils.h"
 #include "sproutsasevent.h"
 #include "sproutletproxy.h"
+#include "sproutlet_async.h"
 #include "snmp_sip_request_types.h"
 
 const pj_str_t SproutletProxy::STR_SERVICE = {"service", 7};
@@ -43,7 +44,9 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
              stateless_proxies),
   _root_uri(NULL),
   _host_aliases(host_aliases),
-  _sproutlets(sproutlets)
+  _sproutlets(sproutlets),
+  _local_hosts(),
+  _service_index()
 {
   /// Store the URI of this SproutletProxy - this is used for Record-Routing.
   TRC_DEBUG("Root Record-Route URI = %s", root_uri.c_str());
@@ -51,6 +54,15 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
                                                        stack_data.pool,
                                                        false);
 
+  // Index the local hostnames.
+  _local_hosts.insert(RouteKey(&_root_uri->host));
+  for (std::unordered_set<std::string>::const_iterator it = _host_aliases.begin();
+       it != _host_aliases.end();
+       ++it)
+  {
+    _local_hosts.insert(RouteKey(*it));
+  }
+
   for (std::list<Sproutlet*>::iterator it = _sproutlets.begin();
        it != _sproutlets.end();
        ++it)
@@ -102,7 +114,8 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
   }
   else
   {
-    _services.insert(std::make_pair(sproutlet->service_name(), sproutlet));
+    i = _services.insert(std::make_pair(sproutlet->service_name(), sproutlet)).first;
+    _service_index[RouteKey(i->first)] = sproutlet;
   }
 
   std::list<std::string> aliases = sproutlet->aliases();
@@ -124,7 +137,8 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
     }
     else
     {
-      _services.insert(std::make_pair(*j, sproutlet));
+      k = _services.insert(std::make_pair(*j, sproutlet)).first;
+      _service_index[RouteKey(k->first)] = sproutlet;
     }
   }
 
@@ -133,7 +147,7 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
   int port = sproutlet->port();
   if (port != 0)
   {
-    std::map<int, Sproutlet*>::const_iterator i;
+    std::unordered_map<int, Sproutlet*>::const_iterator i;
     i = _ports.find(port);
     if (i != _ports.end())
     {
@@ -243,7 +257,7 @@ Sproutlet* SproutletProxy::target_sproutlet(pjsip_msg* req,
       event.add_static_param(port);
       SAS::report_event(event);
 
-      std::map<int, Sproutlet*>::const_iterator it = _ports.find(port);
+      std::unordered_map<int, Sproutlet*>::const_iterator it = _ports.find(port);
       if (it != _ports.end())
       {
         sproutlet = it->second;
@@ -286,8 +300,9 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
   // Now we know we have a SIP URI, cast to one.
   pjsip_sip_uri* sip_uri = (pjsip_sip_uri*)uri;
 
-  std::string service_name;
-  std::map<std::string, Sproutlet*>::const_iterator it;
+  // Whether the host is local is needed by more than one of the checks
+  // below, so only work it out once.
+  bool host_local = is_host_local(&sip_uri->host);
 
   // First check if there is a services parameter, and if it matches a
   // sproutlet.
@@ -299,15 +314,13 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
               services_param->value.slen,
               services_param->value.ptr);
 
-    if (is_host_local(&sip_uri->host))
+    if (host_local)
     {
       // Check if this service matches a sproutlet.
-      service_name = PJUtils::pj_str_to_string(&services_param->value);
-      it = _services.find(service_name);
-      if (it != _services.end())
+      sproutlet = find_service(RouteKey(&services_param->value));
+      if (sproutlet != NULL)
       {
-        sproutlet = it->second;
-        alias = service_name;
+        alias = PJUtils::pj_str_to_string(&services_param->value);
         local_hostname = PJUtils::pj_str_to_string(&sip_uri->host);
         selection_type = SERVICE_NAME;
       }
@@ -328,14 +341,15 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
     if (sep != NULL)
     {
       // Extract the possible service name
-      service_name = std::string(hostname.ptr, sep - hostname.ptr);
+      RouteKey service_name(hostname.ptr, sep - hostname.ptr);
 
       // Remove the service name part and the period from the hostname.
       hostname.slen -= (sep - hostname.ptr + 1);
       hostname.ptr = sep + 1;
 
-      TRC_DEBUG("Possible service name %s will be used if %.*s is a local hostname",
-                service_name.c_str(),
+      TRC_DEBUG("Possible service name %.*s will be used if %.*s is a local hostname",
+                (int)service_name.slen,
+                service_name.ptr,
                 hostname.slen,
                 hostname.ptr);
 
@@ -343,11 +357,10 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
       {
         // Check if the part of the hostname before the first '.' matches
         // a sproutlet.
-        it = _services.find(service_name);
-        if (it != _services.end())
+        sproutlet = find_service(service_name);
+        if (sproutlet != NULL)
         {
-          sproutlet = it->second;
-          alias = service_name;
+          alias = std::string(service_name.ptr, service_name.slen);
           local_hostname = PJUtils::pj_str_to_string(&hostname);
           selection_type = DOMAIN_PART;
         }
@@ -362,15 +375,13 @@ Sproutlet* SproutletProxy::match_sproutlet_from_uri(const pjsip_uri* uri,
   {
     TRC_DEBUG("Found user part - %.*s", sip_uri->user.slen, sip_uri->user.ptr);
 
-    if (is_host_local(&sip_uri->host))
+    if (host_local)
     {
       // Check if the user part matches a sproutlet.
-      service_name = PJUtils::pj_str_to_string(&sip_uri->user);
-      it = _services.find(service_name);
-      if (it != _services.end())
+      sproutlet = find_service(RouteKey(&sip_uri->user));
+      if (sproutlet != NULL)
       {
-        sproutlet = it->second;
-        alias = service_name;
+        alias = PJUtils::pj_str_to_string(&sip_uri->user);
         local_hostname = PJUtils::pj_str_to_string(&sip_uri->host);
         selection_type = USER_PART;
       }
@@ -519,24 +530,14 @@ std::string SproutletProxy::get_local_hostname(const pjsip_sip_uri* uri) const
 
 bool SproutletProxy::is_host_local(const pj_str_t* host) const
 {
-  bool rc = false;
-
-  if (!pj_stricmp(host, &_root_uri->host))
-  {
-    rc = true;
-  }
-
-  for (std::unordered_set<std::string>::const_iterator it = _host_aliases.begin();
-       (rc != true) && (it != _host_aliases.end());
-       ++it)
-  {
-    if (!pj_stricmp2(host, it->c_str()))
-    {
-      rc = true;
-    }
-  }
+  return (_local_hosts.find(RouteKey(host)) != _local_hosts.end());
+}
 
-  return rc;
+Sproutlet* SproutletProxy::find_service(const RouteKey& name) const
+{
+  std::unordered_map<RouteKey, Sproutlet*, RouteKeyHash<false>, RouteKeyEqual<false> >::const_iterator it =
+    _service_index.find(name);
+  return (it != _service_index.end()) ? it->second : NULL;
 }
 
 bool SproutletProxy::is_uri_reflexive(const pjsip_uri* uri,
@@ -600,7 +601,8 @@ SproutletProxy::UASTsx::UASTsx(SproutletProxy* proxy) :
   _pending_req_q(),
   _sproutlet_proxy(proxy),
   _timers(),
-  _pending_timers()
+  _pending_timers(),
+  _pending_async_ops(0)
 {
   TRC_VERBOSE("Sproutlet Proxy transaction (%p) created", this);
 }
@@ -1040,6 +1042,36 @@ void SproutletProxy::UASTsx::process_timer_pop(pj_timer_entry* tentry)
 }
 
 
+bool SproutletProxy::UASTsx::run_async(SproutletWrapper* tsx,
+                                       const std::function<void()>& op,
+                                       void* context)
+{
+  AsyncCallback* cb = new AsyncCallback(this, tsx, context);
+
+  if (!SproutletAsync::run(op, cb))
+  {
+    delete cb;
+    return false;
+  }
+
+  ++_pending_async_ops;
+  return true;
+}
+
+
+void SproutletProxy::UASTsx::process_async_complete(SproutletWrapper* tsx,
+                                                    void* context)
+{
+  enter_context();
+
+  --_pending_async_ops;
+  tsx->on_async_complete(context);
+  schedule_requests();
+
+  exit_context();
+}
+
+
 void SproutletProxy::UASTsx::tx_response(SproutletWrapper* downstream,
                                          pjsip_tx_data* rsp)
 {
@@ -1149,6 +1181,7 @@ void SproutletProxy::UASTsx::check_destroy()
       (_umap.empty()) &&
       (_pending_req_q.empty()) &&
       (_pending_timers.empty()) &&
+      (_pending_async_ops == 0) &&
       (_tsx == NULL))
   {
     // UAS transaction has been destroyed and all Sproutlets are complete.
@@ -1249,6 +1282,7 @@ SproutletWrapper::SproutletWrapper(SproutletProxy* proxy,
   _process_actions_entered(0),
   _forks(),
   _pending_timers(),
+  _pending_async_ops(0),
   _trail_id(trail_id)
 {
   if (_original_transport != NULL)
@@ -1720,6 +1754,21 @@ bool SproutletWrapper::timer_running(TimerID id)
   return _proxy_tsx->timer_running(id);
 }
 
+void SproutletWrapper::run_async(const std::function<void()>& op, void* context)
+{
+  if (_proxy_tsx->run_async(this, op, context))
+  {
+    TRC_DEBUG("%s started asynchronous operation", _id.c_str());
+    ++_pending_async_ops;
+  }
+  else
+  {
+    // Asynchronous operations are disabled, so just run the operation now.
+    op();
+    _sproutlet_tsx->on_async_complete(context);
+  }
+}
+
 SAS::TrailId SproutletWrapper::trail() const
 {
   return _trail_id;
@@ -1955,6 +2004,14 @@ void SproutletWrapper::on_timer_pop(TimerID id, void* context)
   process_actions(false);
 }
 
+void SproutletWrapper::on_async_complete(void* context)
+{
+  TRC_DEBUG("%s asynchronous operation has completed", _id.c_str());
+  --_pending_async_ops;
+  _sproutlet_tsx->on_async_complete(context);
+  process_actions(false);
+}
+
 void SproutletWrapper::register_tdata(pjsip_tx_data* tdata)
 {
   TRC_DEBUG("Adding message %p => txdata %p mapping",
@@ -2047,10 +2104,12 @@ void SproutletWrapper::process_actions(bool complete_after_actions)
   if ((_complete) &&
       (_pending_responses == 0) &&
       (_pending_timers.empty()) &&
+      (_pending_async_ops == 0) &&
       (_process_actions_entered == 0))
   {
     // Sproutlet has sent a final response, has no downstream forks waiting
-    // a response, and has no pending timers, so should destroy itself.
+    // a response, and has no pending timers or asynchronous operations, so
+    // should destroy itself.
     TRC_VERBOSE("%s suiciding", _id.c_str());
     delete this;
   }
@@ -25,7 +25,11 @@ extern "C" {
 #include <set>
 #include <list>
 #include <queue>
+#include <deque>
 #include <string>
+#include <unordered_map>
+#include <pthread.h>
+#include <time.h>
 
 #include "constants.h"
 #include "eventq.h"
@@ -133,12 +137,30 @@ extern void set_quiescing_false()
 }
 
 /// PJSIP threads are donated to PJSIP to handle receiving at transport level
-/// and timers.
+/// and timers.  If there are multiple PJSIP threads, they all poll the same
+/// endpoint, and received messages and timers are handled by whichever thread
+/// polls first.  Note that this means several messages from the same socket
+/// can be processed at once (for example, PJSIP has many reads outstanding on
+/// each UDP socket), so processing on these threads must not rely on being
+/// serialized.  The parameter is the index of the thread - only the first
+/// thread handles quiescing.
+///
+/// The transports can't be partitioned between the threads.  PJSIP registers
+/// every transport with the endpoint's single ioqueue when it creates it, and
+/// runs every timer (including the ones that destroy transactions) off the
+/// endpoint's single timer heap.  Code that relied on there being only one
+/// transport thread has been changed as follows.
+/// - Received messages are correlated with transactions using the trail index
+///   below, rather than by reading the transaction (see get_tsx_trail).
+/// - Transaction callbacks and timers take the transaction group lock
+///   (see BasicProxy::UASTsx::trying_timer_expired).
+/// - The connection tracker has its own lock, and only this first thread
+///   quiesces and unquiesces it.
 static int pjsip_thread_func(void *p)
 {
   pj_time_val delay = {0, 10};
 
-  PJ_UNUSED_ARG(p);
+  bool handle_quiescing = ((size_t)p == 0);
 
   TRC_STATUS("PJSIP thread started");
 
@@ -151,7 +173,7 @@ static int pjsip_thread_func(void *p)
 
     // Check if our quiescing state has changed, and act appropriately
     new_quiescing = quiescing;
-    if (curr_quiescing != new_quiescing)
+    if ((handle_quiescing) && (curr_quiescing != new_quiescing))
     {
       TRC_STATUS("Quiescing state changed");
       curr_quiescing = new_quiescing;
@@ -528,17 +550,120 @@ pj_status_t init_pjsip()
   return PJ_SUCCESS;
 }
 
-pj_status_t start_pjsip_thread()
+/// Index of the trails of transactions, keyed by transaction key.  This is
+/// used to correlate received messages with transactions when there are
+/// several PJSIP threads.  Entries are never removed when the transaction is
+/// destroyed - they just expire after the longest time the transaction could
+/// sensibly be expected to receive messages.  A stale entry can only match a
+/// retransmission of the same request, so it does no harm.
+struct TsxTrail
+{
+  SAS::TrailId trail;
+  time_t expires;
+};
+static pthread_mutex_t tsx_trail_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::unordered_map<std::string, TsxTrail> tsx_trails;
+static std::deque<std::pair<time_t, std::string>> tsx_trail_expiry;
+
+/// Lifetime of an index entry for a non-INVITE transaction (64*T1), and the
+/// extra time allowed for an INVITE transaction (Timer C).
+static const int TSX_TRAIL_LIFETIME_S = (64 * PJSIP_T1_TIMEOUT) / 1000;
+static const int TSX_TRAIL_INVITE_EXTRA_S = 180;
+
+/// Records the trail of a transaction in the index.  This does nothing if
+/// there is only one PJSIP thread, as that thread can read the trail from
+/// the transaction itself.
+void record_tsx_trail(pjsip_transaction* tsx, SAS::TrailId trail)
+{
+  if (stack_data.pjsip_transport_threads.size() <= 1)
+  {
+    return;
+  }
+
+  time_t now = time(NULL);
+  time_t expires = now + TSX_TRAIL_LIFETIME_S;
+  if (tsx->method.id == PJSIP_INVITE_METHOD)
+  {
+    expires += TSX_TRAIL_INVITE_EXTRA_S;
+  }
+
+  std::string key(tsx->transaction_key.ptr, tsx->transaction_key.slen);
+
+  pthread_mutex_lock(&tsx_trail_lock);
+
+  // Purge expired entries.  The expiry queue isn't strictly in order (INVITE
+  // entries live longer), so this may leave some expired entries in the index
+  // for a while, but they are ignored by find_tsx_trail.
+  while ((!tsx_trail_expiry.empty()) &&
+         (tsx_trail_expiry.front().first <= now))
+  {
+    std::unordered_map<std::string, TsxTrail>::iterator it =
+                               tsx_trails.find(tsx_trail_expiry.front().second);
+    if ((it != tsx_trails.end()) &&
+        (it->second.expires == tsx_trail_expiry.front().first))
+    {
+      tsx_trails.erase(it);
+    }
+    tsx_trail_expiry.pop_front();
+  }
+
+  TsxTrail& entry = tsx_trails[key];
+  entry.trail = trail;
+  entry.expires = expires;
+  tsx_trail_expiry.push_back(std::make_pair(expires, key));
+
+  pthread_mutex_unlock(&tsx_trail_lock);
+}
+
+/// Finds the trail of the transaction with the specified key in the index.
+/// Returns 0 if there is no such transaction.
+SAS::TrailId find_tsx_trail(const pj_str_t* key)
+{
+  SAS::TrailId trail = 0;
+  std::string key_str(key->ptr, key->slen);
+
+  pthread_mutex_lock(&tsx_trail_lock);
+
+  std::unordered_map<std::string, TsxTrail>::const_iterator it =
+                                                     tsx_trails.find(key_str);
+  if ((it != tsx_trails.end()) &&
+      (it->second.expires > time(NULL)))
+  {
+    trail = it->second.trail;
+  }
+
+  pthread_mutex_unlock(&tsx_trail_lock);
+
+  return trail;
+}
+
+pj_status_t start_pjsip_threads(int num_pjsip_threads)
 {
   pj_status_t status = PJ_SUCCESS;
 
-  status = pj_thread_create(stack_data.pool, "pjsip", &pjsip_thread_func,
-                            NULL, 0, 0, &stack_data.pjsip_transport_thread);
-  if (status != PJ_SUCCESS)
+  quit_flag = PJ_FALSE;
+
+  // Record the threads before starting any of them, so that
+  // is_pjsip_transport_thread() gives the right answer as soon as the first
+  // thread starts polling.
+  stack_data.pjsip_transport_threads.resize(num_pjsip_threads);
+
+  for (int ii = 0; ii < num_pjsip_threads; ++ii)
   {
-    TRC_ERROR("Error creating PJSIP thread, %s",
-              PJUtils::pj_status_to_string(status).c_str());
-    return 1;
+    status = pj_thread_create(stack_data.pool, "pjsip", &pjsip_thread_func,
+                              (void*)(size_t)ii, 0, PJ_THREAD_SUSPENDED,
+                              &stack_data.pjsip_transport_threads[ii]);
+    if (status != PJ_SUCCESS)
+    {
+      TRC_ERROR("Error creating PJSIP thread, %s",
+                PJUtils::pj_status_to_string(status).c_str());
+      return 1;
+    }
+  }
+
+  for (int ii = 0; ii < num_pjsip_threads; ++ii)
+  {
+    pj_thread_resume(stack_data.pjsip_transport_threads[ii]);
   }
 
   return PJ_SUCCESS;
@@ -873,15 +998,26 @@ pj_status_t init_stack(const std::string& system_name,
 }
 
 
-pj_status_t stop_pjsip_thread()
+pj_status_t stop_pjsip_threads()
 {
-  // Set the quit flag to signal the PJSIP thread to exit, then wait
+  // Set the quit flag to signal the PJSIP threads to exit, then wait
   // for them to exit.
   quit_flag = PJ_TRUE;
 
-  pj_thread_join(stack_data.pjsip_transport_thread);
+  for (std::vector<pj_thread_t*>::iterator ii =
+                                   stack_data.pjsip_transport_threads.begin();
+       ii != stack_data.pjsip_transport_threads.end();
+       ++ii)
+  {
+    pj_thread_join(*ii);
+  }
+
+  stack_data.pjsip_transport_threads.clear();
 
-  stack_data.pjsip_transport_thread = NULL;
+  pthread_mutex_lock(&tsx_trail_lock);
+  tsx_trails.clear();
+  tsx_trail_expiry.clear();
+  pthread_mutex_unlock(&tsx_trail_lock);
 
   return PJ_SUCCESS;
 }
@@ -51,11 +51,13 @@ void delete_bindings(ClassifiedBindings& cbs)
 SubscriberDataManager::SubscriberDataManager(AoRStore* aor_store,
                                              ChronosConnection* chronos_connection,
                                              AnalyticsLogger* analytics_logger,
-                                             bool is_primary) :
+                                             bool is_primary,
+                                             ChronosTimerQueue* timer_queue) :
   _primary_sdm(is_primary)
 {
   _aor_store = aor_store;
-  _chronos_timer_request_sender = new ChronosTimerRequestSender(chronos_connection);
+  _chronos_timer_request_sender = new ChronosTimerRequestSender(chronos_connection,
+                                                                timer_queue);
   _notify_sender = new NotifySender();
   _analytics = analytics_logger;
 }
@@ -77,12 +79,19 @@ AoRPair* SubscriberDataManager::get_aor_data(const std::string& aor_id,
 
   if (aor_data != NULL)
   {
-    // We got some data from the store. Copy the AoR, expire the copy,
-    // and return both AoRs as an AoR pair.
-    AoR* aor_copy = new AoR(*aor_data);
+    // We got some data from the store. Return it as an AoR pair, expiring
+    // any old bindings and subscriptions in the current AoR.  The pair only
+    // copies the AoR when the current AoR is modified, so skip the expiry if
+    // there's nothing to expire - this is the common case for callers that
+    // are just reading the bindings.
     int now = time(NULL);
-    AoRPair* aor_pair = new AoRPair(aor_data, aor_copy);
-    expire_aor_members(aor_pair, now, trail);
+    AoRPair* aor_pair = new AoRPair(aor_data);
+
+    if (has_expired_members(aor_data, now))
+    {
+      expire_aor_members(aor_pair, now, trail);
+    }
+
     return aor_pair;
   }
   else
@@ -332,6 +341,38 @@ int SubscriberDataManager::expire_aor_members(AoRPair* aor_pair,
   return max_expires;
 }
 
+/// Checks whether expire_aor_members would remove anything from an AoR.
+bool SubscriberDataManager::has_expired_members(const AoR* aor_data, int now)
+{
+  for (AoR::Bindings::const_iterator b = aor_data->bindings().begin();
+       b != aor_data->bindings().end();
+       ++b)
+  {
+    if (b->second->_expires <= now)
+    {
+      return true;
+    }
+  }
+
+  // All subscriptions are expired if there are no bindings.
+  if (aor_data->bindings().empty())
+  {
+    return !aor_data->subscriptions().empty();
+  }
+
+  for (AoR::Subscriptions::const_iterator s = aor_data->subscriptions().begin();
+       s != aor_data->subscriptions().end();
+       ++s)
+  {
+    if (s->second->_expires <= now)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 /// Expire any old subscriptions. Expire all subscriptions if requested
 /// (e.g. when all the bindings have expired)
 ///
@@ -436,8 +477,10 @@ int SubscriberDataManager::expire_bindings(AoR* aor_data,
 /// ChronosTimerRequestSender Methods
 
 SubscriberDataManager::ChronosTimerRequestSender::
-     ChronosTimerRequestSender(ChronosConnection* chronos_conn) :
-  _chronos_conn(chronos_conn)
+     ChronosTimerRequestSender(ChronosConnection* chronos_conn,
+                               ChronosTimerQueue* timer_queue) :
+  _chronos_conn(chronos_conn),
+  _timer_queue(timer_queue)
 {
 }
 
@@ -468,11 +511,19 @@ void SubscriberDataManager::ChronosTimerRequestSender::send_timers(
   AoR* current_aor = aor_pair->get_current();
   std::string& timer_id = current_aor->_timer_id;
 
+  // If a queued update changed the timer's ID, pick up the new one, so that
+  // it is used from now on and written back to the AoR.
+  if ((_timer_queue != NULL) && (timer_id != ""))
+  {
+    _timer_queue->update_timer_id(timer_id);
+  }
+
   // An AoR with no bindings is invalid, and the timer should be deleted.
   // We do this before getting next_expires to save on processing.
   if (current_aor->get_bindings_count() == 0)
   {
-    if (timer_id != "")
+    if ((timer_id != "") &&
+        ((_timer_queue == NULL) || (!_timer_queue->remove(timer_id, trail))))
     {
       _chronos_conn->send_delete(timer_id, trail);
     }
@@ -518,7 +569,16 @@ void SubscriberDataManager::ChronosTimerRequestSender::set_timer(
   std::string callback_uri = "/timers";
 
   // If a timer has been previously set for this binding, send a PUT.
-  // Otherwise sent a POST.
+  // Otherwise sent a POST.  PUTs can be queued (if a queued PUT changes the
+  // timer ID, the queue remembers the new ID until send_timers picks it up),
+  // but we need the ID from a POST before writing the AoR.
+  if ((timer_id != "") &&
+      (_timer_queue != NULL) &&
+      (_timer_queue->update(timer_id, expiry, callback_uri, opaque, tags, trail)))
+  {
+    return;
+  }
+
   if (timer_id == "")
   {
     status = _chronos_conn->send_post(temp_timer_id,
@@ -19,15 +19,17 @@ extern "C" {
 
 // Common STL includes.
 #include <cassert>
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <set>
 #include <list>
 #include <queue>
 #include <string>
+#include <atomic>
 
 #include "constants.h"
-#include "eventq.h"
+#include "sharded_priority_eventq.h"
 #include "pjutils.h"
 #include "log.h"
 #include "sas.h"
@@ -46,6 +48,7 @@ extern "C" {
 #include "exception_handler.h"
 #include "snmp_event_accumulator_table.h"
 #include "snmp_event_accumulator_by_scope_table.h"
+#include "snmp_counter_by_scope_table.h"
 
 static std::vector<pj_thread_t*> worker_threads;
 
@@ -54,6 +57,11 @@ struct MessageEvent
   // The received message
   pjsip_rx_data* rdata;
 
+  // The tx_data that holds the received message's parsed message.  The
+  // proxy layer can adopt this as its copy of the request rather than cloning
+  // the message again (see adopt_rx_msg).
+  pjsip_tx_data* tdata;
+
   // A stop watch for tracking SIP message latency
   Utils::StopWatch stop_watch;
 };
@@ -67,6 +75,19 @@ union Event
   MessageEvent* message;
 };
 
+// Priority classes for events on the worker queues.  Events are serviced in
+// this order, so that when the queues back up (for example, in a registration
+// storm) responses and in-dialog traffic keep flowing while requests that
+// start new sessions wait behind them.  ACKs and CANCELs are in the same class
+// as the request they relate to, so they are never processed before it.
+enum Priority
+{
+  PRIORITY_RESPONSE = 0,
+  PRIORITY_IN_DIALOG,
+  PRIORITY_NEW_SESSION,
+  NUM_PRIORITIES
+};
+
 struct worker_thread_qe
 {
   // The type of the event
@@ -76,8 +97,17 @@ struct worker_thread_qe
   Event event;
 };
 
-// Queue for incoming events.
-eventq<struct worker_thread_qe> worker_thread_q;
+// Queue for incoming events.  By default the queue has a single shard shared
+// by all the worker threads.  If the dispatcher is configured with more than
+// one queue, each worker thread is bound to one shard, received messages are
+// assigned to a shard by hashing their Call-ID (so all the messages for a
+// dialog are processed by the same group of threads), and a worker whose own
+// shard is idle steals work from the other shards.
+static sharded_priority_eventq<struct worker_thread_qe>* worker_thread_q = NULL;
+
+// Counter used to spread events that don't have a Call-ID (for example,
+// callbacks) across the queues.
+static std::atomic<unsigned int> next_queue(0);
 
 // Deadlock detection threshold for the message queue (in milliseconds).  This
 // is set to roughly twice the expected maximum service time for each message
@@ -86,12 +116,17 @@ eventq<struct worker_thread_qe> worker_thread_q;
 static const int MSG_Q_DEADLOCK_TIME = 4000;
 
 static int num_worker_threads = 1;
+static int max_queue_depth = 0;
 static SNMP::EventAccumulatorByScopeTable* latency_table = NULL;
 static LoadMonitor* load_monitor = NULL;
 static SNMP::EventAccumulatorByScopeTable* queue_size_table = NULL;
 static ExceptionHandler* exception_handler = NULL;
+static SNMP::CounterByScopeTable* overload_counter = NULL;
 
 static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata);
+static pj_status_t clone_rx_msg(pjsip_rx_data* rdata, MessageEvent* me);
+static void free_rx_msg(MessageEvent* me);
+static void push_event(size_t queue_idx, Priority priority, worker_thread_qe& qe);
 
 // Module to clone SIP requests and dispatch them to worker threads.
 
@@ -119,9 +154,12 @@ static pjsip_module mod_thread_dispatcher =
   NULL,                                 /* on_tsx_state()       */
 };
 
-/// Worker threads handle most SIP message processing.
+/// Worker threads handle most SIP message processing.  The parameter is the
+/// index of the worker queue that the thread is bound to.
 static int worker_thread(void* p)
 {
+  size_t queue_idx = (size_t)p;
+
   // Set up data to always process incoming messages at the first PJSIP
   // module after our module.
   pjsip_process_rdata_param rp;
@@ -133,7 +171,7 @@ static int worker_thread(void* p)
 
   struct worker_thread_qe qe = { MESSAGE };
 
-  while (worker_thread_q.pop(qe))
+  while (worker_thread_q->pop(queue_idx, qe))
   {
     if (qe.type == MESSAGE)
     {
@@ -193,7 +231,7 @@ static int worker_thread(void* p)
         CW_END
 
         TRC_DEBUG("Worker thread completed processing message %p", rdata);
-        pjsip_rx_data_free_cloned(rdata);
+        free_rx_msg(me);
 
         unsigned long latency_us = 0;
         if (me->stop_watch.read(latency_us))
@@ -223,6 +261,242 @@ static int worker_thread(void* p)
   return 0;
 }
 
+/// Clones a received message so that it can be handed off to a worker thread.
+/// This does the same as pjsip_rx_data_clone, except that the parsed message
+/// is cloned into the pool of a new tx_data rather than the pool of the new
+/// rx_data.  The proxy layer can then adopt that tx_data as its copy of the
+/// request (see adopt_rx_msg), so each received message is only deep-copied
+/// once on its way to the proxy.  The rx_data keeps its own pool, so that the
+/// worker thread's allocations from it can't race with anything using the
+/// adopted tx_data.
+static pj_status_t clone_rx_msg(pjsip_rx_data* rdata, MessageEvent* me)
+{
+  pjsip_tx_data* tdata;
+  pj_status_t status = pjsip_endpt_create_tdata(stack_data.endpt, &tdata);
+
+  if (status != PJ_SUCCESS)
+  {
+    return status; // LCOV_EXCL_LINE
+  }
+
+  // Take a reference to the tx_data on behalf of the worker thread.  This is
+  // released once the worker thread has finished processing the message.
+  pjsip_tx_data_add_ref(tdata);
+  tdata->msg = pjsip_msg_clone(tdata->pool, rdata->msg_info.msg);
+
+  pj_pool_t* pool = pjsip_endpt_create_pool(stack_data.endpt,
+                                            "rtd%p",
+                                            PJSIP_POOL_RDATA_LEN,
+                                            PJSIP_POOL_RDATA_INC);
+  if (pool == NULL)
+  {
+    // LCOV_EXCL_START
+    pjsip_tx_data_dec_ref(tdata);
+    return PJ_ENOMEM;
+    // LCOV_EXCL_STOP
+  }
+
+  pjsip_rx_data* clone_rdata = PJ_POOL_ZALLOC_T(pool, pjsip_rx_data);
+  clone_rdata->tp_info.pool = pool;
+  clone_rdata->tp_info.transport = rdata->tp_info.transport;
+
+  // Copy the packet information, including the raw packet.
+  pj_memcpy(&clone_rdata->pkt_info,
+            &rdata->pkt_info,
+            sizeof(rdata->pkt_info));
+  clone_rdata->pkt_info.packet = (char*)pj_pool_alloc(pool,
+                                                      rdata->pkt_info.len + 1);
+  pj_memcpy(clone_rdata->pkt_info.packet,
+            rdata->pkt_info.packet,
+            rdata->pkt_info.len);
+  clone_rdata->pkt_info.packet[rdata->pkt_info.len] = '\0';
+
+  // The parse errors aren't cloned - the only module that uses them runs
+  // before this one.
+  pj_list_init(&clone_rdata->msg_info.parse_err);
+  clone_rdata->msg_info.msg_buf = clone_rdata->pkt_info.packet +
+                             (rdata->msg_info.msg_buf - rdata->pkt_info.packet);
+  clone_rdata->msg_info.len = rdata->msg_info.len;
+  clone_rdata->msg_info.msg = tdata->msg;
+
+  // Find the headers that the rx_data has shortcuts to in the cloned message.
+  for (pjsip_hdr* hdr = tdata->msg->hdr.next;
+       hdr != &tdata->msg->hdr;
+       hdr = hdr->next)
+  {
+    switch (hdr->type)
+    {
+    case PJSIP_H_CALL_ID:
+      clone_rdata->msg_info.cid = (pjsip_cid_hdr*)hdr;
+      break;
+
+    case PJSIP_H_FROM:
+      clone_rdata->msg_info.from = (pjsip_from_hdr*)hdr;
+      break;
+
+    case PJSIP_H_TO:
+      clone_rdata->msg_info.to = (pjsip_to_hdr*)hdr;
+      break;
+
+    case PJSIP_H_VIA:
+      if (clone_rdata->msg_info.via == NULL)
+      {
+        clone_rdata->msg_info.via = (pjsip_via_hdr*)hdr;
+      }
+      break;
+
+    case PJSIP_H_CSEQ:
+      clone_rdata->msg_info.cseq = (pjsip_cseq_hdr*)hdr;
+      break;
+
+    case PJSIP_H_MAX_FORWARDS:
+      clone_rdata->msg_info.max_fwd = (pjsip_max_fwd_hdr*)hdr;
+      break;
+
+    case PJSIP_H_ROUTE:
+      if (clone_rdata->msg_info.route == NULL)
+      {
+        clone_rdata->msg_info.route = (pjsip_route_hdr*)hdr;
+      }
+      break;
+
+    case PJSIP_H_RECORD_ROUTE:
+      if (clone_rdata->msg_info.record_route == NULL)
+      {
+        clone_rdata->msg_info.record_route = (pjsip_rr_hdr*)hdr;
+      }
+      break;
+
+    case PJSIP_H_CONTENT_TYPE:
+      clone_rdata->msg_info.ctype = (pjsip_ctype_hdr*)hdr;
+      break;
+
+    case PJSIP_H_CONTENT_LENGTH:
+      clone_rdata->msg_info.clen = (pjsip_clen_hdr*)hdr;
+      break;
+
+    case PJSIP_H_REQUIRE:
+      if (clone_rdata->msg_info.require == NULL)
+      {
+        clone_rdata->msg_info.require = (pjsip_require_hdr*)hdr;
+      }
+      break;
+
+    case PJSIP_H_SUPPORTED:
+      if (clone_rdata->msg_info.supported == NULL)
+      {
+        clone_rdata->msg_info.supported = (pjsip_supported_hdr*)hdr;
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  // Copy the module data (which includes the SAS trail), and record the
+  // tx_data so that the proxy layer can adopt the message.
+  pj_memcpy(&clone_rdata->endpt_info,
+            &rdata->endpt_info,
+            sizeof(rdata->endpt_info));
+  clone_rdata->endpt_info.mod_data[mod_thread_dispatcher.id] = tdata;
+
+  // Hold a reference to the transport until the worker thread has finished
+  // with the message.
+  pjsip_transport_add_ref(clone_rdata->tp_info.transport);
+
+  me->rdata = clone_rdata;
+  me->tdata = tdata;
+
+  return PJ_SUCCESS;
+}
+
+/// Frees a message that was handed off to a worker thread.  The parsed
+/// message lives on if the proxy layer adopted it.
+static void free_rx_msg(MessageEvent* me)
+{
+  pjsip_rx_data_free_cloned(me->rdata);
+  pjsip_tx_data_dec_ref(me->tdata);
+  me->rdata = NULL;
+  me->tdata = NULL;
+}
+
+pjsip_tx_data* adopt_rx_msg(pjsip_rx_data* rdata)
+{
+  pjsip_tx_data* tdata = NULL;
+
+  if (mod_thread_dispatcher.id >= 0)
+  {
+    tdata = (pjsip_tx_data*)rdata->endpt_info.mod_data[mod_thread_dispatcher.id];
+  }
+
+  if (tdata != NULL)
+  {
+    // The adopter may modify the message, so only let it be adopted once.
+    rdata->endpt_info.mod_data[mod_thread_dispatcher.id] = NULL;
+    set_trail(tdata, get_trail(rdata));
+    pjsip_tx_data_add_ref(tdata);
+    TRC_DEBUG("Adopted %s as %s", pjsip_rx_data_get_info(rdata), tdata->obj_name);
+  }
+
+  return tdata;
+}
+
+/// Selects the worker queue for a received message.  All the messages with
+/// the same Call-ID are queued to the same shard.
+static size_t select_queue(pjsip_rx_data* rdata)
+{
+  size_t queue_idx = 0;
+
+  if (worker_thread_q->num_shards() > 1)
+  {
+    if (rdata->msg_info.cid != NULL)
+    {
+      const pj_str_t& call_id = ((pjsip_cid_hdr*)rdata->msg_info.cid)->id;
+      queue_idx = pj_hash_calc(0, call_id.ptr, call_id.slen) %
+                  worker_thread_q->num_shards();
+    }
+    else
+    {
+      queue_idx = next_queue++ % worker_thread_q->num_shards();
+    }
+  }
+
+  return queue_idx;
+}
+
+/// Determines the priority class of a received message.  Requests are
+/// classified by their To tag, so an ACK or CANCEL is in the same class (and,
+/// having the same Call-ID, the same queue) as the INVITE it relates to, and
+/// stays behind it.
+static Priority get_priority(pjsip_rx_data* rdata)
+{
+  pjsip_msg* msg = rdata->msg_info.msg;
+
+  if (msg->type == PJSIP_RESPONSE_MSG)
+  {
+    return PRIORITY_RESPONSE;
+  }
+  else if ((rdata->msg_info.to != NULL) &&
+           (rdata->msg_info.to->tag.slen > 0))
+  {
+    return PRIORITY_IN_DIALOG;
+  }
+  else
+  {
+    return PRIORITY_NEW_SESSION;
+  }
+}
+
+/// Queues an event to the specified worker queue, tracking the total queue
+/// size.
+static void push_event(size_t queue_idx, Priority priority, worker_thread_qe& qe)
+{
+  // Track the current queue size
+  queue_size_table->accumulate(worker_thread_q->size());
+  worker_thread_q->push(queue_idx, qe, priority);
+}
+
 static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
 {
   // SAS log the start of processing by this module
@@ -230,7 +504,7 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   SAS::report_event(event);
 
   // Check that the worker threads are not all deadlocked.
-  if (worker_thread_q.is_deadlocked())
+  if (worker_thread_q->is_deadlocked())
   {
     // The queue has not been serviced for sufficiently long to imply that
     // all the worker threads are deadlock, so exit the process so it will be
@@ -240,48 +514,71 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
     abort();
   }
 
+  Priority priority = get_priority(rdata);
+
+  // If the queues are full, shed requests that start new sessions so that
+  // the worker threads can keep up with the sessions already in progress.
+  // Responses, in-dialog requests, ACKs and CANCELs are always queued - they
+  // are bounded by the number of existing sessions, and dropping them would
+  // only cause retransmissions.
+  if ((max_queue_depth > 0) &&
+      (priority == PRIORITY_NEW_SESSION) &&
+      (rdata->msg_info.msg->line.req.method.id != PJSIP_ACK_METHOD) &&
+      (rdata->msg_info.msg->line.req.method.id != PJSIP_CANCEL_METHOD) &&
+      (worker_thread_q->size() >= (unsigned int)max_queue_depth))
+  {
+    TRC_DEBUG("Worker queues are full (%d events), rejecting new request",
+              worker_thread_q->size());
+    pjsip_retry_after_hdr* retry_after =
+                           pjsip_retry_after_hdr_create(rdata->tp_info.pool, 0);
+    PJUtils::respond_stateless(stack_data.endpt,
+                               rdata,
+                               PJSIP_SC_SERVICE_UNAVAILABLE,
+                               NULL,
+                               (pjsip_hdr*)retry_after,
+                               NULL);
+    overload_counter->increment();
+    return PJ_TRUE;
+  }
+
   // Before we start, get a timestamp.  This will track the time from
   // receiving a message to forwarding it on (or rejecting it).
   MessageEvent* me = new MessageEvent();
   me->stop_watch.start();
 
   // Clone the message and queue it to a scheduler thread.
-  pjsip_rx_data* clone_rdata;
-  pj_status_t status = pjsip_rx_data_clone(rdata, 0, &clone_rdata);
+  pj_status_t status = clone_rx_msg(rdata, me);
 
   if (status != PJ_SUCCESS)
   {
     // Failed to clone the message, so drop it.
     TRC_ERROR("Failed to clone incoming message (%s)", PJUtils::pj_status_to_string(status).c_str());
+    delete me; me = NULL;
     return PJ_TRUE;
   }
 
   // Make sure the trail identifier is passed across.
+  pjsip_rx_data* clone_rdata = me->rdata;
   set_trail(clone_rdata, get_trail(rdata));
 
-  // @TODO - need to think about back-pressure mechanisms.  For example,
-  // should we have a maximum depth of queue and drop messages after that?
-  // May be better to hold on to the message until the queue has space - this
-  // will force back pressure on the particular TCP connection.  Or should we
-  // have a queue per transport and round-robin them?
-
   TRC_DEBUG("Queuing cloned received message %p for worker threads", clone_rdata);
   me->rdata = clone_rdata;
   Event queue_event;
   queue_event.message = me;
   struct worker_thread_qe qe = { MESSAGE, queue_event };
 
-  // Track the current queue size
-  queue_size_table->accumulate(worker_thread_q.size());
-  worker_thread_q.push(qe);
+  push_event(select_queue(clone_rdata), priority, qe);
 
   // return TRUE to flag that we have absorbed the incoming message.
   return PJ_TRUE;
 }
 
 pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
+                                   int num_worker_queues_arg,
+                                   int max_queue_depth_arg,
                                    SNMP::EventAccumulatorByScopeTable* latency_table_arg,
                                    SNMP::EventAccumulatorByScopeTable* queue_size_table_arg,
+                                   SNMP::CounterByScopeTable* overload_counter_arg,
                                    LoadMonitor* load_monitor_arg,
                                    ExceptionHandler* exception_handler_arg)
 {
@@ -289,12 +586,24 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
   // start_worker_threads is called.
   worker_threads.resize(num_worker_threads_arg);
 
+  // Create the worker queues.  There is no point having more queues than
+  // worker threads, as some queues would then only be serviced by stealing.
+  int num_worker_queues = std::max(1, std::min(num_worker_queues_arg,
+                                               num_worker_threads_arg));
+  TRC_STATUS("Dispatching SIP messages to %d worker queue(s)",
+             num_worker_queues);
+
   // Enable deadlock detection on the message queue.
-  worker_thread_q.set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
+  worker_thread_q =
+    new sharded_priority_eventq<struct worker_thread_qe>(num_worker_queues,
+                                                         NUM_PRIORITIES,
+                                                         MSG_Q_DEADLOCK_TIME);
 
   num_worker_threads = num_worker_threads_arg;
+  max_queue_depth = max_queue_depth_arg;
   latency_table = latency_table_arg;
   queue_size_table = queue_size_table_arg;
+  overload_counter = overload_counter_arg;
   load_monitor = load_monitor_arg;
   exception_handler = exception_handler_arg;
 
@@ -311,9 +620,11 @@ pj_status_t start_worker_threads()
 
   for (size_t ii = 0; ii < worker_threads.size(); ++ii)
   {
+    // Bind the worker threads to the queues round-robin.
     pj_thread_t* thread;
     status = pj_thread_create(stack_data.pool, "worker", &worker_thread,
-                              NULL, 0, 0, &thread);
+                              (void*)(ii % worker_thread_q->num_shards()),
+                              0, 0, &thread);
     if (status != PJ_SUCCESS)
     {
       TRC_ERROR("Error creating worker thread, %s",
@@ -330,7 +641,8 @@ void stop_worker_threads()
 {
   // Now it is safe to signal the worker threads to exit via the queue and to
   // wait for them to terminate.
-  worker_thread_q.terminate();
+  worker_thread_q->terminate();
+
   for (std::vector<pj_thread_t*>::iterator i = worker_threads.begin();
        i != worker_threads.end();
        ++i)
@@ -344,6 +656,7 @@ void unregister_thread_dispatcher(void)
 {
   pjsip_endpt_unregister_module(stack_data.endpt, &mod_thread_dispatcher);
 
+  delete worker_thread_q; worker_thread_q = NULL;
 }
 
 void add_callback_to_queue(PJUtils::Callback* cb)
@@ -353,9 +666,8 @@ void add_callback_to_queue(PJUtils::Callback* cb)
   queue_event.callback = cb;
   worker_thread_qe qe = { CALLBACK, queue_event };
 
-  // Track the current queue size
-  queue_size_table->accumulate(worker_thread_q.size());
-
-  // Add the Event
-  worker_thread_q.push(qe);
+  // Add the Event.  Callbacks complete work that is already in progress, so
+  // queue them at the highest priority.  They have no dialog affinity, so
+  // spread them across the queues.
+  push_event(next_queue++ % worker_thread_q->num_shards(), PRIORITY_RESPONSE, qe);
 }
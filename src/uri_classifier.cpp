@@ -7,19 +7,81 @@
  * Metaswitch Networks in a separate written agreement.
  */
 
+#include <string.h>
 #include <vector>
-#include <boost/regex.hpp>
 #include "uri_classifier.h"
 #include "stack.h"
 #include "constants.h"
 
-// Regexes that match global and local numbers:
+// Characters allowed in global and local numbers:
 // - A global number starts with "+" followed by a combination of digits "0-9"
 //   and visual separators ",-()".
 // - A local number can contain a combination of hexdigits "0-9A-F", "*#" and
 //   visual separators ",-()".
-static const boost::regex CHARS_ALLOWED_IN_GLOBAL_NUM = boost::regex("\\+[0-9,\\-\\(\\)]*");
-static const boost::regex CHARS_ALLOWED_IN_LOCAL_NUM = boost::regex("[0-9A-F\\*#,\\-\\(\\)]*");
+//
+// These are looked up in a table indexed by character, as numbers are
+// classified several times for each request.
+static const unsigned char GLOBAL_NUM_CHAR = 0x01;
+static const unsigned char LOCAL_NUM_CHAR = 0x02;
+
+struct NumCharTable
+{
+  NumCharTable()
+  {
+    memset(flags, 0, sizeof(flags));
+
+    for (const char* c = "0123456789,-()"; *c != '\0'; ++c)
+    {
+      flags[(unsigned char)*c] |= (GLOBAL_NUM_CHAR | LOCAL_NUM_CHAR);
+    }
+
+    for (const char* c = "ABCDEF*#"; *c != '\0'; ++c)
+    {
+      flags[(unsigned char)*c] |= LOCAL_NUM_CHAR;
+    }
+  }
+
+  unsigned char flags[256];
+};
+
+static const NumCharTable NUM_CHARS;
+
+// Classifies a number, without copying it.
+//
+// @returns GLOBAL_PHONE_NUMBER if it is a global number, LOCAL_PHONE_NUMBER if
+// it is a local number, or UNKNOWN if it is neither.
+static URIClass classify_number(const char* number, size_t len)
+{
+  if ((len > 0) && (number[0] == '+'))
+  {
+    size_t ii = 1;
+    while ((ii < len) &&
+           (NUM_CHARS.flags[(unsigned char)number[ii]] & GLOBAL_NUM_CHAR))
+    {
+      ++ii;
+    }
+
+    if (ii == len)
+    {
+      return GLOBAL_PHONE_NUMBER;
+    }
+  }
+
+  for (size_t ii = 0; ii < len; ++ii)
+  {
+    if (!(NUM_CHARS.flags[(unsigned char)number[ii]] & LOCAL_NUM_CHAR))
+    {
+      return UNKNOWN;
+    }
+  }
+
+  return LOCAL_PHONE_NUMBER;
+}
+
+static bool is_whitespace(char c)
+{
+  return ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'));
+}
 
 std::vector<pj_str_t*> URIClassifier::home_domains;
 bool URIClassifier::enforce_global;
@@ -110,9 +172,8 @@ URIClass URIClassifier::classify_uri(const pjsip_uri* uri, bool prefer_sip, bool
   {
     // TEL URIs can only represent phone numbers - decide if it's a global (E.164) number or not
     pjsip_tel_uri* tel_uri = (pjsip_tel_uri*)uri;
-    std::string user = PJUtils::pj_str_to_string(&tel_uri->number);
-    boost::match_results<std::string::const_iterator> results;
-    if (boost::regex_match(user, results, CHARS_ALLOWED_IN_GLOBAL_NUM))
+    if (classify_number(tel_uri->number.ptr,
+                        tel_uri->number.slen) == GLOBAL_PHONE_NUMBER)
     {
       ret = GLOBAL_PHONE_NUMBER;
     }
@@ -142,18 +203,33 @@ URIClass URIClassifier::classify_uri(const pjsip_uri* uri, bool prefer_sip, bool
     if ((!pj_strcmp(&((pjsip_sip_uri*)uri)->user_param, &STR_USER_PHONE) ||
          (home_domain && treat_number_as_phone && !is_gruu)))
     {
-      // Get the user part minus any parameters.
-      std::string user = PJUtils::pj_str_to_string(&sip_uri->user);
-      if (!user.empty())
+      // Get the user part minus any parameters and surrounding whitespace.
+      if (sip_uri->user.slen != 0)
       {
-        std::vector<std::string> user_tokens;
-        Utils::split_string(user, ';', user_tokens, 0, true);
-        boost::match_results<std::string::const_iterator> results;
-        if (boost::regex_match(user_tokens[0], results, CHARS_ALLOWED_IN_GLOBAL_NUM))
+        const char* start = sip_uri->user.ptr;
+        const char* end = start;
+        const char* user_end = start + sip_uri->user.slen;
+        while ((end < user_end) && (*end != ';'))
+        {
+          ++end;
+        }
+
+        while ((start < end) && is_whitespace(*start))
+        {
+          ++start;
+        }
+
+        while ((end > start) && is_whitespace(*(end - 1)))
+        {
+          --end;
+        }
+
+        URIClass number_class = classify_number(start, end - start);
+        if (number_class == GLOBAL_PHONE_NUMBER)
         {
           ret = GLOBAL_PHONE_NUMBER;
         }
-        else if (boost::regex_match(user_tokens[0], results, CHARS_ALLOWED_IN_LOCAL_NUM))
+        else if (number_class == LOCAL_PHONE_NUMBER)
         {
           ret = enforce_global ? LOCAL_PHONE_NUMBER : GLOBAL_PHONE_NUMBER;
         }
@@ -0,0 +1,142 @@
+/**
+ * @file analyticslogger_test.cpp UT for the analytics logger.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <pthread.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "analyticslogger.h"
+
+/// Analytics logger that records logs rather than writing them to syslog,
+/// optionally blocking the thread that writes them.
+class RecordingAnalyticsLogger : public AnalyticsLogger
+{
+public:
+  RecordingAnalyticsLogger(int ring_size) :
+    AnalyticsLogger(ring_size)
+  {
+    pthread_mutex_init(&_write_lock, NULL);
+  }
+
+  virtual ~RecordingAnalyticsLogger()
+  {
+    // Stop the writer thread while this class's write function is still
+    // valid.
+    stop();
+    pthread_mutex_destroy(&_write_lock);
+  }
+
+  std::vector<std::string> _logs;
+  pthread_mutex_t _write_lock;
+
+protected:
+  virtual void write(const struct timespec& timestamp, const char* log)
+  {
+    pthread_mutex_lock(&_write_lock);
+    _logs.push_back(log);
+    pthread_mutex_unlock(&_write_lock);
+  }
+};
+
+// Without a ring buffer, logs are written by the calling thread.
+TEST(AnalyticsLoggerTest, Synchronous)
+{
+  RecordingAnalyticsLogger logger(0);
+
+  logger.call_disconnected("1234@example.com", 200);
+  ASSERT_EQ(1u, logger._logs.size());
+  EXPECT_EQ("Call-Disconnected: CALL_ID=1234@example.com REASON=200",
+            logger._logs[0]);
+}
+
+// With ring buffers, logs are written in order by the background thread, and
+// any still queued are written when the logger stops.
+TEST(AnalyticsLoggerTest, Asynchronous)
+{
+  RecordingAnalyticsLogger logger(100);
+
+  for (int ii = 0; ii < 50; ++ii)
+  {
+    logger.call_disconnected(std::to_string(ii), 200);
+  }
+
+  logger.stop();
+
+  ASSERT_EQ(50u, logger._logs.size());
+  for (int ii = 0; ii < 50; ++ii)
+  {
+    EXPECT_EQ("Call-Disconnected: CALL_ID=" + std::to_string(ii) + " REASON=200",
+              logger._logs[ii]);
+  }
+  EXPECT_EQ(0u, logger.dropped());
+
+  // Logs after stopping are written synchronously.
+  logger.call_disconnected("last", 200);
+  EXPECT_EQ(51u, logger._logs.size());
+}
+
+// Logs are dropped and counted, rather than blocking, when a thread's ring
+// buffer is full.
+TEST(AnalyticsLoggerTest, Overflow)
+{
+  RecordingAnalyticsLogger logger(10);
+
+  // Block the writer thread.
+  pthread_mutex_lock(&logger._write_lock);
+
+  for (int ii = 0; ii < 100; ++ii)
+  {
+    logger.call_disconnected(std::to_string(ii), 200);
+  }
+
+  // The writer thread doesn't free a log's slot until it has written it, so
+  // only 10 logs fit.
+  EXPECT_EQ(90u, logger.dropped());
+
+  pthread_mutex_unlock(&logger._write_lock);
+  logger.stop();
+
+  EXPECT_EQ(100u, logger._logs.size() + logger.dropped());
+}
+
+// Logs generated while the logger is stopping are either queued before the
+// final drain or written synchronously - none are lost.
+TEST(AnalyticsLoggerTest, LogWhileStopping)
+{
+  RecordingAnalyticsLogger logger(1000);
+
+  std::vector<std::thread> threads;
+  for (int ii = 0; ii < 4; ++ii)
+  {
+    threads.push_back(std::thread([&logger]()
+    {
+      for (int jj = 0; jj < 1000; ++jj)
+      {
+        logger.call_disconnected(std::to_string(jj), 200);
+      }
+    }));
+  }
+
+  logger.stop();
+
+  for (std::vector<std::thread>::iterator it = threads.begin();
+       it != threads.end();
+       ++it)
+  {
+    it->join();
+  }
+
+  EXPECT_EQ(4000u, logger._logs.size() + logger.dropped());
+}
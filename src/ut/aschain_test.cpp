@@ -162,6 +162,35 @@ TEST_F(AsChainTest, Basics)
   EXPECT_TRUE(res.complete());
 }
 
+// ODI tokens stop matching once their AS chain has gone, even if the slots
+// they referred to are reused, and malformed tokens don't match anything.
+TEST_F(AsChainTest, StaleOdiTokens)
+{
+  IFCConfiguration ifc_configuration(false, false, "", &SNMP::FAKE_COUNTER_TABLE, &SNMP::FAKE_COUNTER_TABLE);
+  Ifcs ifcs = matching_ifcs(1, "sip:pancommunicon.cw-ngv.com");
+  std::string token;
+
+  // Allocate both chains from the same stripe of the table.
+  _as_chain_table->_next_stripe = 0;
+  {
+    AsChain as_chain(_as_chain_table, SessionCase::Originating, "sip:5755550011@homedomain", true, 0, ifcs, NULL, NULL, ifc_configuration, "sip:scscf.homedomain");
+    token = AsChainLink(&as_chain, 0u).next_odi_token();
+  }
+
+  _as_chain_table->_next_stripe = 0;
+  AsChain as_chain2(_as_chain_table, SessionCase::Originating, "sip:5755550011@homedomain", true, 0, ifcs, NULL, NULL, ifc_configuration, "sip:scscf.homedomain");
+  std::string token2 = AsChainLink(&as_chain2, 0u).next_odi_token();
+
+  EXPECT_NE(token, token2);
+  EXPECT_FALSE(_as_chain_table->lookup(token).is_set());
+  EXPECT_FALSE(_as_chain_table->lookup("").is_set());
+  EXPECT_FALSE(_as_chain_table->lookup("not-a-valid-odi-token!!!").is_set());
+
+  AsChainLink res = _as_chain_table->lookup(token2);
+  EXPECT_EQ(&as_chain2, res._as_chain);
+  EXPECT_EQ(1u, res._index);
+}
+
 // We have matching standard iFCs - we should select the ASs from
 // those iFCs and no more.
 TEST_F(AsChainTest, MatchingStandardiFCs)
@@ -23,6 +23,7 @@
 #include "bgcfsproutlet.h"
 #include "sproutletappserver.h"
 #include "sproutletproxy.h"
+#include "sproutlet_async.h"
 #include "fakesnmp.hpp"
 
 using namespace std;
@@ -488,3 +489,88 @@ TEST_F(BGCFTest, OverrideRoutes)
   hdrs.push_back(HeaderMatcher("Route", "Route: <sip:10.0.0.1:5060;transport=TCP;lr>"));
   doSuccessfulFlow(msg, testing::MatchesRegex("sip:12345@domainvalid"), hdrs);
 }
+
+/// Callbacks that resume sproutlets when their asynchronous operations have
+/// completed.  They are captured rather than passed to a worker thread, so
+/// that each test controls when the sproutlet resumes.
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+static std::list<PJUtils::Callback*> async_callbacks;
+
+static void capture_async_callback(PJUtils::Callback* callback)
+{
+  pthread_mutex_lock(&async_lock);
+  async_callbacks.push_back(callback);
+  pthread_cond_signal(&async_cond);
+  pthread_mutex_unlock(&async_lock);
+}
+
+/// Fixture for BGCF tests that look up ENUM asynchronously.
+class BGCFAsyncTest : public BGCFTest
+{
+public:
+  BGCFAsyncTest()
+  {
+    SproutletAsync::init(NULL, 1, &capture_async_callback);
+  }
+
+  ~BGCFAsyncTest()
+  {
+    SproutletAsync::term();
+  }
+
+protected:
+  /// Waits for an asynchronous operation to complete, then resumes the
+  /// sproutlet that started it on this thread, as a worker thread would.
+  void complete_async_op()
+  {
+    pthread_mutex_lock(&async_lock);
+    while (async_callbacks.empty())
+    {
+      pthread_cond_wait(&async_cond, &async_lock);
+    }
+    PJUtils::Callback* callback = async_callbacks.front();
+    async_callbacks.pop_front();
+    pthread_mutex_unlock(&async_lock);
+
+    callback->run();
+    delete callback;
+  }
+};
+
+// A request to a phone number is routed once the asynchronous ENUM lookup
+// for number portability data completes.
+TEST_F(BGCFAsyncTest, TestSimpleTelURIMatched)
+{
+  add_host_mapping("ut.cw-ngv.com", "10.9.8.7");
+  SCOPED_TRACE("");
+  BGCFMessage msg;
+  msg._toscheme = "tel";
+  msg._to = "+16505551234";
+  msg._todomain = "";
+  pjsip_msg* out;
+
+  // Send INVITE.  Only the 100 Trying is sent while ENUM is queried.
+  inject_msg(msg.get_request());
+  ASSERT_EQ(1, txdata_count());
+  out = current_txdata()->msg;
+  RespMatcher(100).matches(out);
+  free_txdata();
+
+  // Complete the ENUM lookup.  The INVITE is passed on using the number
+  // route.
+  complete_async_op();
+  ASSERT_EQ(1, txdata_count());
+  out = current_txdata()->msg;
+  ReqMatcher req("INVITE");
+  ASSERT_NO_FATAL_FAILURE(req.matches(out));
+  EXPECT_THAT(req.uri(), testing::MatchesRegex(".*16505551234$"));
+  HeaderMatcher("Route", ".*10.0.0.1:5060.*").match(out);
+
+  // Send 200 OK back, which is passed back upstream.
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  out = current_txdata()->msg;
+  RespMatcher(200).matches(out);
+  free_txdata();
+}
@@ -161,3 +161,14 @@ TEST_F(BgcfServiceTest, NumberRouteTests)
   ET("+654-(3.21)", "sip3.example.com").test(bgcf_, RoutingType::NUMBER_ROUTE);
   ET("+654!-(321)", "").test(bgcf_, RoutingType::NUMBER_ROUTE);
 }
+
+TEST_F(BgcfServiceTest, NumberRouteShortNumber)
+{
+  BgcfService bgcf_(string(UT_DIR).append("/test_bgcf.json"));
+
+  // A number that is the start of configured prefixes matches the greatest of
+  // them, but only if it has no visual separators.
+  ET("+12", "sip2.example.com").test(bgcf_, RoutingType::NUMBER_ROUTE);
+  ET("+1-2", "").test(bgcf_, RoutingType::NUMBER_ROUTE);
+  ET("+123-1239", "sip.example.com").test(bgcf_, RoutingType::NUMBER_ROUTE);
+}
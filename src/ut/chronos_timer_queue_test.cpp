@@ -0,0 +1,188 @@
+/**
+ * @file chronos_timer_queue_test.cpp UT for the queue of Chronos timer
+ *                                    updates.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <atomic>
+#include <string>
+#include <unistd.h>
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "chronos_timer_queue.h"
+#include "mock_chronos_connection.h"
+
+using ::testing::_;
+using ::testing::AllOf;
+using ::testing::DoAll;
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::InSequence;
+using ::testing::InvokeWithoutArgs;
+using ::testing::Le;
+using ::testing::Return;
+using ::testing::SetArgReferee;
+
+/// Fixture for ChronosTimerQueueTest.  The batch interval is long enough that
+/// nothing is sent until the queue is destroyed.
+class ChronosTimerQueueTest : public ::testing::Test
+{
+public:
+  ChronosTimerQueueTest() :
+    _chronos_connection("chronos"),
+    _queue(new ChronosTimerQueue(&_chronos_connection, 60000, 2))
+  {
+  }
+
+  virtual ~ChronosTimerQueueTest()
+  {
+    delete _queue; _queue = NULL;
+  }
+
+  /// Waits (for up to a second) for the queue to map a timer ID to the
+  /// expected new ID, and returns the ID it maps to.
+  std::string wait_for_timer_id(const std::string& old_timer_id,
+                                const std::string& new_timer_id)
+  {
+    std::string timer_id;
+
+    for (int ii = 0; ii < 100; ++ii)
+    {
+      timer_id = old_timer_id;
+      _queue->update_timer_id(timer_id);
+      if (timer_id == new_timer_id)
+      {
+        break;
+      }
+      usleep(10000);
+    }
+
+    return timer_id;
+  }
+
+  MockChronosConnection _chronos_connection;
+  ChronosTimerQueue* _queue;
+  std::map<std::string, uint32_t> _tags;
+};
+
+// Only the latest update to each timer is sent, with deletions first.
+TEST_F(ChronosTimerQueueTest, Coalesce)
+{
+  std::map<std::string, uint32_t> new_tags;
+  new_tags["BIND"] = 2;
+
+  EXPECT_TRUE(_queue->update("timer1", 300, "/timers", "{}", _tags, 0));
+  EXPECT_TRUE(_queue->update("timer1", 600, "/timers", "{}", new_tags, 0));
+  EXPECT_TRUE(_queue->update("timer2", 300, "/timers", "{}", _tags, 0));
+  EXPECT_TRUE(_queue->remove("timer2", 0));
+
+  {
+    InSequence s;
+    EXPECT_CALL(_chronos_connection, send_delete("timer2", _))
+      .WillOnce(Return(HTTP_OK));
+    // The timer length is measured from when the update is sent.
+    EXPECT_CALL(_chronos_connection, send_put(_, AllOf(Ge(599u), Le(600u)), "/timers", "{}", _, new_tags))
+      .WillOnce(Return(HTTP_OK));
+  }
+
+  delete _queue; _queue = NULL;
+}
+
+// When too many timers have updates queued, updates to other timers are
+// refused, but updates to timers already in the queue are still accepted.
+TEST_F(ChronosTimerQueueTest, Full)
+{
+  EXPECT_TRUE(_queue->update("timer1", 300, "/timers", "{}", _tags, 0));
+  EXPECT_TRUE(_queue->update("timer2", 300, "/timers", "{}", _tags, 0));
+  EXPECT_FALSE(_queue->update("timer3", 300, "/timers", "{}", _tags, 0));
+  EXPECT_FALSE(_queue->remove("timer3", 0));
+  EXPECT_TRUE(_queue->remove("timer1", 0));
+
+  EXPECT_CALL(_chronos_connection, send_delete("timer1", _))
+    .WillOnce(Return(HTTP_OK));
+  EXPECT_CALL(_chronos_connection, send_put(_, AllOf(Ge(299u), Le(300u)), _, _, _, _))
+    .WillOnce(Return(HTTP_OK));
+
+  delete _queue; _queue = NULL;
+}
+
+// An update to a timer in the batch being sent is queued even if the queue is
+// full, so that it can't be sent before the older update in the batch.
+TEST_F(ChronosTimerQueueTest, FullWhileSending)
+{
+  // Use a short batch interval, so that updates are sent straight away.
+  delete _queue;
+  _queue = new ChronosTimerQueue(&_chronos_connection, 10, 2);
+
+  // Hold up sending the first update to timer1 until the queue has been
+  // filled.
+  std::atomic<bool> sending(false);
+  std::atomic<bool> filled(false);
+
+  {
+    InSequence s;
+    EXPECT_CALL(_chronos_connection, send_put(Eq(std::string("timer1")), AllOf(Ge(299u), Le(300u)), _, _, _, _))
+      .WillOnce(InvokeWithoutArgs([&]()
+                                  {
+                                    sending = true;
+                                    while (!filled)
+                                    {
+                                      usleep(1000);
+                                    }
+                                    return HTTP_OK;
+                                  }));
+    EXPECT_CALL(_chronos_connection, send_delete("timer1", _))
+      .WillOnce(Return(HTTP_OK));
+  }
+  EXPECT_CALL(_chronos_connection, send_put(Eq(std::string("timer2")), _, _, _, _, _))
+    .WillOnce(Return(HTTP_OK));
+  EXPECT_CALL(_chronos_connection, send_put(Eq(std::string("timer3")), _, _, _, _, _))
+    .WillOnce(Return(HTTP_OK));
+
+  EXPECT_TRUE(_queue->update("timer1", 300, "/timers", "{}", _tags, 0));
+  while (!sending)
+  {
+    usleep(1000);
+  }
+
+  EXPECT_TRUE(_queue->update("timer2", 300, "/timers", "{}", _tags, 0));
+  EXPECT_TRUE(_queue->update("timer3", 300, "/timers", "{}", _tags, 0));
+  EXPECT_FALSE(_queue->update("timer4", 300, "/timers", "{}", _tags, 0));
+  EXPECT_TRUE(_queue->remove("timer1", 0));
+  filled = true;
+
+  delete _queue; _queue = NULL;
+}
+
+// If Chronos returns a new ID for a timer when a queued update is sent, the
+// new ID replaces the old one.
+TEST_F(ChronosTimerQueueTest, NewTimerId)
+{
+  // Use a short batch interval, so that updates are sent straight away.
+  delete _queue;
+  _queue = new ChronosTimerQueue(&_chronos_connection, 10, 2);
+
+  EXPECT_CALL(_chronos_connection, send_put(Eq(std::string("timer1")), _, _, _, _, _))
+    .WillOnce(DoAll(SetArgReferee<0>(std::string("timer2")), Return(HTTP_OK)));
+  EXPECT_TRUE(_queue->update("timer1", 300, "/timers", "{}", _tags, 0));
+  EXPECT_EQ("timer2", wait_for_timer_id("timer1", "timer2"));
+
+  // If the ID changes again, an AoR still holding the original ID picks up
+  // the latest one.
+  EXPECT_CALL(_chronos_connection, send_put(Eq(std::string("timer2")), _, _, _, _, _))
+    .WillOnce(DoAll(SetArgReferee<0>(std::string("timer3")), Return(HTTP_OK)));
+  EXPECT_TRUE(_queue->update("timer2", 300, "/timers", "{}", _tags, 0));
+  EXPECT_EQ("timer3", wait_for_timer_id("timer1", "timer3"));
+
+  // IDs that Chronos didn't change are left alone.
+  std::string timer_id = "timer4";
+  _queue->update_timer_id(timer_id);
+  EXPECT_EQ("timer4", timer_id);
+}
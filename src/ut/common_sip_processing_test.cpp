@@ -179,6 +179,34 @@ static pjsip_module mod_reject =
   NULL,                                 /* on_tsx_state()       */
 };
 
+// Helper PJSIP module which records the SAS trail that common processing
+// assigned to a received message, and absorbs the message.
+
+static SAS::TrailId rx_trail = 0;
+
+static pj_bool_t record_trail(pjsip_rx_data* rdata)
+{
+  rx_trail = get_trail(rdata);
+  return PJ_TRUE;
+}
+
+static pjsip_module mod_record_trail =
+{
+  NULL, NULL,                           /* prev, next.          */
+  pj_str("mod-record-trail"),           /* Name.                */
+  -1,                                   /* Id                   */
+  PJSIP_MOD_PRIORITY_TRANSPORT_LAYER-1, /* Priority             */
+  NULL,                                 /* load()               */
+  NULL,                                 /* start()              */
+  NULL,                                 /* stop()               */
+  NULL,                                 /* unload()             */
+  &record_trail,                        /* on_rx_request()      */
+  &record_trail,                        /* on_rx_response()     */
+  NULL,                                 /* on_tx_request()      */
+  NULL,                                 /* on_tx_response()     */
+  NULL,                                 /* on_tsx_state()       */
+};
+
 using TestingCommon::Message;
 
 TEST_F(CommonProcessingTest, RequestAllowed)
@@ -471,3 +499,64 @@ TEST_F(CommonProcessingTest, NoContentLengthDropped)
   ASSERT_EQ(0, txdata_count());
 }
 
+// A CANCEL is logged on the trail of the INVITE transaction it cancels.
+TEST_F(CommonProcessingTest, CancelCorrelatedWithInvite)
+{
+  pjsip_endpt_register_module(stack_data.endpt, &mod_record_trail);
+
+  // Set up an INVITE UAS transaction on a known trail.
+  Message invite;
+  invite._first_hop = true;
+  pjsip_rx_data* rdata = build_rxdata(invite.get_request(), _tp);
+  parse_rxdata(rdata);
+  pjsip_transaction* tsx;
+  ASSERT_EQ(PJ_SUCCESS, pjsip_tsx_create_uas(NULL, rdata, &tsx));
+  set_trail(tsx, 1234);
+
+  // Inject a CANCEL for it.
+  Message cancel = invite;
+  cancel._method = "CANCEL";
+  rx_trail = 0;
+  inject_msg(cancel.get_request(), _tp);
+  EXPECT_EQ(1234u, rx_trail);
+
+  pjsip_endpt_unregister_module(stack_data.endpt, &mod_record_trail);
+}
+
+// With several transport threads, a transaction could be destroyed by one
+// transport thread while another is receiving a message for it, so received
+// messages are correlated using the stack's index of transaction trails
+// instead of the transaction itself.
+TEST_F(CommonProcessingTest, SeveralTransportThreads)
+{
+  pjsip_endpt_register_module(stack_data.endpt, &mod_record_trail);
+  ASSERT_EQ(PJ_SUCCESS, start_pjsip_threads(3));
+  EXPECT_EQ(3u, stack_data.pjsip_transport_threads.size());
+
+  Message invite;
+  invite._first_hop = true;
+  pjsip_rx_data* rdata = build_rxdata(invite.get_request(), _tp);
+  parse_rxdata(rdata);
+  pjsip_transaction* tsx;
+  ASSERT_EQ(PJ_SUCCESS, pjsip_tsx_create_uas(NULL, rdata, &tsx));
+  set_trail(tsx, 1234);
+
+  Message cancel = invite;
+  cancel._method = "CANCEL";
+  rx_trail = 0;
+  inject_msg(cancel.get_request(), _tp);
+  EXPECT_EQ(1234u, rx_trail);
+
+  // The index is emptied when the threads stop, so the transaction's trail is
+  // no longer found after they are restarted.
+  stop_pjsip_threads();
+  EXPECT_EQ(0u, stack_data.pjsip_transport_threads.size());
+  ASSERT_EQ(PJ_SUCCESS, start_pjsip_threads(3));
+  rx_trail = 0;
+  inject_msg(cancel.get_request(), _tp);
+  EXPECT_NE(0u, rx_trail);
+  EXPECT_NE(1234u, rx_trail);
+
+  stop_pjsip_threads();
+  pjsip_endpt_unregister_module(stack_data.endpt, &mod_record_trail);
+}
@@ -440,3 +440,68 @@ TEST_F(DNSEnumServiceTest, PosixRegexTest)
   ET("1234", "").test(enum_);
 }
 
+
+TEST_F(DNSEnumServiceTest, CachedResponseTest)
+{
+  // Responses are cached for their TTL.
+  FakeDNSResolver::_ttl = 60;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  cwtest_advance_time_ms(61000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  cwtest_reset_time();
+}
+
+TEST_F(DNSEnumServiceTest, NegativeCacheTest)
+{
+  // Responses saying that the domain doesn't exist are cached too.
+  FakeDNSResolver::_ttl = 60;
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  ET("1234", "").test(enum_);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+}
+
+TEST_F(DNSEnumServiceTest, CachedNonTerminalRuleTest)
+{
+  // Each step of a lookup is cached separately.
+  FakeDNSResolver::_ttl = 60;
+  struct ares_naptr_reply naptr_reply[] = {{NULL, (unsigned char*)"", (unsigned char*)"e2u+sip", (unsigned char*)"!1234!5678!", ".", 1, 1}};
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("5678", "sip:5678@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, ResponseTTLTest)
+{
+  // A response with two NAPTR records, with TTLs of 120s and 90s.
+  const unsigned char positive[] = {
+    0x00, 0x00, 0x81, 0x80, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+    0x01, '1', 0x04, 'e', '1', '6', '4', 0x00, 0x00, 0x23, 0x00, 0x01,
+    0xc0, 0x0c, 0x00, 0x23, 0x00, 0x01, 0x00, 0x00, 0x00, 0x78, 0x00, 0x00,
+    0xc0, 0x0c, 0x00, 0x23, 0x00, 0x01, 0x00, 0x00, 0x00, 0x5a, 0x00, 0x00};
+  EXPECT_EQ(90, DNSResolver::get_ttl(positive, sizeof(positive), false));
+
+  // An NXDOMAIN response with an SOA record with a TTL of 300s and a MINIMUM
+  // of 60s.
+  const unsigned char negative[] = {
+    0x00, 0x00, 0x81, 0x83, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+    0x01, '1', 0x04, 'e', '1', '6', '4', 0x00, 0x00, 0x23, 0x00, 0x01,
+    0x00, 0x00, 0x06, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x16,
+    0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03,
+    0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x3c};
+  EXPECT_EQ(60, DNSResolver::get_ttl(negative, sizeof(negative), true));
+
+  // A truncated response can't be cached.
+  EXPECT_EQ(0, DNSResolver::get_ttl(negative, sizeof(negative) - 4, true));
+}
@@ -22,6 +22,7 @@ FakeIPCountTable FAKE_IP_COUNT_TABLE;
 FakeCounterTable FAKE_COUNTER_TABLE;
 FakeCounterByScopeTable FAKE_COUNTER_BY_SCOPE_TABLE;
 FakeEventAccumulatorTable FAKE_EVENT_ACCUMULATOR_TABLE;
+FakeEventAccumulatorByScopeTable FAKE_EVENT_ACCUMULATOR_BY_SCOPE_TABLE;
 FakeContinuousAccumulatorTable FAKE_CONTINUOUS_ACCUMULATOR_TABLE;
 FakeSuccessFailCountTable FAKE_INIT_REG_TABLE;
 FakeSuccessFailCountTable FAKE_RE_REG_TABLE;
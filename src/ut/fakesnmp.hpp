@@ -14,6 +14,7 @@
 
 #include "snmp_row.h"
 #include "snmp_event_accumulator_table.h"
+#include "snmp_event_accumulator_by_scope_table.h"
 #include "snmp_continuous_accumulator_table.h"
 #include "snmp_scalar.h"
 #include "snmp_counter_table.h"
@@ -32,6 +33,14 @@ public:
   void accumulate(uint32_t sample) { _count++; };
 };
 
+class FakeEventAccumulatorByScopeTable: public EventAccumulatorByScopeTable
+{
+public:
+  int _count;
+  FakeEventAccumulatorByScopeTable() { _count = 0; };
+  void accumulate(uint32_t sample) { _count++; };
+};
+
 class FakeContinuousAccumulatorTable: public ContinuousAccumulatorTable
 {
 public:
@@ -127,6 +136,7 @@ extern FakeIPCountTable FAKE_IP_COUNT_TABLE;
 extern FakeCounterTable FAKE_COUNTER_TABLE;
 extern FakeCounterByScopeTable FAKE_COUNTER_BY_SCOPE_TABLE;
 extern FakeEventAccumulatorTable FAKE_EVENT_ACCUMULATOR_TABLE;
+extern FakeEventAccumulatorByScopeTable FAKE_EVENT_ACCUMULATOR_BY_SCOPE_TABLE;
 extern FakeContinuousAccumulatorTable FAKE_CONTINUOUS_ACCUMULATOR_TABLE;
 extern FakeSuccessFailCountTable FAKE_INIT_REG_TABLE;
 extern FakeSuccessFailCountTable FAKE_RE_REG_TABLE;
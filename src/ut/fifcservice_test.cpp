@@ -61,8 +61,7 @@ TEST_F(FIFCServiceTest, ValidFIFCFile)
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc.xml"));
 
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs(root);
+  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs();
   EXPECT_EQ(fifc_list.size(), 2);
 
   std::vector<std::string> server_names;
@@ -76,7 +75,6 @@ TEST_F(FIFCServiceTest, ValidFIFCFile)
 
   std::vector<int32_t> expected_priorities = {1, 2};
   EXPECT_THAT(expected_priorities, UnorderedElementsAreArray(priorities));
-  delete root; root = NULL;
 }
 
 // Test that reloading a fallback iFC file with an invalid file doesn't cause the
@@ -87,8 +85,7 @@ TEST_F(FIFCServiceTest, ReloadInvalidFIFCFile)
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc.xml"));
 
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs(root);
+  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs();
   EXPECT_EQ(fifc_list.size(), 2);
 
   // Change the file the fifc service is using to an invalid file (to mimic the
@@ -97,8 +94,7 @@ TEST_F(FIFCServiceTest, ReloadInvalidFIFCFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   fifc._configuration = string(UT_DIR).append("/test_fifc_invalid.xml");
   fifc.update_fifcs();
-  rapidxml::xml_document<>* root_reload = new rapidxml::xml_document<>;
-  fifc_list = fifc.get_fallback_ifcs(root_reload);
+  fifc_list = fifc.get_fallback_ifcs();
   EXPECT_EQ(fifc_list.size(), 2);
 
   std::vector<std::string> server_names;
@@ -112,8 +108,6 @@ TEST_F(FIFCServiceTest, ReloadInvalidFIFCFile)
 
   std::vector<int32_t> expected_priorities = {1, 2};
   EXPECT_THAT(expected_priorities, UnorderedElementsAreArray(priorities));
-  delete root; root = NULL;
-  delete root_reload; root_reload = NULL;
 }
 
 // Test that reloading a fallback iFC file with valid file doesn't destroy any
@@ -124,8 +118,7 @@ TEST_F(FIFCServiceTest, ReloadChangedFIFCFile)
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc.xml"));
 
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs(root);
+  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs();
   EXPECT_EQ(fifc_list.size(), 2);
 
   // Change the file the fifc service is using (to mimic the file being
@@ -134,16 +127,13 @@ TEST_F(FIFCServiceTest, ReloadChangedFIFCFile)
   fifc._configuration = string(UT_DIR).append("/test_fifc_changed.xml");
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   fifc.update_fifcs();
-  rapidxml::xml_document<>* root_reload = new rapidxml::xml_document<>;
-  std::vector<Ifc> fifc_list_reload = fifc.get_fallback_ifcs(root_reload);
+  std::vector<Ifc> fifc_list_reload = fifc.get_fallback_ifcs();
   EXPECT_EQ(fifc_list.size(), 2);
 
   std::string server_name = get_server_name(fifc_list[0]);
   EXPECT_EQ(server_name, "example.com");
   std::string server_name_reload = get_server_name(fifc_list_reload[0]);
   EXPECT_EQ(server_name_reload, "example_two.com");
-  delete root; root = NULL;
-  delete root_reload; root_reload = NULL;
 }
 
 // In the following tests we have various invalid/unexpected fallback iFC xml
@@ -161,9 +151,7 @@ TEST_F(FIFCServiceTest, MissingFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/non_existent_file.xml"));
   EXPECT_TRUE(log.contains("No fallback iFC configuration found"));
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  EXPECT_TRUE(fifc.get_fallback_ifcs(root).empty());
-  delete root; root = NULL;
+  EXPECT_TRUE(fifc.get_fallback_ifcs().empty());
 }
 
 // Test that we log appropriately if the fallback config file is empty.
@@ -173,9 +161,7 @@ TEST_F(FIFCServiceTest, EmptyFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc_empty_file.xml"));
   EXPECT_TRUE(log.contains("Failed to read fallback iFC configuration data"));
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  EXPECT_TRUE(fifc.get_fallback_ifcs(root).empty());
-  delete root; root = NULL;
+  EXPECT_TRUE(fifc.get_fallback_ifcs().empty());
 }
 
 // Test that we log appropriately if the fallback config file is unparseable.
@@ -185,9 +171,7 @@ TEST_F(FIFCServiceTest, ParseError)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc_invalid.xml"));
   EXPECT_TRUE(log.contains("Failed to parse the fallback iFC configuration data"));
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  EXPECT_TRUE(fifc.get_fallback_ifcs(root).empty());
-  delete root; root = NULL;
+  EXPECT_TRUE(fifc.get_fallback_ifcs().empty());
 }
 
 // Test that we log appropriately if the fallback config file has the wrong syntax.
@@ -197,9 +181,7 @@ TEST_F(FIFCServiceTest, IncorrectSyntax)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc_missing_node.xml"));
   EXPECT_TRUE(log.contains("Failed to parse the fallback iFC configuration file as it is invalid (missing FallbackIFCsSet block)"));
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  EXPECT_TRUE(fifc.get_fallback_ifcs(root).empty());
-  delete root; root = NULL;
+  EXPECT_TRUE(fifc.get_fallback_ifcs().empty());
 }
 
 // Test that we cope with the case that the fallback iFC file is valid but empty.
@@ -210,9 +192,7 @@ TEST_F(FIFCServiceTest, EmptyValidFile)
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc_empty_valid.xml"));
   EXPECT_FALSE(log.contains("Failed"));
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  EXPECT_TRUE(fifc.get_fallback_ifcs(root).empty());
-  delete root; root = NULL;
+  EXPECT_TRUE(fifc.get_fallback_ifcs().empty());
 }
 
 // In the following test there is a fallback iFC xml file that has an invalid
@@ -234,13 +214,11 @@ TEST_F(FIFCServiceTest, SingleInvalidIfc)
 
   EXPECT_TRUE(log.contains("Failed to parse one fallback iFC"));
 
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
-  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs(root);
+  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs();
   EXPECT_EQ(fifc_list.size(), 1);
 
   std::string server_name = get_server_name(fifc_list[0]);
   int32_t priority = get_priority(fifc_list[0]);
   EXPECT_EQ(server_name, "example_two.com");
   EXPECT_EQ(priority, 2);
-  delete root; root = NULL;
 }
@@ -131,3 +131,49 @@ TEST_F(FlowTest, FlowUnQuiesceMidDialog)
   EXPECT_FALSE(flow->should_quiesce());
 }
 
+
+TEST_F(FlowTest, FindFlow)
+{
+  pjsip_transport* tp = TransportFlow::udp_transport(stack_data.pcscf_untrusted_port);
+
+  // The flow can be found by address and by token.
+  Flow* found = ft->find_flow(tp, &addr);
+  EXPECT_EQ(flow, found);
+  found->dec_ref();
+
+  found = ft->find_flow(flow->token());
+  EXPECT_EQ(flow, found);
+  found->dec_ref();
+
+  // A different remote port doesn't match.
+  pj_sockaddr other_addr = addr;
+  pj_sockaddr_set_port(&other_addr, 5099);
+  EXPECT_EQ(NULL, ft->find_flow(tp, &other_addr));
+  EXPECT_EQ(NULL, ft->find_flow("not-a-token"));
+}
+
+TEST_F(FlowTest, FlowBeingRemoved)
+{
+  pjsip_transport* tp = TransportFlow::udp_transport(stack_data.pcscf_untrusted_port);
+
+  // Once a flow's reference count has reached zero it is not returned, and a
+  // new flow replaces it.
+  int refs = flow->_refs;
+  flow->_refs = 0;
+
+  EXPECT_EQ(NULL, ft->find_flow(tp, &addr));
+  EXPECT_EQ(NULL, ft->find_flow(flow->token()));
+
+  Flow* new_flow = ft->find_create_flow(tp, &addr);
+  EXPECT_NE(flow, new_flow);
+  EXPECT_NE(flow->token(), new_flow->token());
+
+  // Removing the old flow leaves the new one in place.
+  flow->_refs = refs;
+  ft->remove_flow(flow);
+  flow = new_flow;
+
+  Flow* found = ft->find_flow(tp, &addr);
+  EXPECT_EQ(new_flow, found);
+  found->dec_ref();
+}
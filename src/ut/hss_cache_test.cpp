@@ -0,0 +1,188 @@
+/**
+ * @file hss_cache_test.cpp UT for the HSS subscriber data cache.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "gtest/gtest.h"
+
+#include "hss_cache.h"
+#include "fakesnmp.hpp"
+#include "test_interposer.hpp"
+
+/// Fixture for HSSCacheTest.
+class HSSCacheTest : public ::testing::Test
+{
+public:
+  HSSCacheTest() :
+    _cache(60, 1600, &_hits, &_misses)
+  {
+  }
+
+  virtual ~HSSCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  // Builds subscriber data for an implicit registration set.
+  static HSSCache::Data make_data(const std::string& regstate,
+                                  const std::vector<std::string>& irs)
+  {
+    HSSCache::Data data;
+    data.regstate = regstate;
+    for (std::vector<std::string>::const_iterator it = irs.begin();
+         it != irs.end();
+         ++it)
+    {
+      data.associated_uris.add_uri(*it, false);
+    }
+    data.ccfs.push_back("ccf1");
+    return data;
+  }
+
+  // Caches data that was fetched at the current generation.
+  static bool put(HSSCache& cache,
+                  const std::string& public_id,
+                  const HSSCache::Data& data)
+  {
+    return cache.put(public_id, data, cache.generation(public_id));
+  }
+
+  SNMP::FakeCounterTable _hits;
+  SNMP::FakeCounterTable _misses;
+  HSSCache _cache;
+};
+
+// Data that has been cached is returned, and hits and misses are counted.
+TEST_F(HSSCacheTest, HitAndMiss)
+{
+  EXPECT_FALSE(_cache.get("sip:alice@example.com"));
+  EXPECT_EQ(1, _misses._count);
+
+  put(_cache,
+      "sip:alice@example.com",
+      make_data("REGISTERED", {"sip:alice@example.com"}));
+
+  std::shared_ptr<const HSSCache::Data> data = _cache.get("sip:alice@example.com");
+  ASSERT_TRUE(data);
+  EXPECT_EQ("REGISTERED", data->regstate);
+  EXPECT_EQ(1u, data->ccfs.size());
+  EXPECT_EQ(1, _hits._count);
+  EXPECT_EQ(1, _misses._count);
+}
+
+// Entries expire after the TTL.
+TEST_F(HSSCacheTest, Expiry)
+{
+  put(_cache,
+      "sip:alice@example.com",
+      make_data("REGISTERED", {"sip:alice@example.com"}));
+
+  cwtest_advance_time_ms(59000);
+  EXPECT_TRUE(_cache.get("sip:alice@example.com"));
+
+  cwtest_advance_time_ms(2000);
+  EXPECT_FALSE(_cache.get("sip:alice@example.com"));
+}
+
+// Putting an entry again replaces the existing entry.
+TEST_F(HSSCacheTest, Replace)
+{
+  put(_cache,
+      "sip:alice@example.com",
+      make_data("UNREGISTERED", {"sip:alice@example.com"}));
+  put(_cache,
+      "sip:alice@example.com",
+      make_data("REGISTERED", {"sip:alice@example.com"}));
+
+  std::shared_ptr<const HSSCache::Data> data = _cache.get("sip:alice@example.com");
+  ASSERT_TRUE(data);
+  EXPECT_EQ("REGISTERED", data->regstate);
+}
+
+// Invalidating an identity removes the entries for its whole implicit
+// registration set, but leaves other subscribers alone.
+TEST_F(HSSCacheTest, InvalidateIRS)
+{
+  std::vector<std::string> irs = {"sip:alice@example.com", "tel:+1234"};
+  put(_cache, "sip:alice@example.com", make_data("REGISTERED", irs));
+  put(_cache, "tel:+1234", make_data("REGISTERED", irs));
+  put(_cache,
+      "sip:bob@example.com",
+      make_data("REGISTERED", {"sip:bob@example.com"}));
+
+  _cache.invalidate("sip:alice@example.com");
+
+  EXPECT_FALSE(_cache.get("sip:alice@example.com"));
+  EXPECT_FALSE(_cache.get("tel:+1234"));
+  EXPECT_TRUE(_cache.get("sip:bob@example.com"));
+}
+
+// The least recently used entries are evicted when the cache is full.
+TEST_F(HSSCacheTest, Eviction)
+{
+  HSSCache small_cache(60, 1, NULL, NULL);
+
+  // The cache has a single entry per shard, so adding lots of entries must
+  // evict the first one.
+  put(small_cache,
+      "sip:first@example.com",
+      make_data("REGISTERED", {"sip:first@example.com"}));
+
+  for (int ii = 0; ii < 100; ii++)
+  {
+    std::string impu = "sip:" + std::to_string(ii) + "@example.com";
+    put(small_cache, impu, make_data("REGISTERED", {impu}));
+  }
+
+  EXPECT_FALSE(small_cache.get("sip:first@example.com"));
+  EXPECT_TRUE(small_cache.get("sip:99@example.com"));
+}
+
+// Data fetched before an invalidation isn't cached, as it may be out of date.
+TEST_F(HSSCacheTest, InvalidatedWhileFetching)
+{
+  std::vector<std::string> irs = {"sip:alice@example.com", "tel:+1234"};
+  put(_cache, "tel:+1234", make_data("REGISTERED", irs));
+
+  uint64_t alice_generation = _cache.generation("sip:alice@example.com");
+  uint64_t tel_generation = _cache.generation("tel:+1234");
+  _cache.invalidate("sip:alice@example.com");
+  _cache.invalidate("tel:+1234");
+
+  EXPECT_FALSE(_cache.put("sip:alice@example.com",
+                          make_data("REGISTERED", irs),
+                          alice_generation));
+  EXPECT_FALSE(_cache.put("tel:+1234",
+                          make_data("REGISTERED", irs),
+                          tel_generation));
+  EXPECT_FALSE(_cache.get("sip:alice@example.com"));
+  EXPECT_FALSE(_cache.get("tel:+1234"));
+
+  // Data fetched after the invalidation is cached as normal.
+  EXPECT_TRUE(put(_cache,
+                  "sip:alice@example.com",
+                  make_data("REGISTERED", irs)));
+  EXPECT_TRUE(_cache.get("sip:alice@example.com"));
+}
+
+// Caching new data for an identity drops the rest of the implicit
+// registration set that was cached with the old data.
+TEST_F(HSSCacheTest, PutInvalidatesOldIRS)
+{
+  std::vector<std::string> irs = {"sip:alice@example.com", "tel:+1234"};
+  put(_cache, "sip:alice@example.com", make_data("REGISTERED", irs));
+  put(_cache, "tel:+1234", make_data("REGISTERED", irs));
+
+  put(_cache,
+      "sip:alice@example.com",
+      make_data("REGISTERED", {"sip:alice@example.com"}));
+
+  EXPECT_TRUE(_cache.get("sip:alice@example.com"));
+  EXPECT_FALSE(_cache.get("tel:+1234"));
+}
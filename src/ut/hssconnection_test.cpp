@@ -14,6 +14,9 @@
 
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "utils.h"
@@ -53,6 +56,7 @@ class HssConnectionTest : public BaseTest
          &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
          &_cm,
          NULL,
+         NULL,
          500)
     {
     fakecurl_responses.clear();
@@ -688,6 +692,87 @@ TEST_F(HssConnectionTest, CacheNotAllowed)
   EXPECT_EQ(rc, 200);
 }
 
+// Identical requests made while a request is in progress wait for, and share,
+// its response rather than sending their own.
+TEST_F(HssConnectionTest, CoalesceIdenticalRequests)
+{
+  std::atomic<int> sends(0);
+  std::string waiter_rsp;
+  HTTPCode waiter_rc = 0;
+
+  std::thread waiter;
+  std::string rsp;
+  HTTPCode rc = _hss.send_coalesced(
+    "GET /impu/pubid44/location",
+    [&](std::string& response)
+    {
+      ++sends;
+
+      // Make an identical request while this one is in progress, and wait
+      // until it is waiting for this one.
+      waiter = std::thread([&]()
+      {
+        waiter_rc = _hss.send_coalesced("GET /impu/pubid44/location",
+                                        [&](std::string& response)
+                                        {
+                                          ++sends;
+                                          return HTTP_SERVER_ERROR;
+                                        },
+                                        waiter_rsp);
+      });
+
+      while (true)
+      {
+        pthread_mutex_lock(&_hss._in_flight_lock);
+        int waiters = _hss._in_flight["GET /impu/pubid44/location"]->waiters;
+        pthread_mutex_unlock(&_hss._in_flight_lock);
+
+        if (waiters > 0)
+        {
+          break;
+        }
+
+        usleep(1000);
+      }
+
+      response = "shared";
+      return HTTP_OK;
+    },
+    rsp);
+  waiter.join();
+
+  EXPECT_EQ(1, sends);
+  EXPECT_EQ(HTTP_OK, rc);
+  EXPECT_EQ("shared", rsp);
+  EXPECT_EQ(HTTP_OK, waiter_rc);
+  EXPECT_EQ("shared", waiter_rsp);
+  EXPECT_TRUE(_hss._in_flight.empty());
+
+  // Once the request has completed, the next one is sent.
+  rc = _hss.send_coalesced("GET /impu/pubid44/location",
+                           [&](std::string& response)
+                           {
+                             ++sends;
+                             return HTTP_NOT_FOUND;
+                           },
+                           rsp);
+  EXPECT_EQ(2, sends);
+  EXPECT_EQ(HTTP_NOT_FOUND, rc);
+}
+
+// Only requests that don't change state on Homestead are coalesced.
+TEST_F(HssConnectionTest, CoalescableRequests)
+{
+  EXPECT_TRUE(HSSConnection::can_coalesce_get("/impu/pubid44/location"));
+  EXPECT_TRUE(HSSConnection::can_coalesce_get("/impi/privid69/registration-status?impu=sip%3Aa%2Fav"));
+  EXPECT_FALSE(HSSConnection::can_coalesce_get("/impi/privid69/av"));
+  EXPECT_FALSE(HSSConnection::can_coalesce_get("/impi/privid69/av/aka?impu=pubid44"));
+
+  EXPECT_TRUE(HSSConnection::can_coalesce_put("{\"reqtype\": \"call\", \"server_name\": \"server_name\"}"));
+  EXPECT_FALSE(HSSConnection::can_coalesce_put("{\"reqtype\": \"reg\", \"server_name\": \"server_name\"}"));
+  EXPECT_FALSE(HSSConnection::can_coalesce_put("{\"reqtype\": \"dereg-user\", \"server_name\": \"server_name\"}"));
+}
+
 /// Fake iFCs to use to test Shared iFCs.
 std::string ifc_priority_one = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
                                "<InitialFilterCriteria>\n"
@@ -728,6 +813,7 @@ class HssWithSifcTest : public BaseTest
               &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
               NULL,
               &_sifc_service,
+              NULL,
               500)
   {
     fakecurl_responses.clear();
@@ -1033,7 +1119,7 @@ TEST_F(HssWithSifcTest, SimpleSiFC)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of one shared iFC set, with set id 10.
   const std::set<int32_t> ids = {10};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that two iFCs are now present in the map.
@@ -1053,7 +1139,7 @@ TEST_F(HssWithSifcTest, SifcWithIfc)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of one shared iFC set with set id of 0.
   const std::set<int32_t> ids = {0};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that three iFCs are now present in the map,
@@ -1086,7 +1172,7 @@ TEST_F(HssWithSifcTest, MultipleExtensions)
   // anything at this point.
   std::multimap<int32_t, Ifc> ifc_list_one;
   const std::set<int32_t> set_list_one = {1, 2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifc_list_one)));
 
   // Any iFCs from the first Shared iFC sets will be passed into this function.
@@ -1097,7 +1183,7 @@ TEST_F(HssWithSifcTest, MultipleExtensions)
   ifc_list_two.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   ifc_list_two.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   const std::set<int32_t> set_list_two = {10};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_two, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, set_list_two, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifc_list_two)));
 
   // Send in a message, and check that three iFCs are now in the iFC map.
@@ -1117,7 +1203,7 @@ TEST_F(HssWithSifcTest, MultipleSifcs)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of two shared iFC sets, with set ids 1 and 2.
   const std::set<int32_t> ids = {1, 2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, ids, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check that two iFCs are now in the iFC map.
@@ -1141,9 +1227,9 @@ TEST_F(HssWithSifcTest, MultiplePubIdsWithSifcs)
   // profile, and 2 for the other.
   const std::set<int32_t> id_set_one = {1};
   const std::set<int32_t> id_set_two = {2};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_two, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_two, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // The iFC map composes of keys, which are public ids, and their values, which
@@ -1171,7 +1257,7 @@ TEST_F(HssWithSifcTest, ComplexSifcIfcMix)
   ifcs_from_id.insert(std::pair<int32_t, Ifc>(2, *_ifc_two));
   // Expect input of two shared iFC sets, with ids 3 and 4.
   const std::set<int32_t> id_set_one = {3, 4};
-  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _, _))
+  EXPECT_CALL(_sifc_service, get_ifcs_from_id(_, id_set_one, _))
     .WillOnce(SetArgReferee<0>(std::multimap<int32_t, Ifc>(ifcs_from_id)));
 
   // Send in a message, and check the expected number of iFCs are present, as
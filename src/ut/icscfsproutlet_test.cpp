@@ -23,6 +23,7 @@
 #include "fakehssconnection.hpp"
 #include "test_interposer.hpp"
 #include "sproutletproxy.h"
+#include "sproutlet_async.h"
 #include "fakesnmp.hpp"
 #include "testingcommon.h"
 
@@ -3671,3 +3672,241 @@ TEST_F(ICSCFSproutletTest, ICSCFHandlesUrnUri)
   _hss_connection->delete_result("/impu/sip%3A6505551000%40homedomain/location?originating=true");
   delete tp;
 }
+
+
+/// Callbacks that resume sproutlets when their asynchronous operations have
+/// completed.  They are captured rather than passed to a worker thread, so
+/// that each test controls when the sproutlet resumes.
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cond = PTHREAD_COND_INITIALIZER;
+static std::list<PJUtils::Callback*> async_callbacks;
+
+static void capture_async_callback(PJUtils::Callback* callback)
+{
+  pthread_mutex_lock(&async_lock);
+  async_callbacks.push_back(callback);
+  pthread_cond_signal(&async_cond);
+  pthread_mutex_unlock(&async_lock);
+}
+
+/// Fixture for I-CSCF tests that query the HSS asynchronously.
+class ICSCFSproutletAsyncTest : public ICSCFSproutletTest
+{
+public:
+  ICSCFSproutletAsyncTest()
+  {
+    SproutletAsync::init(NULL, 1, &capture_async_callback);
+  }
+
+  ~ICSCFSproutletAsyncTest()
+  {
+    SproutletAsync::term();
+  }
+
+protected:
+  /// Waits for an asynchronous operation to complete, then resumes the
+  /// sproutlet that started it on this thread, as a worker thread would.
+  void complete_async_op()
+  {
+    pthread_mutex_lock(&async_lock);
+    while (async_callbacks.empty())
+    {
+      pthread_cond_wait(&async_cond, &async_lock);
+    }
+    PJUtils::Callback* callback = async_callbacks.front();
+    async_callbacks.pop_front();
+    pthread_mutex_unlock(&async_lock);
+
+    callback->run();
+    delete callback;
+  }
+};
+
+// A terminating INVITE is routed once the asynchronous HSS query completes.
+TEST_F(ICSCFSproutletAsyncTest, RouteTermInvite)
+{
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the I-CSCF listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        ICSCF_PORT,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Set up the HSS response for the terminating location query.
+  _hss_connection->set_result("/impu/sip%3A6505551234%40homedomain/location",
+                              "{\"result-code\": 2001,"
+                              " \"scscf\": \"sip:scscf1.homedomain:5058;transport=TCP\"}");
+
+  // Inject a terminating INVITE request with a P-Served-User header.
+  Message msg1;
+  msg1._first_hop = true;
+  msg1._method = "INVITE";
+  msg1._via = tp->to_string(false);
+  msg1._extra = "P-Served-User: <sip:6505551000@homedomain>";
+  msg1._route = "Route: <sip:homedomain>";
+  inject_msg(msg1.get_request(), tp);
+
+  // Expecting only the 100 Trying while the HSS is queried.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Complete the HSS query.  The INVITE is forwarded to the S-CSCF named in
+  // the HSS response.
+  complete_async_op();
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.10.1", 5058, tdata);
+  ReqMatcher("INVITE").matches(tdata->msg);
+  pjsip_tx_data* invite_tdata = pop_txdata();
+
+  // Send a 200 OK response, which is forwarded back to the source.
+  inject_msg(respond_to_txdata(invite_tdata, 200));
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(200).matches(tdata->msg);
+  free_txdata();
+
+  _hss_connection->delete_result("/impu/sip%3A6505551234%40homedomain/location");
+
+  delete tp;
+}
+
+// A terminating INVITE that is cancelled while the HSS is queried is rejected
+// when the query completes, rather than being routed.
+TEST_F(ICSCFSproutletAsyncTest, RouteTermInviteCancelDuringHSSQuery)
+{
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the I-CSCF listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        ICSCF_PORT,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Set up the HSS response for the terminating location query.
+  _hss_connection->set_result("/impu/sip%3A6505551234%40homedomain/location",
+                              "{\"result-code\": 2001,"
+                              " \"scscf\": \"sip:scscf1.homedomain:5058;transport=TCP\"}");
+
+  // Inject a terminating INVITE request with a P-Served-User header.
+  Message msg1;
+  msg1._first_hop = true;
+  msg1._method = "INVITE";
+  msg1._via = tp->to_string(false);
+  msg1._extra = "P-Served-User: <sip:6505551000@homedomain>";
+  msg1._route = "Route: <sip:homedomain>";
+  inject_msg(msg1.get_request(), tp);
+
+  // Expecting only the 100 Trying while the HSS is queried.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Build and send a CANCEL chasing the INVITE.
+  Message msg2;
+  msg2._first_hop = true;
+  msg2._method = "CANCEL";
+  msg2._via = tp->to_string(false);
+  msg2._unique = msg1._unique;    // Make sure branch and call-id are same as the INVITE
+  inject_msg(msg2.get_request(), tp);
+
+  // Expect the 200 OK response to the CANCEL, and nothing else, as the
+  // INVITE hasn't been forwarded.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(200).matches(tdata->msg);
+  free_txdata();
+
+  // Complete the HSS query.  The INVITE isn't forwarded, but is rejected with
+  // a 487.
+  complete_async_op();
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(487).matches(tdata->msg);
+  free_txdata();
+
+  test_session_establishment_stats(0, 1, 1, 0);
+
+  _hss_connection->delete_result("/impu/sip%3A6505551234%40homedomain/location");
+
+  delete tp;
+}
+
+// A terminating INVITE to a tel URI that the HSS doesn't know is translated
+// by ENUM, and the HSS queried again, without blocking the transaction.
+TEST_F(ICSCFSproutletAsyncTest, RouteTermInviteEnum)
+{
+  pjsip_tx_data* tdata;
+
+  // Create a TCP connection to the I-CSCF listening port.
+  TransportFlow* tp = new TransportFlow(TransportFlow::Protocol::TCP,
+                                        ICSCF_PORT,
+                                        "1.2.3.4",
+                                        49152);
+
+  // Set up the HSS response for the location query on the translated URI.
+  _hss_connection->set_result("/impu/sip%3A%2B16505551234%40homedomain/location",
+                              "{\"result-code\": 2001,"
+                              " \"scscf\": \"sip:scscf1.homedomain:5058;transport=TCP\"}");
+
+  // Inject an INVITE request to a tel URI with a P-Served-User header.
+  Message msg1;
+  msg1._first_hop = true;
+  msg1._method = "INVITE";
+  msg1._toscheme = "tel";
+  msg1._to = "+16605551234";
+  msg1._todomain = "";
+  msg1._via = tp->to_string(false);
+  msg1._extra = "P-Served-User: <sip:6505551000@homedomain>";
+  msg1._route = "Route: <sip:homedomain>";
+  inject_msg(msg1.get_request(), tp);
+
+  // Expecting only the 100 Trying while the HSS is queried.
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  RespMatcher(100).matches(tdata->msg);
+  tp->expect_target(tdata);
+  free_txdata();
+
+  // Complete the HSS query.  The HSS doesn't know the tel URI, so nothing is
+  // sent while ENUM is queried.
+  complete_async_op();
+  ASSERT_EQ(0, txdata_count());
+
+  // Complete the ENUM lookup.  Nothing is sent while the HSS is queried for
+  // the translated URI.
+  complete_async_op();
+  ASSERT_EQ(0, txdata_count());
+
+  // Complete the second HSS query.  The INVITE is forwarded to the S-CSCF
+  // named in the HSS response.
+  complete_async_op();
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  expect_target("TCP", "10.10.10.1", 5058, tdata);
+  ReqMatcher("INVITE").matches(tdata->msg);
+  string route = get_headers(tdata->msg, "Route");
+  ASSERT_EQ("Route: <sip:scscf1.homedomain:5058;transport=TCP;lr>", route);
+  pjsip_tx_data* invite_tdata = pop_txdata();
+
+  // Send a 200 OK response, which is forwarded back to the source.
+  inject_msg(respond_to_txdata(invite_tdata, 200));
+  ASSERT_EQ(1, txdata_count());
+  tdata = current_txdata();
+  tp->expect_target(tdata);
+  RespMatcher(200).matches(tdata->msg);
+  free_txdata();
+
+  _hss_connection->delete_result("/impu/sip%3A%2B16505551234%40homedomain/location");
+
+  delete tp;
+}
@@ -1381,6 +1381,30 @@ TEST_F(IfcHandlerTest, SIPHeaderBadRegex)
   EXPECT_TRUE(log2.contains("Invalid regular expression in Content element for SIPHeader service point trigger"));
 }
 
+// iFCs are compiled once and the compiled form is shared, but errors in the
+// iFC are still only reported if evaluation reaches them.
+TEST_F(IfcHandlerTest, SIPHeaderBadContentRegexNotReached)
+{
+  for (int ii = 0; ii < 2; ii++)
+  {
+    CapturingTestLogger log;
+    doTest("",
+           "    <TriggerPoint>\n"
+           "    <ConditionTypeCNF>1</ConditionTypeCNF>\n"
+           "    <SPT>\n"
+           "      <ConditionNegated>1</ConditionNegated>\n"
+           "      <Group>0</Group>\n"
+           "      <SIPHeader><Header>NoSuchHeader</Header><Content>?</Content></SIPHeader>\n"
+           "      <Extension></Extension>\n"
+           "    </SPT>\n"
+           "  </TriggerPoint>\n",
+           true,
+           SessionCase::Terminating,
+           true);
+    EXPECT_FALSE(log.contains("Invalid regular expression"));
+  }
+}
+
 TEST_F(IfcHandlerTest, ReqURIMatch)
 {
   doTest("",
@@ -2316,6 +2340,51 @@ TEST_F(IfcHandlerTest, SDPNoEqualsSign)
   EXPECT_TRUE(log.contains("Found badly formatted SDP line: einvalidline"));
 }
 
+// Parses an iFC with the specified server name, and gets its compiled form.
+static std::shared_ptr<const CompiledIfc> get_compiled_ifc(const std::string& server_name)
+{
+  rapidxml::xml_document<> doc;
+  std::string xml = "<InitialFilterCriteria>"
+                    "<Priority>1</Priority>"
+                    "<ApplicationServer>"
+                    "<ServerName>" + server_name + "</ServerName>"
+                    "<DefaultHandling>0</DefaultHandling>"
+                    "</ApplicationServer>"
+                    "</InitialFilterCriteria>";
+  doc.parse<0>(doc.allocate_string(xml.c_str()));
+  return Ifc::get_compiled_ifc(doc.first_node());
+}
+
+// iFCs with the same XML share a compiled iFC, and iFCs with different XML
+// don't.
+TEST_F(IfcHandlerTest, CompiledIfcShared)
+{
+  std::shared_ptr<const CompiledIfc> compiled1 = get_compiled_ifc("sip:as1.homedomain");
+  std::shared_ptr<const CompiledIfc> compiled2 = get_compiled_ifc("sip:as1.homedomain");
+  std::shared_ptr<const CompiledIfc> compiled3 = get_compiled_ifc("sip:as2.homedomain");
+  EXPECT_EQ(compiled1, compiled2);
+  EXPECT_NE(compiled1, compiled3);
+}
+
+// When the cache of compiled iFCs is full, the least recently used iFC is
+// evicted.
+TEST_F(IfcHandlerTest, CompiledIfcLRU)
+{
+  std::shared_ptr<const CompiledIfc> compiled1 = get_compiled_ifc("sip:lru1.homedomain");
+  std::shared_ptr<const CompiledIfc> compiled2 = get_compiled_ifc("sip:lru2.homedomain");
+
+  // Fill the cache with other iFCs, using the first iFC after each one so it
+  // stays recently used.
+  for (size_t ii = 0; ii < Ifc::MAX_COMPILED_IFCS; ii++)
+  {
+    get_compiled_ifc("sip:filler" + std::to_string(ii) + ".homedomain");
+    get_compiled_ifc("sip:lru1.homedomain");
+  }
+
+  EXPECT_EQ(compiled1, get_compiled_ifc("sip:lru1.homedomain"));
+  EXPECT_NE(compiled2, get_compiled_ifc("sip:lru2.homedomain"));
+}
+
 
 // @@@ iFC XML parse error
 // @@@ lookup_ifcs gets no served user
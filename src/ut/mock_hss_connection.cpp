@@ -12,6 +12,7 @@ MockHSSConnection::MockHSSConnection():
                 &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
                 NULL,
                 NULL,
+                NULL,
                 0) {};
 MockHSSConnection::~MockHSSConnection() {};
 
@@ -0,0 +1,103 @@
+/**
+ * @file prefix_trie_test.cpp UT for the number prefix trie.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "prefix_trie.h"
+
+/// Fixture for PrefixTrieTest.
+class PrefixTrieTest : public ::testing::Test
+{
+public:
+  PrefixTrieTest()
+  {
+    _trie.insert("+22", "two");
+    _trie.insert("+2222", "four");
+    _trie.insert("+222", "three");
+    _trie.insert("+44", "uk");
+  }
+
+  // Returns the value matched for a number, or "" if there is no match.
+  std::string match(const std::string& number,
+                    bool match_longer_prefixes = false)
+  {
+    const std::string* value = _trie.match(number, match_longer_prefixes);
+    return (value != NULL) ? *value : "";
+  }
+
+  PrefixTrie<std::string> _trie;
+};
+
+// The longest matching prefix is used.
+TEST_F(PrefixTrieTest, LongestMatch)
+{
+  EXPECT_EQ(4u, _trie.size());
+  EXPECT_EQ("two", match("+22338899"));
+  EXPECT_EQ("three", match("+22238899"));
+  EXPECT_EQ("four", match("+22228899"));
+  EXPECT_EQ("four", match("+2222"));
+  EXPECT_EQ("uk", match("+441234"));
+  EXPECT_EQ("", match("+33123"));
+  EXPECT_EQ("", match("+2"));
+  EXPECT_EQ("", match(""));
+}
+
+// The matched prefix is returned if requested.
+TEST_F(PrefixTrieTest, MatchedPrefix)
+{
+  std::string prefix;
+  EXPECT_TRUE(_trie.match("+2223", false, &prefix) != NULL);
+  EXPECT_EQ("+222", prefix);
+  EXPECT_TRUE(_trie.match("+2", true, &prefix) != NULL);
+  EXPECT_EQ("+2222", prefix);
+}
+
+// A number that is the start of longer prefixes matches the greatest of them
+// if requested.
+TEST_F(PrefixTrieTest, LongerPrefixes)
+{
+  EXPECT_EQ("four", match("+2", true));
+  EXPECT_EQ("four", match("+222", true));
+  EXPECT_EQ("three", match("+222", false));
+  EXPECT_EQ("four", match("+2222", true));
+  EXPECT_EQ("uk", match("+4", true));
+  EXPECT_EQ("", match("+3", true));
+}
+
+// The first value inserted for a prefix is kept.
+TEST_F(PrefixTrieTest, DuplicatePrefix)
+{
+  EXPECT_FALSE(_trie.insert("+22", "duplicate"));
+  EXPECT_EQ(4u, _trie.size());
+  EXPECT_EQ("two", match("+2233"));
+}
+
+// An empty prefix matches every number.
+TEST_F(PrefixTrieTest, EmptyPrefix)
+{
+  _trie.insert("", "default");
+  EXPECT_EQ("default", match("+33123"));
+  EXPECT_EQ("two", match("+2233"));
+}
+
+// Swapping tries exchanges their contents.
+TEST_F(PrefixTrieTest, Swap)
+{
+  PrefixTrie<std::string> other;
+  other.insert("+1", "us");
+  _trie.swap(other);
+
+  EXPECT_EQ(1u, _trie.size());
+  EXPECT_EQ("us", match("+1555"));
+  EXPECT_EQ("", match("+2233"));
+  EXPECT_TRUE(other.match("+2233", false) != NULL);
+}
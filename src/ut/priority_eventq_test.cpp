@@ -0,0 +1,81 @@
+/**
+ * @file priority_eventq_test.cpp UT for the priority event queue.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "priority_eventq.h"
+
+/// Fixture for PriorityEventqTest.
+class PriorityEventqTest : public ::testing::Test
+{
+public:
+  PriorityEventqTest() : _q(3) {}
+  virtual ~PriorityEventqTest() {}
+
+  priority_eventq<int> _q;
+};
+
+// Items are popped in priority order, and in FIFO order within a class.
+TEST_F(PriorityEventqTest, PriorityOrder)
+{
+  _q.push(1, 2);
+  _q.push(2, 1);
+  _q.push(3, 2);
+  _q.push(4, 0);
+  _q.push(5, 1);
+  EXPECT_EQ(5u, _q.size());
+
+  int item;
+  int expected[] = {4, 2, 5, 1, 3};
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    EXPECT_TRUE(_q.pop(item, 0));
+    EXPECT_EQ(expected[ii], item);
+  }
+
+  EXPECT_EQ(0u, _q.size());
+}
+
+// Popping an empty queue times out.
+TEST_F(PriorityEventqTest, PopTimeout)
+{
+  int item;
+  EXPECT_FALSE(_q.pop(item, 0));
+  EXPECT_FALSE(_q.pop(item, 10));
+}
+
+// A terminated queue rejects pushes and pops.
+TEST_F(PriorityEventqTest, Terminate)
+{
+  _q.push(1, 0);
+  _q.terminate();
+
+  int item;
+  EXPECT_FALSE(_q.pop(item));
+  EXPECT_FALSE(_q.push(2, 0));
+}
+
+// The queue is only deadlocked if it is non-empty and hasn't been serviced
+// within the threshold.
+TEST_F(PriorityEventqTest, Deadlock)
+{
+  _q.set_deadlock_threshold(1);
+  EXPECT_FALSE(_q.is_deadlocked());
+
+  _q.push(1, 1);
+  usleep(5000);
+  EXPECT_TRUE(_q.is_deadlocked());
+
+  int item;
+  EXPECT_TRUE(_q.pop(item, 0));
+  EXPECT_FALSE(_q.is_deadlocked());
+}
@@ -10,14 +10,17 @@
  */
 
 #include <string>
+#include <stdexcept>
 #include "gtest/gtest.h"
 
 #include "basetest.hpp"
 #include "ralf_processor.h"
 #include "mockhttpconnection.h"
+#include "fakesnmp.hpp"
 
 using ::testing::_;
 using ::testing::Return;
+using ::testing::Throw;
 
 class RalfProcessorTest : public BaseTest
 {
@@ -49,3 +52,83 @@ TEST_F(RalfProcessorTest, RequestComplete)
   _ralf_processor->send_request_to_ralf(rr);
   sleep(1);
 }
+
+TEST_F(RalfProcessorTest, BatchedRequests)
+{
+  // Create a processor that batches ACRs, and allows two to be queued.
+  SNMP::FakeCounterTable dropped_tbl;
+  RalfProcessor* batching_processor =
+    new RalfProcessor(_ralf_connection, NULL, 1, 100, 2, &dropped_tbl);
+
+  EXPECT_CALL(*_ralf_connection, send_post("path1",_,_,_,_)).WillOnce(Return(200));
+  EXPECT_CALL(*_ralf_connection, send_post("path2",_,_,_,_)).WillOnce(Return(200));
+
+  for (int ii = 1; ii <= 3; ii++)
+  {
+    RalfProcessor::RalfRequest* rr = new RalfProcessor::RalfRequest();
+    rr->path = "path" + std::to_string(ii);
+    rr->message = "message";
+    rr->trail = 0;
+    batching_processor->send_request_to_ralf(rr);
+  }
+
+  // The third ACR is dropped, and the others are sent at the next flush.
+  EXPECT_EQ(1, dropped_tbl._count);
+  sleep(1);
+
+  delete batching_processor;
+}
+
+TEST_F(RalfProcessorTest, ExceptionSendingBatch)
+{
+  // Create a processor that batches ACRs with a long interval, so that ACRs
+  // stay queued until the test sends them, and allows two to be queued.
+  SNMP::FakeCounterTable dropped_tbl;
+  RalfProcessor* batching_processor =
+    new RalfProcessor(_ralf_connection, NULL, 1, 100000, 2, &dropped_tbl);
+
+  for (int ii = 1; ii <= 2; ii++)
+  {
+    RalfProcessor::RalfRequest* rr = new RalfProcessor::RalfRequest();
+    rr->path = "path" + std::to_string(ii);
+    rr->message = "message";
+    rr->trail = 0;
+    batching_processor->send_request_to_ralf(rr);
+  }
+
+  RalfProcessor::RalfBatch* batch = new RalfProcessor::RalfBatch();
+  batch->processor = batching_processor;
+  pthread_mutex_lock(&batching_processor->_lock);
+  batch->requests.swap(batching_processor->_pending);
+  pthread_mutex_unlock(&batching_processor->_lock);
+  ASSERT_EQ(2u, batch->requests.size());
+
+  // Send the batch as a ralf thread would, with the second send hitting an
+  // exception, and then call the exception callback as the pool would.
+  EXPECT_CALL(*_ralf_connection, send_post("path1",_,_,_,_)).WillOnce(Return(200));
+  EXPECT_CALL(*_ralf_connection, send_post("path2",_,_,_,_))
+    .WillOnce(Throw(std::runtime_error("send failed")));
+
+  RalfProcessor::RalfBatch* work = batch;
+  EXPECT_THROW(batching_processor->_thread_pool->process_work(work),
+               std::runtime_error);
+  RalfProcessor::exception_callback(batch);
+
+  // The batch no longer counts towards the queued ACRs, so another ACR can be
+  // queued.
+  EXPECT_EQ(0u, batching_processor->_queued);
+
+  RalfProcessor::RalfRequest* rr = new RalfProcessor::RalfRequest();
+  rr->path = "path3";
+  rr->message = "message";
+  rr->trail = 0;
+  batching_processor->send_request_to_ralf(rr);
+  EXPECT_EQ(0, dropped_tbl._count);
+  EXPECT_EQ(1u, batching_processor->_queued);
+
+  // The queued ACR is flushed when the processor is destroyed.
+  EXPECT_CALL(*_ralf_connection, send_post("path3",_,_,_,_))
+    .Times(testing::AtMost(1))
+    .WillOnce(Return(200));
+  delete batching_processor;
+}
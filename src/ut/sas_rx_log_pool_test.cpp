@@ -0,0 +1,151 @@
+/**
+ * @file sas_rx_log_pool_test.cpp UT for the pool that logs received messages
+ *                                to SAS.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "sas_rx_log_pool.h"
+
+/// Pool that records the messages it logs rather than logging them to SAS,
+/// and can be held up part way through logging a message.
+class RecordingSASRxLogPool : public SASRxLogPool
+{
+public:
+  RecordingSASRxLogPool(unsigned int max_queued) :
+    SASRxLogPool(NULL, 1, max_queued)
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+    pthread_mutex_init(&_block_lock, NULL);
+  }
+
+  virtual ~RecordingSASRxLogPool()
+  {
+    pthread_mutex_destroy(&_block_lock);
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Waits (for up to a second) for the specified number of messages to have
+  /// been picked up for logging.
+  bool wait_for_logs(size_t num_logs)
+  {
+    struct timespec abstime;
+    clock_gettime(CLOCK_REALTIME, &abstime);
+    abstime.tv_sec += 1;
+
+    pthread_mutex_lock(&_lock);
+    int rc = 0;
+    while ((_logs.size() < num_logs) && (rc == 0))
+    {
+      rc = pthread_cond_timedwait(&_cond, &_lock, &abstime);
+    }
+    bool logged = (_logs.size() >= num_logs);
+    pthread_mutex_unlock(&_lock);
+
+    return logged;
+  }
+
+  std::vector<std::string> _logs;
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+
+  /// Held by the test to hold up the thread logging a message.
+  pthread_mutex_t _block_lock;
+
+protected:
+  virtual void log(SASRxLog* rx_log)
+  {
+    pthread_mutex_lock(&_lock);
+    _logs.push_back(rx_log->msg);
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    pthread_mutex_lock(&_block_lock);
+    pthread_mutex_unlock(&_block_lock);
+  }
+};
+
+static SASRxLog* make_log(const std::string& msg)
+{
+  SASRxLog* rx_log = new SASRxLog();
+  rx_log->trail = 0;
+  rx_log->timestamp = 0;
+  rx_log->transport_type = PJSIP_TRANSPORT_UDP;
+  rx_log->src_port = 5060;
+  rx_log->src_name = "1.2.3.4";
+  rx_log->msg = msg;
+  return rx_log;
+}
+
+// Messages are logged in order, and once the threads have caught up more can
+// be queued.
+TEST(SASRxLogPoolTest, QueueAndDrain)
+{
+  RecordingSASRxLogPool pool(2);
+  pool.start();
+
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    EXPECT_TRUE(pool.queue_log(make_log("msg" + std::to_string(ii))));
+    ASSERT_TRUE(pool.wait_for_logs(ii + 1));
+  }
+
+  ASSERT_EQ(5u, pool._logs.size());
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    EXPECT_EQ("msg" + std::to_string(ii), pool._logs[ii]);
+  }
+  EXPECT_EQ(0u, pool.dropped());
+
+  pool.stop();
+  pool.join();
+}
+
+// Messages are dropped and counted, rather than queued, when too many are
+// waiting to be logged.
+TEST(SASRxLogPoolTest, Full)
+{
+  RecordingSASRxLogPool pool(2);
+  pool.start();
+
+  // Hold up the logging thread part way through the first message.
+  pthread_mutex_lock(&pool._block_lock);
+  EXPECT_TRUE(pool.queue_log(make_log("msg0")));
+  ASSERT_TRUE(pool.wait_for_logs(1));
+
+  // Two more messages fit in the queue, and the rest are dropped.
+  EXPECT_TRUE(pool.queue_log(make_log("msg1")));
+  EXPECT_TRUE(pool.queue_log(make_log("msg2")));
+  EXPECT_FALSE(pool.queue_log(make_log("msg3")));
+  EXPECT_FALSE(pool.queue_log(make_log("msg4")));
+  EXPECT_EQ(2u, pool.dropped());
+
+  // Let the logging thread drain the queue.
+  pthread_mutex_unlock(&pool._block_lock);
+  ASSERT_TRUE(pool.wait_for_logs(3));
+  EXPECT_EQ("msg1", pool._logs[1]);
+  EXPECT_EQ("msg2", pool._logs[2]);
+
+  // There's room in the queue again.
+  EXPECT_TRUE(pool.queue_log(make_log("msg5")));
+  ASSERT_TRUE(pool.wait_for_logs(4));
+  EXPECT_EQ("msg5", pool._logs[3]);
+  EXPECT_EQ(2u, pool.dropped());
+
+  pool.stop();
+  pool.join();
+}
@@ -0,0 +1,126 @@
+/**
+ * @file sdm_fanout_test.cpp UT for parallel access to remote SDMs.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <atomic>
+#include <string>
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "sdm_fanout.h"
+#include "mock_subscriber_data_manager.h"
+
+using ::testing::_;
+using ::testing::Return;
+using ::testing::Invoke;
+
+/// Fixture for SDMFanoutTest.  The tests are run with the remote SDMs
+/// accessed sequentially and in parallel.
+class SDMFanoutTest : public ::testing::TestWithParam<int>
+{
+public:
+  SDMFanoutTest()
+  {
+    SDMFanout::init(NULL, GetParam());
+
+    for (int ii = 0; ii < 3; ++ii)
+    {
+      MockSubscriberDataManager* sdm = new MockSubscriberDataManager();
+      EXPECT_CALL(*sdm, has_servers()).WillRepeatedly(Return(true));
+      _mock_sdms.push_back(sdm);
+      _sdms.push_back(sdm);
+    }
+  }
+
+  virtual ~SDMFanoutTest()
+  {
+    SDMFanout::term();
+
+    for (std::vector<MockSubscriberDataManager*>::iterator it = _mock_sdms.begin();
+         it != _mock_sdms.end();
+         ++it)
+    {
+      delete *it;
+    }
+  }
+
+  // Creates AoR data, with a binding if requested.
+  static AoRPair* aor_data(bool with_binding)
+  {
+    AoR* aor = new AoR("sip:6505550231@homedomain");
+    if (with_binding)
+    {
+      aor->get_binding("<sip:6505550231@192.91.191.29:59934;transport=tcp>");
+    }
+    return new AoRPair(new AoR(*aor), aor);
+  }
+
+  std::vector<MockSubscriberDataManager*> _mock_sdms;
+  std::vector<SubscriberDataManager*> _sdms;
+};
+
+INSTANTIATE_TEST_CASE_P(SequentialAndParallel,
+                        SDMFanoutTest,
+                        ::testing::Values(0, 3));
+
+// The AoR data with bindings is returned.
+TEST_P(SDMFanoutTest, GetAoRData)
+{
+  EXPECT_CALL(*_mock_sdms[0], get_aor_data(_, _)).WillOnce(Return(aor_data(false)));
+  EXPECT_CALL(*_mock_sdms[1], get_aor_data(_, _)).WillOnce(Return(aor_data(true)));
+
+  // The last read may or may not happen (depending on whether the reads are
+  // in parallel), so its data is only created if it is needed.
+  EXPECT_CALL(*_mock_sdms[2], get_aor_data(_, _)).Times(::testing::AtMost(1))
+    .WillOnce(Invoke([](const std::string&, SAS::TrailId) { return aor_data(false); }));
+
+  AoRPair* aor_pair = SDMFanout::get_aor_data(_sdms, "sip:6505550231@homedomain", 0);
+  ASSERT_TRUE(aor_pair != NULL);
+  EXPECT_TRUE(aor_pair->current_contains_bindings());
+  delete aor_pair;
+
+  // Wait for any outstanding reads before the mocks are checked.
+  SDMFanout::term();
+}
+
+// If no remote SDM has bindings, AoR data without bindings is returned.
+TEST_P(SDMFanoutTest, GetAoRDataNoBindings)
+{
+  EXPECT_CALL(*_mock_sdms[0], get_aor_data(_, _)).WillOnce(Return(aor_data(false)));
+  EXPECT_CALL(*_mock_sdms[1], get_aor_data(_, _)).WillOnce(Return((AoRPair*)NULL));
+  EXPECT_CALL(*_mock_sdms[2], get_aor_data(_, _)).WillOnce(Return(aor_data(false)));
+
+  AoRPair* aor_pair = SDMFanout::get_aor_data(_sdms, "sip:6505550231@homedomain", 0);
+  ASSERT_TRUE(aor_pair != NULL);
+  EXPECT_FALSE(aor_pair->current_contains_bindings());
+  delete aor_pair;
+}
+
+// Remote SDMs without servers aren't read.
+TEST_P(SDMFanoutTest, GetAoRDataNoServers)
+{
+  for (std::vector<MockSubscriberDataManager*>::iterator it = _mock_sdms.begin();
+       it != _mock_sdms.end();
+       ++it)
+  {
+    EXPECT_CALL(**it, has_servers()).WillRepeatedly(Return(false));
+    EXPECT_CALL(**it, get_aor_data(_, _)).Times(0);
+  }
+
+  EXPECT_TRUE(SDMFanout::get_aor_data(_sdms, "sip:6505550231@homedomain", 0) == NULL);
+}
+
+// The function is called for every remote SDM before for_each returns.
+TEST_P(SDMFanoutTest, ForEach)
+{
+  std::atomic<int> calls(0);
+  SDMFanout::for_each(_sdms, [&calls](SubscriberDataManager* sdm) { ++calls; });
+  EXPECT_EQ(3, calls);
+}
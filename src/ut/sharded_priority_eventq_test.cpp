@@ -0,0 +1,125 @@
+/**
+ * @file sharded_priority_eventq_test.cpp UT for the sharded priority event
+ * queue.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "sharded_priority_eventq.h"
+
+/// Fixture for ShardedPriorityEventqTest.
+class ShardedPriorityEventqTest : public ::testing::Test
+{
+public:
+  ShardedPriorityEventqTest() : _q(2, 2) {}
+  virtual ~ShardedPriorityEventqTest() {}
+
+  /// Waits (for up to a second) for the queue to be drained.
+  bool wait_for_empty()
+  {
+    for (int ii = 0; (ii < 1000) && (_q.size() > 0); ++ii)
+    {
+      usleep(1000);
+    }
+    return (_q.size() == 0);
+  }
+
+  sharded_priority_eventq<int> _q;
+};
+
+// A consumer services its home shard first, and steals from the other shards
+// when its home shard is empty.
+TEST_F(ShardedPriorityEventqTest, HomeShardFirst)
+{
+  _q.push(0, 1, 0);
+  _q.push(1, 2, 1);
+  _q.push(1, 3, 0);
+  EXPECT_EQ(3u, _q.size());
+
+  int item;
+  EXPECT_TRUE(_q.pop(1, item));
+  EXPECT_EQ(3, item);
+  EXPECT_TRUE(_q.pop(1, item));
+  EXPECT_EQ(2, item);
+  EXPECT_TRUE(_q.pop(1, item));
+  EXPECT_EQ(1, item);
+  EXPECT_EQ(0u, _q.size());
+}
+
+// A backed up shard is drained by a consumer bound to a different shard that
+// is waiting for work.
+TEST_F(ShardedPriorityEventqTest, BackedUpShardDrainedByOtherConsumer)
+{
+  std::vector<int> items;
+  std::thread consumer([&]()
+  {
+    int item;
+    while (_q.pop(1, item))
+    {
+      items.push_back(item);
+    }
+  });
+
+  // Give the consumer time to find its queues empty and wait.
+  usleep(10000);
+
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    _q.push(0, ii, 0);
+  }
+
+  EXPECT_TRUE(wait_for_empty());
+
+  _q.terminate();
+  consumer.join();
+
+  ASSERT_EQ(5u, items.size());
+  for (int ii = 0; ii < 5; ++ii)
+  {
+    EXPECT_EQ(ii, items[ii]);
+  }
+}
+
+// Terminating the queue wakes up waiting consumers and rejects pushes.
+TEST_F(ShardedPriorityEventqTest, Terminate)
+{
+  bool popped = true;
+  std::thread consumer([&]()
+  {
+    int item;
+    popped = _q.pop(0, item);
+  });
+
+  usleep(10000);
+  _q.terminate();
+  consumer.join();
+
+  EXPECT_FALSE(popped);
+  EXPECT_FALSE(_q.push(0, 1, 0));
+}
+
+// The queue is deadlocked if any shard hasn't been serviced within the
+// threshold.
+TEST_F(ShardedPriorityEventqTest, Deadlock)
+{
+  sharded_priority_eventq<int> q(2, 2, 1);
+  EXPECT_FALSE(q.is_deadlocked());
+
+  q.push(1, 1, 0);
+  usleep(5000);
+  EXPECT_TRUE(q.is_deadlocked());
+
+  int item;
+  EXPECT_TRUE(q.pop(0, item));
+  EXPECT_FALSE(q.is_deadlocked());
+}
@@ -56,9 +56,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // iFC for ID 2).
   std::set<int> single_ifc; single_ifc.insert(2);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "publish.example.com");
 
@@ -66,7 +64,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // ID 1)
   std::set<int> multiple_ifcs; multiple_ifcs.insert(1);
   std::multimap<int32_t, Ifc> multiple_ifc_map;
-  sifc.get_ifcs_from_id(multiple_ifc_map, multiple_ifcs, root, 0);
+  sifc.get_ifcs_from_id(multiple_ifc_map, multiple_ifcs, 0);
   EXPECT_EQ(multiple_ifc_map.size(), 2);
   std::vector<std::string> expected_server_names;
   expected_server_names.push_back("invite.example.com");
@@ -83,7 +81,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // Pull out multiple iFCs from multiple IDs
   std::set<int> multiple_ids; multiple_ids.insert(1); multiple_ids.insert(2);
   std::multimap<int32_t, Ifc> multiple_ids_map;
-  sifc.get_ifcs_from_id(multiple_ids_map, multiple_ids, root, 0);
+  sifc.get_ifcs_from_id(multiple_ids_map, multiple_ids, 0);
   EXPECT_EQ(multiple_ids_map.size(), 3);
   expected_server_names.push_back("publish.example.com");
   std::vector<std::string> server_names_multiple_ids;
@@ -99,7 +97,7 @@ TEST_F(SIFCServiceTest, ValidSIFCFile)
   // check that this doesn't return any iFCs.
   std::set<int> missing_ids; missing_ids.insert(100);
   std::multimap<int32_t, Ifc> missing_ids_map;
-  sifc.get_ifcs_from_id(missing_ids_map, missing_ids, root, 0);
+  sifc.get_ifcs_from_id(missing_ids_map, missing_ids, 0);
   EXPECT_EQ(missing_ids_map.size(), 0);
 }
 
@@ -113,9 +111,7 @@ TEST_F(SIFCServiceTest, SIFCReloadInvalidFile)
   // Load the iFC file, and check that it's been parsed correctly
   std::set<int> id; id.insert(2);
   std::multimap<int32_t, Ifc> ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
   EXPECT_EQ(ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
 
@@ -126,7 +122,7 @@ TEST_F(SIFCServiceTest, SIFCReloadInvalidFile)
   sifc._configuration = string(UT_DIR).append("/test_sifc_parse_error.xml");
   sifc.update_sets();
   std::multimap<int32_t, Ifc> ifc_map_reload;
-  sifc.get_ifcs_from_id(ifc_map_reload, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map_reload, id, 0);
   EXPECT_EQ(ifc_map_reload.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map_reload.find(0)->second), "publish.example.com");
 }
@@ -141,9 +137,7 @@ TEST_F(SIFCServiceTest, SIFCReloadDifferentFile)
   // Load the iFC file, and check that it's been parsed correctly
   std::set<int> id; id.insert(2);
   std::multimap<int32_t, Ifc> ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
   EXPECT_EQ(ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
 
@@ -154,12 +148,28 @@ TEST_F(SIFCServiceTest, SIFCReloadDifferentFile)
   sifc._configuration = string(UT_DIR).append("/test_sifc_changed.xml");
   sifc.update_sets();
   std::multimap<int32_t, Ifc> ifc_map_reload;
-  sifc.get_ifcs_from_id(ifc_map_reload, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map_reload, id, 0);
   EXPECT_EQ(ifc_map_reload.size(), 1);
   EXPECT_EQ(get_server_name(ifc_map_reload.find(0)->second), "register.example.com");
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
 }
 
+// Test that iFCs handed out by the service stay valid after the service (and
+// so the configuration they came from) has gone.
+TEST_F(SIFCServiceTest, IfcsOutliveService)
+{
+  EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
+  SIFCService* sifc = new SIFCService(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc.xml"));
+
+  std::set<int> id; id.insert(2);
+  std::multimap<int32_t, Ifc> ifc_map;
+  sifc->get_ifcs_from_id(ifc_map, id, 0);
+  delete sifc; sifc = NULL;
+
+  EXPECT_EQ(ifc_map.size(), 1);
+  EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
+}
+
 // In the following tests we have various invalid/unexpected SiFC xml files.
 // These tests check that the correct logs are made in each case; this isn't
 // ideal as it means the tests are quite fragile, but it's the best we can do.
@@ -174,7 +184,7 @@ TEST_F(SIFCServiceTest, MissingFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/non_existent_file.xml"));
   EXPECT_TRUE(log.contains("No shared iFCs configuration"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_FALSE(sifc._shared_ifc_sets);
 }
 
 // Test that we log appropriately if the shared iFC file is empty.
@@ -184,7 +194,7 @@ TEST_F(SIFCServiceTest, EmptyFile)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_empty_file.xml"));
   EXPECT_TRUE(log.contains("Failed to read shared iFCs configuration"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_FALSE(sifc._shared_ifc_sets);
 }
 
 // Test that we log appropriately if the shared iFC file is unparseable.
@@ -194,7 +204,7 @@ TEST_F(SIFCServiceTest, ParseError)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_parse_error.xml"));
   EXPECT_TRUE(log.contains("Failed to parse the shared iFCs configuration data"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_FALSE(sifc._shared_ifc_sets);
 }
 
 // Test that we log appropriately if the shared iFC file has the wrong syntax.
@@ -204,7 +214,7 @@ TEST_F(SIFCServiceTest, MissingSetBlock)
   EXPECT_CALL(*_mock_alarm, set()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_missing_set.xml"));
   EXPECT_TRUE(log.contains("Invalid shared iFCs configuration file - missing SharedIFCsSets block"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  EXPECT_FALSE(sifc._shared_ifc_sets);
 }
 
 // Test that we cope with the case that the shared iFC file is valid but empty
@@ -214,7 +224,8 @@ TEST_F(SIFCServiceTest, NoEntries)
   EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
   SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc_no_entries.xml"));
   EXPECT_FALSE(log.contains("Failed"));
-  EXPECT_TRUE(sifc._shared_ifc_sets.empty());
+  ASSERT_TRUE(sifc._shared_ifc_sets);
+  EXPECT_TRUE(sifc._shared_ifc_sets->sets.empty());
 }
 
 // In the following tests we have various SiFC xml files that have invalid
@@ -236,9 +247,7 @@ TEST_F(SIFCServiceTest, MissingSetID)
   // was added to the map.
   std::set<int> single_ifc; single_ifc.insert(2);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "register.example.com");
 }
@@ -255,9 +264,7 @@ TEST_F(SIFCServiceTest, InvalidSetID)
   // was added to the map.
   std::set<int> single_ifc; single_ifc.insert(2);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "register.example.com");
 }
@@ -275,9 +282,7 @@ TEST_F(SIFCServiceTest, RepeatedSetID)
   // Check that the map entry has the correct server name.
   std::set<int> single_ifc; single_ifc.insert(1);
   std::multimap<int32_t, Ifc> single_ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, root, 0);
+  sifc.get_ifcs_from_id(single_ifc_map, single_ifc, 0);
   EXPECT_EQ(single_ifc_map.size(), 1);
   EXPECT_EQ(get_server_name(single_ifc_map.find(0)->second), "publish.example.com");
 }
@@ -295,9 +300,7 @@ TEST_F(SIFCServiceTest, SIFCPriorities)
   // Get the iFCs for ID. There should be two (as one was invalid)
   std::set<int> id; id.insert(1);
   std::multimap<int32_t, Ifc> ifc_map;
-  rapidxml::xml_document<>* root_underlying_ptr = new rapidxml::xml_document<>;
-  std::shared_ptr<rapidxml::xml_document<> > root (root_underlying_ptr);
-  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map, id, 0);
   EXPECT_EQ(ifc_map.size(), 2);
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "invite.example.com");
   EXPECT_EQ(get_server_name(ifc_map.find(200)->second), "register.example.com");
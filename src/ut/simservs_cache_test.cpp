@@ -0,0 +1,235 @@
+/**
+ * @file simservs_cache_test.cpp UT for the MMTEL simservs cache.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "simservs_cache.h"
+#include "mmtel.h"
+#include "fakehttpconnection.hpp"
+#include "fakesnmp.hpp"
+#include "test_interposer.hpp"
+
+using ::testing::_;
+using ::testing::Return;
+
+/// Fixture for SimservsCacheTest.
+class SimservsCacheTest : public ::testing::Test
+{
+public:
+  SimservsCacheTest() :
+    _cache(60, 1600, &_hits, &_misses, &_revalidations)
+  {
+  }
+
+  virtual ~SimservsCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  static std::shared_ptr<const simservs> make_services()
+  {
+    return std::make_shared<const simservs>("");
+  }
+
+  SNMP::FakeCounterTable _hits;
+  SNMP::FakeCounterTable _misses;
+  SNMP::FakeCounterTable _revalidations;
+  SimservsCache _cache;
+};
+
+// Simservs that have been cached are returned with their entity tag, and hits
+// and misses are counted.
+TEST_F(SimservsCacheTest, HitAndMiss)
+{
+  std::shared_ptr<const simservs> services;
+  std::string etag;
+
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", services, etag));
+  EXPECT_FALSE(services);
+  EXPECT_EQ(1, _misses._count);
+
+  std::shared_ptr<const simservs> cached = make_services();
+  _cache.put("sip:alice@example.com", cached, "\"v1\"");
+
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", services, etag));
+  EXPECT_EQ(cached, services);
+  EXPECT_EQ("\"v1\"", etag);
+  EXPECT_EQ(1, _hits._count);
+  EXPECT_EQ(1, _misses._count);
+}
+
+// Expired entries are still returned, so that they can be revalidated, and
+// revalidating an entry restarts its TTL.
+TEST_F(SimservsCacheTest, ExpiryAndRevalidation)
+{
+  std::shared_ptr<const simservs> cached = make_services();
+  _cache.put("sip:alice@example.com", cached, "\"v1\"");
+
+  std::shared_ptr<const simservs> services;
+  std::string etag;
+
+  cwtest_advance_time_ms(61000);
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", services, etag));
+  EXPECT_EQ(cached, services);
+  EXPECT_EQ("\"v1\"", etag);
+
+  _cache.revalidated("sip:alice@example.com");
+  EXPECT_EQ(1, _revalidations._count);
+
+  cwtest_advance_time_ms(59000);
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", services, etag));
+  EXPECT_EQ(cached, services);
+}
+
+// Putting an entry again replaces the existing entry.
+TEST_F(SimservsCacheTest, Replace)
+{
+  _cache.put("sip:alice@example.com", make_services(), "\"v1\"");
+
+  std::shared_ptr<const simservs> cached = make_services();
+  _cache.put("sip:alice@example.com", cached, "\"v2\"");
+
+  std::shared_ptr<const simservs> services;
+  std::string etag;
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", services, etag));
+  EXPECT_EQ(cached, services);
+  EXPECT_EQ("\"v2\"", etag);
+
+  _cache.invalidate("sip:alice@example.com");
+  services.reset();
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", services, etag));
+  EXPECT_FALSE(services);
+}
+
+// The least recently used entries are evicted when the cache is full.
+TEST_F(SimservsCacheTest, Eviction)
+{
+  SimservsCache small_cache(60, 1, NULL, NULL, NULL);
+
+  small_cache.put("sip:first@example.com", make_services(), "");
+
+  for (int ii = 0; ii < 100; ii++)
+  {
+    small_cache.put("sip:" + std::to_string(ii) + "@example.com",
+                    make_services(),
+                    "");
+  }
+
+  std::shared_ptr<const simservs> services;
+  std::string etag;
+  EXPECT_FALSE(small_cache.get("sip:first@example.com", services, etag));
+  EXPECT_TRUE(small_cache.get("sip:99@example.com", services, etag));
+}
+
+/// XDMConnection whose conditional GET returns whatever the test specifies.
+class MockXDMConnection : public XDMConnection
+{
+public:
+  MockXDMConnection() :
+    XDMConnection(new FakeHttpConnection(), &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE)
+  {
+  }
+
+  MOCK_METHOD4(get_simservs, HTTPCode(const std::string& user,
+                                      std::string& xml_data,
+                                      std::string& etag,
+                                      SAS::TrailId trail));
+};
+
+/// Fixture for the MMTEL AS's use of the simservs cache.
+class MmtelSimservsCacheTest : public SimservsCacheTest
+{
+public:
+  MmtelSimservsCacheTest() :
+    _mmtel("mmtel", &_xdmc, &_cache)
+  {
+  }
+
+  /// Caches simservs for alice, and lets them expire.
+  std::shared_ptr<const simservs> cache_expired_services()
+  {
+    std::shared_ptr<const simservs> cached = make_services();
+    _cache.put("sip:alice@example.com", cached, "\"v1\"");
+    cwtest_advance_time_ms(61000);
+    return cached;
+  }
+
+  MockXDMConnection _xdmc;
+  Mmtel _mmtel;
+};
+
+// If the XDMS confirms that an expired copy is still valid, the copy is used
+// and its TTL restarted.
+TEST_F(MmtelSimservsCacheTest, RevalidateNotModified)
+{
+  std::shared_ptr<const simservs> cached = cache_expired_services();
+
+  EXPECT_CALL(_xdmc, get_simservs("sip:alice@example.com", _, std::string("\"v1\""), _))
+    .WillOnce(Return(XDMConnection::NOT_MODIFIED));
+  EXPECT_EQ(cached, _mmtel.get_cached_user_services("sip:alice@example.com", 0));
+  EXPECT_EQ(1, _revalidations._count);
+
+  // The copy is now used without contacting the XDMS.
+  EXPECT_EQ(cached, _mmtel.get_cached_user_services("sip:alice@example.com", 0));
+}
+
+// If the user's simservs have been removed, the removal is cached and the user
+// has no services.
+TEST_F(MmtelSimservsCacheTest, RevalidateNotFound)
+{
+  std::shared_ptr<const simservs> cached = cache_expired_services();
+
+  EXPECT_CALL(_xdmc, get_simservs("sip:alice@example.com", _, _, _))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+  std::shared_ptr<const simservs> services =
+    _mmtel.get_cached_user_services("sip:alice@example.com", 0);
+  ASSERT_TRUE(services);
+  EXPECT_NE(cached, services);
+  EXPECT_FALSE(services->oip_enabled());
+
+  std::string etag;
+  std::shared_ptr<const simservs> cached_now;
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", cached_now, etag));
+  EXPECT_EQ(services, cached_now);
+  EXPECT_EQ("", etag);
+}
+
+// If an expired copy can't be revalidated because the XDMS fails or times
+// out, the expired copy is used, and revalidated again on the next call.
+TEST_F(MmtelSimservsCacheTest, RevalidateError)
+{
+  std::shared_ptr<const simservs> cached = cache_expired_services();
+
+  EXPECT_CALL(_xdmc, get_simservs("sip:alice@example.com", _, std::string("\"v1\""), _))
+    .WillOnce(Return(HTTP_SERVER_UNAVAILABLE))
+    .WillOnce(Return(HTTP_GATEWAY_TIMEOUT));
+  EXPECT_EQ(cached, _mmtel.get_cached_user_services("sip:alice@example.com", 0));
+  EXPECT_EQ(cached, _mmtel.get_cached_user_services("sip:alice@example.com", 0));
+  EXPECT_EQ(0, _revalidations._count);
+}
+
+// If the XDMS fails and there's no cached copy, the user has no services, and
+// nothing is cached.
+TEST_F(MmtelSimservsCacheTest, FetchError)
+{
+  EXPECT_CALL(_xdmc, get_simservs("sip:alice@example.com", _, std::string(""), _))
+    .WillOnce(Return(HTTP_SERVER_UNAVAILABLE));
+  std::shared_ptr<const simservs> services =
+    _mmtel.get_cached_user_services("sip:alice@example.com", 0);
+  ASSERT_TRUE(services);
+  EXPECT_FALSE(services->oip_enabled());
+
+  std::string etag;
+  std::shared_ptr<const simservs> cached;
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", cached, etag));
+  EXPECT_FALSE(cached);
+}
@@ -1061,3 +1061,97 @@ TEST_F(SipParserTest, StarHashToHeader)
   pj_str_t goal = pj_str("*1234#");
   EXPECT_EQ(pj_strcmp(user, &goal), 0);
 }
+
+TEST_F(SipParserTest, LazyChargingHeaders)
+{
+  set_lazy_charging_headers(true);
+
+  string str("INVITE sip:6505554321@homedomain SIP/2.0\n"
+             "Via: SIP/2.0/TCP 10.0.0.1:5060;rport;branch=z9hG4bKPjPtKqxhkZnvVKI2LUEWoZVFjFaqo.cOzf;alias\n"
+             "Max-Forwards: 63\n"
+             "From: <sip:6505551234@homedomain>;tag=1234\n"
+             "To: <sip:6505554321@homedomain>\n"
+             "P-Charging-Vector: icid-value=4815162542; orig-ioi=homedomain\n"
+             "P-Charging-Function-Addresses: ccf=10.0.0.2; ecf=10.0.0.1\n"
+             "Contact: <sip:6505551234@10.0.0.1:5060;transport=TCP;ob>\n"
+             "Call-ID: 1-13919@10.151.20.48\n"
+             "CSeq: 1 INVITE\n"
+             "Content-Length: 0\n\n");
+
+  pjsip_rx_data* rdata = build_rxdata(str);
+  parse_rxdata(rdata);
+
+  // The P-CV header is held as raw text, and is printed and cloned as it is.
+  pjsip_hdr* hdr = (pjsip_hdr*)pjsip_msg_find_hdr_by_name(rdata->msg_info.msg,
+                                                          &STR_P_C_V,
+                                                          NULL);
+  ASSERT_NE(hdr, (pjsip_hdr*)NULL);
+  EXPECT_PJEQ(((pjsip_lazy_hdr*)hdr)->hvalue, "icid-value=4815162542; orig-ioi=homedomain");
+
+  char buf[1024];
+  pjsip_hdr* clone = (pjsip_hdr*)hdr->vptr->clone(stack_data.pool, (void*)hdr);
+  int written = clone->vptr->print_on(clone, buf, sizeof(buf));
+  EXPECT_EQ(written, 61);
+  EXPECT_STREQ("P-Charging-Vector: icid-value=4815162542; orig-ioi=homedomain", buf);
+  EXPECT_EQ(clone->vptr->print_on(clone, buf, written), -1);
+
+  // Looking it up with the typed accessor parses it, and replaces it in the
+  // message.
+  pjsip_p_c_v_hdr* pcv = (pjsip_p_c_v_hdr*)
+    pjsip_msg_find_parsed_hdr_by_name(rdata->msg_info.msg, &STR_P_C_V);
+  ASSERT_NE(pcv, (pjsip_p_c_v_hdr*)NULL);
+  EXPECT_PJEQ(pcv->icid, "4815162542");
+  EXPECT_PJEQ(pcv->orig_ioi, "homedomain");
+  EXPECT_EQ((pjsip_hdr*)pcv,
+            (pjsip_hdr*)pjsip_msg_find_hdr_by_name(rdata->msg_info.msg,
+                                                   &STR_P_C_V,
+                                                   NULL));
+  EXPECT_EQ((pjsip_hdr*)pcv,
+            pjsip_msg_find_parsed_hdr_by_name(rdata->msg_info.msg, &STR_P_C_V));
+
+  // Check the same for the P-CFA header, this time on a clone of the message.
+  pjsip_msg* msg = pjsip_msg_clone(stack_data.pool, rdata->msg_info.msg);
+  pjsip_p_c_f_a_hdr* pcfa = (pjsip_p_c_f_a_hdr*)
+    pjsip_msg_find_parsed_hdr_by_name(msg, &STR_P_C_F_A);
+  ASSERT_NE(pcfa, (pjsip_p_c_f_a_hdr*)NULL);
+  EXPECT_EQ(1u, pj_list_size(&pcfa->ccf));
+  EXPECT_EQ(1u, pj_list_size(&pcfa->ecf));
+
+  set_lazy_charging_headers(false);
+}
+
+TEST_F(SipParserTest, LazyChargingHeadersInvalid)
+{
+  set_lazy_charging_headers(true);
+
+  string str("INVITE sip:6505554321@homedomain SIP/2.0\n"
+             "Via: SIP/2.0/TCP 10.0.0.1:5060;rport;branch=z9hG4bKPjPtKqxhkZnvVKI2LUEWoZVFjFaqo.cOzf;alias\n"
+             "Max-Forwards: 63\n"
+             "From: <sip:6505551234@homedomain>;tag=1234\n"
+             "To: <sip:6505554321@homedomain>\n"
+             "P-Charging-Vector: orig-ioi=homedomain\n"
+             "Contact: <sip:6505551234@10.0.0.1:5060;transport=TCP;ob>\n"
+             "Call-ID: 1-13919@10.151.20.48\n"
+             "CSeq: 1 INVITE\n"
+             "Content-Length: 0\n\n");
+
+  pjsip_rx_data* rdata = build_rxdata(str);
+  parse_rxdata(rdata);
+
+  // The message parses, but the header can't be parsed when it is needed.
+  // It is left in the message as it is.
+  EXPECT_TRUE(pj_list_empty(&rdata->msg_info.parse_err));
+  EXPECT_EQ((pjsip_hdr*)NULL,
+            pjsip_msg_find_parsed_hdr_by_name(rdata->msg_info.msg, &STR_P_C_V));
+  EXPECT_NE((pjsip_hdr*)NULL,
+            pjsip_msg_find_hdr_by_name(rdata->msg_info.msg, &STR_P_C_V, NULL));
+
+  // The failure is remembered, so the header isn't parsed again.
+  pjsip_lazy_hdr* lazy = (pjsip_lazy_hdr*)
+    pjsip_msg_find_hdr_by_name(rdata->msg_info.msg, &STR_P_C_V, NULL);
+  EXPECT_EQ((pjsip_parse_hdr_func*)NULL, lazy->parser);
+  EXPECT_EQ((pjsip_hdr*)NULL,
+            pjsip_msg_find_parsed_hdr_by_name(rdata->msg_info.msg, &STR_P_C_V));
+
+  set_lazy_charging_headers(false);
+}
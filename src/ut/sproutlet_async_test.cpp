@@ -0,0 +1,112 @@
+/**
+ * @file sproutlet_async_test.cpp UT for the asynchronous sproutlet operation
+ *                                pool.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <pthread.h>
+#include "gtest/gtest.h"
+
+#include "sproutlet_async.h"
+
+/// Callback that records whether the operation had run when it was resumed.
+class TestCallback : public PJUtils::Callback
+{
+public:
+  TestCallback(bool* op_run) : _op_run(op_run), _op_run_before_resume(false) {}
+
+  void run()
+  {
+    _op_run_before_resume = *_op_run;
+  }
+
+  bool* _op_run;
+  bool _op_run_before_resume;
+};
+
+static pthread_mutex_t dispatch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dispatch_cond = PTHREAD_COND_INITIALIZER;
+static TestCallback* dispatched = NULL;
+
+static void dispatch(PJUtils::Callback* callback)
+{
+  callback->run();
+
+  pthread_mutex_lock(&dispatch_lock);
+  dispatched = (TestCallback*)callback;
+  pthread_cond_signal(&dispatch_cond);
+  pthread_mutex_unlock(&dispatch_lock);
+}
+
+/// Fixture for SproutletAsyncTest.
+class SproutletAsyncTest : public ::testing::Test
+{
+public:
+  SproutletAsyncTest()
+  {
+    dispatched = NULL;
+  }
+
+  virtual ~SproutletAsyncTest()
+  {
+    SproutletAsync::term();
+    delete dispatched; dispatched = NULL;
+  }
+
+  // Waits for a callback to be dispatched.
+  static TestCallback* wait_for_dispatch()
+  {
+    pthread_mutex_lock(&dispatch_lock);
+    while (dispatched == NULL)
+    {
+      pthread_cond_wait(&dispatch_cond, &dispatch_lock);
+    }
+    TestCallback* callback = dispatched;
+    pthread_mutex_unlock(&dispatch_lock);
+    return callback;
+  }
+};
+
+// Without a thread pool, operations aren't run, so that the caller can run
+// them synchronously.
+TEST_F(SproutletAsyncTest, Disabled)
+{
+  SproutletAsync::init(NULL, 0, &dispatch);
+  EXPECT_FALSE(SproutletAsync::enabled());
+
+  bool op_run = false;
+  TestCallback* callback = new TestCallback(&op_run);
+  EXPECT_FALSE(SproutletAsync::run([&op_run]() { op_run = true; }, callback));
+  EXPECT_FALSE(op_run);
+  delete callback;
+}
+
+// Operations are run on another thread, and the resume callback is
+// dispatched once they have completed.
+TEST_F(SproutletAsyncTest, RunOperation)
+{
+  SproutletAsync::init(NULL, 2, &dispatch);
+  EXPECT_TRUE(SproutletAsync::enabled());
+
+  bool op_run = false;
+  pthread_t caller = pthread_self();
+  bool op_on_caller_thread = true;
+  TestCallback* callback = new TestCallback(&op_run);
+
+  EXPECT_TRUE(SproutletAsync::run([&]()
+                                  {
+                                    op_on_caller_thread = pthread_equal(pthread_self(), caller);
+                                    op_run = true;
+                                  },
+                                  callback));
+
+  EXPECT_EQ(callback, wait_for_dispatch());
+  EXPECT_TRUE(callback->_op_run_before_resume);
+  EXPECT_FALSE(op_on_caller_thread);
+}
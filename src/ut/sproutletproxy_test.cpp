@@ -2348,6 +2348,30 @@ TEST_F(SproutletProxyTest, SproutletSelection)
   ASSERT_EQ("b2bua", service_name);
 }
 
+// Tests that local hostnames are matched ignoring case, but service names are
+// matched exactly.
+TEST_F(SproutletProxyTest, SproutletMatchingCase)
+{
+  std::string service_name;
+  std::string uri_str = "sip:PROXY1.HomeDomain-Alias;service=fwd";
+  pjsip_sip_uri* uri = (pjsip_sip_uri*)PJUtils::uri_from_string(uri_str, stack_data.pool, PJ_FALSE);
+
+  service_name = match_sproutlet_from_uri((pjsip_uri*)uri);
+  ASSERT_EQ("fwd", service_name);
+
+  uri_str = "sip:scscf.Proxy1.HOMEDOMAIN";
+  uri = (pjsip_sip_uri*)PJUtils::uri_from_string(uri_str, stack_data.pool, PJ_FALSE);
+
+  service_name = match_sproutlet_from_uri((pjsip_uri*)uri);
+  ASSERT_EQ("scscf", service_name);
+
+  uri_str = "sip:proxy1.homedomain;service=FWD";
+  uri = (pjsip_sip_uri*)PJUtils::uri_from_string(uri_str, stack_data.pool, PJ_FALSE);
+
+  service_name = match_sproutlet_from_uri((pjsip_uri*)uri);
+  ASSERT_EQ("", service_name);
+}
+
 // Tests that it's not possible to register more than one Sproutlet for the
 // same service name or port.
 TEST_F(SproutletProxyTest, ConflictingSproutlets)
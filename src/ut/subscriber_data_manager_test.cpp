@@ -11,6 +11,7 @@
 
 
 #include <string>
+#include <unistd.h>
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -445,6 +446,53 @@ TEST_F(BasicSubscriberDataManagerTest, AssociatedURIsTests)
   delete aor_data1; aor_data1 = NULL;
 }
 
+// Reading an AoR with nothing to expire doesn't copy it, and the original AoR
+// is only copied when the current AoR is modified.
+TEST_F(BasicSubscriberDataManagerTest, CopyOnWrite)
+{
+  std::string aor = "5102175698@cw-ngv.com";
+  std::string b_id = "urn:uuid:00000000-0000-0000-0000-b4dd32817622:1";
+  int now = time(NULL);
+
+  AoRPair* aor_data1 = this->_store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  AoR::Binding* b1 = aor_data1->get_current()->get_binding(b_id);
+  b1->_uri = std::string("<sip:5102175698@192.91.191.29:59934;transport=tcp;ob>");
+  b1->_cid = std::string("gfYHoZGaFaRNxhlV0WIwoS-f91NoJ2gq");
+  b1->_cseq = 17038;
+  b1->_expires = now + 300;
+  b1->_priority = 0;
+  b1->_private_id = "5102175698@cw-ngv.com";
+  b1->_emergency_registration = false;
+
+  EXPECT_CALL(*(this->_analytics_logger), registration(_, _, _, _));
+  EXPECT_EQ(Store::OK, this->_store->set_aor_data(aor, aor_data1, 0));
+  delete aor_data1; aor_data1 = NULL;
+
+  aor_data1 = this->_store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  EXPECT_TRUE(aor_data1->_orig_aor == NULL);
+  EXPECT_EQ(1u, aor_data1->get_current_const()->bindings().size());
+  EXPECT_TRUE(aor_data1->get_removed_bindings().empty());
+  EXPECT_TRUE(aor_data1->_orig_aor == NULL);
+
+  aor_data1->get_current()->remove_binding(b_id);
+  EXPECT_TRUE(aor_data1->_orig_aor != NULL);
+  EXPECT_EQ(0u, aor_data1->get_current_const()->bindings().size());
+  EXPECT_EQ(1u, aor_data1->get_removed_bindings().size());
+  delete aor_data1; aor_data1 = NULL;
+
+  // Once the binding has expired, reading the AoR expires it in the current
+  // AoR but not the original.
+  cwtest_advance_time_ms(301000);
+  aor_data1 = this->_store->get_aor_data(aor, 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  EXPECT_EQ(0u, aor_data1->get_current_const()->bindings().size());
+  EXPECT_EQ(1u, aor_data1->get_removed_bindings().size());
+  delete aor_data1; aor_data1 = NULL;
+  cwtest_reset_time();
+}
+
 TEST_F(BasicSubscriberDataManagerTest, CopyTests)
 {
   AoRPair* aor_data1;
@@ -719,6 +767,126 @@ TEST_F(SubscriberDataManagerCorruptDataTest, EmptyJsonObject)
   delete aor_data1;
 }
 
+TEST_F(SubscriberDataManagerCorruptDataTest, TruncatedBinary)
+{
+  AoRPair* aor_data1;
+
+  // A binary record claiming to have a notify CSeq and nothing else.
+  EXPECT_CALL(*_datastore, get_data(_, _, _, _, _))
+    .WillOnce(DoAll(SetArgReferee<2>(std::string("\0AoR\x01\x02", 6)),
+                    SetArgReferee<3>(1), // CAS
+                    Return(Store::OK)));
+
+  aor_data1 = this->_store->get_aor_data(std::string("2010000001@cw-ngv.com"), 0);
+  ASSERT_TRUE(aor_data1 == NULL);
+  delete aor_data1;
+}
+
+/// Builds an AoR with every field set, for testing (de)serialization.
+static AoR* build_full_aor(const std::string& aor_id)
+{
+  AoR* aor = new AoR(aor_id);
+  aor->_notify_cseq = 7;
+  aor->_timer_id = "AoRtimer";
+  aor->_scscf_uri = "sip:scscf.cw-ngv.com";
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    std::string id = "urn:uuid:00000000-0000-0000-0000-b4dd3281762" + std::to_string(ii);
+    AoR::Binding* b = aor->get_binding(id);
+    b->_uri = "<sip:5102175698@192.91.191.29:59934;transport=tcp;ob>";
+    b->_cid = "gfYHoZGaFaRNxhlV0WIwoS-f91NoJ2gq";
+    b->_cseq = 17038 + ii;
+    b->_expires = 1500000000 + ii;
+    b->_priority = -1;
+    b->_path_uris.push_back("sip:abcdefgh@bono-1.homedomain;lr");
+    b->_path_headers.push_back("\"Bob\" <sip:abcdefgh@bono-1.homedomain;lr>;tag=6ht7");
+    b->_params["+sip.instance"] = "\"<" + id + ">\"";
+    b->_params["reg-id"] = std::to_string(ii);
+    b->_params["+custom.param"] = "";
+    b->_private_id = "5102175698@cw-ngv.com";
+    b->_emergency_registration = (ii == 1);
+  }
+
+  AoR::Subscription* s = aor->get_subscription("1234");
+  s->_req_uri = "sip:5102175698@192.91.191.29:59934;transport=tcp";
+  s->_from_uri = "<sip:5102175698@cw-ngv.com>";
+  s->_from_tag = "4321";
+  s->_to_uri = "<sip:5102175698@cw-ngv.com>";
+  s->_to_tag = "1234";
+  s->_cid = "xyzabc@192.91.191.29";
+  s->_route_uris.push_back("<sip:abcdefgh@bono1.homedomain;lr>");
+  s->_expires = 1500000300;
+
+  aor->_associated_uris.add_uri("sip:5102175698@cw-ngv.com", false);
+  aor->_associated_uris.add_uri("sip:5102175699@cw-ngv.com", true);
+  aor->_associated_uris.add_wildcard_mapping("sip:51021756!.*!@cw-ngv.com",
+                                             "sip:5102175699@cw-ngv.com");
+  return aor;
+}
+
+// An AoR survives a round trip through the binary format unchanged (as
+// compared by its JSON form), and takes less space than in JSON.
+TEST(AstaireAoRStoreTest, BinaryRoundTrip)
+{
+  AstaireAoRStore::JsonSerializerDeserializer json;
+  AstaireAoRStore::BinarySerializerDeserializer binary;
+  AoR* aor = build_full_aor("5102175698@cw-ngv.com");
+
+  std::string json_data = json.serialize_aor(aor);
+  std::string binary_data = binary.serialize_aor(aor);
+  EXPECT_TRUE(AstaireAoRStore::BinarySerializerDeserializer::is_binary(binary_data));
+  EXPECT_FALSE(AstaireAoRStore::BinarySerializerDeserializer::is_binary(json_data));
+  EXPECT_LT(binary_data.size(), json_data.size());
+
+  AoR* copy = binary.deserialize_aor("5102175698@cw-ngv.com", binary_data);
+  ASSERT_TRUE(copy != NULL);
+  EXPECT_EQ(json_data, json.serialize_aor(copy));
+  EXPECT_EQ("5102175698@cw-ngv.com",
+            copy->bindings().begin()->second->_address_of_record);
+
+  // Every truncation of the record is rejected.
+  for (size_t ii = 0; ii < binary_data.size(); ++ii)
+  {
+    EXPECT_TRUE(binary.deserialize_aor("5102175698@cw-ngv.com",
+                                       binary_data.substr(0, ii)) == NULL);
+  }
+
+  delete copy;
+  delete aor;
+}
+
+// A store writing binary records can still read JSON records, and vice versa.
+TEST(AstaireAoRStoreTest, ReadEitherFormat)
+{
+  MockStore datastore;
+  AstaireAoRStore binary_store(&datastore, AstaireAoRStore::Format::BINARY);
+  AstaireAoRStore json_store(&datastore, AstaireAoRStore::Format::JSON);
+  AoR* aor = build_full_aor("5102175698@cw-ngv.com");
+  std::string json_data = AstaireAoRStore::JsonSerializerDeserializer().serialize_aor(aor);
+  std::string binary_data = AstaireAoRStore::BinarySerializerDeserializer().serialize_aor(aor);
+
+  EXPECT_CALL(datastore, get_data(_, _, _, _, _))
+    .WillOnce(DoAll(SetArgReferee<2>(json_data),
+                    SetArgReferee<3>(1), // CAS
+                    Return(Store::OK)))
+    .WillOnce(DoAll(SetArgReferee<2>(binary_data),
+                    SetArgReferee<3>(1), // CAS
+                    Return(Store::OK)));
+
+  AoR* from_json = binary_store.get_aor_data("5102175698@cw-ngv.com", 0);
+  ASSERT_TRUE(from_json != NULL);
+  EXPECT_EQ(2u, from_json->bindings().size());
+  delete from_json;
+
+  AoR* from_binary = json_store.get_aor_data("5102175698@cw-ngv.com", 0);
+  ASSERT_TRUE(from_binary != NULL);
+  EXPECT_EQ(2u, from_binary->bindings().size());
+  delete from_binary;
+
+  delete aor;
+}
+
 /// Test using a Mock Chronos connection that doesn't just swallow requests
 class SubscriberDataManagerChronosRequestsTest : public SipTest
 {
@@ -1208,6 +1376,90 @@ TEST_F(SubscriberDataManagerChronosRequestsTest, AoRTimerBadRequestNoIDTest)
   delete aor_data1; aor_data1 = NULL;
 }
 
+// Test that if Chronos returns a new timer ID for a queued PUT, the new ID is
+// used for the next update to the AoR, and written back to the store.
+TEST_F(SubscriberDataManagerChronosRequestsTest, QueuedUpdateNewTimerIdTest)
+{
+  AoRPair* aor_data1;
+  AoR::Binding* b1;
+  bool rc;
+  int now;
+
+  // Use a store that queues timer updates, with a short batch interval.
+  ChronosTimerQueue timer_queue(this->_chronos_connection, 10, 10);
+  SubscriberDataManager store(this->_aor_store,
+                              this->_chronos_connection,
+                              this->_analytics_logger,
+                              true,
+                              &timer_queue);
+
+  // Get an initial empty AoR record and add a binding.
+  now = time(NULL);
+  aor_data1 = store.get_aor_data(std::string("5102175698@cw-ngv.com"), 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  b1 = aor_data1->get_current()->get_binding(std::string("urn:uuid:00000000-0000-0000-0000-b4dd32817622:1"));
+  b1->_uri = std::string("<sip:5102175698@192.91.191.29:59934;transport=tcp;ob>");
+  b1->_cid = std::string("gfYHoZGaFaRNxhlV0WIwoS-f91NoJ2gq");
+  b1->_cseq = 17038;
+  b1->_expires = now + 300;
+  b1->_priority = 0;
+  b1->_private_id = "5102175698@cw-ngv.com";
+  b1->_emergency_registration = false;
+
+  // Write the record back to the store.  The timer is created inline.
+  EXPECT_CALL(*(this->_chronos_connection), send_post(_, _, _, _, _, _)).
+                   WillOnce(DoAll(SetArgReferee<0>("TIMER_ID"),
+                                  Return(HTTP_OK)));
+  std::string aor = "5102175698@cw-ngv.com";
+  AssociatedURIs associated_uris = {};
+  associated_uris.add_uri(aor, false);
+  aor_data1->get_current()->_associated_uris = associated_uris;
+
+  rc = store.set_aor_data(aor, aor_data1, 0);
+  EXPECT_TRUE(rc);
+  delete aor_data1; aor_data1 = NULL;
+
+  // Extend the binding.  The PUT is queued, and Chronos returns a new ID
+  // when it is sent.
+  aor_data1 = store.get_aor_data(std::string("5102175698@cw-ngv.com"), 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  aor_data1->get_current()->get_binding(std::string("urn:uuid:00000000-0000-0000-0000-b4dd32817622:1"))->_expires = now + 600;
+
+  EXPECT_CALL(*(this->_chronos_connection), send_put(testing::Eq(std::string("TIMER_ID")), _, _, _, _, _)).
+                   WillOnce(DoAll(SetArgReferee<0>("NEW_TIMER_ID"),
+                                  Return(HTTP_OK)));
+  rc = store.set_aor_data(aor, aor_data1, 0);
+  EXPECT_TRUE(rc);
+  delete aor_data1; aor_data1 = NULL;
+
+  std::string timer_id;
+  for (int ii = 0; (ii < 100) && (timer_id != "NEW_TIMER_ID"); ++ii)
+  {
+    usleep(10000);
+    timer_id = "TIMER_ID";
+    timer_queue.update_timer_id(timer_id);
+  }
+  ASSERT_EQ("NEW_TIMER_ID", timer_id);
+
+  // Extend the binding again.  The PUT uses the new ID, and the new ID is
+  // written to the store.
+  aor_data1 = store.get_aor_data(std::string("5102175698@cw-ngv.com"), 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  EXPECT_EQ("TIMER_ID", aor_data1->get_current()->_timer_id);
+  aor_data1->get_current()->get_binding(std::string("urn:uuid:00000000-0000-0000-0000-b4dd32817622:1"))->_expires = now + 900;
+
+  EXPECT_CALL(*(this->_chronos_connection), send_put(testing::Eq(std::string("NEW_TIMER_ID")), _, _, _, _, _)).
+                   WillOnce(Return(HTTP_OK));
+  rc = store.set_aor_data(aor, aor_data1, 0);
+  EXPECT_TRUE(rc);
+  delete aor_data1; aor_data1 = NULL;
+
+  aor_data1 = store.get_aor_data(std::string("5102175698@cw-ngv.com"), 0);
+  ASSERT_TRUE(aor_data1 != NULL);
+  EXPECT_EQ("NEW_TIMER_ID", aor_data1->get_current()->_timer_id);
+  delete aor_data1; aor_data1 = NULL;
+}
+
 TEST_F(BasicSubscriberDataManagerTest, AoRComparisonCreatedBinding)
 {
   std::string aor_id = "5102175698@cw-ngv.com";
@@ -0,0 +1,268 @@
+/**
+ * @file thread_dispatcher_test.cpp UT for the thread dispatcher.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "pjutils.h"
+#include "siptest.hpp"
+#include "utils.h"
+#include "test_utils.hpp"
+#include "thread_dispatcher.h"
+#include "fakesnmp.hpp"
+#include "testingcommon.h"
+
+using namespace std;
+using TestingCommon::Message;
+
+class ThreadDispatcherTest;
+
+/// Module that runs after the thread dispatcher, and so is called on the
+/// worker threads.  It hands the messages it receives to the current test.
+static pj_bool_t record_rx_msg(pjsip_rx_data* rdata);
+
+static pjsip_module mod_record =
+{
+  NULL, NULL,                           /* prev, next.          */
+  pj_str("mod-record"),                 /* Name.                */
+  -1,                                   /* Id                   */
+  PJSIP_MOD_PRIORITY_TRANSPORT_LAYER,   /* Priority             */
+  NULL,                                 /* load()               */
+  NULL,                                 /* start()              */
+  NULL,                                 /* stop()               */
+  NULL,                                 /* unload()             */
+  &record_rx_msg,                       /* on_rx_request()      */
+  &record_rx_msg,                       /* on_rx_response()     */
+  NULL,                                 /* on_tx_request()      */
+  NULL,                                 /* on_tx_response()     */
+  NULL,                                 /* on_tsx_state()       */
+};
+
+class ThreadDispatcherTest : public SipTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    SipTest::SetUpTestCase();
+  }
+
+  static void TearDownTestCase()
+  {
+    SipTest::TearDownTestCase();
+  }
+
+  ThreadDispatcherTest() :
+    _num_adopts(0),
+    _rx_msg(NULL)
+  {
+    _lm = new LoadMonitor(0, 1, 0, 0);
+    _current = this;
+
+    // A single worker thread, so that messages are processed in the order
+    // they are dequeued.  The worker threads aren't started until each test
+    // has queued the messages it wants.
+    init_thread_dispatcher(1,
+                           1,
+                           0,
+                           &SNMP::FAKE_EVENT_ACCUMULATOR_BY_SCOPE_TABLE,
+                           &SNMP::FAKE_EVENT_ACCUMULATOR_BY_SCOPE_TABLE,
+                           &SNMP::FAKE_COUNTER_BY_SCOPE_TABLE,
+                           _lm,
+                           NULL);
+    pjsip_endpt_register_module(stack_data.endpt, &mod_record);
+  }
+
+  ~ThreadDispatcherTest()
+  {
+    stop_worker_threads();
+    pjsip_endpt_unregister_module(stack_data.endpt, &mod_record);
+    unregister_thread_dispatcher();
+    _current = NULL;
+    delete _lm; _lm = NULL;
+
+    for (std::vector<pjsip_tx_data*>::iterator ii = _adopted.begin();
+         ii != _adopted.end();
+         ++ii)
+    {
+      if (*ii != NULL)
+      {
+        pjsip_tx_data_dec_ref(*ii);
+      }
+    }
+  }
+
+  /// Called on the worker thread for each message it processes.
+  virtual void on_rx_msg(pjsip_rx_data* rdata)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Try to adopt the message the requested number of times, as the proxy
+    // layer does when it starts a transaction.
+    _rx_msg = rdata->msg_info.msg;
+    for (int ii = 0; ii < _num_adopts; ++ii)
+    {
+      _adopted.push_back(adopt_rx_msg(rdata));
+    }
+
+    _methods.push_back(std::string(rdata->msg_info.cseq->method.name.ptr,
+                                   rdata->msg_info.cseq->method.name.slen));
+    _cond.notify_all();
+  }
+
+  /// Waits (for up to a second) for the worker threads to have processed
+  /// the specified number of messages.
+  bool wait_for_msgs(size_t num_msgs)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _cond.wait_for(lock,
+                          std::chrono::seconds(1),
+                          [&]() { return _methods.size() >= num_msgs; });
+  }
+
+  static ThreadDispatcherTest* _current;
+
+protected:
+  LoadMonitor* _lm;
+
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::vector<std::string> _methods;
+
+  // The number of times to try to adopt each message on the worker thread,
+  // the results, and the last message the worker thread processed.
+  int _num_adopts;
+  std::vector<pjsip_tx_data*> _adopted;
+  pjsip_msg* _rx_msg;
+};
+
+ThreadDispatcherTest* ThreadDispatcherTest::_current = NULL;
+
+static pj_bool_t record_rx_msg(pjsip_rx_data* rdata)
+{
+  if (ThreadDispatcherTest::_current != NULL)
+  {
+    ThreadDispatcherTest::_current->on_rx_msg(rdata);
+  }
+
+  return PJ_TRUE;
+}
+
+// A CANCEL is processed after the INVITE it cancels, even if both are queued
+// before a worker thread picks either of them up.
+TEST_F(ThreadDispatcherTest, CancelAfterInvite)
+{
+  Message invite;
+  invite._first_hop = true;
+  Message cancel = invite;
+  cancel._method = "CANCEL";
+
+  inject_msg(invite.get_request());
+  inject_msg(cancel.get_request());
+
+  start_worker_threads();
+  ASSERT_TRUE(wait_for_msgs(2));
+
+  EXPECT_EQ("INVITE", _methods[0]);
+  EXPECT_EQ("CANCEL", _methods[1]);
+}
+
+// Responses are processed ahead of requests that start new sessions.
+TEST_F(ThreadDispatcherTest, ResponsesFirst)
+{
+  Message invite;
+  invite._first_hop = true;
+  Message response;
+  response._method = "SUBSCRIBE";
+
+  inject_msg(invite.get_request());
+  inject_msg(response.get_response());
+
+  start_worker_threads();
+  ASSERT_TRUE(wait_for_msgs(2));
+
+  EXPECT_EQ("SUBSCRIBE", _methods[0]);
+  EXPECT_EQ("INVITE", _methods[1]);
+}
+
+// The proxy layer adopts the message handed off to a worker thread rather
+// than copying it again.
+TEST_F(ThreadDispatcherTest, AdoptRequest)
+{
+  _num_adopts = 1;
+  Message invite;
+  invite._first_hop = true;
+  inject_msg(invite.get_request());
+
+  start_worker_threads();
+  ASSERT_TRUE(wait_for_msgs(1));
+  stop_worker_threads();
+
+  ASSERT_EQ(1u, _adopted.size());
+  ASSERT_NE((pjsip_tx_data*)NULL, _adopted[0]);
+  EXPECT_EQ(_rx_msg, _adopted[0]->msg);
+  EXPECT_EQ(PJSIP_INVITE_METHOD, _adopted[0]->msg->line.req.method.id);
+}
+
+// A message can only be adopted once.
+TEST_F(ThreadDispatcherTest, AdoptRequestTwice)
+{
+  _num_adopts = 2;
+  Message invite;
+  invite._first_hop = true;
+  inject_msg(invite.get_request());
+
+  start_worker_threads();
+  ASSERT_TRUE(wait_for_msgs(1));
+  stop_worker_threads();
+
+  ASSERT_EQ(2u, _adopted.size());
+  EXPECT_NE((pjsip_tx_data*)NULL, _adopted[0]);
+  EXPECT_EQ((pjsip_tx_data*)NULL, _adopted[1]);
+}
+
+// The adopted message remains valid after the worker thread has finished
+// with, and freed, the received message.
+TEST_F(ThreadDispatcherTest, AdoptedOutlivesReceivedMessage)
+{
+  _num_adopts = 1;
+  Message invite;
+  invite._first_hop = true;
+  inject_msg(invite.get_request());
+
+  // Stopping the worker threads waits for them to free the received message.
+  start_worker_threads();
+  ASSERT_TRUE(wait_for_msgs(1));
+  stop_worker_threads();
+
+  ASSERT_EQ(1u, _adopted.size());
+  ASSERT_NE((pjsip_tx_data*)NULL, _adopted[0]);
+  char buf[16384];
+  pj_ssize_t len = pjsip_msg_print(_adopted[0]->msg, buf, sizeof(buf));
+  ASSERT_GT(len, 0);
+  std::string printed(buf, len);
+  EXPECT_THAT(printed, testing::HasSubstr("INVITE sip:6505551234@homedomain SIP/2.0"));
+  EXPECT_THAT(printed, testing::HasSubstr("Max-Forwards: 68"));
+}
+
+// A message that wasn't handed off to a worker thread can't be adopted.
+TEST_F(ThreadDispatcherTest, AdoptNotHandedOff)
+{
+  Message invite;
+  invite._first_hop = true;
+  pjsip_rx_data* rdata = build_rxdata(invite.get_request());
+  parse_rxdata(rdata);
+  EXPECT_EQ((pjsip_tx_data*)NULL, adopt_rx_msg(rdata));
+}
@@ -155,3 +155,23 @@ TEST_F(URIClassiferTest, NoUserSIPURI)
   EXPECT_EQ(URIClass::HOME_DOMAIN_SIP_URI,
             classify_uri_helper("sip:homedomain", false));
 }
+
+TEST_F(URIClassiferTest, NumberCharacters)
+{
+  URIClassifier::enforce_global = true;
+
+  // Visual separators are allowed in both global and local numbers, and
+  // hexdigits, "*" and "#" in local numbers only.
+  EXPECT_EQ(URIClass::GLOBAL_PHONE_NUMBER,
+            classify_uri_helper("sip:+1-(234),5@example.com;user=phone"));
+  EXPECT_EQ(URIClass::LOCAL_PHONE_NUMBER,
+            classify_uri_helper("sip:*12AB@example.com;user=phone"));
+
+  // Anything else isn't a number.
+  EXPECT_EQ(URIClass::HOME_DOMAIN_SIP_URI,
+            classify_uri_helper("sip:+12AB@homedomain;user=phone"));
+  EXPECT_EQ(URIClass::HOME_DOMAIN_SIP_URI,
+            classify_uri_helper("sip:12ab@homedomain;user=phone"));
+  EXPECT_EQ(URIClass::HOME_DOMAIN_SIP_URI,
+            classify_uri_helper("sip:+12.34@homedomain;user=phone"));
+}
@@ -69,3 +69,16 @@ TEST_F(XdmConnectionTest, SimServsGet)
   EXPECT_CONTAINED("X-XCAP-Asserted-Identity: gand/alf", req._headers);
 }
 
+
+TEST_F(XdmConnectionTest, SimServsConditionalGet)
+{
+  string output;
+  string etag = "\"abc\"";
+  HTTPCode rc = _xdm.get_simservs("gand/alf", output, etag, 0);
+  EXPECT_EQ(HTTP_OK, rc);
+  EXPECT_EQ("<?xml version=\"1.0\" encoding=\"UTF-8\"><boring>Still</boring>", output);
+  Request& req = fakecurl_requests["http://cyrus:80/org.etsi.ngn.simservs/users/gand%2Falf/simservs.xml"];
+  EXPECT_EQ("GET", req._method);
+  EXPECT_CONTAINED("X-XCAP-Asserted-Identity: gand/alf", req._headers);
+  EXPECT_CONTAINED("If-None-Match: \"abc\"", req._headers);
+}
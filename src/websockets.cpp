@@ -20,6 +20,9 @@ extern "C" {
 
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <map>
+#include <pthread.h>
 
 #include "stack.h"
 #include "log.h"
@@ -29,6 +32,7 @@ extern "C" {
 using websocketpp::server;
 
 static unsigned short ws_port;
+static unsigned int ws_num_threads;
 
 //
 // mod_ws_transport is the module implementing websockets
@@ -370,6 +374,124 @@ static pj_status_t ws_destroy_transport(pjsip_transport *transport)
   return PJ_SUCCESS;
 }
 
+/*
+ * Registers the calling thread with PJSIP.  The WebSocket server runs its
+ * connections on a pool of threads created by boost, which PJSIP doesn't
+ * know about until they are registered.
+ */
+static void ws_register_thread()
+{
+  if (!pj_thread_is_registered())
+  {
+    // The thread descriptor must stay in scope for the lifetime of the
+    // thread, so is allocated from the heap.  It is never freed, but the
+    // server only creates a fixed pool of threads when it starts.
+    pj_thread_desc* td = (pj_thread_desc*)malloc(sizeof(pj_thread_desc));
+    pj_bzero(*td, sizeof(pj_thread_desc));
+    pj_thread_t* thread = 0;
+
+    // Register with the same name as the main WebSockets thread, so that
+    // these threads are recognised as WebSockets transport threads.
+    pj_status_t status = pj_thread_register("websockets", *td, &thread);
+    if (status != PJ_SUCCESS)
+    {
+      TRC_ERROR("Failed to register WebSockets thread with PJSIP");
+    }
+  }
+}
+
+/*
+ * Map from WebSocket connections to their PJSIP transports.  Connections
+ * are served by several threads, so the map is split into shards, each
+ * with its own lock, so that the threads don't all contend on one lock.
+ */
+class ws_connection_map
+{
+  public:
+    typedef server::handler::connection_ptr connection_ptr;
+
+    ws_connection_map()
+    {
+      for (int ii = 0; ii < NUM_SHARDS; ++ii)
+      {
+        pthread_mutex_init(&_shards[ii].lock, NULL);
+      }
+    }
+
+    ~ws_connection_map()
+    {
+      for (int ii = 0; ii < NUM_SHARDS; ++ii)
+      {
+        pthread_mutex_destroy(&_shards[ii].lock);
+      }
+    }
+
+    void insert(connection_ptr con, struct ws_transport* transport)
+    {
+      shard& s = get_shard(con);
+      pthread_mutex_lock(&s.lock);
+      s.map[con] = transport;
+      pthread_mutex_unlock(&s.lock);
+    }
+
+    /* Returns the transport for the connection, or NULL if there isn't one.
+     * A reference is taken on the transport before the lock is released, so
+     * that a concurrent on_close can't destroy it - the caller must call
+     * pjsip_transport_dec_ref when it has finished with it. */
+    struct ws_transport* find(connection_ptr con)
+    {
+      struct ws_transport* transport = NULL;
+      shard& s = get_shard(con);
+      pthread_mutex_lock(&s.lock);
+      std::map<connection_ptr, struct ws_transport*>::const_iterator it =
+        s.map.find(con);
+      if (it != s.map.end())
+      {
+        transport = it->second;
+        pjsip_transport_add_ref(&transport->base);
+      }
+      pthread_mutex_unlock(&s.lock);
+      return transport;
+    }
+
+    /* Removes the connection and returns its transport, or NULL if there
+     * isn't one. */
+    struct ws_transport* remove(connection_ptr con)
+    {
+      struct ws_transport* transport = NULL;
+      shard& s = get_shard(con);
+      pthread_mutex_lock(&s.lock);
+      std::map<connection_ptr, struct ws_transport*>::iterator it =
+        s.map.find(con);
+      if (it != s.map.end())
+      {
+        transport = it->second;
+        s.map.erase(it);
+      }
+      pthread_mutex_unlock(&s.lock);
+      return transport;
+    }
+
+  private:
+    static const int NUM_SHARDS = 16;
+
+    struct shard
+    {
+      pthread_mutex_t lock;
+      std::map<connection_ptr, struct ws_transport*> map;
+    };
+
+    shard& get_shard(const connection_ptr& con)
+    {
+      // Connection objects are heap allocated, so the low bits of their
+      // addresses carry little information - discard them.
+      uintptr_t addr = (uintptr_t)con.get();
+      return _shards[(addr >> 6) % NUM_SHARDS];
+    }
+
+    shard _shards[NUM_SHARDS];
+};
+
 /* Setup callbacks for WebSockets events */
 class sip_server_handler : public server::handler {
   public:
@@ -403,6 +525,8 @@ class sip_server_handler : public server::handler {
     }
 
     void on_open(connection_ptr con) {
+      ws_register_thread();
+
       TRC_DEBUG("New web socket connection, creating PJSIP transport");
       pjsip_transport *transport;
       pj_status_t status = ws_transport_create(stack_data.endpt,
@@ -411,21 +535,29 @@ class sip_server_handler : public server::handler {
           &transport);
       if (status == PJ_SUCCESS){
         TRC_DEBUG("Created WS transport");
+        connectionMap.insert(con, (struct ws_transport*)transport);
       }
       else{
         TRC_DEBUG("Failed to create WS transport");
       }
-
-      connectionMap.insert(
-          std::pair<connection_ptr, struct ws_transport*>(con, (struct ws_transport*)transport));
     }
 
     void on_message(connection_ptr con, message_ptr msg) {
       ws_transport *transport;
 
+      ws_register_thread();
+
       TRC_DEBUG("Received message from websockets");
 
-      transport = connectionMap.find(con)->second;
+      transport = connectionMap.find(con);
+      if (transport == NULL)
+      {
+        TRC_DEBUG("No WS transport for connection, dropping message");
+        return;
+      }
+
+      // The message is parsed on this thread and passed straight up the
+      // stack, which queues it for the worker threads.
       TRC_DEBUG("Sending message to PJSIP...");
       pj_status_t status = on_ws_data(transport, msg);
       if (status == PJ_TRUE){
@@ -434,14 +566,24 @@ class sip_server_handler : public server::handler {
       else{
         TRC_DEBUG("Failed to pass message to PJSIP");
       }
+
+      /* Release the reference taken when the transport was found */
+      pjsip_transport_dec_ref(&transport->base);
     }
 
     void on_close(connection_ptr con) {
       ws_transport *transport;
       pjsip_tp_state_callback state_cb;
 
+      ws_register_thread();
+
       TRC_DEBUG("Closing websocket...");
-      transport = connectionMap.find(con)->second;
+      transport = connectionMap.remove(con);
+      if (transport == NULL)
+      {
+        TRC_DEBUG("No WS transport for connection");
+        return;
+      }
 
       /* Notify application of transport disconnected state */
       state_cb = pjsip_tpmgr_get_state_cb(transport->base.tpmgr);
@@ -463,7 +605,7 @@ class sip_server_handler : public server::handler {
 
   private:
     static std::string SUBPROTOCOL;
-    std::map<connection_ptr, struct ws_transport*> connectionMap;
+    ws_connection_map connectionMap;
 };
 
 std::string sip_server_handler::SUBPROTOCOL = "sip";
@@ -485,9 +627,12 @@ static int websocket_thread(void* p)
     sip_endpoint.elog().set_level(websocketpp::log::elevel::RERROR);
     sip_endpoint.elog().set_level(websocketpp::log::elevel::FATAL);
 
-    TRC_DEBUG("Starting WebSocket SIP server on port %hu", ws_port);
+    // If there is more than one thread, the server creates a pool of threads
+    // to serve the connections, and this thread waits for them to finish.
+    TRC_DEBUG("Starting WebSocket SIP server on port %hu with %u threads",
+              ws_port, ws_num_threads);
     boost::asio::ip::tcp::endpoint ep(boost::asio::ip::tcp::v4(), ws_port);
-    sip_endpoint.listen(ep);
+    sip_endpoint.listen(ep, ws_num_threads);
   } catch (std::exception& e) {
     TRC_ERROR("Exception: %s", e.what());
   }
@@ -512,9 +657,10 @@ static pj_bool_t ws_transport_on_start()
   return PJ_SUCCESS;
 }
 
-pj_status_t init_websockets(unsigned short port)
+pj_status_t init_websockets(unsigned short port, unsigned int num_threads)
 {
   ws_port = port;
+  ws_num_threads = (num_threads > 0) ? num_threads : 1;
 
   pj_status_t status;
   status = pjsip_endpt_register_module(stack_data.endpt, &mod_ws_transport);
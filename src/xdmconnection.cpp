@@ -14,6 +14,9 @@
 #include <curl/curl.h>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <vector>
+#include <strings.h>
 
 #include "utils.h"
 #include "log.h"
@@ -63,7 +66,7 @@ bool XDMConnection::get_simservs(const std::string& user,
   Utils::StopWatch stopWatch;
   stopWatch.start();
 
-  std::string url = "/org.etsi.ngn.simservs/users/" + Utils::url_escape(user) + "/simservs.xml";
+  std::string url = simservs_url(user);
 
   HTTPCode http_code = _http->send_get(url, xml_data, user, trail);
 
@@ -76,3 +79,57 @@ bool XDMConnection::get_simservs(const std::string& user,
   return (http_code == HTTP_OK);
 }
 
+HTTPCode XDMConnection::get_simservs(const std::string& user,
+                                     std::string& xml_data,
+                                     std::string& etag,
+                                     SAS::TrailId trail)
+{
+  Utils::StopWatch stopWatch;
+  stopWatch.start();
+
+  std::vector<std::string> req_headers;
+  if (!etag.empty())
+  {
+    req_headers.push_back("If-None-Match: " + etag);
+  }
+
+  std::map<std::string, std::string> rsp_headers;
+  HTTPCode http_code = _http->send_get(simservs_url(user),
+                                       rsp_headers,
+                                       xml_data,
+                                       user,
+                                       req_headers,
+                                       trail);
+
+  unsigned long latency_us = 0;
+  if (stopWatch.read(latency_us))
+  {
+    _latency_tbl->accumulate(latency_us);
+  }
+
+  if (http_code == HTTP_OK)
+  {
+    // Pick up the entity tag of the new document (header names are case
+    // insensitive).
+    etag.clear();
+    for (std::map<std::string, std::string>::const_iterator it = rsp_headers.begin();
+         it != rsp_headers.end();
+         ++it)
+    {
+      if (strcasecmp(it->first.c_str(), "ETag") == 0)
+      {
+        etag = it->second;
+        Utils::trim(etag);
+        break;
+      }
+    }
+  }
+
+  return http_code;
+}
+
+std::string XDMConnection::simservs_url(const std::string& user)
+{
+  return "/org.etsi.ngn.simservs/users/" + Utils::url_escape(user) + "/simservs.xml";
+}
+